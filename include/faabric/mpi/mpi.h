@@ -191,8 +191,14 @@ extern "C"
 
 // Misc constants
 #define MPI_ANY_SOURCE -1
+#define MPI_ANY_TAG -1
 #define MPI_UNDEFINED -1
 
+// Completed or inactive requests. Request ids are never zero, so the world
+// uses zero for a null request.
+#define FAABRIC_REQUEST_NULL_ID 0
+#define MPI_REQUEST_NULL ((MPI_Request)(0))
+
 // Misc limits
 #define MPI_MAX_PROCESSOR_NAME 256
 #define MPI_CART_MAX_DIMENSIONS 2
@@ -413,6 +419,13 @@ extern "C"
                  MPI_Op op,
                  MPI_Comm comm);
 
+    int MPI_Exscan(const void* sendbuf,
+                   void* recvbuf,
+                   int count,
+                   MPI_Datatype datatype,
+                   MPI_Op op,
+                   MPI_Comm comm);
+
     int MPI_Alltoall(const void* sendbuf,
                      int sendcount,
                      MPI_Datatype sendtype,
@@ -536,6 +549,11 @@ extern "C"
                     int* index,
                     MPI_Status* status);
 
+    int MPI_Testall(int count,
+                    MPI_Request array_of_requests[],
+                    int* flag,
+                    MPI_Status* array_of_statuses);
+
     int MPI_Comm_create(MPI_Comm comm, MPI_Group group, MPI_Comm* newcomm);
 
     int MPI_Comm_group(MPI_Comm comm, MPI_Group* group);
@@ -97,6 +97,16 @@ class Redis
                           const uint8_t* value,
                           size_t size);
 
+    void setPipeline(const std::string& key,
+                     const uint8_t* value,
+                     size_t size);
+
+    void expirePipeline(const std::string& key, long expiry);
+
+    void enqueueBytesPipeline(const std::string& queueName,
+                              const uint8_t* buffer,
+                              size_t bufferLen);
+
     void flushPipeline(long pipelineLength);
 
     void getRange(const std::string& key,
@@ -9,5 +9,7 @@ enum FunctionCalls
     Unregister = 3,
     GetResources = 4,
     SetThreadResult = 5,
+    PushResources = 6,
+    SetFunctionResult = 7,
 };
 }
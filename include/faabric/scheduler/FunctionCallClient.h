@@ -25,6 +25,11 @@ getResourceRequests();
 std::vector<std::pair<std::string, faabric::UnregisterRequest>>
 getUnregisterRequests();
 
+std::vector<std::pair<std::string, faabric::PushResourcesRequest>>
+getResourcePushes();
+
+std::vector<std::pair<std::string, faabric::Message>> getFunctionResultPushes();
+
 void queueResourceResponse(const std::string& host,
                            faabric::HostResources& res);
 
@@ -49,6 +54,10 @@ class FunctionCallClient : public faabric::transport::MessageEndpointClient
 
     void unregister(faabric::UnregisterRequest& req);
 
+    void pushResources(faabric::PushResourcesRequest& req);
+
+    void setFunctionResult(faabric::Message& msg);
+
   private:
     void sendHeader(faabric::scheduler::FunctionCalls call);
 };
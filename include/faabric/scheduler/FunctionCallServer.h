@@ -32,5 +32,9 @@ class FunctionCallServer final
     void recvExecuteFunctions(const uint8_t* buffer, size_t bufferSize);
 
     void recvUnregister(const uint8_t* buffer, size_t bufferSize);
+
+    void recvPushResources(const uint8_t* buffer, size_t bufferSize);
+
+    void recvSetFunctionResult(const uint8_t* buffer, size_t bufferSize);
 };
 }
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <faabric/mpi/mpi.h>
+#include <faabric/proto/faabric.pb.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace faabric::scheduler {
+/* The MPI message matcher pairs up the messages arriving at a rank with the
+ * receives the rank has posted, following MPI's matching rules. A receive
+ * matches messages of its own message type (so that collectives never take
+ * point-to-point messages), from its source and with its tag, either of which
+ * may be a wildcard. A receive takes the earliest message it matches, and a
+ * message goes to the earliest receive it matches.
+ *
+ * Messages that arrive before a matching receive has been posted are kept as
+ * unexpected, and receives posted before a matching message has arrived are
+ * kept as pending. Both are indexed by (message type, source, tag), so that
+ * matching only looks at the entries that could match, rather than scanning
+ * through everything outstanding.
+ */
+class MpiMessageMatcher
+{
+  public:
+    class PendingRecv
+    {
+      public:
+        int requestId = -1;
+        int source = MPI_ANY_SOURCE;
+        int tag = MPI_ANY_TAG;
+        faabric::MPIMessage::MPIMessageType messageType =
+          faabric::MPIMessage::NORMAL;
+        uint8_t* buffer = nullptr;
+        faabric_datatype_t* dataType = nullptr;
+        int count = -1;
+
+        // Null until the receive has been matched
+        std::shared_ptr<faabric::MPIMessage> msg = nullptr;
+
+        bool isMatched() const { return msg != nullptr; }
+
+        bool isWildcard() const
+        {
+            return source == MPI_ANY_SOURCE || tag == MPI_ANY_TAG;
+        }
+    };
+
+    /* Interface to query the matcher size */
+
+    bool isEmpty();
+
+    int getNumRecvs();
+
+    int getNumUnexpected();
+
+    /* Interface to post receives and add arriving messages */
+
+    // Matches the receive with the earliest unexpected message it can take,
+    // if there is one, and keeps it until it's removed
+    PendingRecv& postRecv(const PendingRecv& recv);
+
+    // Matches the message with the earliest pending receive that can take it,
+    // returning its request id, or keeps it as unexpected and returns -1
+    int addMessage(std::shared_ptr<faabric::MPIMessage> msg);
+
+    // Returns nullptr if there is no receive with the given id
+    PendingRecv* getRecv(int requestId);
+
+    void removeRecv(int requestId);
+
+    /* Interface to look ahead without matching */
+
+    // Earliest unexpected message a receive with these parameters would take
+    std::shared_ptr<faabric::MPIMessage> peekUnexpected(
+      int source,
+      int tag,
+      faabric::MPIMessage::MPIMessageType messageType);
+
+    // Pending receives posted for exactly this source and tag
+    int getNumPending(int source,
+                      int tag,
+                      faabric::MPIMessage::MPIMessageType messageType);
+
+    // Pending receives with a wildcard source or tag
+    int getNumPendingWildcards();
+
+    // Sources that pending receives are waiting on, in ascending order, so
+    // MPI_ANY_SOURCE comes first if any receive is waiting on it
+    std::vector<int> getPendingSources();
+
+  private:
+    // Ordered by message type first, so that all the entries a wildcard may
+    // match are in one contiguous range
+    typedef std::tuple<int, int, int> MatchKey;
+
+    // Receives and messages are numbered in the order they come in, so that
+    // the earliest wins when more than one could match
+    typedef std::deque<std::pair<long, int>> PendingQueue;
+    typedef std::deque<std::pair<long, std::shared_ptr<faabric::MPIMessage>>>
+      UnexpectedQueue;
+
+    long nextSeq = 0;
+
+    std::unordered_map<int, PendingRecv> recvs;
+
+    std::map<MatchKey, PendingQueue> pendingRecvs;
+
+    std::map<MatchKey, UnexpectedQueue> unexpectedMsgs;
+
+    int nPendingWildcards = 0;
+
+    std::map<int, int> nPendingBySource;
+
+    int nUnexpected = 0;
+
+    void removePendingSource(int source);
+
+    std::map<MatchKey, UnexpectedQueue>::iterator findUnexpected(
+      int source,
+      int tag,
+      faabric::MPIMessage::MPIMessageType messageType);
+};
+}
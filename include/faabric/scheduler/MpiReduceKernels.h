@@ -0,0 +1,25 @@
+#pragma once
+
+#include <faabric/mpi/mpi.h>
+
+#include <cstdint>
+
+namespace faabric::scheduler {
+
+// Reduces count elements of the input buffer into the output buffer in place,
+// i.e. out[i] = out[i] op in[i]
+typedef void (*MpiReduceKernel)(const uint8_t* inBuffer,
+                                uint8_t* outBuffer,
+                                int count);
+
+// Layout of MPI_DOUBLE_INT, the datatype used with MPI_MAXLOC and MPI_MINLOC
+struct MpiDoubleInt
+{
+    double value;
+    int index;
+};
+
+// Returns the kernel for the given operation and datatype ids, or nullptr if
+// the operation isn't defined for the datatype (e.g. MPI_BAND on floats)
+MpiReduceKernel getMpiReduceKernel(int opId, int datatypeId);
+}
@@ -4,23 +4,65 @@
 
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/scheduler/InMemoryMessageQueue.h>
-#include <faabric/scheduler/MpiMessageBuffer.h>
+#include <faabric/scheduler/MpiMessageMatcher.h>
 #include <faabric/transport/MpiMessageEndpoint.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/timing.h>
 
 #include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
+// Broadcasts of at least this size may be pipelined down a chain of ranks, in
+// segments of the given size
+#define MPI_BCAST_CHAIN_MIN_BYTES (1024 * 1024)
+#define MPI_BCAST_SEGMENT_BYTES (128 * 1024)
+
+// Allreduces of at least this size use the ring algorithm
+#define MPI_ALLREDUCE_RING_MIN_BYTES (256 * 1024)
+
+// Remote rendezvous sends may have this many chunks in flight at a time
+#define MPI_RENDEZVOUS_WINDOW_CHUNKS 4
+
 namespace faabric::scheduler {
-typedef faabric::util::Queue<std::shared_ptr<faabric::MPIMessage>>
+// Each queue only ever has one sending rank and one receiving rank
+typedef faabric::util::SpscQueue<std::shared_ptr<faabric::MPIMessage>>
   InMemoryMpiQueue;
 
+// A receiving rank can post its buffer here so that the message its receive
+// will match is copied straight into it, rather than into the message itself.
+// This is done by the sender if it's on the same host, or by the thread
+// receiving remote messages if not. Receives only match messages with their
+// own message type and tag, so the sequence numbers count the messages with
+// each through the corresponding local queue. Only the sender (sendSeqs) or
+// receiver (recvSeqs) touches each.
+struct LocalRendezvous
+{
+    // Identifies the current posting, or -1 if there isn't one. Whoever sets
+    // it back to -1 owns the posting, whether to fill or withdraw it.
+    std::atomic<long> postedTicket{ -1 };
+
+    // Key and sequence number of the message the buffer is posted for
+    std::atomic<int64_t> postedKey{ 0 };
+    std::atomic<long> postedSeq{ -1 };
+    std::atomic<uint8_t*> buffer{ nullptr };
+    std::atomic<size_t> capacity{ 0 };
+
+    alignas(64) long nextTicket = 0;
+    std::unordered_map<int64_t, long> recvSeqs;
+
+    alignas(64) std::unordered_map<int64_t, long> sendSeqs;
+};
+
 class MpiWorld
 {
   public:
     MpiWorld();
 
+    ~MpiWorld();
+
     void create(const faabric::Message& call, int newId, int newSize);
 
     void broadcastHostsToRanks();
@@ -59,10 +101,23 @@ class MpiWorld
               faabric_datatype_t* dataType,
               int count,
               faabric::MPIMessage::MPIMessageType messageType =
-                faabric::MPIMessage::NORMAL);
+                faabric::MPIMessage::NORMAL,
+              int tag = 0);
 
     int isend(int sendRank,
               int recvRank,
+              const uint8_t* buffer,
+              faabric_datatype_t* dataType,
+              int count,
+              faabric::MPIMessage::MPIMessageType messageType =
+                faabric::MPIMessage::NORMAL,
+              int tag = 0);
+
+    // Sends from the root to every other rank in turn, which receive it with
+    // recv. This can't use a tree, as the other ranks don't forward it.
+    [[deprecated("Call broadcast(sendRank, recvRank, ...) from every rank, "
+                 "which broadcasts down a tree")]] void
+    broadcast(int sendRank,
               const uint8_t* buffer,
               faabric_datatype_t* dataType,
               int count,
@@ -70,7 +125,8 @@ class MpiWorld
                 faabric::MPIMessage::NORMAL);
 
     void broadcast(int sendRank,
-                   const uint8_t* buffer,
+                   int recvRank,
+                   uint8_t* buffer,
                    faabric_datatype_t* dataType,
                    int count,
                    faabric::MPIMessage::MPIMessageType messageType =
@@ -83,7 +139,8 @@ class MpiWorld
               int count,
               MPI_Status* status,
               faabric::MPIMessage::MPIMessageType messageType =
-                faabric::MPIMessage::NORMAL);
+                faabric::MPIMessage::NORMAL,
+              int tag = 0);
 
     int irecv(int sendRank,
               int recvRank,
@@ -91,9 +148,24 @@ class MpiWorld
               faabric_datatype_t* dataType,
               int count,
               faabric::MPIMessage::MPIMessageType messageType =
-                faabric::MPIMessage::NORMAL);
+                faabric::MPIMessage::NORMAL,
+              int tag = 0);
+
+    void awaitAsyncRequest(int requestId,
+                           MPI_Status* status = MPI_STATUS_IGNORE);
+
+    // Messages are taken off the queues for all the given requests as they
+    // arrive, so the order of the requests doesn't hold any of them up. As
+    // with MPI request handles, requests that complete are set to
+    // FAABRIC_REQUEST_NULL_ID, and null requests are ignored.
+    void awaitAllAsyncRequests(std::vector<int>& requestIds,
+                               MPI_Status* statuses = MPI_STATUSES_IGNORE);
+
+    int awaitAnyAsyncRequest(std::vector<int>& requestIds,
+                             MPI_Status* status = MPI_STATUS_IGNORE);
 
-    void awaitAsyncRequest(int requestId);
+    bool testAllAsyncRequests(std::vector<int>& requestIds,
+                              MPI_Status* statuses = MPI_STATUSES_IGNORE);
 
     void sendRecv(uint8_t* sendBuffer,
                   int sendcount,
@@ -104,7 +176,9 @@ class MpiWorld
                   faabric_datatype_t* recvDataType,
                   int recvRank,
                   int myRank,
-                  MPI_Status* status);
+                  MPI_Status* status,
+                  int sendTag = 0,
+                  int recvTag = 0);
 
     void scatter(int sendRank,
                  int recvRank,
@@ -160,6 +234,13 @@ class MpiWorld
               int count,
               faabric_op_t* operation);
 
+    void exscan(int rank,
+                uint8_t* sendBuffer,
+                uint8_t* recvBuffer,
+                faabric_datatype_t* datatype,
+                int count,
+                faabric_op_t* operation);
+
     void allToAll(int rank,
                   uint8_t* sendBuffer,
                   faabric_datatype_t* sendType,
@@ -168,7 +249,10 @@ class MpiWorld
                   faabric_datatype_t* recvType,
                   int recvCount);
 
-    void probe(int sendRank, int recvRank, MPI_Status* status);
+    void probe(int sendRank,
+               int recvRank,
+               MPI_Status* status,
+               int tag = MPI_ANY_TAG);
 
     void barrier(int thisRank);
 
@@ -200,22 +284,86 @@ class MpiWorld
     std::vector<std::string> rankHosts;
     int getIndexForRanks(int sendRank, int recvRank);
 
+    // Ranks grouped by host, each in ascending order, for the collectives
+    std::vector<int> allRanks;
+    std::map<std::string, std::vector<int>> ranksForHost;
+    void initRanksForHost();
+
+    bool useHierarchicalCollectives();
+
+    int getLocalLeader(int rank, int root);
+
+    std::vector<int> getLeaders(int root);
+
     // In-memory queues for local messaging
     std::vector<std::shared_ptr<InMemoryMpiQueue>> localQueues;
     void initLocalQueues();
 
-    // Rank-to-rank sockets for remote messaging
+    // Receive buffers exposed to local senders for large messages
+    size_t rendezvousThreshold = 0;
+    std::vector<std::shared_ptr<LocalRendezvous>> localRendezvous;
+
+    void postLocalRecvBuffer(
+      const MpiMessageMatcher::PendingRecv& pendingRecv,
+      int recvRank,
+      size_t bufferSize);
+
+    uint8_t* claimPostedRecvBuffer(
+      int sendRank,
+      int recvRank,
+      int tag,
+      faabric::MPIMessage::MPIMessageType messageType,
+      size_t bufferSize);
+
+    std::shared_ptr<faabric::MPIMessage> dequeueLocal(
+      int sendRank,
+      int recvRank,
+      long timeoutMs = DEFAULT_QUEUE_TIMEOUT_MS);
+
+    // Remote messaging goes over a single channel from each host to each
+    // other host. Each host receives on its own port, recorded here for each
+    // of its ranks, and a background thread routes what arrives to the local
+    // queues.
     std::vector<int> basePorts;
     std::vector<int> initLocalBasePorts(
       const std::vector<std::string>& executedAt);
 
-    void initRemoteMpiEndpoint(int localRank, int remoteRank);
+    std::once_flag remoteRecvStarted;
+    std::thread remoteRecvThread;
+    std::atomic<bool> remoteRecvRunning = false;
+    std::atomic<int> nDestroyedRanks = 0;
+
+    void initRemoteRecvThread();
+
+    void startRemoteRecvThread();
+
+    void stopRemoteRecvThread();
 
-    std::pair<int, int> getPortForRanks(int localRank, int remoteRank);
+    void routeRemoteMpiMessages(int port);
 
-    void sendRemoteMpiMessage(int sendRank,
-                              int recvRank,
-                              const std::shared_ptr<faabric::MPIMessage>& msg);
+    // Remote messages larger than the eager limit are sent with a rendezvous,
+    // in chunks. Credit to send them comes back through the background thread.
+    size_t eagerLimit = 0;
+    size_t chunkSize = 0;
+    std::vector<std::shared_ptr<faabric::util::SpscQueue<int>>>
+      rendezvousCredits;
+
+    // Bytes of rendezvous payload received from each remote sender, so that
+    // receivers keep waiting while a large message is still arriving
+    std::unique_ptr<std::atomic<size_t>[]> rendezvousProgress;
+
+    faabric::transport::MpiSendMessageEndpoint& getMpiSendEndpoint(
+      const std::string& host,
+      int port);
+
+    void sendRemoteMpiMessage(
+      const faabric::transport::MpiMessageHeader& header,
+      const uint8_t* buffer);
+
+    void sendRemoteRendezvous(faabric::transport::MpiMessageHeader header,
+                              const uint8_t* buffer);
+
+    void sendRendezvousCredit(int sendRank, int recvRank, int nChunks);
 
     std::shared_ptr<faabric::MPIMessage> recvRemoteMpiMessage(int sendRank,
                                                               int recvRank);
@@ -227,18 +375,128 @@ class MpiWorld
 
     void closeMpiMessageEndpoints();
 
-    // Support for asyncrhonous communications
-    std::shared_ptr<MpiMessageBuffer> getUnackedMessageBuffer(int sendRank,
-                                                              int recvRank);
+    // Matching of messages to receives. Every receive is posted to the
+    // receiving rank's matcher, then messages are taken off the queues and
+    // handed to it until the receive has been matched. Those that progress
+    // receives return the ids of the receives matched.
+    MpiMessageMatcher& getMessageMatcher(int recvRank);
 
-    std::shared_ptr<faabric::MPIMessage> recvBatchReturnLast(int sendRank,
-                                                             int recvRank,
-                                                             int batchSize = 0);
+    int postRecv(int sendRank,
+                 int recvRank,
+                 uint8_t* buffer,
+                 faabric_datatype_t* dataType,
+                 int count,
+                 faabric::MPIMessage::MPIMessageType messageType,
+                 int tag);
+
+    void awaitRecv(int recvRank, int requestId, MPI_Status* status);
+
+    bool isAsyncRequestReady(int requestId, int& recvRank);
+
+    std::vector<int> getPendingSendRanks(int recvRank);
+
+    int progressRecv(int sendRank, int recvRank);
+
+    std::vector<int> progressRecvs(int recvRank,
+                                   const std::vector<int>& sendRanks);
+
+    int pollRecvs(int recvRank,
+                  const std::vector<int>& sendRanks,
+                  std::vector<int>& matched);
 
     /* Helper methods */
 
     void checkRanksRange(int sendRank, int recvRank);
 
+    void checkRecvRanksRange(int sendRank, int recvRank);
+
+    // Broadcast algorithms, called on every rank in the given group
+    void broadcastInGroup(const std::vector<int>& ranks,
+                          int sendRank,
+                          int recvRank,
+                          uint8_t* buffer,
+                          faabric_datatype_t* dataType,
+                          int count,
+                          faabric::MPIMessage::MPIMessageType messageType);
+
+    void broadcastBinomial(const std::vector<int>& ranks,
+                           int sendRank,
+                           int recvRank,
+                           uint8_t* buffer,
+                           faabric_datatype_t* dataType,
+                           int count,
+                           faabric::MPIMessage::MPIMessageType messageType);
+
+    void broadcastChain(const std::vector<int>& ranks,
+                        int sendRank,
+                        int recvRank,
+                        uint8_t* buffer,
+                        faabric_datatype_t* dataType,
+                        int count,
+                        faabric::MPIMessage::MPIMessageType messageType);
+
+    // Reduces onto the root of the given group, called on every rank in it
+    void reduceInGroup(const std::vector<int>& ranks,
+                       int sendRank,
+                       int recvRank,
+                       uint8_t* sendBuffer,
+                       uint8_t* recvBuffer,
+                       faabric_datatype_t* datatype,
+                       int count,
+                       faabric_op_t* operation);
+
+    // Two-level collectives, in which ranks first combine with the others on
+    // their host, and one leader per host takes part in the cross-host phase
+    void reduceHierarchical(int sendRank,
+                            int recvRank,
+                            uint8_t* sendBuffer,
+                            uint8_t* recvBuffer,
+                            faabric_datatype_t* datatype,
+                            int count,
+                            faabric_op_t* operation);
+
+    void gatherHierarchical(int sendRank,
+                            int recvRank,
+                            const uint8_t* sendBuffer,
+                            faabric_datatype_t* sendType,
+                            int sendCount,
+                            uint8_t* recvBuffer,
+                            faabric_datatype_t* recvType,
+                            int recvCount);
+
+    void barrierHierarchical(int thisRank);
+
+    // Allreduce algorithms, called on every rank
+    void allReduceReduceBroadcast(int rank,
+                                  uint8_t* sendBuffer,
+                                  uint8_t* recvBuffer,
+                                  faabric_datatype_t* datatype,
+                                  int count,
+                                  faabric_op_t* operation);
+
+    void allReduceRecursiveDoubling(int rank,
+                                    uint8_t* sendBuffer,
+                                    uint8_t* recvBuffer,
+                                    faabric_datatype_t* datatype,
+                                    int count,
+                                    faabric_op_t* operation);
+
+    void allReduceRing(int rank,
+                       uint8_t* sendBuffer,
+                       uint8_t* recvBuffer,
+                       faabric_datatype_t* datatype,
+                       int count,
+                       faabric_op_t* operation);
+
+    // Recursive doubling scan, shared by scan and exscan
+    void doScan(int rank,
+                uint8_t* sendBuffer,
+                uint8_t* recvBuffer,
+                faabric_datatype_t* datatype,
+                int count,
+                faabric_op_t* operation,
+                bool isExclusive);
+
     // Abstraction of the bulk of the recv work, shared among various functions
     void doRecv(std::shared_ptr<faabric::MPIMessage> m,
                 uint8_t* buffer,
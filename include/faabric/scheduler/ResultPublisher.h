@@ -0,0 +1,82 @@
+#pragma once
+
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/util/clock.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace faabric::scheduler {
+
+struct ResultPublisherStats
+{
+    long nFlushes = 0;
+    long nResults = 0;
+
+    // Time from the first result in a batch being handed over to the whole
+    // batch being written to Redis
+    long lastFlushMicros = 0;
+    long maxFlushMicros = 0;
+    long totalFlushMicros = 0;
+};
+
+/*
+ * Writes function results to Redis in the background, so that executor
+ * threads can move on to their next task straight away. Results are
+ * coalesced into pipelined batches, which are written when the batch is full
+ * or when the oldest result has waited for the flush interval.
+ */
+class ResultPublisher
+{
+  public:
+    ResultPublisher();
+
+    ~ResultPublisher();
+
+    // Writes the long-lived status key for the message and, if requested,
+    // adds it to its result queue. The publisher thread is started on first
+    // use, including the first use after a stop.
+    void publish(const faabric::Message& msg, bool enqueueResult);
+
+    // Blocks until everything published so far has been written
+    void flush();
+
+    void stop();
+
+    ResultPublisherStats getStats();
+
+  private:
+    struct PendingResult
+    {
+        faabric::Message msg;
+        bool enqueueResult = false;
+    };
+
+    std::mutex mx;
+    std::condition_variable pendingCv;
+    std::condition_variable writtenCv;
+
+    size_t batchSize = 0;
+    std::chrono::microseconds flushInterval;
+
+    bool running = false;
+    bool stopping = false;
+    bool flushRequested = false;
+    std::thread publisherThread;
+
+    std::vector<PendingResult> pending;
+    faabric::util::TimePoint pendingStart;
+
+    long publishedCount = 0;
+    long writtenCount = 0;
+
+    ResultPublisherStats stats;
+
+    void run();
+
+    void writeBatch(const std::vector<PendingResult>& batch);
+};
+}
@@ -4,6 +4,8 @@
 #include <faabric/scheduler/ExecGraph.h>
 #include <faabric/scheduler/FunctionCallClient.h>
 #include <faabric/scheduler/InMemoryMessageQueue.h>
+#include <faabric/scheduler/ResultPublisher.h>
+#include <faabric/scheduler/SchedulingPolicy.h>
 #include <faabric/snapshot/SnapshotClient.h>
 #include <faabric/util/config.h>
 #include <faabric/util/func.h>
@@ -11,6 +13,10 @@
 #include <faabric/util/snapshot.h>
 #include <faabric/util/timing.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <future>
 #include <shared_mutex>
 
@@ -38,6 +44,10 @@ class ExecutorTask
     std::shared_ptr<std::atomic<int>> batchCounter;
     bool needsSnapshotPush = false;
     bool skipReset = false;
+
+    // Whether an idle thread pool thread may take this task from the thread
+    // it was assigned to
+    bool stealable = false;
 };
 
 class Executor
@@ -69,11 +79,21 @@ class Executor
 
     virtual faabric::util::SnapshotData snapshot();
 
+    // The executor's memory, without taking a copy. Executors that don't
+    // provide it have their dirty pages tracked in the result of snapshot().
+    virtual faabric::util::SnapshotData getMemoryView();
+
   protected:
     virtual void restore(faabric::Message& msg);
 
     virtual void postFinish();
 
+    // Executors that keep per-thread state relied on by their tasks (i.e.
+    // indexed by threadPoolIdx) can override this to stop idle threads
+    // stealing tasks in the batch
+    virtual bool requiresThreadAffinity(
+      std::shared_ptr<faabric::BatchExecuteRequest> req);
+
     faabric::Message boundMessage;
 
     uint32_t threadPoolSize = 0;
@@ -83,11 +103,47 @@ class Executor
 
     std::atomic<bool> claimed = false;
 
+    // The memory whose writes are tracked while a batch of threads executes
+    std::mutex trackedMemoryMx;
+    faabric::util::SnapshotData trackedMemory;
+
+    faabric::util::SnapshotData getTrackedMemory();
+
+    void startMemoryTracking();
+
+    void stopMemoryTracking();
+
     std::mutex threadsMutex;
     std::vector<std::shared_ptr<std::thread>> threadPoolThreads;
     std::vector<std::shared_ptr<std::thread>> deadThreads;
 
-    std::vector<faabric::util::Queue<ExecutorTask>> threadTaskQueues;
+    // Each thread pool thread has its own deque of tasks. Threads take tasks
+    // from the front of their own deque, and steal from the back of others'
+    // when they have nothing to do.
+    struct ThreadTaskQueue
+    {
+        std::mutex mx;
+        std::deque<ExecutorTask> tasks;
+
+        // Guarded by the idle mutex
+        std::condition_variable cv;
+        bool idle = false;
+        bool woken = false;
+    };
+
+    std::vector<ThreadTaskQueue> threadTaskQueues;
+    std::atomic<int> nStealableTasks = 0;
+    std::mutex idleMx;
+
+    void enqueueTask(int threadPoolIdx, ExecutorTask task);
+
+    bool dequeueTask(int threadPoolIdx, ExecutorTask& task);
+
+    bool stealTask(int threadPoolIdx, ExecutorTask& task);
+
+    bool waitForTask(int threadPoolIdx, ExecutorTask& task);
+
+    void startThread(int threadPoolIdx);
 
     void threadPoolThread(int threadPoolIdx);
 };
@@ -127,6 +183,14 @@ class Scheduler
 
     void setFunctionResult(faabric::Message& msg);
 
+    // As above, but leaves any Redis writes to the result publisher so the
+    // caller does not block on them
+    void setFunctionResultAsync(faabric::Message& msg);
+
+    void setFunctionResultLocally(const faabric::Message& msg);
+
+    ResultPublisher& getResultPublisher();
+
     faabric::Message getFunctionResult(unsigned int messageId, int timeout);
 
     void setThreadResult(const faabric::Message& msg, int32_t returnValue);
@@ -162,6 +226,15 @@ class Scheduler
 
     void setThisHostResources(faabric::HostResources& res);
 
+    void setHostResources(const std::string& host,
+                          const faabric::HostResources& res);
+
+    void publishThisHostResources();
+
+    void startResourcePublisher();
+
+    void stopResourcePublisher();
+
     // ----------------------------------
     // Testing
     // ----------------------------------
@@ -189,37 +262,163 @@ class Scheduler
 
     faabric::util::SystemConfig& conf;
 
+    // Scheduler state is split so that calls to independent functions can be
+    // scheduled concurrently. The shared mutex only guards the structure of
+    // the maps below (and other host-wide state), and is only ever held
+    // briefly. The executors and registered hosts for a given function are
+    // guarded by that function's own mutex. Locks are always acquired in the
+    // order function mutex -> shared mutex, and none are held across network
+    // calls.
+    std::shared_mutex mx;
+
+    std::unordered_map<std::string, std::shared_ptr<std::mutex>>
+      functionMutexes;
+
     std::vector<std::shared_ptr<Executor>> deadExecutors;
 
     std::unordered_map<std::string, std::vector<std::shared_ptr<Executor>>>
       executors;
 
-    std::shared_mutex mx;
-
+    std::mutex threadResultsMx;
     std::unordered_map<uint32_t, std::promise<int32_t>> threadResults;
 
+    // Results of functions scheduled from this host are sent straight back
+    // here and handed to waiters in memory. Redis is only used for results
+    // nobody on this host is expecting.
+    struct PendingFunctionResult
+    {
+        std::promise<faabric::Message> promise;
+        std::shared_future<faabric::Message> future;
+        bool isSet = false;
+        int nWaiters = 0;
+        long registeredMillis = 0;
+    };
+
+    std::mutex functionResultsMx;
+    std::unordered_map<uint32_t, std::shared_ptr<PendingFunctionResult>>
+      functionResults;
+    long lastFunctionResultsPruneMillis = 0;
+
+    ResultPublisher resultPublisher;
+
+    bool sendFunctionResult(faabric::Message& msg);
+
+    bool deliverFunctionResultLocally(const faabric::Message& msg);
+
+    void registerFunctionResults(
+      std::shared_ptr<faabric::BatchExecuteRequest> req);
+
+    std::vector<faabric::Message> pruneFunctionResults(long nowMillis);
+
+    std::shared_ptr<PendingFunctionResult> getPendingFunctionResult(
+      uint32_t msgId);
+
     faabric::scheduler::FunctionCallClient& getFunctionCallClient(
       const std::string& otherHost);
 
     faabric::snapshot::SnapshotClient& getSnapshotClient(
       const std::string& otherHost);
 
-    faabric::HostResources thisHostResources;
+    // Slots on this host are claimed and vacated without taking any locks
+    std::atomic<int32_t> thisHostSlots = 0;
+    std::atomic<int32_t> thisHostUsedSlots = 0;
+
+    // Other hosts periodically push their resources to us, so we can keep a
+    // local table of them and use it optimistically when scheduling, rather
+    // than asking each host for its resources on every batch.
+    struct HostResourcesRecord
+    {
+        faabric::HostResources resources;
+        long updatedMillis = 0;
+    };
+
+    std::mutex hostResourcesMx;
+    std::unordered_map<std::string, HostResourcesRecord> hostResources;
+
+    std::thread resourcePublisherThread;
+    std::mutex resourcePublisherMx;
+    std::condition_variable resourcePublisherCv;
+    std::atomic<bool> resourcePublisherRunning = false;
+    bool resourcePushRequested = false;
+    std::atomic<int32_t> lastPublishedUsedSlots = 0;
+
+    std::shared_ptr<SchedulingPolicy> policy;
+
+    // Requests to other hosts are sent from a pool of threads, so that when
+    // a batch is spread over several hosts we only wait on the slowest. Each
+    // host has its own queue, which any idle thread can drain, but only one
+    // thread at a time, so requests to a host are still sent in order and a
+    // slow host only holds up its own requests.
+    struct HostDispatchQueue
+    {
+        std::deque<std::function<void()>> tasks;
+
+        // Set while the host is waiting for a thread, or being handled by one
+        bool scheduled = false;
+    };
+
+    std::mutex dispatchMx;
+    std::condition_variable dispatchCv;
+    std::unordered_map<std::string, HostDispatchQueue> hostDispatchQueues;
+    std::deque<std::string> readyDispatchHosts;
+    std::vector<std::thread> dispatchThreads;
+    bool dispatchStopping = false;
+
+    // Bumped when a host leaves, so dispatch threads know to drop their
+    // clients for it
+    std::unordered_map<std::string, int> dispatchHostEpochs;
+
+    std::future<void> dispatchToHost(const std::string& host,
+                                     std::function<void()> task);
+
+    void runDispatchThread();
+
+    void stopDispatchThreads();
+
+    void resetDispatchHost(const std::string& host);
+
     std::set<std::string> availableHostsCache;
+    long availableHostsRefreshedMillis = 0;
     std::unordered_map<std::string, std::set<std::string>> registeredHosts;
 
+    // Hosts we've pushed each snapshot to, which are kept up to date with
+    // diffs until the snapshot is deleted
+    std::unordered_map<std::string, std::set<std::string>> snapshotHosts;
+
     std::vector<faabric::Message> recordedMessagesAll;
     std::vector<faabric::Message> recordedMessagesLocal;
     std::vector<std::pair<std::string, faabric::Message>>
       recordedMessagesShared;
 
-    std::vector<std::string> getUnregisteredHosts(const std::string& funcStr,
-                                                  bool noCache = false);
+    std::set<std::string> refreshAvailableHosts(
+      const std::set<std::string>& previousHosts);
+
+    std::set<std::string> getUnregisteredHosts(const std::string& funcStr,
+                                               bool noCache = false);
+
+    std::shared_ptr<SchedulingPolicy> getPolicy();
+
+    std::set<std::string> getSnapshotHosts(const std::string& snapshotKey);
+
+    std::shared_ptr<std::mutex> getFunctionMutex(const std::string& funcStr);
+
+    std::vector<std::shared_ptr<Executor>>& getFunctionExecutors(
+      const std::string& funcStr);
+
+    std::set<std::string> getRegisteredHosts(const std::string& funcStr);
+
+    void registerHost(const std::string& funcStr, const std::string& host);
+
+    int claimLocalSlots(int nRequested);
 
     std::shared_ptr<Executor> claimExecutor(faabric::Message& msg);
 
     faabric::HostResources getHostResources(const std::string& host);
 
+    int claimHostSlots(const std::string& host, int nRequested);
+
+    void notifyLocalSlotsChanged();
+
     ExecGraphNode getFunctionExecGraphNode(unsigned int msgId);
 
     void updateHostResources();
@@ -229,7 +428,9 @@ class Scheduler
       std::shared_ptr<faabric::BatchExecuteRequest> req,
       std::vector<std::string>& records,
       int offset,
-      faabric::util::SnapshotData* snapshot);
+      int nMessagesMax,
+      faabric::util::SnapshotData* snapshot,
+      std::vector<std::future<void>>& dispatches);
 };
 
 }
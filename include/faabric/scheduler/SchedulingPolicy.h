@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#define BIN_PACK_POLICY "binpack"
+#define SPREAD_POLICY "spread"
+#define SNAPSHOT_AFFINITY_POLICY "snapshot"
+
+namespace faabric::scheduler {
+
+/*
+ * The hosts the scheduler can choose from when placing a batch. Registered
+ * hosts are already executing the function, snapshot hosts already hold the
+ * batch's snapshot, and other hosts are everything else in the available set.
+ */
+struct SchedulingCandidates
+{
+    std::string thisHost;
+    std::set<std::string> registeredHosts;
+    std::set<std::string> snapshotHosts;
+    std::set<std::string> otherHosts;
+};
+
+/*
+ * A scheduling policy decides where the messages in a batch are placed. The
+ * scheduler visits hosts in the order returned by the policy, placing at most
+ * the policy's limit on each. It then makes a second pass without the limit
+ * to use up any remaining capacity, before overloading this host.
+ */
+class SchedulingPolicy
+{
+  public:
+    virtual ~SchedulingPolicy(){};
+
+    // By default visit this host, then registered hosts, then any others
+    virtual std::vector<std::string> getHostOrder(
+      const SchedulingCandidates& candidates);
+
+    virtual int getHostLimit(int nMessages, int nHosts);
+};
+
+/*
+ * Packs as many messages as possible onto each host in turn.
+ */
+class BinPackPolicy final : public SchedulingPolicy
+{};
+
+/*
+ * Divides the batch evenly between all hosts.
+ */
+class SpreadPolicy final : public SchedulingPolicy
+{
+  public:
+    int getHostLimit(int nMessages, int nHosts) override;
+};
+
+/*
+ * Fills this host, then hosts that already hold the snapshot, then registered
+ * hosts, then any others. This avoids pushing full snapshots to new hosts when
+ * ones holding the snapshot have capacity.
+ */
+class SnapshotAffinityPolicy final : public SchedulingPolicy
+{
+  public:
+    std::vector<std::string> getHostOrder(
+      const SchedulingCandidates& candidates) override;
+};
+
+std::shared_ptr<SchedulingPolicy> getSchedulingPolicy(
+  const std::string& policyName);
+}
@@ -8,5 +8,9 @@ enum SnapshotCalls
     PushSnapshotDiffs = 2,
     DeleteSnapshot = 3,
     ThreadResult = 4,
+    StreamSnapshotStart = 5,
+    StreamSnapshotChunk = 6,
+    StreamSnapshotAck = 7,
+    PushSnapshotManifest = 8,
 };
 }
@@ -36,8 +36,10 @@ class SnapshotClient final : public faabric::transport::MessageEndpointClient
 
     /* Snapshot client external API */
 
-    void pushSnapshot(const std::string& key,
-                      const faabric::util::SnapshotData& data);
+    // Returns how many bytes of the snapshot were sent, which is less than
+    // its size if the receiver already held some of its pages
+    size_t pushSnapshot(const std::string& key,
+                        const faabric::util::SnapshotData& data);
 
     void pushSnapshotDiffs(std::string snapshotKey,
                            std::vector<faabric::util::SnapshotDiff> diffs);
@@ -48,5 +50,19 @@ class SnapshotClient final : public faabric::transport::MessageEndpointClient
 
   private:
     void sendHeader(faabric::snapshot::SnapshotCalls call);
+
+    void streamSnapshot(const std::string& key,
+                        const faabric::util::SnapshotData& data);
+
+    size_t pushSnapshotPages(const std::string& key,
+                             const faabric::util::SnapshotData& data);
+
+    void streamSnapshotRanges(
+      const std::string& key,
+      const faabric::util::SnapshotData& data,
+      const std::vector<std::pair<size_t, size_t>>& ranges,
+      size_t bytesWritten);
+
+    void sendStreamAck(const std::string& key, size_t nBytes, bool complete);
 };
 }
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <deque>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/util/snapshot.h>
@@ -18,9 +22,14 @@ class SnapshotRegistry
 
     void mapSnapshot(const std::string& key, uint8_t* target);
 
+    // If ownsData is set, the data is a mapping of the snapshot's fd, which
+    // is unmapped when the snapshot is deleted. Page hashes the caller already
+    // has are indexed as they are, rather than hashing the pages again.
     void takeSnapshot(const std::string& key,
                       faabric::util::SnapshotData data,
-                      bool locallyRestorable = true);
+                      bool locallyRestorable = true,
+                      bool ownsData = false,
+                      std::vector<faabric::util::PageHash> pageHashes = {});
 
     void deleteSnapshot(const std::string& key);
 
@@ -28,12 +37,69 @@ class SnapshotRegistry
 
     void clear();
 
+    // Returns the hashes of the pages of the snapshot with the given key, if
+    // they've been indexed and it still refers to the given data
+    std::vector<faabric::util::PageHash> getPageHashes(
+      const std::string& key,
+      const faabric::util::SnapshotData& data);
+
+    // Hashes the pages covering the given (offset, size) ranges again, to be
+    // called after changing a snapshot in place so its hashes stay valid
+    void reindexPages(const std::string& key,
+                      const std::vector<std::pair<size_t, size_t>>& ranges);
+
+    // Copies a page with the given hash from one of the snapshots held here
+    // into the target, returning false if there isn't one
+    bool copyPageByHash(const faabric::util::PageHash& hash,
+                        uint8_t* target,
+                        size_t size);
+
   private:
     std::unordered_map<std::string, faabric::util::SnapshotData> snapshotMap;
 
     std::mutex snapshotsMx;
 
+    std::unordered_set<std::string> ownedSnapshots;
+
+    // Where to find a page with each hash, and which hashes each snapshot
+    // added. Snapshots can be changed after they're indexed, so pages are
+    // checked against their hash before they're used.
+    struct PageLocation
+    {
+        std::string key;
+        size_t offset = 0;
+        size_t size = 0;
+    };
+
+    std::unordered_map<faabric::util::PageHash,
+                       PageLocation,
+                       faabric::util::PageHashHasher>
+      pageIndex;
+
+    std::unordered_map<std::string, std::vector<faabric::util::PageHash>>
+      snapshotPageHashes;
+
+    // Deleted snapshots whose fds are kept, oldest first, so their pages can
+    // still be reused when the same application is scheduled again
+    std::deque<std::pair<std::string, faabric::util::SnapshotData>>
+      retiredSnapshots;
+
+    size_t retiredBytes = 0;
+
+    int retiredCount = 0;
+
     int writeSnapshotToFd(const std::string& key);
+
+    void retireSnapshot(const std::string& key,
+                        const faabric::util::SnapshotData& data);
+
+    void indexPages(const std::string& key,
+                    std::vector<faabric::util::PageHash> hashes);
+
+    void removeIndexedPages(const std::string& key);
+
+    void releaseOwnedData(const std::string& key,
+                          const faabric::util::SnapshotData& data);
 };
 
 SnapshotRegistry& getSnapshotRegistry();
@@ -4,6 +4,15 @@
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/snapshot/SnapshotApi.h>
 #include <faabric/transport/MessageEndpointServer.h>
+#include <faabric/util/snapshot.h>
+#include <faabric/util/timing.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace faabric::snapshot {
 class SnapshotServer final : public faabric::transport::MessageEndpointServer
@@ -11,6 +20,9 @@ class SnapshotServer final : public faabric::transport::MessageEndpointServer
   public:
     SnapshotServer();
 
+    // Snapshots being streamed to this host that haven't completed
+    size_t getIncomingSnapshotCount();
+
   protected:
     void doAsyncRecv(int header,
                      const uint8_t* buffer,
@@ -30,5 +42,67 @@ class SnapshotServer final : public faabric::transport::MessageEndpointServer
     void recvDeleteSnapshot(const uint8_t* buffer, size_t bufferSize);
 
     void recvThreadResult(const uint8_t* buffer, size_t bufferSize);
+
+    std::unique_ptr<google::protobuf::Message> recvStreamSnapshotStart(
+      const uint8_t* buffer,
+      size_t bufferSize);
+
+    void recvStreamSnapshotChunk(const uint8_t* buffer, size_t bufferSize);
+
+    std::unique_ptr<google::protobuf::Message> recvStreamSnapshotAck(
+      const uint8_t* buffer,
+      size_t bufferSize);
+
+    std::unique_ptr<google::protobuf::Message> recvPushSnapshotManifest(
+      const uint8_t* buffer,
+      size_t bufferSize);
+
+  private:
+    // A snapshot being streamed to this host, whose chunks are written
+    // straight into its fd as they arrive. The fd and mapping are released
+    // with it, unless they've been handed over to the registry.
+    struct IncomingSnapshot
+    {
+        IncomingSnapshot() = default;
+
+        IncomingSnapshot(const IncomingSnapshot&) = delete;
+
+        IncomingSnapshot& operator=(const IncomingSnapshot&) = delete;
+
+        ~IncomingSnapshot();
+
+        int fd = 0;
+        size_t size = 0;
+        uint8_t* data = nullptr;
+        size_t bytesWritten = 0;
+
+        // Set when a chunk couldn't be written, so the next ack can fail
+        bool failed = false;
+
+        // Hashes from the manifest, if the snapshot was sent with one
+        std::vector<faabric::util::PageHash> pageHashes;
+
+        faabric::util::TimePoint lastUsed;
+    };
+
+    std::unordered_map<std::string, std::shared_ptr<IncomingSnapshot>>
+      incomingSnapshots;
+
+    std::mutex incomingMx;
+
+    std::condition_variable incomingCv;
+
+    std::shared_ptr<IncomingSnapshot> createIncomingSnapshot(
+      const std::string& key,
+      size_t size);
+
+    void addIncomingSnapshot(const std::string& key,
+                             std::shared_ptr<IncomingSnapshot> incoming);
+
+    void expireIncomingSnapshots();
+
+    void writeIncomingChunk(const std::string& key,
+                            IncomingSnapshot& incoming,
+                            const SnapshotStreamChunkRequest* r);
 };
 }
@@ -60,6 +60,8 @@ class MessageEndpoint
 
     Message recvBuffer(zmq::socket_t& socket, int size);
 
+    bool recvIntoBuffer(zmq::socket_t& socket, uint8_t* buffer, size_t size);
+
     Message recvNoBuffer(zmq::socket_t& socket);
 };
 
@@ -106,6 +108,10 @@ class RecvMessageEndpoint : public MessageEndpoint
 
     virtual Message recv(int size = 0);
 
+    // Receives a message of exactly the given size straight into the buffer.
+    // Returns false if the context has been closed.
+    bool recvInto(uint8_t* buffer, size_t size);
+
   protected:
     zmq::socket_t socket;
 };
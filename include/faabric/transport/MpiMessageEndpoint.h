@@ -3,31 +3,97 @@
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/transport/MessageEndpoint.h>
 #include <faabric/transport/common.h>
-#include <faabric/transport/macros.h>
+
+#include <cstdint>
 
 namespace faabric::transport {
 
-// This class abstracts the notion of a communication channel between two remote
-// MPI ranks. There will always be one rank local to this host, and one remote.
-// Note that the ports are unique per (user, function, sendRank, recvRank)
-// tuple.
-//
-// This is different to our normal messaging clients as it wraps two
-// _async_ sockets.
+// Messages larger than the eager limit are sent with a rendezvous. The sender
+// first asks to send, then sends the payload in chunks, at most as many at a
+// time as the receiver has given it credit for.
+enum class MpiMessageKind : int32_t
+{
+    // The whole payload follows the header
+    Eager,
+    // Asks to send the payload in chunks of the given size. Nothing follows
+    // the header, whose payload size is that of the whole message.
+    RendezvousRequest,
+    // One chunk of the payload, to be written at the given offset
+    RendezvousChunk,
+    // Lets the sender of a rendezvous send count more chunks
+    RendezvousCredit,
+};
 
-class MpiMessageEndpoint
+// All MPI messages sent from one host to another in a given world share a
+// single channel, regardless of which ranks they are between. Messages are sent
+// as this fixed-size header, followed by a frame holding the raw payload if
+// there is one. Hosts in a world are assumed to share the same architecture.
+struct MpiMessageHeader
+{
+    uint64_t payloadSize;
+    uint64_t offset;
+    MpiMessageKind kind;
+    int32_t worldId;
+    int32_t sender;
+    int32_t destination;
+    int32_t id;
+    int32_t messageType;
+    int32_t datatype;
+    int32_t count;
+    int32_t tag;
+    int32_t chunkSize;
+
+    bool hasPayloadFrame() const
+    {
+        return payloadSize > 0 && (kind == MpiMessageKind::Eager ||
+                                   kind == MpiMessageKind::RendezvousChunk);
+    }
+};
+
+// Sending end of a channel, connected to the receiving host's port for the
+// world. Like all sockets, each one must only be used from a single thread.
+class MpiSendMessageEndpoint
 {
   public:
-    MpiMessageEndpoint(const std::string& hostIn, int sendPort, int recvPort);
+    MpiSendMessageEndpoint(const std::string& hostIn, int portIn);
 
-    void sendMpiMessage(const std::shared_ptr<faabric::MPIMessage>& msg);
+    // Sends the payload straight from the given buffer, which can be reused
+    // as soon as this returns
+    void sendMpiMessage(const MpiMessageHeader& header, const uint8_t* payload);
 
-    std::shared_ptr<faabric::MPIMessage> recvMpiMessage();
+    // Tells the receiving end to stop, only ever sent from the host itself
+    void sendShutdown();
 
   private:
     std::string host;
 
     AsyncSendMessageEndpoint sendSocket;
+};
+
+// Receiving end of all the channels into this host for a world
+class MpiRecvMessageEndpoint
+{
+  public:
+    MpiRecvMessageEndpoint(int portIn, int timeoutMs = DEFAULT_RECV_TIMEOUT_MS);
+
+    // Returns false on shutdown, or if the underlying context is closed. If
+    // the header has a payload frame, it must be received next.
+    bool recvHeader(MpiMessageHeader& header);
+
+    // Receives the payload frame straight into the given buffer, which must
+    // be exactly the size of the payload
+    bool recvPayload(uint8_t* buffer, size_t bufferSize);
+
+    // Receives an eager message, with the payload straight into the returned
+    // message. Returns nullptr on shutdown, or if the context is closed.
+    std::shared_ptr<faabric::MPIMessage> recvMpiMessage(
+      MpiMessageHeader& header);
+
+  private:
     AsyncRecvMessageEndpoint recvSocket;
 };
+
+// Builds the message to be received from the given header, with no payload
+std::shared_ptr<faabric::MPIMessage> mpiMessageFromHeader(
+  const MpiMessageHeader& header);
 }
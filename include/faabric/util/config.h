@@ -19,6 +19,13 @@ class SystemConfig
     std::string logFile;
     std::string stateMode;
     std::string deltaSnapshotEncoding;
+    std::string dirtyTrackingMode;
+    int snapshotDiffMergeGap;
+    int snapshotChunkSize;
+    int snapshotChunkWindow;
+    int snapshotPageDedup;
+    int snapshotPageCacheMb;
+    int snapshotStreamExpiryMs;
 
     // Redis
     std::string redisStateHost;
@@ -28,6 +35,13 @@ class SystemConfig
     // Scheduling
     int noScheduler;
     int overrideCpuCount;
+    std::string schedulingPolicy;
+    int resourcePushIntervalMs;
+    int resourcePushThreshold;
+    int resourceTableTtlMs;
+    int resultBatchSize;
+    int resultFlushIntervalUs;
+    int pendingResultExpiryMs;
 
     // Worker-related timeouts
     int globalMessageTimeout;
@@ -35,6 +49,10 @@ class SystemConfig
 
     // MPI
     int defaultMpiWorldSize;
+    int mpiRendezvousThreshold;
+    int mpiEagerLimit;
+    int mpiChunkSize;
+    std::string mpiAllReduceAlgorithm;
 
     // Endpoint
     std::string endpointInterface;
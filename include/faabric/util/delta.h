@@ -1,8 +1,11 @@
 #pragma once
 
+#include <faabric/util/snapshot.h>
+
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace faabric::util {
@@ -46,8 +49,22 @@ std::vector<uint8_t> serializeDelta(const DeltaSettings& cfg,
                                     const uint8_t* newDataStart,
                                     size_t newDataLen);
 
-void applyDelta(const std::vector<uint8_t>& delta,
-                std::function<void(uint32_t)> setDataSize,
-                std::function<uint8_t*()> getDataPointer);
+// Encodes the diffs as overwrites, for when the receiver's copy of the data
+// they were taken from isn't known, so can't be XORed with
+std::vector<uint8_t> serializeDiffsDelta(
+  const DeltaSettings& cfg,
+  const std::vector<SnapshotDiff>& diffs);
+
+// Returns the (offset, length) ranges of the data written by the delta
+std::vector<std::pair<size_t, size_t>> applyDelta(
+  const std::vector<uint8_t>& delta,
+  std::function<void(uint32_t)> setDataSize,
+  std::function<uint8_t*()> getDataPointer);
+
+std::vector<std::pair<size_t, size_t>> applyDelta(
+  const uint8_t* delta,
+  size_t deltaLen,
+  std::function<void(uint32_t)> setDataSize,
+  std::function<uint8_t*()> getDataPointer);
 
 }
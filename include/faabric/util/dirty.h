@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace faabric::util {
+
+/* Dirty trackers record which pages of a region of memory have been written
+ * since tracking for that region was last reset, so that snapshot diffs only
+ * need to look at those pages.
+ */
+class DirtyTracker
+{
+  public:
+    virtual ~DirtyTracker() = default;
+
+    // Clears the dirty pages of the region and tracks writes to it from now
+    // on. The region must be page-aligned, and nothing should be writing to it
+    // while it's reset
+    virtual void resetTracking(uint8_t* ptr, size_t size) = 0;
+
+    // Stops tracking the region, which must be done before it's unmapped
+    virtual void stopTracking(uint8_t* ptr, size_t size) = 0;
+
+    // Marks the pages covering the given range dirty, and makes sure they can
+    // be written. This must be called before handing tracked memory to
+    // anything that writes to it from the kernel, e.g. a read syscall
+    virtual void markDirty(uint8_t* ptr, size_t size) = 0;
+
+    virtual std::vector<int> getDirtyPageNumbers(const uint8_t* ptr,
+                                                 int nPages) = 0;
+
+    virtual std::string getMode() = 0;
+};
+
+/* Uses the kernel's soft-dirty bits. These can only be cleared for the whole
+ * process, so resetting one region would lose the writes made so far to any
+ * other. Instead, resetting a region marks every other tracked region wholly
+ * dirty until it's reset itself. This is always safe, but means concurrent
+ * batches each diff all of their memory; the segfault tracker avoids that.
+ */
+class SoftPTEDirtyTracker final : public DirtyTracker
+{
+  public:
+    void resetTracking(uint8_t* ptr, size_t size) override;
+
+    void stopTracking(uint8_t* ptr, size_t size) override;
+
+    void markDirty(uint8_t* ptr, size_t size) override;
+
+    std::vector<int> getDirtyPageNumbers(const uint8_t* ptr,
+                                         int nPages) override;
+
+    std::string getMode() override { return "softpte"; }
+
+  private:
+    std::mutex mx;
+
+    // Whether each tracked region, by start address, has had its soft-dirty
+    // bits cleared by a reset of another region
+    std::unordered_map<const uint8_t*, bool> allDirty;
+};
+
+/* Write-protects each tracked region, and marks a page dirty and makes it
+ * writable again the first time it's written, from a SIGSEGV handler. Each
+ * region is tracked independently of all the others.
+ *
+ * Writes made by the kernel (e.g. a read syscall into a tracked region) don't
+ * raise a signal, they fail with EFAULT. Anything passing tracked memory to
+ * the kernel to write must call markDirty on it first. Pages outside any
+ * tracked region are all reported dirty.
+ */
+class SegfaultDirtyTracker final : public DirtyTracker
+{
+  public:
+    void resetTracking(uint8_t* ptr, size_t size) override;
+
+    void stopTracking(uint8_t* ptr, size_t size) override;
+
+    void markDirty(uint8_t* ptr, size_t size) override;
+
+    std::vector<int> getDirtyPageNumbers(const uint8_t* ptr,
+                                         int nPages) override;
+
+    std::string getMode() override { return "segfault"; }
+};
+
+// Returns the tracker for the DIRTY_TRACKING_MODE in the system config
+DirtyTracker& getDirtyTracker();
+}
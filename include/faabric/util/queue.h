@@ -4,10 +4,24 @@
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 
+#include <atomic>
+#include <memory>
 #include <queue>
+#include <thread>
 
 #define DEFAULT_QUEUE_TIMEOUT_MS 5000
 
+// Number of times a waiting thread on a fixed capacity queue retries before
+// parking on a condition variable
+#define QUEUE_SPIN_ITERATIONS 1000
+
+// A waiting consumer on a single-producer single-consumer queue busy-spins,
+// then yields, then parks
+#define SPSC_QUEUE_SPIN_ITERATIONS 2000
+#define SPSC_QUEUE_YIELD_ITERATIONS 200
+#define SPSC_QUEUE_SEGMENT_SIZE 64
+#define SPSC_QUEUE_SPARE_SEGMENTS 2
+
 namespace faabric::util {
 class QueueTimeoutException : public faabric::util::FaabricException
 {
@@ -137,6 +151,529 @@ class Queue
     std::mutex mx;
 };
 
+/*
+ * Bounded, lock-free multi-producer multi-consumer queue. Enqueueing and
+ * dequeueing only touch atomics, unless a thread has to wait, in which case
+ * it spins briefly before parking on a condition variable. Enqueueing blocks
+ * while the queue is full. Timeouts behave as they do for Queue, except that
+ * peeking is not supported.
+ *
+ * This is the queue described by Dmitry Vyukov, where each cell carries a
+ * sequence number saying whether it is ready to be written or read at a
+ * given position.
+ */
+template<typename T>
+class FixedCapacityQueue
+{
+  public:
+    explicit FixedCapacityQueue(size_t capacityIn)
+      : capacity(roundUpToPowerOfTwo(capacityIn))
+      , mask(capacity - 1)
+      , cells(new Cell[capacity])
+    {
+        for (size_t i = 0; i < capacity; i++) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    void enqueue(T value, long timeoutMs = DEFAULT_QUEUE_TIMEOUT_MS)
+    {
+        if (tryEnqueue(value)) {
+            return;
+        }
+
+        bool success = waitFor(
+          [this, &value] { return tryEnqueue(value); },
+          nWaitingProducers,
+          notFullNotifier,
+          timeoutMs);
+
+        if (!success) {
+            throw QueueTimeoutException("Timeout waiting for enqueue");
+        }
+    }
+
+    void dequeueIfPresent(T* res)
+    {
+        tryDequeue(*res);
+    }
+
+    T dequeue(long timeoutMs = DEFAULT_QUEUE_TIMEOUT_MS)
+    {
+        if (timeoutMs <= 0) {
+            SPDLOG_ERROR("Invalid queue timeout: {} <= 0", timeoutMs);
+            throw std::runtime_error("Invalid queue timeout");
+        }
+
+        T value;
+        if (tryDequeue(value)) {
+            return value;
+        }
+
+        bool success = waitFor([this, &value] { return tryDequeue(value); },
+                               nWaitingConsumers,
+                               notEmptyNotifier,
+                               timeoutMs);
+
+        if (!success) {
+            throw QueueTimeoutException("Timeout waiting for dequeue");
+        }
+
+        return value;
+    }
+
+    void waitToDrain(long timeoutMs)
+    {
+        if (size() == 0) {
+            return;
+        }
+
+        bool success = waitFor([this] { return size() == 0; },
+                               nWaitingDrainers,
+                               emptyNotifier,
+                               timeoutMs);
+
+        if (!success) {
+            throw QueueTimeoutException("Timeout waiting for empty");
+        }
+    }
+
+    void drain()
+    {
+        T value;
+        while (tryDequeue(value)) {
+            ;
+        }
+    }
+
+    long size()
+    {
+        size_t head = dequeuePos.load(std::memory_order_acquire);
+        size_t tail = enqueuePos.load(std::memory_order_acquire);
+
+        return tail > head ? (long)(tail - head) : 0;
+    }
+
+    void reset() { drain(); }
+
+  private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    const size_t capacity;
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+
+    // Keep the producer and consumer positions on separate cache lines
+    alignas(64) std::atomic<size_t> enqueuePos = 0;
+    alignas(64) std::atomic<size_t> dequeuePos = 0;
+
+    // Only used when threads have to park
+    std::mutex mx;
+    std::condition_variable notEmptyNotifier;
+    std::condition_variable notFullNotifier;
+    std::condition_variable emptyNotifier;
+    std::atomic<int> nWaitingConsumers = 0;
+    std::atomic<int> nWaitingProducers = 0;
+    std::atomic<int> nWaitingDrainers = 0;
+    uint64_t notifyEpoch = 0;
+
+    static size_t roundUpToPowerOfTwo(size_t n)
+    {
+        size_t res = 1;
+        while (res < n) {
+            res <<= 1;
+        }
+
+        return res;
+    }
+
+    bool tryEnqueue(T& value)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(
+                      pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Full
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->seq.store(pos + 1, std::memory_order_release);
+
+        wakeWaiters(nWaitingConsumers, notEmptyNotifier);
+
+        return true;
+    }
+
+    bool tryDequeue(T& value)
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(
+                      pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Empty
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->value);
+        cell->seq.store(pos + mask + 1, std::memory_order_release);
+
+        wakeWaiters(nWaitingProducers, notFullNotifier);
+        wakeWaiters(nWaitingDrainers, emptyNotifier);
+
+        return true;
+    }
+
+    void wakeWaiters(std::atomic<int>& nWaiting, std::condition_variable& cv)
+    {
+        // Pairs with the fence in waitFor, so that either the waiter sees our
+        // update, or we see the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (nWaiting.load(std::memory_order_relaxed) > 0) {
+            UniqueLock lock(mx);
+            notifyEpoch++;
+            cv.notify_all();
+        }
+    }
+
+    // Spins, then parks, until the given operation succeeds. A non-positive
+    // timeout waits forever. Returns false on timeout. The operation is never
+    // run with the mutex held, as a successful operation may need to wake
+    // other waiters.
+    template<typename F>
+    bool waitFor(F&& tryOp,
+                 std::atomic<int>& nWaiting,
+                 std::condition_variable& cv,
+                 long timeoutMs)
+    {
+        for (int i = 0; i < QUEUE_SPIN_ITERATIONS; i++) {
+            if (tryOp()) {
+                return true;
+            }
+
+            std::this_thread::yield();
+        }
+
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(timeoutMs);
+
+        nWaiting++;
+
+        bool success = false;
+        for (;;) {
+            // Any wake-up after we read the epoch will stop us parking
+            uint64_t epoch;
+            {
+                UniqueLock lock(mx);
+                epoch = notifyEpoch;
+            }
+
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (tryOp()) {
+                success = true;
+                break;
+            }
+
+            UniqueLock lock(mx);
+            auto isWoken = [this, epoch] { return notifyEpoch != epoch; };
+
+            bool woken = true;
+            if (timeoutMs > 0) {
+                woken = cv.wait_until(lock, deadline, isWoken);
+            } else {
+                cv.wait(lock, isWoken);
+            }
+
+            if (!woken) {
+                lock.unlock();
+                success = tryOp();
+                break;
+            }
+        }
+
+        nWaiting--;
+        return success;
+    }
+};
+
+/*
+ * Unbounded queue for exactly one producer thread and one consumer thread.
+ * Elements are stored in a linked list of fixed-size ring segments, so both
+ * sides complete in a bounded number of steps without taking any locks. The
+ * only shared state is the count of elements written and read.
+ *
+ * Segments the consumer has finished with are handed back to the producer
+ * rather than freed, and a few are allocated up front, so the producer only
+ * allocates when the queue grows beyond anything it has held before.
+ *
+ * A consumer waiting on an empty queue spins, then yields, then parks on a
+ * condition variable. The producer only takes the mutex if the consumer has
+ * parked. Timeouts behave as they do for Queue.
+ */
+template<typename T>
+class SpscQueue
+{
+  public:
+    SpscQueue()
+    {
+        head = new Segment();
+        tail = head;
+
+        for (int i = 0; i < SPSC_QUEUE_SPARE_SEGMENTS; i++) {
+            Segment* spare = new Segment();
+            spare->next.store(spareSegments, std::memory_order_relaxed);
+            spareSegments = spare;
+        }
+    }
+
+    ~SpscQueue()
+    {
+        deleteSegments(head);
+        deleteSegments(spareSegments);
+        deleteSegments(retiredSegments.load(std::memory_order_acquire));
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer only
+    void enqueue(T value)
+    {
+        if (tailIdx == SPSC_QUEUE_SEGMENT_SIZE) {
+            // Link the next segment before publishing anything in it
+            Segment* next = takeSpareSegment();
+            tail->next.store(next, std::memory_order_release);
+            tail = next;
+            tailIdx = 0;
+        }
+
+        tail->cells[tailIdx++] = std::move(value);
+
+        size_t written = nWritten.load(std::memory_order_relaxed);
+        nWritten.store(written + 1, std::memory_order_seq_cst);
+
+        if (consumerParked.load(std::memory_order_seq_cst)) {
+            UniqueLock lock(mx);
+            enqueueNotifier.notify_one();
+        }
+    }
+
+    // Consumer only
+    void dequeueIfPresent(T* res)
+    {
+        if (isAvailable()) {
+            *res = pop();
+        }
+    }
+
+    // Consumer only
+    T dequeue(long timeoutMs = DEFAULT_QUEUE_TIMEOUT_MS)
+    {
+        if (timeoutMs <= 0) {
+            SPDLOG_ERROR("Invalid queue timeout: {} <= 0", timeoutMs);
+            throw std::runtime_error("Invalid queue timeout");
+        }
+
+        if (!awaitAvailable(timeoutMs)) {
+            throw QueueTimeoutException("Timeout waiting for dequeue");
+        }
+
+        return pop();
+    }
+
+    // Consumer only. The element stays valid until it is dequeued.
+    T* peek(long timeoutMs = 0)
+    {
+        if (!awaitAvailable(timeoutMs)) {
+            throw QueueTimeoutException("Timeout waiting for dequeue");
+        }
+
+        moveToNextSegmentIfNeeded();
+        return &head->cells[headIdx];
+    }
+
+    // Consumer only
+    void drain()
+    {
+        while (isAvailable()) {
+            pop();
+        }
+    }
+
+    long size()
+    {
+        size_t read = nRead.load(std::memory_order_acquire);
+        size_t written = nWritten.load(std::memory_order_acquire);
+
+        return (long)(written - read);
+    }
+
+  private:
+    struct Segment
+    {
+        T cells[SPSC_QUEUE_SEGMENT_SIZE];
+        std::atomic<Segment*> next = nullptr;
+    };
+
+    // Producer state
+    alignas(64) Segment* tail = nullptr;
+    size_t tailIdx = 0;
+    std::atomic<size_t> nWritten = 0;
+    Segment* spareSegments = nullptr;
+
+    // Consumer state
+    alignas(64) Segment* head = nullptr;
+    size_t headIdx = 0;
+    std::atomic<size_t> nRead = 0;
+
+    // Segments passed back from the consumer to the producer
+    alignas(64) std::atomic<Segment*> retiredSegments = nullptr;
+
+    // Only used when the consumer parks
+    alignas(64) std::atomic<bool> consumerParked = false;
+    std::mutex mx;
+    std::condition_variable enqueueNotifier;
+
+    // Must be sequentially consistent to pair with the parked flag
+    bool isAvailable()
+    {
+        return nWritten.load(std::memory_order_seq_cst) >
+               nRead.load(std::memory_order_relaxed);
+    }
+
+    void moveToNextSegmentIfNeeded()
+    {
+        if (headIdx < SPSC_QUEUE_SEGMENT_SIZE) {
+            return;
+        }
+
+        // The producer has moved on to the next segment before writing to it,
+        // so nothing else refers to this one
+        Segment* next = head->next.load(std::memory_order_acquire);
+        retireSegment(head);
+        head = next;
+        headIdx = 0;
+    }
+
+    // Consumer only. The producer only ever takes the whole retired list at
+    // once, so this only retries if that happens at the same time.
+    void retireSegment(Segment* segment)
+    {
+        Segment* top = retiredSegments.load(std::memory_order_relaxed);
+        do {
+            segment->next.store(top, std::memory_order_relaxed);
+        } while (!retiredSegments.compare_exchange_weak(
+          top, segment, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Producer only
+    Segment* takeSpareSegment()
+    {
+        if (spareSegments == nullptr) {
+            spareSegments =
+              retiredSegments.exchange(nullptr, std::memory_order_acquire);
+        }
+
+        if (spareSegments == nullptr) {
+            return new Segment();
+        }
+
+        Segment* segment = spareSegments;
+        spareSegments = segment->next.load(std::memory_order_relaxed);
+        segment->next.store(nullptr, std::memory_order_relaxed);
+        return segment;
+    }
+
+    static void deleteSegments(Segment* segment)
+    {
+        while (segment != nullptr) {
+            Segment* next = segment->next.load(std::memory_order_relaxed);
+            delete segment;
+            segment = next;
+        }
+    }
+
+    T pop()
+    {
+        moveToNextSegmentIfNeeded();
+
+        T value = std::move(head->cells[headIdx]);
+        head->cells[headIdx] = T();
+        headIdx++;
+
+        nRead.fetch_add(1, std::memory_order_release);
+
+        return value;
+    }
+
+    // Spins, then yields, then parks until an element is available. A
+    // non-positive timeout waits forever. Returns false on timeout.
+    bool awaitAvailable(long timeoutMs)
+    {
+        for (int i = 0; i < SPSC_QUEUE_SPIN_ITERATIONS; i++) {
+            if (isAvailable()) {
+                return true;
+            }
+        }
+
+        for (int i = 0; i < SPSC_QUEUE_YIELD_ITERATIONS; i++) {
+            if (isAvailable()) {
+                return true;
+            }
+
+            std::this_thread::yield();
+        }
+
+        UniqueLock lock(mx);
+        consumerParked.store(true, std::memory_order_seq_cst);
+
+        bool available = true;
+        auto isAvailableFunc = [this] { return isAvailable(); };
+        if (timeoutMs > 0) {
+            available = enqueueNotifier.wait_for(
+              lock, std::chrono::milliseconds(timeoutMs), isAvailableFunc);
+        } else {
+            enqueueNotifier.wait(lock, isAvailableFunc);
+        }
+
+        consumerParked.store(false, std::memory_order_relaxed);
+
+        return available;
+    }
+};
+
 class TokenPool
 {
   public:
@@ -156,6 +693,6 @@ class TokenPool
 
   private:
     int _size;
-    Queue<int> queue;
+    FixedCapacityQueue<int> queue;
 };
 }
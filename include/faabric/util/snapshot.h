@@ -1,10 +1,46 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
 namespace faabric::util {
 
+// Identifies a page by the SHA-256 of its contents, so that hosts can find
+// pages of a snapshot they already hold. Pages are shared between all the
+// snapshots on a host, so the hash has to be collision resistant, otherwise
+// one function could craft a page that's taken for another's.
+#define PAGE_HASH_BYTES 32
+
+struct PageHash
+{
+    std::array<uint8_t, PAGE_HASH_BYTES> bytes{};
+
+    bool operator==(const PageHash& other) const
+    {
+        return bytes == other.bytes;
+    }
+};
+
+struct PageHashHasher
+{
+    // The digest is already uniformly distributed
+    size_t operator()(const PageHash& hash) const
+    {
+        size_t h;
+        std::memcpy(&h, hash.bytes.data(), sizeof(size_t));
+        return h;
+    }
+};
+
+PageHash hashPage(const uint8_t* data, size_t size);
+
+// Hashes each host page of the data, the last of which may be partial
+std::vector<PageHash> hashPages(const uint8_t* data, size_t size);
+
 struct SnapshotDiff
 {
     uint32_t offset = 0;
@@ -187,6 +187,8 @@ faabric_datatype_t* getFaabricDatatypeFromId(int datatypeId)
             return MPI_DOUBLE_INT;
         case FAABRIC_CHAR:
             return MPI_CHAR;
+        case FAABRIC_C_BOOL:
+            return MPI_C_BOOL;
         case FAABRIC_BYTE:
             return MPI_BYTE;
         default:
@@ -94,7 +94,8 @@ int MPI_Send(const void* buf,
                              (uint8_t*)buf,
                              datatype,
                              count,
-                             faabric::MPIMessage::NORMAL);
+                             faabric::MPIMessage::NORMAL,
+                             tag);
 
     return MPI_SUCCESS;
 }
@@ -127,7 +128,8 @@ int MPI_Recv(void* buf,
                              datatype,
                              count,
                              status,
-                             faabric::MPIMessage::NORMAL);
+                             faabric::MPIMessage::NORMAL,
+                             tag);
 
     return MPI_SUCCESS;
 }
@@ -159,7 +161,9 @@ int MPI_Sendrecv(const void* sendbuf,
                                  recvtype,
                                  source,
                                  executingContext.getRank(),
-                                 status);
+                                 status,
+                                 sendtag,
+                                 recvtag);
 
     return MPI_SUCCESS;
 }
@@ -190,7 +194,8 @@ int MPI_Get_count(const MPI_Status* status, MPI_Datatype datatype, int* count)
 int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status* status)
 {
     SPDLOG_DEBUG("MPI - MPI_Probe");
-    getExecutingWorld().probe(source, executingContext.getRank(), status);
+    getExecutingWorld().probe(
+      source, executingContext.getRank(), status, tag);
 
     return MPI_SUCCESS;
 }
@@ -212,20 +217,14 @@ int MPI_Bcast(void* buffer,
     faabric::scheduler::MpiWorld& world = getExecutingWorld();
 
     int rank = executingContext.getRank();
-    if (rank == root) {
-        SPDLOG_DEBUG(fmt::format("MPI_Bcast {} -> all", rank));
-        world.broadcast(
-          rank, (uint8_t*)buffer, datatype, count, faabric::MPIMessage::NORMAL);
-    } else {
-        SPDLOG_DEBUG(fmt::format("MPI_Bcast {} <- {}", rank, root));
-        world.recv(root,
-                   rank,
-                   (uint8_t*)buffer,
-                   datatype,
-                   count,
-                   nullptr,
-                   faabric::MPIMessage::NORMAL);
-    }
+    SPDLOG_DEBUG(fmt::format("MPI_Bcast {} -> {}", root, rank));
+    world.broadcast(root,
+                    rank,
+                    (uint8_t*)buffer,
+                    datatype,
+                    count,
+                    faabric::MPIMessage::NORMAL);
+
     return MPI_SUCCESS;
 }
 
@@ -396,6 +395,28 @@ int MPI_Scan(const void* sendbuf,
     return MPI_SUCCESS;
 }
 
+int MPI_Exscan(const void* sendbuf,
+               void* recvbuf,
+               int count,
+               MPI_Datatype datatype,
+               MPI_Op op,
+               MPI_Comm comm)
+{
+    if (sendbuf == MPI_IN_PLACE) {
+        sendbuf = recvbuf;
+    }
+
+    SPDLOG_DEBUG("MPI - MPI_Exscan");
+    getExecutingWorld().exscan(executingContext.getRank(),
+                               (uint8_t*)sendbuf,
+                               (uint8_t*)recvbuf,
+                               datatype,
+                               count,
+                               op);
+
+    return MPI_SUCCESS;
+}
+
 int MPI_Alltoall(const void* sendbuf,
                  int sendcount,
                  MPI_Datatype sendtype,
@@ -622,8 +643,13 @@ int MPI_Isend(const void* buf,
 
     faabric::scheduler::MpiWorld& world = getExecutingWorld();
     (*request) = (faabric_request_t*)malloc(sizeof(faabric_request_t));
-    int requestId = world.isend(
-      executingContext.getRank(), dest, (uint8_t*)buf, datatype, count);
+    int requestId = world.isend(executingContext.getRank(),
+                                dest,
+                                (uint8_t*)buf,
+                                datatype,
+                                count,
+                                faabric::MPIMessage::NORMAL,
+                                tag);
     (*request)->id = requestId;
 
     return MPI_SUCCESS;
@@ -642,8 +668,13 @@ int MPI_Irecv(void* buf,
 
     faabric::scheduler::MpiWorld& world = getExecutingWorld();
     (*request) = (faabric_request_t*)malloc(sizeof(faabric_request_t));
-    int requestId = world.irecv(
-      source, executingContext.getRank(), (uint8_t*)buf, datatype, count);
+    int requestId = world.irecv(source,
+                                executingContext.getRank(),
+                                (uint8_t*)buf,
+                                datatype,
+                                count,
+                                faabric::MPIMessage::NORMAL,
+                                tag);
     (*request)->id = requestId;
 
     return MPI_SUCCESS;
@@ -659,16 +690,52 @@ double MPI_Wtime()
 int MPI_Wait(MPI_Request* request, MPI_Status* status)
 {
     SPDLOG_DEBUG("MPI - MPI_Wait");
-    getExecutingWorld().awaitAsyncRequest((*request)->id);
+    if (*request == MPI_REQUEST_NULL) {
+        return MPI_SUCCESS;
+    }
+
+    getExecutingWorld().awaitAsyncRequest((*request)->id, status);
+
+    free(*request);
+    *request = MPI_REQUEST_NULL;
 
     return MPI_SUCCESS;
 }
 
+static std::vector<int> getRequestIds(int count, MPI_Request requests[])
+{
+    std::vector<int> requestIds(count);
+    for (int i = 0; i < count; i++) {
+        requestIds.at(i) = requests[i] == MPI_REQUEST_NULL
+                             ? FAABRIC_REQUEST_NULL_ID
+                             : requests[i]->id;
+    }
+
+    return requestIds;
+}
+
+// Frees the handles of any requests the world has completed
+static void releaseCompletedRequests(int count,
+                                     MPI_Request requests[],
+                                     const std::vector<int>& requestIds)
+{
+    for (int i = 0; i < count; i++) {
+        if (requests[i] != MPI_REQUEST_NULL &&
+            requestIds.at(i) == FAABRIC_REQUEST_NULL_ID) {
+            free(requests[i]);
+            requests[i] = MPI_REQUEST_NULL;
+        }
+    }
+}
+
 int MPI_Waitall(int count,
                 MPI_Request array_of_requests[],
                 MPI_Status* array_of_statuses)
 {
-    notImplemented("MPI_Waitall");
+    SPDLOG_DEBUG("MPI - MPI_Waitall");
+    std::vector<int> requestIds = getRequestIds(count, array_of_requests);
+    getExecutingWorld().awaitAllAsyncRequests(requestIds, array_of_statuses);
+    releaseCompletedRequests(count, array_of_requests, requestIds);
 
     return MPI_SUCCESS;
 }
@@ -678,7 +745,24 @@ int MPI_Waitany(int count,
                 int* index,
                 MPI_Status* status)
 {
-    notImplemented("MPI_Waitany");
+    SPDLOG_DEBUG("MPI - MPI_Waitany");
+    std::vector<int> requestIds = getRequestIds(count, array_of_requests);
+    *index = getExecutingWorld().awaitAnyAsyncRequest(requestIds, status);
+    releaseCompletedRequests(count, array_of_requests, requestIds);
+
+    return MPI_SUCCESS;
+}
+
+int MPI_Testall(int count,
+                MPI_Request array_of_requests[],
+                int* flag,
+                MPI_Status* array_of_statuses)
+{
+    SPDLOG_DEBUG("MPI - MPI_Testall");
+    std::vector<int> requestIds = getRequestIds(count, array_of_requests);
+    *flag =
+      getExecutingWorld().testAllAsyncRequests(requestIds, array_of_statuses);
+    releaseCompletedRequests(count, array_of_requests, requestIds);
 
     return MPI_SUCCESS;
 }
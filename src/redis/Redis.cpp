@@ -317,6 +317,26 @@ void Redis::setRangePipeline(const std::string& key,
       context, "SETRANGE %s %li %b", key.c_str(), offset, value, size);
 }
 
+void Redis::setPipeline(const std::string& key,
+                        const uint8_t* value,
+                        size_t size)
+{
+    redisAppendCommand(context, "SET %s %b", key.c_str(), value, size);
+}
+
+void Redis::expirePipeline(const std::string& key, long expiry)
+{
+    redisAppendCommand(context, "EXPIRE %s %d", key.c_str(), expiry);
+}
+
+void Redis::enqueueBytesPipeline(const std::string& queueName,
+                                 const uint8_t* buffer,
+                                 size_t bufferLen)
+{
+    redisAppendCommand(
+      context, "RPUSH %s %b", queueName.c_str(), buffer, bufferLen);
+}
+
 void Redis::flushPipeline(long pipelineLength)
 {
     void* reply;
@@ -42,6 +42,9 @@ void FaabricMain::startRunner()
     auto& sch = faabric::scheduler::getScheduler();
     sch.addHostToGlobalSet();
 
+    // Share this host's resources with the others
+    sch.startResourcePublisher();
+
 #if (FAASM_SGX)
     // Check for SGX capability and create shared enclave
     sgx::checkSgxSetup();
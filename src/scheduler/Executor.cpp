@@ -4,6 +4,7 @@
 #include <faabric/state/State.h>
 #include <faabric/util/clock.h>
 #include <faabric/util/config.h>
+#include <faabric/util/dirty.h>
 #include <faabric/util/environment.h>
 #include <faabric/util/func.h>
 #include <faabric/util/gids.h>
@@ -13,6 +14,8 @@
 #include <faabric/util/queue.h>
 #include <faabric/util/timing.h>
 
+#include <set>
+
 #define POOL_SHUTDOWN -1
 
 namespace faabric::scheduler {
@@ -60,8 +63,8 @@ void Executor::finish()
 
         // Send a kill message
         SPDLOG_TRACE("Executor {} killing thread pool {}", id, i);
-        threadTaskQueues[i].enqueue(
-          ExecutorTask(POOL_SHUTDOWN, nullptr, nullptr, false, false));
+        enqueueTask(
+          i, ExecutorTask(POOL_SHUTDOWN, nullptr, nullptr, false, false));
 
         // Await the thread
         if (threadPoolThreads.at(i)->joinable()) {
@@ -76,6 +79,9 @@ void Executor::finish()
         }
     }
 
+    // Tracking must stop before the hook, which may unmap the memory
+    stopMemoryTracking();
+
     // Hook
     this->postFinish();
 
@@ -137,7 +143,7 @@ void Executor::executeTasks(std::vector<int> msgIdxs,
     // Note this must be done after the restore has happened
     bool needsSnapshotPush = false;
     if (isThreads && isSnapshot && !isMaster) {
-        faabric::util::resetDirtyTracking();
+        startMemoryTracking();
         needsSnapshotPush = true;
     }
 
@@ -150,7 +156,10 @@ void Executor::executeTasks(std::vector<int> msgIdxs,
     // original function call will cause a reset
     bool skipReset = isMaster && isThreads;
 
+    bool stealable = !requiresThreadAffinity(req);
+
     // Iterate through and invoke tasks
+    std::set<int> assignedIdxs;
     for (int msgIdx : msgIdxs) {
         const faabric::Message& msg = req->messages().at(msgIdx);
 
@@ -167,15 +176,176 @@ void Executor::executeTasks(std::vector<int> msgIdxs,
         // Enqueue the task
         SPDLOG_TRACE(
           "Assigning app index {} to thread {}", msg.appindex(), threadPoolIdx);
-        threadTaskQueues[threadPoolIdx].enqueue(ExecutorTask(
-          msgIdx, req, batchCounter, needsSnapshotPush, skipReset));
+        ExecutorTask task(
+          msgIdx, req, batchCounter, needsSnapshotPush, skipReset);
+        task.stealable = stealable;
+        enqueueTask(threadPoolIdx, std::move(task));
+        assignedIdxs.insert(threadPoolIdx);
 
         // Lazily create the thread
-        if (threadPoolThreads.at(threadPoolIdx) == nullptr) {
-            threadPoolThreads.at(threadPoolIdx) = std::make_shared<std::thread>(
-              &Executor::threadPoolThread, this, threadPoolIdx);
+        startThread(threadPoolIdx);
+    }
+
+    // If several tasks have been assigned to the same thread, start enough
+    // other threads that they can steal them
+    if (stealable) {
+        int nSpare = msgIdxs.size() - assignedIdxs.size();
+        for (int i = 0; i < threadPoolSize && nSpare > 0; i++) {
+            if (threadPoolThreads.at(i) != nullptr || (isThreads && i == 0)) {
+                continue;
+            }
+
+            startThread(i);
+            nSpare--;
+        }
+    }
+}
+
+void Executor::startThread(int threadPoolIdx)
+{
+    if (threadPoolThreads.at(threadPoolIdx) == nullptr) {
+        threadPoolThreads.at(threadPoolIdx) = std::make_shared<std::thread>(
+          &Executor::threadPoolThread, this, threadPoolIdx);
+    }
+}
+
+void Executor::enqueueTask(int threadPoolIdx, ExecutorTask task)
+{
+    ThreadTaskQueue& queue = threadTaskQueues.at(threadPoolIdx);
+
+    bool stealable = task.stealable;
+    bool isThreads =
+      task.req != nullptr &&
+      task.req->type() == faabric::BatchExecuteRequest::THREADS;
+
+    {
+        faabric::util::UniqueLock lock(queue.mx);
+        queue.tasks.emplace_back(std::move(task));
+    }
+
+    if (stealable) {
+        nStealableTasks++;
+    }
+
+    // Wake the owner if it's idle, otherwise wake another idle thread to
+    // steal the task
+    faabric::util::UniqueLock lock(idleMx);
+    if (queue.idle) {
+        queue.woken = true;
+        queue.cv.notify_one();
+        return;
+    }
+
+    if (!stealable) {
+        return;
+    }
+
+    for (int i = 0; i < threadTaskQueues.size(); i++) {
+        ThreadTaskQueue& other = threadTaskQueues.at(i);
+        if (other.idle && !other.woken && !(isThreads && i == 0)) {
+            other.woken = true;
+            other.cv.notify_one();
+            return;
+        }
+    }
+}
+
+bool Executor::dequeueTask(int threadPoolIdx, ExecutorTask& task)
+{
+    ThreadTaskQueue& queue = threadTaskQueues.at(threadPoolIdx);
+
+    {
+        faabric::util::UniqueLock lock(queue.mx);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+
+            if (task.stealable) {
+                nStealableTasks--;
+            }
+
+            return true;
+        }
+    }
+
+    return stealTask(threadPoolIdx, task);
+}
+
+bool Executor::stealTask(int threadPoolIdx, ExecutorTask& task)
+{
+    if (nStealableTasks.load() == 0) {
+        return false;
+    }
+
+    // Visit the other threads in turn, starting with our neighbour so that
+    // thieves spread out over the busy threads
+    for (int offset = 1; offset < threadTaskQueues.size(); offset++) {
+        int victimIdx = (threadPoolIdx + offset) % threadTaskQueues.size();
+        ThreadTaskQueue& victim = threadTaskQueues.at(victimIdx);
+
+        faabric::util::UniqueLock lock(victim.mx);
+        for (auto it = victim.tasks.rbegin(); it != victim.tasks.rend(); ++it) {
+            if (!it->stealable) {
+                continue;
+            }
+
+            // Thread zero must stay free for functions spawning threads
+            bool isThreads =
+              it->req->type() == faabric::BatchExecuteRequest::THREADS;
+            if (isThreads && threadPoolIdx == 0) {
+                continue;
+            }
+
+            SPDLOG_TRACE("Thread {}:{} stealing task {} from thread {}",
+                         id,
+                         threadPoolIdx,
+                         it->messageIndex,
+                         victimIdx);
+
+            task = std::move(*it);
+            victim.tasks.erase(std::next(it).base());
+            nStealableTasks--;
+
+            return true;
         }
     }
+
+    return false;
+}
+
+// Waits for up to the bound timeout for a task to arrive or become available
+// to steal. Returns false on timeout.
+bool Executor::waitForTask(int threadPoolIdx, ExecutorTask& task)
+{
+    const auto& conf = faabric::util::getSystemConfig();
+    ThreadTaskQueue& queue = threadTaskQueues.at(threadPoolIdx);
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(conf.boundTimeout);
+
+    while (!dequeueTask(threadPoolIdx, task)) {
+        faabric::util::UniqueLock lock(idleMx);
+
+        // Check again once marked as idle, as anything enqueued before this
+        // point will not have woken us
+        queue.idle = true;
+        if (dequeueTask(threadPoolIdx, task)) {
+            queue.idle = false;
+            return true;
+        }
+
+        bool woken =
+          queue.cv.wait_until(lock, deadline, [&queue] { return queue.woken; });
+
+        queue.idle = false;
+        queue.woken = false;
+
+        if (!woken) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 void Executor::threadPoolThread(int threadPoolIdx)
@@ -192,9 +362,7 @@ void Executor::threadPoolThread(int threadPoolIdx)
 
         ExecutorTask task;
 
-        try {
-            task = threadTaskQueues[threadPoolIdx].dequeue(conf.boundTimeout);
-        } catch (faabric::util::QueueTimeoutException& ex) {
+        if (!waitForTask(threadPoolIdx, task)) {
             // If the thread has had no messages, it needs to
             // remove itself
             SPDLOG_TRACE("Thread {}:{} got no messages in timeout {}ms",
@@ -256,7 +424,8 @@ void Executor::threadPoolThread(int threadPoolIdx)
         // Handle snapshot diffs _before_ we reset the executor
         if (isLastInBatch && task.needsSnapshotPush) {
             // Get diffs between original snapshot and after execution
-            faabric::util::SnapshotData snapshotPostExecution = snapshot();
+            faabric::util::SnapshotData snapshotPostExecution =
+              getTrackedMemory();
 
             faabric::util::SnapshotData snapshotPreExecution =
               faabric::snapshot::getSnapshotRegistry().getSnapshot(
@@ -268,8 +437,9 @@ void Executor::threadPoolThread(int threadPoolIdx)
 
             sch.pushSnapshotDiffs(msg, diffs);
 
-            // Reset dirty page tracking now that we've pushed the diffs
-            faabric::util::resetDirtyTracking();
+            // Stop tracking now that we've pushed the diffs, as resetting may
+            // remap the memory. The next batch starts tracking it again.
+            stopMemoryTracking();
         }
 
         // If this batch is finished, reset the executor and release its claim.
@@ -299,8 +469,8 @@ void Executor::threadPoolThread(int threadPoolIdx)
             // Set non-final thread result
             sch.setThreadResult(msg, returnValue);
         } else {
-            // Set normal function result
-            sch.setFunctionResult(msg);
+            // Set normal function result without waiting on Redis
+            sch.setFunctionResultAsync(msg);
         }
     }
 
@@ -362,6 +532,12 @@ int32_t Executor::executeTask(int threadPoolIdx,
 
 void Executor::postFinish() {}
 
+bool Executor::requiresThreadAffinity(
+  std::shared_ptr<faabric::BatchExecuteRequest> req)
+{
+    return false;
+}
+
 void Executor::reset(faabric::Message& msg) {}
 
 faabric::util::SnapshotData Executor::snapshot()
@@ -371,6 +547,48 @@ faabric::util::SnapshotData Executor::snapshot()
     return d;
 }
 
+faabric::util::SnapshotData Executor::getMemoryView()
+{
+    return faabric::util::SnapshotData();
+}
+
+faabric::util::SnapshotData Executor::getTrackedMemory()
+{
+    faabric::util::SnapshotData memory = getMemoryView();
+    if (memory.data == nullptr) {
+        memory = snapshot();
+    }
+
+    return memory;
+}
+
+void Executor::startMemoryTracking()
+{
+    faabric::util::UniqueLock lock(trackedMemoryMx);
+    faabric::util::DirtyTracker& tracker = faabric::util::getDirtyTracker();
+
+    // Memory that's moved since the last batch is tracked from scratch
+    faabric::util::SnapshotData memory = getTrackedMemory();
+    if (trackedMemory.data != nullptr && trackedMemory.data != memory.data) {
+        tracker.stopTracking(trackedMemory.data, trackedMemory.size);
+    }
+
+    tracker.resetTracking(memory.data, memory.size);
+    trackedMemory = memory;
+}
+
+void Executor::stopMemoryTracking()
+{
+    faabric::util::UniqueLock lock(trackedMemoryMx);
+    if (trackedMemory.data == nullptr) {
+        return;
+    }
+
+    faabric::util::getDirtyTracker().stopTracking(trackedMemory.data,
+                                                  trackedMemory.size);
+    trackedMemory = faabric::util::SnapshotData();
+}
+
 void Executor::restore(faabric::Message& msg)
 {
     SPDLOG_WARN("Executor has not implemented restore method");
@@ -30,6 +30,12 @@ static std::unordered_map<std::string,
 static std::vector<std::pair<std::string, faabric::UnregisterRequest>>
   unregisterRequests;
 
+static std::vector<std::pair<std::string, faabric::PushResourcesRequest>>
+  resourcePushes;
+
+static std::vector<std::pair<std::string, faabric::Message>>
+  functionResultPushes;
+
 std::vector<std::pair<std::string, faabric::Message>> getFunctionCalls()
 {
     return functionCalls;
@@ -58,6 +64,17 @@ getUnregisterRequests()
     return unregisterRequests;
 }
 
+std::vector<std::pair<std::string, faabric::PushResourcesRequest>>
+getResourcePushes()
+{
+    return resourcePushes;
+}
+
+std::vector<std::pair<std::string, faabric::Message>> getFunctionResultPushes()
+{
+    return functionResultPushes;
+}
+
 void queueResourceResponse(const std::string& host, faabric::HostResources& res)
 {
     queuedResourceResponses[host].enqueue(res);
@@ -69,6 +86,8 @@ void clearMockRequests()
     batchMessages.clear();
     resourceRequests.clear();
     unregisterRequests.clear();
+    resourcePushes.clear();
+    functionResultPushes.clear();
 
     for (auto& p : queuedResourceResponses) {
         p.second.reset();
@@ -141,4 +160,24 @@ void FunctionCallClient::unregister(faabric::UnregisterRequest& req)
         asyncSend(faabric::scheduler::FunctionCalls::Unregister, &req);
     }
 }
+
+void FunctionCallClient::pushResources(faabric::PushResourcesRequest& req)
+{
+    if (faabric::util::isMockMode()) {
+        faabric::util::UniqueLock lock(mockMutex);
+        resourcePushes.emplace_back(host, req);
+    } else {
+        asyncSend(faabric::scheduler::FunctionCalls::PushResources, &req);
+    }
+}
+
+void FunctionCallClient::setFunctionResult(faabric::Message& msg)
+{
+    if (faabric::util::isMockMode()) {
+        faabric::util::UniqueLock lock(mockMutex);
+        functionResultPushes.emplace_back(host, msg);
+    } else {
+        asyncSend(faabric::scheduler::FunctionCalls::SetFunctionResult, &msg);
+    }
+}
 }
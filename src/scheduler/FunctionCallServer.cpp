@@ -27,6 +27,14 @@ void FunctionCallServer::doAsyncRecv(int header,
             recvUnregister(buffer, bufferSize);
             break;
         }
+        case faabric::scheduler::FunctionCalls::PushResources: {
+            recvPushResources(buffer, bufferSize);
+            break;
+        }
+        case faabric::scheduler::FunctionCalls::SetFunctionResult: {
+            recvSetFunctionResult(buffer, bufferSize);
+            break;
+        }
         default: {
             throw std::runtime_error(
               fmt::format("Unrecognized async call header: {}", header));
@@ -89,6 +97,27 @@ void FunctionCallServer::recvUnregister(const uint8_t* buffer,
     scheduler.removeRegisteredHost(msg.host(), msg.function());
 }
 
+void FunctionCallServer::recvPushResources(const uint8_t* buffer,
+                                           size_t bufferSize)
+{
+    PARSE_MSG(faabric::PushResourcesRequest, buffer, bufferSize)
+
+    SPDLOG_TRACE("Received resources from {} ({}/{} slots used)",
+                 msg.host(),
+                 msg.resources().usedslots(),
+                 msg.resources().slots());
+
+    scheduler.setHostResources(msg.host(), msg.resources());
+}
+
+void FunctionCallServer::recvSetFunctionResult(const uint8_t* buffer,
+                                               size_t bufferSize)
+{
+    PARSE_MSG(faabric::Message, buffer, bufferSize)
+
+    scheduler.setFunctionResultLocally(msg);
+}
+
 std::unique_ptr<google::protobuf::Message> FunctionCallServer::recvGetResources(
   const uint8_t* buffer,
   size_t bufferSize)
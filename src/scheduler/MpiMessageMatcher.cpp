@@ -0,0 +1,232 @@
+#include <faabric/scheduler/MpiMessageMatcher.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <climits>
+
+namespace faabric::scheduler {
+
+bool MpiMessageMatcher::isEmpty()
+{
+    return recvs.empty() && nUnexpected == 0;
+}
+
+int MpiMessageMatcher::getNumRecvs()
+{
+    return recvs.size();
+}
+
+int MpiMessageMatcher::getNumUnexpected()
+{
+    return nUnexpected;
+}
+
+MpiMessageMatcher::PendingRecv& MpiMessageMatcher::postRecv(
+  const PendingRecv& recv)
+{
+    auto [recvIt, isNew] = recvs.try_emplace(recv.requestId, recv);
+    if (!isNew) {
+        SPDLOG_ERROR("MPI receive {} posted twice", recv.requestId);
+        throw std::runtime_error("MPI receive posted twice");
+    }
+    PendingRecv& posted = recvIt->second;
+
+    auto msgIt = findUnexpected(recv.source, recv.tag, recv.messageType);
+    if (msgIt != unexpectedMsgs.end()) {
+        posted.msg = std::move(msgIt->second.front().second);
+        msgIt->second.pop_front();
+        if (msgIt->second.empty()) {
+            unexpectedMsgs.erase(msgIt);
+        }
+        nUnexpected--;
+
+        return posted;
+    }
+
+    pendingRecvs[{ recv.messageType, recv.source, recv.tag }].emplace_back(
+      nextSeq++, recv.requestId);
+    nPendingBySource[recv.source]++;
+    if (recv.isWildcard()) {
+        nPendingWildcards++;
+    }
+
+    return posted;
+}
+
+int MpiMessageMatcher::addMessage(std::shared_ptr<faabric::MPIMessage> msg)
+{
+    // A message can only be taken by receives for its own source and tag, or
+    // with a wildcard in place of either or both
+    int type = msg->messagetype();
+    const MatchKey candidates[] = {
+        { type, msg->sender(), msg->tag() },
+        { type, MPI_ANY_SOURCE, msg->tag() },
+        { type, msg->sender(), MPI_ANY_TAG },
+        { type, MPI_ANY_SOURCE, MPI_ANY_TAG },
+    };
+
+    auto bestIt = pendingRecvs.end();
+    for (const MatchKey& key : candidates) {
+        auto it = pendingRecvs.find(key);
+        if (it == pendingRecvs.end()) {
+            continue;
+        }
+
+        if (bestIt == pendingRecvs.end() ||
+            it->second.front().first < bestIt->second.front().first) {
+            bestIt = it;
+        }
+    }
+
+    if (bestIt == pendingRecvs.end()) {
+        unexpectedMsgs[{ type, msg->sender(), msg->tag() }].emplace_back(
+          nextSeq++, std::move(msg));
+        nUnexpected++;
+
+        return -1;
+    }
+
+    int requestId = bestIt->second.front().second;
+    bestIt->second.pop_front();
+    if (bestIt->second.empty()) {
+        pendingRecvs.erase(bestIt);
+    }
+
+    PendingRecv& recv = recvs.at(requestId);
+    removePendingSource(recv.source);
+    if (recv.isWildcard()) {
+        nPendingWildcards--;
+    }
+    recv.msg = std::move(msg);
+
+    return requestId;
+}
+
+MpiMessageMatcher::PendingRecv* MpiMessageMatcher::getRecv(int requestId)
+{
+    auto it = recvs.find(requestId);
+    if (it == recvs.end()) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+void MpiMessageMatcher::removeRecv(int requestId)
+{
+    auto it = recvs.find(requestId);
+    if (it == recvs.end()) {
+        return;
+    }
+
+    // Receives are normally only removed once matched
+    const PendingRecv& recv = it->second;
+    if (!recv.isMatched()) {
+        auto pendingIt =
+          pendingRecvs.find({ recv.messageType, recv.source, recv.tag });
+        PendingQueue& queue = pendingIt->second;
+        queue.erase(std::find_if(
+          queue.begin(), queue.end(), [requestId](const auto& entry) {
+              return entry.second == requestId;
+          }));
+        if (queue.empty()) {
+            pendingRecvs.erase(pendingIt);
+        }
+
+        removePendingSource(recv.source);
+        if (recv.isWildcard()) {
+            nPendingWildcards--;
+        }
+    }
+
+    recvs.erase(it);
+}
+
+std::shared_ptr<faabric::MPIMessage> MpiMessageMatcher::peekUnexpected(
+  int source,
+  int tag,
+  faabric::MPIMessage::MPIMessageType messageType)
+{
+    auto it = findUnexpected(source, tag, messageType);
+    if (it == unexpectedMsgs.end()) {
+        return nullptr;
+    }
+
+    return it->second.front().second;
+}
+
+int MpiMessageMatcher::getNumPending(
+  int source,
+  int tag,
+  faabric::MPIMessage::MPIMessageType messageType)
+{
+    auto it = pendingRecvs.find({ messageType, source, tag });
+    if (it == pendingRecvs.end()) {
+        return 0;
+    }
+
+    return it->second.size();
+}
+
+int MpiMessageMatcher::getNumPendingWildcards()
+{
+    return nPendingWildcards;
+}
+
+std::vector<int> MpiMessageMatcher::getPendingSources()
+{
+    std::vector<int> sources;
+    sources.reserve(nPendingBySource.size());
+    for (const auto& [source, nPending] : nPendingBySource) {
+        sources.push_back(source);
+    }
+
+    return sources;
+}
+
+void MpiMessageMatcher::removePendingSource(int source)
+{
+    auto it = nPendingBySource.find(source);
+    if (--it->second == 0) {
+        nPendingBySource.erase(it);
+    }
+}
+
+std::map<MpiMessageMatcher::MatchKey,
+         MpiMessageMatcher::UnexpectedQueue>::iterator
+MpiMessageMatcher::findUnexpected(
+  int source,
+  int tag,
+  faabric::MPIMessage::MPIMessageType messageType)
+{
+    if (source != MPI_ANY_SOURCE && tag != MPI_ANY_TAG) {
+        return unexpectedMsgs.find({ messageType, source, tag });
+    }
+
+    // Wildcards look through all the entries for the message type, or only
+    // those for the source if it's given, and take the earliest that matches
+    MatchKey first = { messageType, INT_MIN, INT_MIN };
+    MatchKey last = { messageType + 1, INT_MIN, INT_MIN };
+    if (source != MPI_ANY_SOURCE) {
+        first = { messageType, source, INT_MIN };
+        last = { messageType, source + 1, INT_MIN };
+    }
+
+    auto it = unexpectedMsgs.lower_bound(first);
+    auto endIt = unexpectedMsgs.lower_bound(last);
+
+    auto bestIt = unexpectedMsgs.end();
+    for (; it != endIt; it++) {
+        if (tag != MPI_ANY_TAG && std::get<2>(it->first) != tag) {
+            continue;
+        }
+
+        if (bestIt == unexpectedMsgs.end() ||
+            it->second.front().first < bestIt->second.front().first) {
+            bestIt = it;
+        }
+    }
+
+    return bestIt;
+}
+}
@@ -0,0 +1,277 @@
+#include <faabric/scheduler/MpiReduceKernels.h>
+
+#include <array>
+#include <utility>
+
+static_assert(sizeof(faabric::scheduler::MpiDoubleInt) == 16,
+              "MPI_DOUBLE_INT layout must match the one in mpi.cpp");
+
+namespace faabric::scheduler {
+
+// Groups of datatypes, as in section 5.9.2 of the MPI standard, which say
+// which operations each datatype supports
+enum class DatatypeGroup
+{
+    None,
+    Integer,
+    Floating,
+    Logical,
+    Byte,
+    Pair,
+};
+
+template<int DatatypeId>
+struct Datatype
+{
+    using type = void;
+    static constexpr DatatypeGroup group = DatatypeGroup::None;
+};
+
+#define REDUCE_DATATYPE(datatypeId, cType, datatypeGroup)                      \
+    template<>                                                                 \
+    struct Datatype<datatypeId>                                                \
+    {                                                                          \
+        using type = cType;                                                    \
+        static constexpr DatatypeGroup group = DatatypeGroup::datatypeGroup;   \
+    };
+
+REDUCE_DATATYPE(FAABRIC_INT8, int8_t, Integer)
+REDUCE_DATATYPE(FAABRIC_INT16, int16_t, Integer)
+REDUCE_DATATYPE(FAABRIC_INT32, int32_t, Integer)
+REDUCE_DATATYPE(FAABRIC_INT, int32_t, Integer)
+REDUCE_DATATYPE(FAABRIC_INT64, int64_t, Integer)
+REDUCE_DATATYPE(FAABRIC_UINT8, uint8_t, Integer)
+REDUCE_DATATYPE(FAABRIC_UINT16, uint16_t, Integer)
+REDUCE_DATATYPE(FAABRIC_UINT32, uint32_t, Integer)
+REDUCE_DATATYPE(FAABRIC_UINT, uint32_t, Integer)
+REDUCE_DATATYPE(FAABRIC_UINT64, uint64_t, Integer)
+REDUCE_DATATYPE(FAABRIC_LONG, long, Integer)
+REDUCE_DATATYPE(FAABRIC_LONG_LONG, long long, Integer)
+REDUCE_DATATYPE(FAABRIC_LONG_LONG_INT, long long int, Integer)
+REDUCE_DATATYPE(FAABRIC_CHAR, char, Integer)
+REDUCE_DATATYPE(FAABRIC_FLOAT, float, Floating)
+REDUCE_DATATYPE(FAABRIC_DOUBLE, double, Floating)
+REDUCE_DATATYPE(FAABRIC_C_BOOL, bool, Logical)
+REDUCE_DATATYPE(FAABRIC_BYTE, uint8_t, Byte)
+REDUCE_DATATYPE(FAABRIC_DOUBLE_INT, MpiDoubleInt, Pair)
+
+// Each operation says which datatype groups it supports, and how to combine
+// two elements. These are kept branch-free where possible so that the loops
+// below can be vectorised.
+template<int OpId>
+struct Op
+{
+    static constexpr bool supports(DatatypeGroup g) { return false; }
+};
+
+template<>
+struct Op<FAABRIC_OP_MAX>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Integer || g == DatatypeGroup::Floating;
+    }
+
+    template<typename T>
+    static T apply(T a, T b)
+    {
+        return a < b ? b : a;
+    }
+};
+
+template<>
+struct Op<FAABRIC_OP_MIN>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Integer || g == DatatypeGroup::Floating;
+    }
+
+    template<typename T>
+    static T apply(T a, T b)
+    {
+        return b < a ? b : a;
+    }
+};
+
+template<>
+struct Op<FAABRIC_OP_SUM>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Integer || g == DatatypeGroup::Floating;
+    }
+
+    template<typename T>
+    static T apply(T a, T b)
+    {
+        return a + b;
+    }
+};
+
+template<>
+struct Op<FAABRIC_OP_PROD>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Integer || g == DatatypeGroup::Floating;
+    }
+
+    template<typename T>
+    static T apply(T a, T b)
+    {
+        return a * b;
+    }
+};
+
+template<>
+struct Op<FAABRIC_OP_LAND>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Integer || g == DatatypeGroup::Logical;
+    }
+
+    template<typename T>
+    static T apply(T a, T b)
+    {
+        return (a != 0) & (b != 0);
+    }
+};
+
+template<>
+struct Op<FAABRIC_OP_LOR>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Integer || g == DatatypeGroup::Logical;
+    }
+
+    template<typename T>
+    static T apply(T a, T b)
+    {
+        return (a != 0) | (b != 0);
+    }
+};
+
+template<>
+struct Op<FAABRIC_OP_BAND>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Integer || g == DatatypeGroup::Byte;
+    }
+
+    template<typename T>
+    static T apply(T a, T b)
+    {
+        return a & b;
+    }
+};
+
+template<>
+struct Op<FAABRIC_OP_BOR>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Integer || g == DatatypeGroup::Byte;
+    }
+
+    template<typename T>
+    static T apply(T a, T b)
+    {
+        return a | b;
+    }
+};
+
+// Ties go to the lowest index, as the standard requires
+template<>
+struct Op<FAABRIC_OP_MAXLOC>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Pair;
+    }
+
+    static MpiDoubleInt apply(MpiDoubleInt a, MpiDoubleInt b)
+    {
+        if (a.value == b.value) {
+            return a.index <= b.index ? a : b;
+        }
+
+        return a.value < b.value ? b : a;
+    }
+};
+
+template<>
+struct Op<FAABRIC_OP_MINLOC>
+{
+    static constexpr bool supports(DatatypeGroup g)
+    {
+        return g == DatatypeGroup::Pair;
+    }
+
+    static MpiDoubleInt apply(MpiDoubleInt a, MpiDoubleInt b)
+    {
+        if (a.value == b.value) {
+            return a.index <= b.index ? a : b;
+        }
+
+        return b.value < a.value ? b : a;
+    }
+};
+
+template<int OpId, typename T>
+void reduceKernel(const uint8_t* inBuffer, uint8_t* outBuffer, int count)
+{
+    const T* __restrict__ in = reinterpret_cast<const T*>(inBuffer);
+    T* __restrict__ out = reinterpret_cast<T*>(outBuffer);
+
+    for (int i = 0; i < count; i++) {
+        out[i] = Op<OpId>::apply(out[i], in[i]);
+    }
+}
+
+template<int OpId, int DatatypeId>
+constexpr MpiReduceKernel kernelFor()
+{
+    if constexpr (Op<OpId>::supports(Datatype<DatatypeId>::group)) {
+        return &reduceKernel<OpId, typename Datatype<DatatypeId>::type>;
+    } else {
+        return nullptr;
+    }
+}
+
+// Ids in mpi.h start at one, and the null ones are last
+constexpr int nOps = FAABRIC_OP_NULL + 1;
+constexpr int nDatatypes = FAABRIC_DATATYPE_NULL + 1;
+
+typedef std::array<MpiReduceKernel, nDatatypes> KernelRow;
+
+template<int OpId, int... DatatypeIds>
+constexpr KernelRow kernelRow(std::integer_sequence<int, DatatypeIds...>)
+{
+    return { kernelFor<OpId, DatatypeIds>()... };
+}
+
+template<int... OpIds>
+constexpr std::array<KernelRow, nOps> kernelTable(
+  std::integer_sequence<int, OpIds...>)
+{
+    return { kernelRow<OpIds>(
+      std::make_integer_sequence<int, nDatatypes>())... };
+}
+
+static constexpr std::array<KernelRow, nOps> kernels =
+  kernelTable(std::make_integer_sequence<int, nOps>());
+
+MpiReduceKernel getMpiReduceKernel(int opId, int datatypeId)
+{
+    if (opId < 0 || opId >= nOps || datatypeId < 0 ||
+        datatypeId >= nDatatypes) {
+        return nullptr;
+    }
+
+    return kernels[opId][datatypeId];
+}
+}
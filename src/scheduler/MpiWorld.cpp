@@ -1,24 +1,38 @@
+#include <faabric/scheduler/MpiReduceKernels.h>
 #include <faabric/scheduler/MpiWorld.h>
 #include <faabric/scheduler/Scheduler.h>
+#include <faabric/transport/macros.h>
+#include <faabric/util/config.h>
 #include <faabric/util/environment.h>
 #include <faabric/util/func.h>
 #include <faabric/util/gids.h>
 #include <faabric/util/macros.h>
+#include <faabric/util/network.h>
 #include <faabric/util/testing.h>
 
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
 // Each MPI rank runs in a separate thread, thus we use TLS to maintain the
-// per-rank data structures
-static thread_local std::vector<
-  std::unique_ptr<faabric::transport::MpiMessageEndpoint>>
+// per-rank data structures. Ranks send to each remote host over their own
+// socket, as sockets can't be shared between threads, but all of them connect
+// to the same port on that host. Sockets are kept by world and then by host,
+// as the port for a host differs between worlds.
+static thread_local std::unordered_map<
+  int,
+  std::unordered_map<
+    std::string,
+    std::unique_ptr<faabric::transport::MpiSendMessageEndpoint>>>
   mpiMessageEndpoints;
 
 static thread_local std::vector<
-  std::shared_ptr<faabric::scheduler::MpiMessageBuffer>>
-  unackedMessageBuffers;
+  std::unique_ptr<faabric::scheduler::MpiMessageMatcher>>
+  messageMatchers;
 
-static thread_local std::set<int> iSendRequests;
+static thread_local std::unordered_set<int> iSendRequests;
 
-static thread_local std::map<int, std::pair<int, int>> reqIdToRanks;
+static thread_local std::unordered_map<int, std::pair<int, int>> reqIdToRanks;
 
 // These long-lived sockets are used by each world to communicate rank-to-host
 // mappings. They are thread-local to ensure separation between concurrent
@@ -43,6 +57,11 @@ MpiWorld::MpiWorld()
   , cartProcsPerDim(2)
 {}
 
+MpiWorld::~MpiWorld()
+{
+    stopRemoteRecvThread();
+}
+
 faabric::MpiHostsToRanksMessage MpiWorld::recvMpiHostRankMsg()
 {
     if (faabric::util::isMockMode()) {
@@ -85,91 +104,332 @@ void MpiWorld::sendMpiHostRankMsg(const std::string& hostIn,
     ranksSendEndpoints[hostIn]->send(buffer, msgSize, false);
 }
 
-void MpiWorld::initRemoteMpiEndpoint(int localRank, int remoteRank)
+faabric::transport::MpiSendMessageEndpoint& MpiWorld::getMpiSendEndpoint(
+  const std::string& host,
+  int port)
+{
+    auto& worldEndpoints = mpiMessageEndpoints[id];
+    auto it = worldEndpoints.find(host);
+    if (it == worldEndpoints.end()) {
+        SPDLOG_TRACE("Open MPI endpoint to {}:{} (world {})", host, port, id);
+        it = worldEndpoints
+               .emplace(
+                 host,
+                 std::make_unique<faabric::transport::MpiSendMessageEndpoint>(
+                   host, port))
+               .first;
+    }
+
+    return *it->second;
+}
+
+void MpiWorld::sendRemoteMpiMessage(
+  const faabric::transport::MpiMessageHeader& header,
+  const uint8_t* buffer)
+{
+    int recvRank = header.destination;
+    getMpiSendEndpoint(getHostForRank(recvRank), basePorts[recvRank])
+      .sendMpiMessage(header, buffer);
+}
+
+// The payload is sent straight from the buffer in chunks, with no more than
+// the receiver has given credit for in flight at any one time. Therefore we
+// only return once it has all been sent.
+void MpiWorld::sendRemoteRendezvous(faabric::transport::MpiMessageHeader header,
+                                    const uint8_t* buffer)
+{
+    int recvRank = header.destination;
+    faabric::transport::MpiSendMessageEndpoint& endpoint =
+      getMpiSendEndpoint(getHostForRank(recvRank), basePorts[recvRank]);
+
+    size_t totalSize = header.payloadSize;
+    header.kind = faabric::transport::MpiMessageKind::RendezvousRequest;
+    header.chunkSize = chunkSize;
+    endpoint.sendMpiMessage(header, nullptr);
+
+    faabric::util::SpscQueue<int>& credits =
+      *rendezvousCredits[getIndexForRanks(header.sender, recvRank)];
+
+    int nCredits = 0;
+    header.kind = faabric::transport::MpiMessageKind::RendezvousChunk;
+    for (size_t offset = 0; offset < totalSize; offset += chunkSize) {
+        // Credit comes back through the background thread. A slow receiver
+        // is not an error, so we keep waiting for as long as it's running.
+        while (nCredits == 0) {
+            try {
+                nCredits = credits.dequeue(DEFAULT_RECV_TIMEOUT_MS);
+            } catch (faabric::util::QueueTimeoutException& e) {
+                if (!remoteRecvRunning) {
+                    SPDLOG_ERROR("No rendezvous credit for {} -> {}, not "
+                                 "receiving remote messages",
+                                 header.sender,
+                                 recvRank);
+                    throw std::runtime_error("No rendezvous credit");
+                }
+
+                SPDLOG_DEBUG("Waiting for rendezvous credit for {} -> {}",
+                             header.sender,
+                             recvRank);
+            }
+        }
+
+        header.offset = offset;
+        header.payloadSize = std::min(chunkSize, totalSize - offset);
+        endpoint.sendMpiMessage(header, buffer + offset);
+        nCredits--;
+    }
+}
+
+void MpiWorld::sendRendezvousCredit(int sendRank, int recvRank, int nChunks)
 {
-    SPDLOG_TRACE("Open MPI endpoint between ranks (local-remote) {} - {}",
-                 localRank,
-                 remoteRank);
+    faabric::transport::MpiMessageHeader header{};
+    header.kind = faabric::transport::MpiMessageKind::RendezvousCredit;
+    header.worldId = id;
+    header.sender = sendRank;
+    header.destination = recvRank;
+    header.count = nChunks;
+
+    getMpiSendEndpoint(getHostForRank(sendRank), basePorts[sendRank])
+      .sendMpiMessage(header, nullptr);
+}
+
+// Messages from remote ranks are put in the local queues by the background
+// thread, just like those from local ranks. Rendezvous messages are only
+// queued once their last chunk lands, so we keep waiting for as long as
+// chunks keep arriving, rather than timing out on large messages.
+std::shared_ptr<faabric::MPIMessage> MpiWorld::recvRemoteMpiMessage(
+  int sendRank,
+  int recvRank)
+{
+    std::atomic<size_t>& progress =
+      rendezvousProgress[getIndexForRanks(sendRank, recvRank)];
+
+    size_t lastProgress = progress.load(std::memory_order_relaxed);
+    while (true) {
+        try {
+            return dequeueLocal(sendRank, recvRank, DEFAULT_RECV_TIMEOUT_MS);
+        } catch (faabric::util::QueueTimeoutException& e) {
+            size_t currentProgress = progress.load(std::memory_order_relaxed);
+            if (currentProgress == lastProgress) {
+                throw;
+            }
 
-    // Resize the message endpoint vector and initialise to null. Note that we
-    // allocate size x size slots to cover all possible (sendRank, recvRank)
-    // pairs
-    if (mpiMessageEndpoints.empty()) {
-        for (int i = 0; i < size * size; i++) {
-            mpiMessageEndpoints.emplace_back(nullptr);
+            SPDLOG_DEBUG("Waiting for rendezvous message {} -> {}",
+                         sendRank,
+                         recvRank);
+            lastProgress = currentProgress;
         }
     }
+}
 
-    // Get host for remote rank
-    std::string otherHost = getHostForRank(remoteRank);
+// The background thread is started when the world is set up on this host,
+// so that rendezvous credit flows without waiting for a local rank to
+// receive. Senders can go ahead before then, as their messages are queued
+// until we bind.
+void MpiWorld::initRemoteRecvThread()
+{
+    // Worlds with all their ranks on this host have nothing to receive
+    if (ranksForHost.size() < 2 || ranksForHost.count(thisHost) == 0) {
+        return;
+    }
 
-    // Get the index for the rank-host pair
-    int index = getIndexForRanks(localRank, remoteRank);
+    std::call_once(remoteRecvStarted, [this] { startRemoteRecvThread(); });
+}
 
-    // Get port for send-recv pair
-    std::pair<int, int> sendRecvPorts = getPortForRanks(localRank, remoteRank);
+void MpiWorld::startRemoteRecvThread()
+{
+    int port = basePorts[ranksForHost.at(thisHost).front()];
 
-    // Create MPI message endpoint
-    mpiMessageEndpoints.emplace(
-      mpiMessageEndpoints.begin() + index,
-      std::make_unique<faabric::transport::MpiMessageEndpoint>(
-        otherHost, sendRecvPorts.first, sendRecvPorts.second));
+    remoteRecvRunning = true;
+    remoteRecvThread = std::thread([this, port] {
+        routeRemoteMpiMessages(port);
+        remoteRecvRunning = false;
+    });
 }
 
-void MpiWorld::sendRemoteMpiMessage(
-  int sendRank,
-  int recvRank,
-  const std::shared_ptr<faabric::MPIMessage>& msg)
+// State of a rendezvous receive, only touched by the background thread
+struct RemoteRendezvous
 {
-    // Get the index for the rank-host pair
-    // Note - message endpoints are identified by a (localRank, remoteRank)
-    // pair, not a (sendRank, recvRank) one
-    int index = getIndexForRanks(sendRank, recvRank);
+    std::shared_ptr<faabric::MPIMessage> msg;
+    uint8_t* buffer = nullptr;
+    size_t size = 0;
+    size_t received = 0;
+    int nChunks = 0;
+    int nGranted = 0;
+};
+
+void MpiWorld::routeRemoteMpiMessages(int port)
+{
+    using faabric::transport::MpiMessageKind;
+
+    SPDLOG_TRACE("Receiving remote MPI messages for world {} on {}", id, port);
+    faabric::transport::MpiRecvMessageEndpoint endpoint(port);
+
+    // Rendezvous receives in progress, by rank pair. There is at most one for
+    // each pair, as the sender waits for it to finish before sending more.
+    std::unordered_map<int, RemoteRendezvous> rendezvous;
+
+    faabric::transport::MpiMessageHeader header;
+    bool isRunning = true;
+    while (isRunning) {
+        // Stop on shutdown, or when the context has been closed
+        try {
+            isRunning = endpoint.recvHeader(header);
+        } catch (faabric::transport::MessageTimeoutException& ex) {
+            continue;
+        }
+
+        if (!isRunning) {
+            break;
+        }
+
+        // Worlds that run one after the other reuse the same ports. Credit is
+        // the only thing sent to the sender's host.
+        bool isValid = header.worldId == id && header.sender >= 0 &&
+                       header.sender < size && header.destination >= 0 &&
+                       header.destination < size;
+        if (isValid) {
+            int localRank = header.kind == MpiMessageKind::RendezvousCredit
+                              ? header.sender
+                              : header.destination;
+            isValid = getHostForRank(localRank) == thisHost;
+        }
+
+        int index = isValid
+                      ? getIndexForRanks(header.sender, header.destination)
+                      : -1;
+        auto rdvIt = rendezvous.find(index);
+        if (isValid && header.kind == MpiMessageKind::RendezvousChunk) {
+            isValid = rdvIt != rendezvous.end() &&
+                      header.offset + header.payloadSize <= rdvIt->second.size;
+        }
+
+        if (!isValid) {
+            SPDLOG_ERROR("Dropping MPI message {} -> {} for world {} (world "
+                         "{} on {})",
+                         header.sender,
+                         header.destination,
+                         header.worldId,
+                         id,
+                         thisHost);
+
+            if (header.hasPayloadFrame()) {
+                std::vector<uint8_t> discarded(header.payloadSize);
+                isRunning =
+                  endpoint.recvPayload(discarded.data(), discarded.size());
+            }
+
+            continue;
+        }
+
+        switch (header.kind) {
+            case MpiMessageKind::Eager: {
+                // Receive straight into a posted buffer if there is one
+                auto msg = faabric::transport::mpiMessageFromHeader(header);
+                uint8_t* buffer = claimPostedRecvBuffer(
+                  header.sender,
+                  header.destination,
+                  header.tag,
+                  msg->messagetype(),
+                  header.payloadSize);
+                if (header.payloadSize > 0) {
+                    if (buffer == nullptr) {
+                        msg->mutable_buffer()->resize(header.payloadSize);
+                        buffer = BYTES(msg->mutable_buffer()->data());
+                    }
+
+                    isRunning =
+                      endpoint.recvPayload(buffer, header.payloadSize);
+                }
 
-    if (mpiMessageEndpoints.empty() || mpiMessageEndpoints[index] == nullptr) {
-        initRemoteMpiEndpoint(sendRank, recvRank);
+                localQueues[index]->enqueue(std::move(msg));
+                break;
+            }
+            case MpiMessageKind::RendezvousRequest: {
+                // Without a posted buffer, the payload goes in the message
+                RemoteRendezvous& rdv = rendezvous[index];
+                rdv.msg = faabric::transport::mpiMessageFromHeader(header);
+                rdv.size = header.payloadSize;
+                rdv.received = 0;
+                rdv.buffer = claimPostedRecvBuffer(header.sender,
+                                                   header.destination,
+                                                   header.tag,
+                                                   rdv.msg->messagetype(),
+                                                   rdv.size);
+                if (rdv.buffer == nullptr) {
+                    rdv.msg->mutable_buffer()->resize(rdv.size);
+                    rdv.buffer = BYTES(rdv.msg->mutable_buffer()->data());
+                }
+
+                size_t requestChunkSize = std::max(header.chunkSize, 1);
+                rdv.nChunks =
+                  (rdv.size + requestChunkSize - 1) / requestChunkSize;
+                rdv.nGranted =
+                  std::min(rdv.nChunks, MPI_RENDEZVOUS_WINDOW_CHUNKS);
+                sendRendezvousCredit(
+                  header.sender, header.destination, rdv.nGranted);
+                break;
+            }
+            case MpiMessageKind::RendezvousChunk: {
+                RemoteRendezvous& rdv = rdvIt->second;
+                isRunning = endpoint.recvPayload(rdv.buffer + header.offset,
+                                                 header.payloadSize);
+                rdv.received += header.payloadSize;
+                rendezvousProgress[index].fetch_add(header.payloadSize,
+                                                    std::memory_order_relaxed);
+
+                // The message is only queued once it's all arrived
+                if (rdv.received >= rdv.size) {
+                    localQueues[index]->enqueue(std::move(rdv.msg));
+                    rendezvous.erase(rdvIt);
+                } else if (rdv.nGranted < rdv.nChunks) {
+                    rdv.nGranted++;
+                    sendRendezvousCredit(header.sender, header.destination, 1);
+                }
+                break;
+            }
+            case MpiMessageKind::RendezvousCredit: {
+                rendezvousCredits[index]->enqueue(header.count);
+                break;
+            }
+        }
     }
 
-    mpiMessageEndpoints[index]->sendMpiMessage(msg);
+    SPDLOG_TRACE("Stopped receiving remote MPI messages for world {}", id);
 }
 
-std::shared_ptr<faabric::MPIMessage> MpiWorld::recvRemoteMpiMessage(
-  int sendRank,
-  int recvRank)
+void MpiWorld::stopRemoteRecvThread()
 {
-    // Get the index for the rank-host pair
-    // Note - message endpoints are identified by a (localRank, remoteRank)
-    // pair, not a (sendRank, recvRank) one
-    int index = getIndexForRanks(recvRank, sendRank);
+    if (!remoteRecvThread.joinable()) {
+        return;
+    }
 
-    if (mpiMessageEndpoints.empty() || mpiMessageEndpoints[index] == nullptr) {
-        initRemoteMpiEndpoint(recvRank, sendRank);
+    // The thread will have stopped by itself if the context has been closed
+    if (remoteRecvRunning) {
+        int port = basePorts[ranksForHost.at(thisHost).front()];
+        faabric::transport::MpiSendMessageEndpoint shutdownSender(LOCALHOST,
+                                                                  port);
+        shutdownSender.sendShutdown();
     }
 
-    return mpiMessageEndpoints[index]->recvMpiMessage();
+    remoteRecvThread.join();
 }
 
-std::shared_ptr<faabric::scheduler::MpiMessageBuffer>
-MpiWorld::getUnackedMessageBuffer(int sendRank, int recvRank)
+MpiMessageMatcher& MpiWorld::getMessageMatcher(int recvRank)
 {
     // We want to lazily initialise this data structure because, given its
     // thread local nature, we expect it to be quite sparse (i.e. filled with
     // nullptr).
-    if (unackedMessageBuffers.size() == 0) {
-        unackedMessageBuffers.resize(size * size, nullptr);
+    if (messageMatchers.size() < size) {
+        messageMatchers.resize(size);
     }
 
-    // Get the index for the rank-host pair
-    int index = getIndexForRanks(sendRank, recvRank);
-    assert(index >= 0 && index < size * size);
-
-    if (unackedMessageBuffers[index] == nullptr) {
-        unackedMessageBuffers.emplace(
-          unackedMessageBuffers.begin() + index,
-          std::make_shared<faabric::scheduler::MpiMessageBuffer>());
+    assert(recvRank >= 0 && recvRank < size);
+    if (messageMatchers[recvRank] == nullptr) {
+        messageMatchers[recvRank] = std::make_unique<MpiMessageMatcher>();
     }
 
-    return unackedMessageBuffers[index];
+    return *messageMatchers[recvRank];
 }
 
 void MpiWorld::create(const faabric::Message& call, int newId, int newSize)
@@ -208,9 +468,12 @@ void MpiWorld::create(const faabric::Message& call, int newId, int newSize)
     // Record rank-to-host mapping and base ports
     rankHosts = executedAt;
     basePorts = initLocalBasePorts(executedAt);
+    initRanksForHost();
 
     // Initialise the memory queues for message reception
     initLocalQueues();
+
+    initRemoteRecvThread();
 }
 
 void MpiWorld::broadcastHostsToRanks()
@@ -246,24 +509,30 @@ void MpiWorld::destroy()
     // We must force the destructors for all message endpoints to run here
     // rather than at the end of their global thread-local lifespan. If we
     // don't, the ZMQ shutdown can hang.
-    mpiMessageEndpoints.clear();
+    mpiMessageEndpoints.erase(id);
     ranksRecvEndpoint = nullptr;
     ranksSendEndpoints.clear();
 
-    // Unacked message buffers
-    if (!unackedMessageBuffers.empty()) {
-        for (auto& umb : unackedMessageBuffers) {
-            if (umb != nullptr) {
-                if (!umb->isEmpty()) {
-                    SPDLOG_ERROR("Destroying the MPI world with outstanding {}"
-                                 " messages in the message buffer",
-                                 umb->size());
-                    throw std::runtime_error(
-                      "Destroying world with a non-empty MPI message buffer");
-                }
+    // The last local rank out closes the port for the next world
+    auto it = ranksForHost.find(thisHost);
+    if (it != ranksForHost.end() &&
+        nDestroyedRanks.fetch_add(1) + 1 == (int)it->second.size()) {
+        stopRemoteRecvThread();
+    }
+
+    // Message matchers, which may still hold unexpected messages that were
+    // never received
+    if (!messageMatchers.empty()) {
+        for (auto& matcher : messageMatchers) {
+            if (matcher != nullptr && matcher->getNumRecvs() > 0) {
+                SPDLOG_ERROR("Destroying the MPI world with {} outstanding"
+                             " receives in the message matcher",
+                             matcher->getNumRecvs());
+                throw std::runtime_error(
+                  "Destroying world with outstanding MPI receives");
             }
         }
-        unackedMessageBuffers.clear();
+        messageMatchers.clear();
     }
 
     // Request to rank map should be empty
@@ -307,9 +576,12 @@ void MpiWorld::initialiseFromMsg(const faabric::Message& msg)
     rankHosts = { hostRankMsg.hosts().begin(), hostRankMsg.hosts().end() };
     basePorts = { hostRankMsg.baseports().begin(),
                   hostRankMsg.baseports().end() };
+    initRanksForHost();
 
     // Initialise the memory queues for message reception
     initLocalQueues();
+
+    initRemoteRecvThread();
 }
 
 std::string MpiWorld::getHostForRank(int rank)
@@ -325,38 +597,6 @@ std::string MpiWorld::getHostForRank(int rank)
     return host;
 }
 
-// Returns a pair (sendPort, recvPort)
-// To assign the send and recv ports, we follow a protocol establishing:
-// 1) Port range (offset) corresponding to the world that receives
-// 2) Within a world's port range, port corresponding to the outcome of
-//    getIndexForRanks(localRank, remoteRank) Where local and remote are
-//    relative to the world whose port range we are in
-std::pair<int, int> MpiWorld::getPortForRanks(int localRank, int remoteRank)
-{
-    std::pair<int, int> sendRecvPortPair;
-
-    // Get base port for local and remote worlds
-    int localBasePort = basePorts[localRank];
-    int remoteBasePort = basePorts[remoteRank];
-    assert(localBasePort != remoteBasePort);
-
-    // Assign send port
-    // 1) Port range corresponding to remote world, as they are receiving
-    // 2) Index switching localRank and remoteRank, as remote rank is "local"
-    //    to the remote world
-    sendRecvPortPair.first =
-      remoteBasePort + getIndexForRanks(remoteRank, localRank);
-
-    // Assign recv port
-    // 1) Port range corresponding to our world, as we are the one's receiving
-    // 2) Port using our local rank as `localRank`, as we are in the local
-    //    offset
-    sendRecvPortPair.second =
-      localBasePort + getIndexForRanks(localRank, remoteRank);
-
-    return sendRecvPortPair;
-}
-
 void MpiWorld::getCartesianRank(int rank,
                                 int maxDims,
                                 const int* dims,
@@ -487,39 +727,32 @@ int MpiWorld::isend(int sendRank,
                     const uint8_t* buffer,
                     faabric_datatype_t* dataType,
                     int count,
-                    faabric::MPIMessage::MPIMessageType messageType)
+                    faabric::MPIMessage::MPIMessageType messageType,
+                    int tag)
 {
     int requestId = (int)faabric::util::generateGid();
     iSendRequests.insert(requestId);
 
-    send(sendRank, recvRank, buffer, dataType, count, messageType);
+    send(sendRank, recvRank, buffer, dataType, count, messageType, tag);
 
     return requestId;
 }
 
+// The receive is posted straight away, and matched with a message when it is
+// awaited. The sending rank may be MPI_ANY_SOURCE, and the tag MPI_ANY_TAG.
 int MpiWorld::irecv(int sendRank,
                     int recvRank,
                     uint8_t* buffer,
                     faabric_datatype_t* dataType,
                     int count,
-                    faabric::MPIMessage::MPIMessageType messageType)
+                    faabric::MPIMessage::MPIMessageType messageType,
+                    int tag)
 {
-    int requestId = (int)faabric::util::generateGid();
-    reqIdToRanks.try_emplace(requestId, sendRank, recvRank);
-
-    // Enqueue an unacknowleged request (no message)
-    faabric::scheduler::MpiMessageBuffer::PendingAsyncMpiMessage pendingMsg;
-    pendingMsg.requestId = requestId;
-    pendingMsg.sendRank = sendRank;
-    pendingMsg.recvRank = recvRank;
-    pendingMsg.buffer = buffer;
-    pendingMsg.dataType = dataType;
-    pendingMsg.count = count;
-    pendingMsg.messageType = messageType;
-    assert(!pendingMsg.isAcknowledged());
+    checkRecvRanksRange(sendRank, recvRank);
 
-    auto umb = getUnackedMessageBuffer(sendRank, recvRank);
-    umb->addMessage(pendingMsg);
+    int requestId =
+      postRecv(sendRank, recvRank, buffer, dataType, count, messageType, tag);
+    reqIdToRanks.try_emplace(requestId, sendRank, recvRank);
 
     return requestId;
 }
@@ -529,10 +762,15 @@ void MpiWorld::send(int sendRank,
                     const uint8_t* buffer,
                     faabric_datatype_t* dataType,
                     int count,
-                    faabric::MPIMessage::MPIMessageType messageType)
+                    faabric::MPIMessage::MPIMessageType messageType,
+                    int tag)
 {
     // Sanity-check input parameters
     checkRanksRange(sendRank, recvRank);
+    if (tag < 0) {
+        SPDLOG_ERROR("Invalid MPI tag for send: {}", tag);
+        throw std::runtime_error("Invalid MPI tag");
+    }
     if (getHostForRank(sendRank) != thisHost) {
         SPDLOG_ERROR("Trying to send message from a non-local rank: {}",
                      sendRank);
@@ -546,6 +784,34 @@ void MpiWorld::send(int sendRank,
     // Generate a message ID
     int msgId = (int)faabric::util::generateGid();
 
+    size_t bufferSize = 0;
+    if (count > 0 && buffer != nullptr) {
+        bufferSize = dataType->size * count;
+    }
+
+    // Remote messages are sent straight from the buffer, with no message
+    // object in between
+    if (!isLocal) {
+        SPDLOG_TRACE("MPI - send remote {} -> {}", sendRank, recvRank);
+        faabric::transport::MpiMessageHeader header{};
+        header.payloadSize = bufferSize;
+        header.worldId = id;
+        header.sender = sendRank;
+        header.destination = recvRank;
+        header.id = msgId;
+        header.messageType = messageType;
+        header.datatype = dataType->id;
+        header.count = count;
+        header.tag = tag;
+
+        if (eagerLimit > 0 && bufferSize > eagerLimit) {
+            sendRemoteRendezvous(header, buffer);
+        } else {
+            sendRemoteMpiMessage(header, buffer);
+        }
+        return;
+    }
+
     // Create the message
     auto m = std::make_shared<faabric::MPIMessage>();
     m->set_id(msgId);
@@ -555,20 +821,24 @@ void MpiWorld::send(int sendRank,
     m->set_type(dataType->id);
     m->set_count(count);
     m->set_messagetype(messageType);
-
-    // Set up message data
-    if (count > 0 && buffer != nullptr) {
-        m->set_buffer(buffer, dataType->size * count);
+    m->set_tag(tag);
+
+    // Set up message data. If the local receiver has already posted its
+    // buffer, the data goes straight there and the message carries none
+    uint8_t* recvBuffer =
+      claimPostedRecvBuffer(sendRank, recvRank, tag, messageType, bufferSize);
+    if (recvBuffer != nullptr) {
+        SPDLOG_TRACE("MPI - rendezvous {} -> {} ({} bytes)",
+                     sendRank,
+                     recvRank,
+                     bufferSize);
+        std::memcpy(recvBuffer, buffer, bufferSize);
+    } else if (bufferSize > 0) {
+        m->set_buffer(buffer, bufferSize);
     }
 
-    // Dispatch the message locally or globally
-    if (isLocal) {
-        SPDLOG_TRACE("MPI - send {} -> {}", sendRank, recvRank);
-        getLocalQueue(sendRank, recvRank)->enqueue(std::move(m));
-    } else {
-        SPDLOG_TRACE("MPI - send remote {} -> {}", sendRank, recvRank);
-        sendRemoteMpiMessage(sendRank, recvRank, m);
-    }
+    SPDLOG_TRACE("MPI - send {} -> {}", sendRank, recvRank);
+    getLocalQueue(sendRank, recvRank)->enqueue(std::move(m));
 }
 
 void MpiWorld::recv(int sendRank,
@@ -577,17 +847,15 @@ void MpiWorld::recv(int sendRank,
                     faabric_datatype_t* dataType,
                     int count,
                     MPI_Status* status,
-                    faabric::MPIMessage::MPIMessageType messageType)
+                    faabric::MPIMessage::MPIMessageType messageType,
+                    int tag)
 {
     // Sanity-check input parameters
-    checkRanksRange(sendRank, recvRank);
+    checkRecvRanksRange(sendRank, recvRank);
 
-    // Recv message from underlying transport
-    std::shared_ptr<faabric::MPIMessage> m =
-      recvBatchReturnLast(sendRank, recvRank);
-
-    // Do the processing
-    doRecv(m, buffer, dataType, count, status, messageType);
+    int requestId =
+      postRecv(sendRank, recvRank, buffer, dataType, count, messageType, tag);
+    awaitRecv(recvRank, requestId, status);
 }
 
 void MpiWorld::doRecv(std::shared_ptr<faabric::MPIMessage> m,
@@ -602,8 +870,8 @@ void MpiWorld::doRecv(std::shared_ptr<faabric::MPIMessage> m,
     assert(m->messagetype() == messageType);
     assert(m->count() <= count);
 
-    // TODO - avoid copy here
-    // Copy message data
+    // Copy message data. Messages sent to a posted buffer carry no data, as
+    // it's already been copied into place
     if (m->count() > 0) {
         std::move(m->buffer().begin(), m->buffer().end(), buffer);
     }
@@ -616,8 +884,7 @@ void MpiWorld::doRecv(std::shared_ptr<faabric::MPIMessage> m,
         // Note, take the message size here as the receive count may be larger
         status->bytesSize = m->count() * dataType->size;
 
-        // TODO - thread through tag
-        status->MPI_TAG = -1;
+        status->MPI_TAG = m->tag();
     }
 }
 
@@ -630,7 +897,9 @@ void MpiWorld::sendRecv(uint8_t* sendBuffer,
                         faabric_datatype_t* recvDataType,
                         int recvRank,
                         int myRank,
-                        MPI_Status* status)
+                        MPI_Status* status,
+                        int sendTag,
+                        int recvTag)
 {
     SPDLOG_TRACE("MPI - Sendrecv. Rank {}. Sending to: {} - Receiving from: {}",
                  myRank,
@@ -652,18 +921,23 @@ void MpiWorld::sendRecv(uint8_t* sendBuffer,
                        recvBuffer,
                        recvDataType,
                        recvCount,
-                       faabric::MPIMessage::SENDRECV);
+                       faabric::MPIMessage::SENDRECV,
+                       recvTag);
     // Then send the message
     send(myRank,
          sendRank,
          sendBuffer,
          sendDataType,
          sendCount,
-         faabric::MPIMessage::SENDRECV);
+         faabric::MPIMessage::SENDRECV,
+         sendTag);
     // And wait
-    awaitAsyncRequest(recvId);
+    awaitAsyncRequest(recvId, status);
 }
 
+// Sends directly from the root to every other rank, each of which receives
+// the message with a normal recv. Deprecated in favour of the broadcast every
+// rank takes part in.
 void MpiWorld::broadcast(int sendRank,
                          const uint8_t* buffer,
                          faabric_datatype_t* dataType,
@@ -683,6 +957,183 @@ void MpiWorld::broadcast(int sendRank,
     }
 }
 
+int ceilLog2(int n)
+{
+    int log = 0;
+    while ((1 << log) < n) {
+        log++;
+    }
+
+    return log;
+}
+
+// Pipelining down a chain takes roughly (size - 1 + nSegments) steps, each
+// sending one segment, whereas the binomial tree sends the whole buffer at
+// each of its log2(size) levels
+bool useChainBroadcast(int worldSize, size_t bufferSize)
+{
+    if (worldSize <= 2 || bufferSize < MPI_BCAST_CHAIN_MIN_BYTES) {
+        return false;
+    }
+
+    long nSegments =
+      (bufferSize + MPI_BCAST_SEGMENT_BYTES - 1) / MPI_BCAST_SEGMENT_BYTES;
+    long chainSteps = worldSize - 1 + nSegments;
+    long treeSteps = ceilLog2(worldSize) * nSegments;
+
+    return chainSteps < treeSteps;
+}
+
+// Broadcast in which every rank takes part, including the root. Non-root
+// ranks may forward the data on to others, so must all call this rather than
+// recv.
+void MpiWorld::broadcast(int sendRank,
+                         int recvRank,
+                         uint8_t* buffer,
+                         faabric_datatype_t* dataType,
+                         int count,
+                         faabric::MPIMessage::MPIMessageType messageType)
+{
+    checkRanksRange(sendRank, recvRank);
+
+    if (!useHierarchicalCollectives()) {
+        broadcastInGroup(
+          allRanks, sendRank, recvRank, buffer, dataType, count, messageType);
+        return;
+    }
+
+    // The root first sends to one leader on each other host, then each leader
+    // fans out to the ranks on its host
+    int leader = getLocalLeader(recvRank, sendRank);
+    if (recvRank == leader) {
+        broadcastInGroup(getLeaders(sendRank),
+                         sendRank,
+                         recvRank,
+                         buffer,
+                         dataType,
+                         count,
+                         messageType);
+    }
+
+    broadcastInGroup(ranksForHost.at(getHostForRank(recvRank)),
+                     leader,
+                     recvRank,
+                     buffer,
+                     dataType,
+                     count,
+                     messageType);
+}
+
+void MpiWorld::broadcastInGroup(
+  const std::vector<int>& ranks,
+  int sendRank,
+  int recvRank,
+  uint8_t* buffer,
+  faabric_datatype_t* dataType,
+  int count,
+  faabric::MPIMessage::MPIMessageType messageType)
+{
+    size_t bufferSize = dataType->size * count;
+    if (useChainBroadcast(ranks.size(), bufferSize)) {
+        broadcastChain(
+          ranks, sendRank, recvRank, buffer, dataType, count, messageType);
+    } else {
+        broadcastBinomial(
+          ranks, sendRank, recvRank, buffer, dataType, count, messageType);
+    }
+}
+
+int indexInGroup(const std::vector<int>& ranks, int rank)
+{
+    auto it = std::find(ranks.begin(), ranks.end(), rank);
+    assert(it != ranks.end());
+
+    return it - ranks.begin();
+}
+
+// Ranks are numbered relative to the root, and each receives from the rank
+// given by clearing its lowest set bit. It then forwards to the ranks given
+// by setting each of the bits below that one, furthest first.
+void MpiWorld::broadcastBinomial(
+  const std::vector<int>& ranks,
+  int sendRank,
+  int recvRank,
+  uint8_t* buffer,
+  faabric_datatype_t* dataType,
+  int count,
+  faabric::MPIMessage::MPIMessageType messageType)
+{
+    int groupSize = ranks.size();
+    int rootIdx = indexInGroup(ranks, sendRank);
+    int relativeRank = (indexInGroup(ranks, recvRank) - rootIdx + groupSize) %
+                       groupSize;
+
+    int mask = 1;
+    while (mask < groupSize) {
+        if (relativeRank & mask) {
+            int parent = ranks[(relativeRank - mask + rootIdx) % groupSize];
+            SPDLOG_TRACE("MPI - bcast tree {} <- {}", recvRank, parent);
+            recv(
+              parent, recvRank, buffer, dataType, count, nullptr, messageType);
+            break;
+        }
+
+        mask <<= 1;
+    }
+
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+        if (relativeRank + mask < groupSize) {
+            int child = ranks[(relativeRank + mask + rootIdx) % groupSize];
+            send(recvRank, child, buffer, dataType, count, messageType);
+        }
+    }
+}
+
+// Each rank receives each segment from the one before it, and passes it on
+// to the next, so that all links in the chain are busy at once
+void MpiWorld::broadcastChain(const std::vector<int>& ranks,
+                              int sendRank,
+                              int recvRank,
+                              uint8_t* buffer,
+                              faabric_datatype_t* dataType,
+                              int count,
+                              faabric::MPIMessage::MPIMessageType messageType)
+{
+    int groupSize = ranks.size();
+    int idx = indexInGroup(ranks, recvRank);
+    int relativeRank =
+      (idx - indexInGroup(ranks, sendRank) + groupSize) % groupSize;
+    int prevRank = ranks[(idx - 1 + groupSize) % groupSize];
+    int nextRank = ranks[(idx + 1) % groupSize];
+    bool isFirst = relativeRank == 0;
+    bool isLast = relativeRank == groupSize - 1;
+
+    int segmentCount =
+      std::max<int>(MPI_BCAST_SEGMENT_BYTES / dataType->size, 1);
+
+    SPDLOG_TRACE(
+      "MPI - bcast chain {} <- {} -> {}", recvRank, prevRank, nextRank);
+
+    for (int offset = 0; offset < count; offset += segmentCount) {
+        int thisCount = std::min(segmentCount, count - offset);
+        uint8_t* segment = buffer + (size_t)offset * dataType->size;
+
+        if (!isFirst) {
+            recv(prevRank,
+                 recvRank,
+                 segment,
+                 dataType,
+                 thisCount,
+                 nullptr,
+                 messageType);
+        }
+
+        if (!isLast) {
+            send(recvRank, nextRank, segment, dataType, thisCount, messageType);
+        }
+    }
+}
+
 void checkSendRecvMatch(faabric_datatype_t* sendType,
                         int sendCount,
                         faabric_datatype_t* recvType,
@@ -755,6 +1206,18 @@ void MpiWorld::gather(int sendRank,
 {
     checkSendRecvMatch(sendType, sendCount, recvType, recvCount);
 
+    if (useHierarchicalCollectives()) {
+        gatherHierarchical(sendRank,
+                           recvRank,
+                           sendBuffer,
+                           sendType,
+                           sendCount,
+                           recvBuffer,
+                           recvType,
+                           recvCount);
+        return;
+    }
+
     size_t sendOffset = sendCount * sendType->size;
     size_t recvOffset = recvCount * recvType->size;
 
@@ -815,6 +1278,114 @@ void MpiWorld::gather(int sendRank,
     }
 }
 
+// Each leader packs the chunks of the ranks on its host, in rank order, and
+// sends them to the root as a single message. Ranks on the root's host send
+// to the root directly.
+void MpiWorld::gatherHierarchical(int sendRank,
+                                  int recvRank,
+                                  const uint8_t* sendBuffer,
+                                  faabric_datatype_t* sendType,
+                                  int sendCount,
+                                  uint8_t* recvBuffer,
+                                  faabric_datatype_t* recvType,
+                                  int recvCount)
+{
+    size_t sendOffset = sendCount * sendType->size;
+    size_t recvOffset = recvCount * recvType->size;
+
+    // See gather for why only part of the buffer is sent when in-place
+    bool isInPlace = sendBuffer == recvBuffer;
+    const uint8_t* sendChunk =
+      isInPlace ? sendBuffer + (sendRank * sendOffset) : sendBuffer;
+
+    int leader = getLocalLeader(sendRank, recvRank);
+    if (sendRank != leader) {
+        send(sendRank,
+             leader,
+             sendChunk,
+             sendType,
+             sendCount,
+             faabric::MPIMessage::GATHER);
+        return;
+    }
+
+    const std::vector<int>& localRanks =
+      ranksForHost.at(getHostForRank(sendRank));
+
+    if (sendRank != recvRank) {
+        SPDLOG_TRACE("MPI - gather host leader {} -> {}", sendRank, recvRank);
+
+        std::vector<uint8_t> hostData(localRanks.size() * sendOffset);
+        for (int i = 0; i < localRanks.size(); i++) {
+            uint8_t* hostChunk = hostData.data() + (i * sendOffset);
+            if (localRanks[i] == sendRank) {
+                std::copy(sendChunk, sendChunk + sendOffset, hostChunk);
+            } else {
+                recv(localRanks[i],
+                     sendRank,
+                     hostChunk,
+                     sendType,
+                     sendCount,
+                     nullptr,
+                     faabric::MPIMessage::GATHER);
+            }
+        }
+
+        send(sendRank,
+             recvRank,
+             hostData.data(),
+             sendType,
+             sendCount * localRanks.size(),
+             faabric::MPIMessage::GATHER);
+        return;
+    }
+
+    SPDLOG_TRACE("MPI - gather all -> {} (hierarchical)", recvRank);
+
+    for (int r : localRanks) {
+        if (r == recvRank) {
+            if (!isInPlace) {
+                std::copy(sendBuffer,
+                          sendBuffer + sendOffset,
+                          recvBuffer + (r * recvOffset));
+            }
+        } else {
+            recv(r,
+                 recvRank,
+                 recvBuffer + (r * recvOffset),
+                 recvType,
+                 recvCount,
+                 nullptr,
+                 faabric::MPIMessage::GATHER);
+        }
+    }
+
+    std::vector<uint8_t> hostData;
+    for (int otherLeader : getLeaders(recvRank)) {
+        if (otherLeader == recvRank) {
+            continue;
+        }
+
+        const std::vector<int>& otherRanks =
+          ranksForHost.at(getHostForRank(otherLeader));
+        hostData.resize(otherRanks.size() * recvOffset);
+        recv(otherLeader,
+             recvRank,
+             hostData.data(),
+             recvType,
+             recvCount * otherRanks.size(),
+             nullptr,
+             faabric::MPIMessage::GATHER);
+
+        for (int i = 0; i < otherRanks.size(); i++) {
+            uint8_t* hostChunk = hostData.data() + (i * recvOffset);
+            std::copy(hostChunk,
+                      hostChunk + recvOffset,
+                      recvBuffer + (otherRanks[i] * recvOffset));
+        }
+    }
+}
+
 void MpiWorld::allGather(int rank,
                          const uint8_t* sendBuffer,
                          faabric_datatype_t* sendType,
@@ -840,26 +1411,17 @@ void MpiWorld::allGather(int rank,
     // Note that sendCount and recvCount here are per-rank, so we need to work
     // out the full buffer size
     int fullCount = recvCount * size;
-    if (rank == root) {
-        // Broadcast the result
-        broadcast(root,
-                  recvBuffer,
-                  recvType,
-                  fullCount,
-                  faabric::MPIMessage::ALLGATHER);
-    } else {
-        // Await the broadcast from the master
-        recv(root,
-             rank,
-             recvBuffer,
-             recvType,
-             fullCount,
-             nullptr,
-             faabric::MPIMessage::ALLGATHER);
-    }
+
+    // Broadcast the result
+    broadcast(root,
+              rank,
+              recvBuffer,
+              recvType,
+              fullCount,
+              faabric::MPIMessage::ALLGATHER);
 }
 
-void MpiWorld::awaitAsyncRequest(int requestId)
+void MpiWorld::awaitAsyncRequest(int requestId, MPI_Status* status)
 {
     SPDLOG_TRACE("MPI - await {}", requestId);
 
@@ -878,57 +1440,190 @@ void MpiWorld::awaitAsyncRequest(int requestId)
         SPDLOG_ERROR("Asynchronous request id not recognized: {}", requestId);
         throw std::runtime_error("Unrecognized async request id");
     }
-    int sendRank = it->second.first;
     int recvRank = it->second.second;
     reqIdToRanks.erase(it);
 
-    std::shared_ptr<faabric::scheduler::MpiMessageBuffer> umb =
-      getUnackedMessageBuffer(sendRank, recvRank);
+    awaitRecv(recvRank, requestId, status);
+}
 
-    std::list<MpiMessageBuffer::PendingAsyncMpiMessage>::iterator msgIt =
-      umb->getRequestPendingMsg(requestId);
+void MpiWorld::awaitAllAsyncRequests(std::vector<int>& requestIds,
+                                     MPI_Status* statuses)
+{
+    SPDLOG_TRACE("MPI - await all {} requests", requestIds.size());
+
+    // Complete whatever is ready already, and keep track of the rest by id
+    std::unordered_map<int, int> pendingIdxs;
+    int recvRank = -1;
+    for (int i = 0; i < requestIds.size(); i++) {
+        int& requestId = requestIds.at(i);
+        if (requestId == FAABRIC_REQUEST_NULL_ID) {
+            continue;
+        }
 
-    std::shared_ptr<faabric::MPIMessage> m;
-    if (msgIt->msg != nullptr) {
-        // This id has already been acknowledged by a recv call, so do the recv
-        m = msgIt->msg;
-    } else {
-        // We need to acknowledge all messages not acknowledged from the
-        // begining until us
-        m = recvBatchReturnLast(
-          sendRank, recvRank, umb->getTotalUnackedMessagesUntil(msgIt) + 1);
+        if (isAsyncRequestReady(requestId, recvRank)) {
+            awaitAsyncRequest(requestId,
+                              statuses == MPI_STATUSES_IGNORE ? nullptr
+                                                              : &statuses[i]);
+            requestId = FAABRIC_REQUEST_NULL_ID;
+        } else {
+            pendingIdxs.emplace(requestId, i);
+        }
     }
 
-    doRecv(m,
-           msgIt->buffer,
-           msgIt->dataType,
-           msgIt->count,
-           MPI_STATUS_IGNORE,
-           msgIt->messageType);
+    // Then complete each of the rest as soon as its message is matched. All
+    // receives of a rank share its matcher, so some matched may not be ours.
+    while (!pendingIdxs.empty()) {
+        for (int requestId :
+             progressRecvs(recvRank, getPendingSendRanks(recvRank))) {
+            auto it = pendingIdxs.find(requestId);
+            if (it == pendingIdxs.end()) {
+                continue;
+            }
 
-    // Remove the acknowledged indexes from the UMB
-    umb->deleteMessage(msgIt);
+            awaitAsyncRequest(requestId,
+                              statuses == MPI_STATUSES_IGNORE
+                                ? nullptr
+                                : &statuses[it->second]);
+            requestIds.at(it->second) = FAABRIC_REQUEST_NULL_ID;
+            pendingIdxs.erase(it);
+        }
+    }
 }
 
-void MpiWorld::reduce(int sendRank,
-                      int recvRank,
-                      uint8_t* sendBuffer,
-                      uint8_t* recvBuffer,
-                      faabric_datatype_t* datatype,
-                      int count,
-                      faabric_op_t* operation)
+// Returns the index of the request completed, or MPI_UNDEFINED if there are
+// none left to wait on
+int MpiWorld::awaitAnyAsyncRequest(std::vector<int>& requestIds,
+                                   MPI_Status* status)
 {
-    // If we're the receiver, await inputs
-    if (sendRank == recvRank) {
-        SPDLOG_TRACE("MPI - reduce ({}) all -> {}", operation->id, recvRank);
+    SPDLOG_TRACE("MPI - await any of {} requests", requestIds.size());
+
+    std::unordered_map<int, int> pendingIdxs;
+    int recvRank = -1;
+    int completedIdx = MPI_UNDEFINED;
+    for (int i = 0; i < requestIds.size(); i++) {
+        int requestId = requestIds.at(i);
+        if (requestId == FAABRIC_REQUEST_NULL_ID) {
+            continue;
+        }
 
-        size_t bufferSize = datatype->size * count;
+        if (isAsyncRequestReady(requestId, recvRank)) {
+            completedIdx = i;
+            break;
+        }
+        pendingIdxs.emplace(requestId, i);
+    }
 
-        bool isInPlace = sendBuffer == recvBuffer;
+    while (completedIdx == MPI_UNDEFINED && !pendingIdxs.empty()) {
+        for (int requestId :
+             progressRecvs(recvRank, getPendingSendRanks(recvRank))) {
+            auto it = pendingIdxs.find(requestId);
+            if (it != pendingIdxs.end()) {
+                completedIdx = it->second;
+                break;
+            }
+        }
+    }
 
-        // If not receiving in-place, initialize the receive buffer to the send
-        // buffer values. This prevents issues when 0-initializing for operators
-        // like the minimum, or product.
+    if (completedIdx != MPI_UNDEFINED) {
+        awaitAsyncRequest(requestIds.at(completedIdx), status);
+        requestIds.at(completedIdx) = FAABRIC_REQUEST_NULL_ID;
+    }
+
+    return completedIdx;
+}
+
+// Only completes the requests if they are all ready, otherwise leaves them all
+// outstanding
+bool MpiWorld::testAllAsyncRequests(std::vector<int>& requestIds,
+                                    MPI_Status* statuses)
+{
+    SPDLOG_TRACE("MPI - test all {} requests", requestIds.size());
+
+    bool isReady = true;
+    int recvRank = -1;
+    for (int requestId : requestIds) {
+        if (requestId != FAABRIC_REQUEST_NULL_ID &&
+            !isAsyncRequestReady(requestId, recvRank)) {
+            isReady = false;
+            break;
+        }
+    }
+
+    // Take whatever has arrived, and check again
+    if (!isReady) {
+        std::vector<int> matched;
+        pollRecvs(recvRank, getPendingSendRanks(recvRank), matched);
+
+        for (int requestId : requestIds) {
+            if (requestId != FAABRIC_REQUEST_NULL_ID &&
+                !isAsyncRequestReady(requestId, recvRank)) {
+                return false;
+            }
+        }
+    }
+
+    for (int i = 0; i < requestIds.size(); i++) {
+        if (requestIds.at(i) == FAABRIC_REQUEST_NULL_ID) {
+            continue;
+        }
+
+        awaitAsyncRequest(requestIds.at(i),
+                          statuses == MPI_STATUSES_IGNORE ? nullptr
+                                                          : &statuses[i]);
+        requestIds.at(i) = FAABRIC_REQUEST_NULL_ID;
+    }
+
+    return true;
+}
+
+void MpiWorld::reduce(int sendRank,
+                      int recvRank,
+                      uint8_t* sendBuffer,
+                      uint8_t* recvBuffer,
+                      faabric_datatype_t* datatype,
+                      int count,
+                      faabric_op_t* operation)
+{
+    if (useHierarchicalCollectives()) {
+        reduceHierarchical(sendRank,
+                           recvRank,
+                           sendBuffer,
+                           recvBuffer,
+                           datatype,
+                           count,
+                           operation);
+    } else {
+        reduceInGroup(allRanks,
+                      sendRank,
+                      recvRank,
+                      sendBuffer,
+                      recvBuffer,
+                      datatype,
+                      count,
+                      operation);
+    }
+}
+
+void MpiWorld::reduceInGroup(const std::vector<int>& ranks,
+                             int sendRank,
+                             int recvRank,
+                             uint8_t* sendBuffer,
+                             uint8_t* recvBuffer,
+                             faabric_datatype_t* datatype,
+                             int count,
+                             faabric_op_t* operation)
+{
+    // If we're the receiver, await inputs
+    if (sendRank == recvRank) {
+        SPDLOG_TRACE("MPI - reduce ({}) all -> {}", operation->id, recvRank);
+
+        size_t bufferSize = datatype->size * count;
+
+        bool isInPlace = sendBuffer == recvBuffer;
+
+        // If not receiving in-place, initialize the receive buffer to the send
+        // buffer values. This prevents issues when 0-initializing for operators
+        // like the minimum, or product.
         // If we're receiving from ourselves and in-place, our work is
         // already done and the results are written in the recv buffer
         if (!isInPlace) {
@@ -936,7 +1631,7 @@ void MpiWorld::reduce(int sendRank,
         }
 
         uint8_t* rankData = new uint8_t[bufferSize];
-        for (int r = 0; r < size; r++) {
+        for (int r : ranks) {
             // Work out the data for this rank
             memset(rankData, 0, bufferSize);
             if (r != recvRank) {
@@ -965,6 +1660,93 @@ void MpiWorld::reduce(int sendRank,
     }
 }
 
+// Each leader reduces the data from the ranks on its host, then sends the
+// partial result on to the root. This relies on all operations being
+// commutative, which is true of all the ones we support.
+void MpiWorld::reduceHierarchical(int sendRank,
+                                  int recvRank,
+                                  uint8_t* sendBuffer,
+                                  uint8_t* recvBuffer,
+                                  faabric_datatype_t* datatype,
+                                  int count,
+                                  faabric_op_t* operation)
+{
+    const std::vector<int>& localRanks =
+      ranksForHost.at(getHostForRank(sendRank));
+    int leader = getLocalLeader(sendRank, recvRank);
+
+    if (sendRank != leader) {
+        reduceInGroup(localRanks,
+                      sendRank,
+                      leader,
+                      sendBuffer,
+                      nullptr,
+                      datatype,
+                      count,
+                      operation);
+        return;
+    }
+
+    if (sendRank == recvRank) {
+        reduceInGroup(localRanks,
+                      sendRank,
+                      recvRank,
+                      sendBuffer,
+                      recvBuffer,
+                      datatype,
+                      count,
+                      operation);
+        reduceInGroup(getLeaders(recvRank),
+                      sendRank,
+                      recvRank,
+                      recvBuffer,
+                      recvBuffer,
+                      datatype,
+                      count,
+                      operation);
+        return;
+    }
+
+    std::vector<uint8_t> hostResult(datatype->size * count);
+    reduceInGroup(localRanks,
+                  sendRank,
+                  sendRank,
+                  sendBuffer,
+                  hostResult.data(),
+                  datatype,
+                  count,
+                  operation);
+    reduceInGroup(getLeaders(recvRank),
+                  sendRank,
+                  recvRank,
+                  hostResult.data(),
+                  nullptr,
+                  datatype,
+                  count,
+                  operation);
+}
+
+// Recursive doubling takes log2(size) steps, but sends the whole buffer at
+// each. The ring takes 2 * (size - 1) steps, each sending 1 / size of the
+// buffer, so is better for large buffers. When hosts have several ranks each,
+// the hierarchical reduce and broadcast send the buffer across hosts just
+// twice per host, whereas the other two have every rank send across hosts.
+std::string chooseAllReduceAlgorithm(int worldSize,
+                                     int count,
+                                     size_t bufferSize,
+                                     bool isHierarchical)
+{
+    if (isHierarchical) {
+        return "reduce_broadcast";
+    }
+
+    if (bufferSize >= MPI_ALLREDUCE_RING_MIN_BYTES && count >= worldSize) {
+        return "ring";
+    }
+
+    return "recursive_doubling";
+}
+
 void MpiWorld::allReduce(int rank,
                          uint8_t* sendBuffer,
                          uint8_t* recvBuffer,
@@ -972,24 +1754,214 @@ void MpiWorld::allReduce(int rank,
                          int count,
                          faabric_op_t* operation)
 {
-    // Rank 0 coordinates the allreduce operation
-    if (rank == 0) {
-        // Run the standard reduce
-        reduce(0, 0, sendBuffer, recvBuffer, datatype, count, operation);
+    std::string algorithm =
+      faabric::util::getSystemConfig().mpiAllReduceAlgorithm;
+    if (algorithm == "auto") {
+        algorithm = chooseAllReduceAlgorithm(
+          size, count, datatype->size * count, useHierarchicalCollectives());
+    }
 
-        // Broadcast the result
-        broadcast(
-          0, recvBuffer, datatype, count, faabric::MPIMessage::ALLREDUCE);
+    SPDLOG_TRACE("MPI - allreduce {} ({})", rank, algorithm);
+
+    if (algorithm == "reduce_broadcast") {
+        allReduceReduceBroadcast(
+          rank, sendBuffer, recvBuffer, datatype, count, operation);
+    } else if (algorithm == "recursive_doubling") {
+        allReduceRecursiveDoubling(
+          rank, sendBuffer, recvBuffer, datatype, count, operation);
+    } else if (algorithm == "ring") {
+        allReduceRing(rank, sendBuffer, recvBuffer, datatype, count, operation);
     } else {
-        // Run the standard reduce
-        reduce(rank, 0, sendBuffer, recvBuffer, datatype, count, operation);
+        SPDLOG_ERROR("Unrecognised allreduce algorithm: {}", algorithm);
+        throw std::runtime_error("Unrecognised allreduce algorithm");
+    }
+}
 
-        // Await the broadcast from the master
-        recv(0,
-             rank,
+void MpiWorld::allReduceReduceBroadcast(int rank,
+                                        uint8_t* sendBuffer,
+                                        uint8_t* recvBuffer,
+                                        faabric_datatype_t* datatype,
+                                        int count,
+                                        faabric_op_t* operation)
+{
+    // Rank 0 coordinates the allreduce operation
+    reduce(rank, 0, sendBuffer, recvBuffer, datatype, count, operation);
+
+    // Broadcast the result
+    broadcast(
+      0, rank, recvBuffer, datatype, count, faabric::MPIMessage::ALLREDUCE);
+}
+
+// At each step, ranks exchange their partial results with the rank whose
+// index differs in one bit, and both reduce them. If the world size isn't a
+// power of two, the even ranks among the first 2 * nExtra hand their data
+// to the next rank up beforehand, and get the result back at the end.
+void MpiWorld::allReduceRecursiveDoubling(int rank,
+                                          uint8_t* sendBuffer,
+                                          uint8_t* recvBuffer,
+                                          faabric_datatype_t* datatype,
+                                          int count,
+                                          faabric_op_t* operation)
+{
+    size_t bufferSize = datatype->size * count;
+    if (sendBuffer != recvBuffer) {
+        memcpy(recvBuffer, sendBuffer, bufferSize);
+    }
+
+    std::vector<uint8_t> partnerData(bufferSize);
+
+    int pow2Size = 1;
+    while (pow2Size * 2 <= size) {
+        pow2Size *= 2;
+    }
+    int nExtra = size - pow2Size;
+
+    // Work out our index among the ranks taking part in the exchanges
+    int exchangeRank = -1;
+    if (rank >= 2 * nExtra) {
+        exchangeRank = rank - nExtra;
+    } else if (rank % 2 == 0) {
+        send(rank,
+             rank + 1,
              recvBuffer,
              datatype,
              count,
+             faabric::MPIMessage::ALLREDUCE);
+    } else {
+        recv(rank - 1,
+             rank,
+             partnerData.data(),
+             datatype,
+             count,
+             nullptr,
+             faabric::MPIMessage::ALLREDUCE);
+        op_reduce(operation, datatype, count, partnerData.data(), recvBuffer);
+        exchangeRank = rank / 2;
+    }
+
+    if (exchangeRank >= 0) {
+        for (int mask = 1; mask < pow2Size; mask <<= 1) {
+            int partnerExchangeRank = exchangeRank ^ mask;
+            int partner = partnerExchangeRank < nExtra
+                            ? partnerExchangeRank * 2 + 1
+                            : partnerExchangeRank + nExtra;
+
+            send(rank,
+                 partner,
+                 recvBuffer,
+                 datatype,
+                 count,
+                 faabric::MPIMessage::ALLREDUCE);
+            recv(partner,
+                 rank,
+                 partnerData.data(),
+                 datatype,
+                 count,
+                 nullptr,
+                 faabric::MPIMessage::ALLREDUCE);
+            op_reduce(
+              operation, datatype, count, partnerData.data(), recvBuffer);
+        }
+    }
+
+    if (rank < 2 * nExtra) {
+        if (rank % 2 == 0) {
+            recv(rank + 1,
+                 rank,
+                 recvBuffer,
+                 datatype,
+                 count,
+                 nullptr,
+                 faabric::MPIMessage::ALLREDUCE);
+        } else {
+            send(rank,
+                 rank - 1,
+                 recvBuffer,
+                 datatype,
+                 count,
+                 faabric::MPIMessage::ALLREDUCE);
+        }
+    }
+}
+
+// The buffer is split into one chunk per rank. In the reduce-scatter phase,
+// each rank passes a chunk to the next rank round the ring, and reduces the
+// one it gets from the previous rank into its own. After (size - 1) steps,
+// each rank holds one fully reduced chunk, which are then passed round the
+// ring in the same way to finish.
+void MpiWorld::allReduceRing(int rank,
+                             uint8_t* sendBuffer,
+                             uint8_t* recvBuffer,
+                             faabric_datatype_t* datatype,
+                             int count,
+                             faabric_op_t* operation)
+{
+    if (sendBuffer != recvBuffer) {
+        memcpy(recvBuffer, sendBuffer, datatype->size * count);
+    }
+
+    if (size == 1) {
+        return;
+    }
+
+    // Spread any remainder over the first chunks
+    std::vector<int> chunkOffsets(size + 1, 0);
+    for (int c = 0; c < size; c++) {
+        int chunkCount = count / size + (c < count % size ? 1 : 0);
+        chunkOffsets[c + 1] = chunkOffsets[c] + chunkCount;
+    }
+
+    auto chunkPtr = [&](int c) {
+        return recvBuffer + (size_t)chunkOffsets[c] * datatype->size;
+    };
+    auto chunkCount = [&](int c) {
+        return chunkOffsets[c + 1] - chunkOffsets[c];
+    };
+
+    int nextRank = (rank + 1) % size;
+    int prevRank = (rank - 1 + size) % size;
+
+    std::vector<uint8_t> chunkData(chunkCount(0) * datatype->size);
+
+    for (int step = 0; step < size - 1; step++) {
+        int sendChunk = (rank - step + size) % size;
+        int recvChunk = (rank - step - 1 + size) % size;
+
+        send(rank,
+             nextRank,
+             chunkPtr(sendChunk),
+             datatype,
+             chunkCount(sendChunk),
+             faabric::MPIMessage::ALLREDUCE);
+        recv(prevRank,
+             rank,
+             chunkData.data(),
+             datatype,
+             chunkCount(recvChunk),
+             nullptr,
+             faabric::MPIMessage::ALLREDUCE);
+        op_reduce(operation,
+                  datatype,
+                  chunkCount(recvChunk),
+                  chunkData.data(),
+                  chunkPtr(recvChunk));
+    }
+
+    for (int step = 0; step < size - 1; step++) {
+        int sendChunk = (rank + 1 - step + size) % size;
+        int recvChunk = (rank - step + size) % size;
+
+        send(rank,
+             nextRank,
+             chunkPtr(sendChunk),
+             datatype,
+             chunkCount(sendChunk),
+             faabric::MPIMessage::ALLREDUCE);
+        recv(prevRank,
+             rank,
+             chunkPtr(recvChunk),
+             datatype,
+             chunkCount(recvChunk),
              nullptr,
              faabric::MPIMessage::ALLREDUCE);
     }
@@ -1003,97 +1975,16 @@ void MpiWorld::op_reduce(faabric_op_t* operation,
 {
     SPDLOG_TRACE(
       "MPI - reduce op: {} datatype {}", operation->id, datatype->id);
-    if (operation->id == faabric_op_max.id) {
-        if (datatype->id == FAABRIC_INT) {
-            auto inBufferCast = reinterpret_cast<int*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<int*>(outBuffer);
-
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] =
-                  std::max<int>(outBufferCast[slot], inBufferCast[slot]);
-            }
-        } else if (datatype->id == FAABRIC_DOUBLE) {
-            auto inBufferCast = reinterpret_cast<double*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<double*>(outBuffer);
-
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] =
-                  std::max<double>(outBufferCast[slot], inBufferCast[slot]);
-            }
-        } else if (datatype->id == FAABRIC_LONG_LONG) {
-            auto inBufferCast = reinterpret_cast<long long*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<long long*>(outBuffer);
-
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] =
-                  std::max<long long>(outBufferCast[slot], inBufferCast[slot]);
-            }
-        } else {
-            SPDLOG_ERROR("Unsupported type for max reduction (datatype={})",
-                         datatype->id);
-            throw std::runtime_error("Unsupported type for max reduction");
-        }
-    } else if (operation->id == faabric_op_min.id) {
-        if (datatype->id == FAABRIC_INT) {
-            auto inBufferCast = reinterpret_cast<int*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<int*>(outBuffer);
-
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] =
-                  std::min<int>(outBufferCast[slot], inBufferCast[slot]);
-            }
-        } else if (datatype->id == FAABRIC_DOUBLE) {
-            auto inBufferCast = reinterpret_cast<double*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<double*>(outBuffer);
-
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] =
-                  std::min<double>(outBufferCast[slot], inBufferCast[slot]);
-            }
-        } else if (datatype->id == FAABRIC_LONG_LONG) {
-            auto inBufferCast = reinterpret_cast<long long*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<long long*>(outBuffer);
 
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] =
-                  std::min<long long>(outBufferCast[slot], inBufferCast[slot]);
-            }
-        } else {
-            SPDLOG_ERROR("Unsupported type for min reduction (datatype={})",
-                         datatype->id);
-            throw std::runtime_error("Unsupported type for min reduction");
-        }
-    } else if (operation->id == faabric_op_sum.id) {
-        if (datatype->id == FAABRIC_INT) {
-            auto inBufferCast = reinterpret_cast<int*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<int*>(outBuffer);
-
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] += inBufferCast[slot];
-            }
-        } else if (datatype->id == FAABRIC_DOUBLE) {
-            auto inBufferCast = reinterpret_cast<double*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<double*>(outBuffer);
-
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] += inBufferCast[slot];
-            }
-        } else if (datatype->id == FAABRIC_LONG_LONG) {
-            auto inBufferCast = reinterpret_cast<long long*>(inBuffer);
-            auto outBufferCast = reinterpret_cast<long long*>(outBuffer);
-
-            for (int slot = 0; slot < count; slot++) {
-                outBufferCast[slot] += inBufferCast[slot];
-            }
-        } else {
-            SPDLOG_ERROR("Unsupported type for sum reduction (datatype={})",
-                         datatype->id);
-            throw std::runtime_error("Unsupported type for sum reduction");
-        }
-    } else {
-        SPDLOG_ERROR("Reduce operation not implemented: {}", operation->id);
-        throw std::runtime_error("Not yet implemented reduce operation");
+    MpiReduceKernel kernel = getMpiReduceKernel(operation->id, datatype->id);
+    if (kernel == nullptr) {
+        SPDLOG_ERROR("Unsupported reduce operation {} for datatype {}",
+                     operation->id,
+                     datatype->id);
+        throw std::runtime_error("Unsupported reduce operation for datatype");
     }
+
+    kernel(inBuffer, outBuffer, count);
 }
 
 void MpiWorld::scan(int rank,
@@ -1105,43 +1996,86 @@ void MpiWorld::scan(int rank,
 {
     SPDLOG_TRACE("MPI - scan");
 
+    doScan(rank, sendBuffer, recvBuffer, datatype, count, operation, false);
+}
+
+// As with MPI_Exscan, the receive buffer on rank 0 is left untouched
+void MpiWorld::exscan(int rank,
+                      uint8_t* sendBuffer,
+                      uint8_t* recvBuffer,
+                      faabric_datatype_t* datatype,
+                      int count,
+                      faabric_op_t* operation)
+{
+    SPDLOG_TRACE("MPI - exscan");
+
+    doScan(rank, sendBuffer, recvBuffer, datatype, count, operation, true);
+}
+
+// Each rank keeps the reduction of a contiguous run of ranks ending with its
+// own. In the round with distance d, it sends this on to rank + d, and extends
+// it with the run received from rank - d, so the runs double in length each
+// round and the scan finishes in log2(size) rounds. The runs received are
+// exactly the ranks before this one, so they also make up the exclusive scan.
+void MpiWorld::doScan(int rank,
+                      uint8_t* sendBuffer,
+                      uint8_t* recvBuffer,
+                      faabric_datatype_t* datatype,
+                      int count,
+                      faabric_op_t* operation,
+                      bool isExclusive)
+{
     if (rank > this->size - 1) {
         throw std::runtime_error(
           fmt::format("Rank {} bigger than world size {}", rank, this->size));
     }
 
-    bool isInPlace = sendBuffer == recvBuffer;
-
-    // Scan performs an inclusive prefix reduction, so our input values
-    // need also to be considered.
     size_t bufferSize = datatype->size * count;
-    if (!isInPlace) {
+
+    // For an inclusive scan the result is the run itself, so we can work in
+    // the receive buffer
+    std::vector<uint8_t> exclusiveRun;
+    uint8_t* run = recvBuffer;
+    if (isExclusive) {
+        exclusiveRun.assign(sendBuffer, sendBuffer + bufferSize);
+        run = exclusiveRun.data();
+    } else if (sendBuffer != recvBuffer) {
         memcpy(recvBuffer, sendBuffer, bufferSize);
     }
 
-    if (rank > 0) {
-        // Receive the current accumulated value
-        auto currentAcc = new uint8_t[bufferSize];
-        recv(rank - 1,
+    std::vector<uint8_t> received(bufferSize);
+    bool hasExclusiveResult = false;
+
+    for (int distance = 1; distance < size; distance <<= 1) {
+        if (rank + distance < size) {
+            send(rank,
+                 rank + distance,
+                 run,
+                 datatype,
+                 count,
+                 faabric::MPIMessage::SCAN);
+        }
+
+        if (rank - distance < 0) {
+            continue;
+        }
+
+        recv(rank - distance,
              rank,
-             currentAcc,
+             received.data(),
              datatype,
              count,
              nullptr,
              faabric::MPIMessage::SCAN);
-        // Reduce with our own value
-        op_reduce(operation, datatype, count, currentAcc, recvBuffer);
-        delete[] currentAcc;
-    }
 
-    // If not the last process, send to the next one
-    if (rank < this->size - 1) {
-        send(rank,
-             rank + 1,
-             recvBuffer,
-             MPI_INT,
-             count,
-             faabric::MPIMessage::SCAN);
+        if (isExclusive && hasExclusiveResult) {
+            op_reduce(operation, datatype, count, received.data(), recvBuffer);
+        } else if (isExclusive) {
+            memcpy(recvBuffer, received.data(), bufferSize);
+            hasExclusiveResult = true;
+        }
+
+        op_reduce(operation, datatype, count, received.data(), run);
     }
 }
 
@@ -1198,20 +2132,37 @@ void MpiWorld::allToAll(int rank,
     }
 }
 
-void MpiWorld::probe(int sendRank, int recvRank, MPI_Status* status)
+// Messages are taken off the queues until there's one that a receive with the
+// same parameters would match, which is left for that receive to take
+void MpiWorld::probe(int sendRank, int recvRank, MPI_Status* status, int tag)
 {
-    const std::shared_ptr<InMemoryMpiQueue>& queue =
-      getLocalQueue(sendRank, recvRank);
-    std::shared_ptr<faabric::MPIMessage> m = *(queue->peek());
+    checkRecvRanksRange(sendRank, recvRank);
+
+    MpiMessageMatcher& matcher = getMessageMatcher(recvRank);
+    std::shared_ptr<faabric::MPIMessage> m;
+    while ((m = matcher.peekUnexpected(
+              sendRank, tag, faabric::MPIMessage::NORMAL)) == nullptr) {
+        if (sendRank == MPI_ANY_SOURCE) {
+            progressRecvs(recvRank, allRanks);
+        } else {
+            progressRecv(sendRank, recvRank);
+        }
+    }
 
     faabric_datatype_t* datatype = getFaabricDatatypeFromId(m->type());
     status->bytesSize = m->count() * datatype->size;
     status->MPI_ERROR = 0;
     status->MPI_SOURCE = m->sender();
+    status->MPI_TAG = m->tag();
 }
 
 void MpiWorld::barrier(int thisRank)
 {
+    if (useHierarchicalCollectives()) {
+        barrierHierarchical(thisRank);
+        return;
+    }
+
     if (thisRank == 0) {
         // This is the root, hence just does the waiting
         SPDLOG_TRACE("MPI - barrier init {}", thisRank);
@@ -1225,7 +2176,7 @@ void MpiWorld::barrier(int thisRank)
         }
 
         // Broadcast that the barrier is done
-        broadcast(0, nullptr, MPI_INT, 0, faabric::MPIMessage::BARRIER_DONE);
+        broadcast(0, 0, nullptr, MPI_INT, 0, faabric::MPIMessage::BARRIER_DONE);
     } else {
         // Tell the root that we're waiting
         SPDLOG_TRACE("MPI - barrier join {}", thisRank);
@@ -1233,15 +2184,63 @@ void MpiWorld::barrier(int thisRank)
           thisRank, 0, nullptr, MPI_INT, 0, faabric::MPIMessage::BARRIER_JOIN);
 
         // Receive a message saying the barrier is done
-        recv(0,
-             thisRank,
+        broadcast(
+          0, thisRank, nullptr, MPI_INT, 0, faabric::MPIMessage::BARRIER_DONE);
+        SPDLOG_TRACE("MPI - barrier done {}", thisRank);
+    }
+}
+
+// Leaders join once all the ranks on their host have joined them, and the
+// root then broadcasts to the leaders, which pass it on
+void MpiWorld::barrierHierarchical(int thisRank)
+{
+    int root = 0;
+    int leader = getLocalLeader(thisRank, root);
+
+    if (thisRank != leader) {
+        SPDLOG_TRACE("MPI - barrier join {} -> {}", thisRank, leader);
+        send(thisRank,
+             leader,
              nullptr,
              MPI_INT,
              0,
-             nullptr,
-             faabric::MPIMessage::BARRIER_DONE);
-        SPDLOG_TRACE("MPI - barrier done {}", thisRank);
+             faabric::MPIMessage::BARRIER_JOIN);
+    } else {
+        std::vector<int> joinRanks = ranksForHost.at(getHostForRank(thisRank));
+        if (thisRank == root) {
+            for (int l : getLeaders(root)) {
+                if (l != root) {
+                    joinRanks.push_back(l);
+                }
+            }
+        }
+
+        for (int r : joinRanks) {
+            if (r != thisRank) {
+                recv(r,
+                     thisRank,
+                     nullptr,
+                     MPI_INT,
+                     0,
+                     nullptr,
+                     faabric::MPIMessage::BARRIER_JOIN);
+            }
+        }
+
+        if (thisRank != root) {
+            SPDLOG_TRACE("MPI - barrier join {} -> {}", thisRank, root);
+            send(thisRank,
+                 root,
+                 nullptr,
+                 MPI_INT,
+                 0,
+                 faabric::MPIMessage::BARRIER_JOIN);
+        }
     }
+
+    broadcast(
+      root, thisRank, nullptr, MPI_INT, 0, faabric::MPIMessage::BARRIER_DONE);
+    SPDLOG_TRACE("MPI - barrier done {}", thisRank);
 }
 
 std::shared_ptr<InMemoryMpiQueue> MpiWorld::getLocalQueue(int sendRank,
@@ -1262,101 +2261,398 @@ void MpiWorld::initLocalQueues()
     // Assert we only allocate queues once
     assert(localQueues.size() == 0);
     localQueues.resize(size * size);
+    localRendezvous.resize(size * size);
+    rendezvousCredits.resize(size * size);
+    rendezvousProgress =
+      std::make_unique<std::atomic<size_t>[]>(size * size);
+
+    faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+    rendezvousThreshold = std::max(conf.mpiRendezvousThreshold, 0);
+    eagerLimit = std::max(conf.mpiEagerLimit, 0);
+    chunkSize = std::max(conf.mpiChunkSize, 1);
     for (int recvRank = 0; recvRank < size; recvRank++) {
         if (getHostForRank(recvRank) == thisHost) {
             for (int sendRank = 0; sendRank < size; sendRank++) {
                 localQueues[getIndexForRanks(sendRank, recvRank)] =
                   std::make_shared<InMemoryMpiQueue>();
+                localRendezvous[getIndexForRanks(sendRank, recvRank)] =
+                  std::make_shared<LocalRendezvous>();
+            }
+        } else {
+            // Credit for rendezvous sends from local ranks to this one
+            for (int sendRank : ranksForHost.at(thisHost)) {
+                rendezvousCredits[getIndexForRanks(sendRank, recvRank)] =
+                  std::make_shared<faabric::util::SpscQueue<int>>();
             }
         }
     }
 }
 
-// Here we rely on the scheduler returning a list of hosts where equal
-// hosts are always contiguous with the exception of the master host
-// (thisHost) which may appear repeated at the end if the system is
-// overloaded.
+// Receives only match messages with the same message type and tag
+static int64_t getMatchKey(int tag,
+                           faabric::MPIMessage::MPIMessageType messageType)
+{
+    return ((int64_t)messageType << 32) | (uint32_t)tag;
+}
+
+// Receive buffers are only posted for messages above the threshold, and for
+// one message at a time on each pair of ranks. Messages with the receive's
+// type and tag go to the receives posted for them in order, so the buffer is
+// posted for the one after those that earlier receives will take. This
+// doesn't hold if there are wildcard receives, so none are posted then.
+void MpiWorld::postLocalRecvBuffer(
+  const MpiMessageMatcher::PendingRecv& pendingRecv,
+  int recvRank,
+  size_t bufferSize)
+{
+    if (pendingRecv.buffer == nullptr || rendezvousThreshold == 0 ||
+        bufferSize < rendezvousThreshold) {
+        return;
+    }
+
+    MpiMessageMatcher& matcher = getMessageMatcher(recvRank);
+    if (pendingRecv.isWildcard() || matcher.getNumPendingWildcards() > 0) {
+        return;
+    }
+
+    int sendRank = pendingRecv.source;
+    LocalRendezvous& rdv =
+      *localRendezvous[getIndexForRanks(sendRank, recvRank)];
+    if (rdv.postedTicket.load(std::memory_order_acquire) != -1) {
+        return;
+    }
+
+    // Nothing to do if the message has already been sent
+    long nAhead = matcher.getNumPending(
+                    sendRank, pendingRecv.tag, pendingRecv.messageType) -
+                  1;
+    if (getLocalQueueSize(sendRank, recvRank) > nAhead) {
+        return;
+    }
+
+    int64_t key = getMatchKey(pendingRecv.tag, pendingRecv.messageType);
+    rdv.postedKey.store(key, std::memory_order_relaxed);
+    rdv.postedSeq.store(rdv.recvSeqs[key] + nAhead, std::memory_order_relaxed);
+    rdv.buffer.store(pendingRecv.buffer, std::memory_order_relaxed);
+    rdv.capacity.store(bufferSize, std::memory_order_relaxed);
+    rdv.postedTicket.store(rdv.nextTicket++, std::memory_order_release);
+}
+
+// Called by whoever puts messages in the local queue, i.e. the sending rank if
+// it's local, or the background thread if not. This must be called for every
+// message, and if it returns a buffer, the caller must fill it before queueing
+// the message.
+uint8_t* MpiWorld::claimPostedRecvBuffer(
+  int sendRank,
+  int recvRank,
+  int tag,
+  faabric::MPIMessage::MPIMessageType messageType,
+  size_t bufferSize)
+{
+    // Nothing is ever posted, so no need to count messages
+    if (rendezvousThreshold == 0) {
+        return nullptr;
+    }
+
+    LocalRendezvous& rdv =
+      *localRendezvous[getIndexForRanks(sendRank, recvRank)];
+    int64_t key = getMatchKey(tag, messageType);
+    long seq = rdv.sendSeqs[key]++;
+
+    long ticket = rdv.postedTicket.load(std::memory_order_acquire);
+    if (bufferSize == 0 || ticket == -1) {
+        return nullptr;
+    }
+
+    // If the buffer is withdrawn and posted again while we look at it, the
+    // ticket changes and claiming it fails
+    if (rdv.postedSeq.load(std::memory_order_relaxed) != seq ||
+        rdv.postedKey.load(std::memory_order_relaxed) != key ||
+        rdv.capacity.load(std::memory_order_relaxed) < bufferSize) {
+        return nullptr;
+    }
+    uint8_t* recvBuffer = rdv.buffer.load(std::memory_order_relaxed);
+
+    if (!rdv.postedTicket.compare_exchange_strong(
+          ticket, -1, std::memory_order_acq_rel)) {
+        return nullptr;
+    }
+
+    return recvBuffer;
+}
+
+std::shared_ptr<faabric::MPIMessage> MpiWorld::dequeueLocal(int sendRank,
+                                                            int recvRank,
+                                                            long timeoutMs)
+{
+    std::shared_ptr<faabric::MPIMessage> m =
+      getLocalQueue(sendRank, recvRank)->dequeue(timeoutMs);
+
+    if (rendezvousThreshold == 0) {
+        return m;
+    }
+
+    // Withdraw the posted buffer if the sender didn't copy into it (e.g. as
+    // it sent before the buffer was posted)
+    LocalRendezvous& rdv =
+      *localRendezvous[getIndexForRanks(sendRank, recvRank)];
+    int64_t key = getMatchKey(m->tag(), m->messagetype());
+    long seq = rdv.recvSeqs[key]++;
+    long ticket = rdv.postedTicket.load(std::memory_order_acquire);
+    if (ticket != -1 && rdv.postedKey.load(std::memory_order_relaxed) == key &&
+        rdv.postedSeq.load(std::memory_order_relaxed) == seq) {
+        rdv.postedTicket.compare_exchange_strong(
+          ticket, -1, std::memory_order_acq_rel);
+    }
+
+    return m;
+}
+
+void MpiWorld::initRanksForHost()
+{
+    assert(rankHosts.size() == size);
+
+    allRanks.clear();
+    ranksForHost.clear();
+    for (int r = 0; r < size; r++) {
+        allRanks.push_back(r);
+        ranksForHost[rankHosts[r]].push_back(r);
+    }
+}
+
+// Only worth it when the world spans several hosts, and at least one of them
+// has more than one rank
+bool MpiWorld::useHierarchicalCollectives()
+{
+    return ranksForHost.size() > 1 && ranksForHost.size() < size;
+}
+
+// The root leads the ranks on its own host, and the lowest rank leads on
+// every other host
+int MpiWorld::getLocalLeader(int rank, int root)
+{
+    const std::string& host = getHostForRank(rank);
+    if (getHostForRank(root) == host) {
+        return root;
+    }
+
+    return ranksForHost.at(host).front();
+}
+
+std::vector<int> MpiWorld::getLeaders(int root)
+{
+    std::vector<int> leaders;
+    for (const auto& [host, ranks] : ranksForHost) {
+        leaders.push_back(getLocalLeader(ranks.front(), root));
+    }
+
+    std::sort(leaders.begin(), leaders.end());
+    return leaders;
+}
+
+// Each host gets its own port, just above the one used to share the
+// rank-to-host mapping, in the order in which it first appears
 std::vector<int> MpiWorld::initLocalBasePorts(
   const std::vector<std::string>& executedAt)
 {
     std::vector<int> basePortForRank;
     basePortForRank.reserve(size);
 
-    std::string lastHost = thisHost;
-    int lastPort = basePort;
+    std::unordered_map<std::string, int> portForHost;
     for (const auto& host : executedAt) {
-        if (host == thisHost) {
-            basePortForRank.push_back(basePort);
-        } else if (host == lastHost) {
-            basePortForRank.push_back(lastPort);
-        } else {
-            lastHost = host;
-            lastPort += size * size;
-            basePortForRank.push_back(lastPort);
+        auto it = portForHost.find(host);
+        if (it == portForHost.end()) {
+            int port = basePort + 1 + portForHost.size();
+            it = portForHost.emplace(host, port).first;
         }
+
+        basePortForRank.push_back(it->second);
     }
 
     assert(basePortForRank.size() == size);
     return basePortForRank;
 }
 
-std::shared_ptr<faabric::MPIMessage>
-MpiWorld::recvBatchReturnLast(int sendRank, int recvRank, int batchSize)
+int MpiWorld::postRecv(int sendRank,
+                       int recvRank,
+                       uint8_t* buffer,
+                       faabric_datatype_t* dataType,
+                       int count,
+                       faabric::MPIMessage::MPIMessageType messageType,
+                       int tag)
 {
-    std::shared_ptr<faabric::scheduler::MpiMessageBuffer> umb =
-      getUnackedMessageBuffer(sendRank, recvRank);
-
-    // When calling from recv, we set the batch size to zero and work
-    // out the total here. We want to acknowledge _all_ unacknowleged messages
-    // _and then_ receive ours (which is not in the MMB).
-    if (batchSize == 0) {
-        batchSize = umb->getTotalUnackedMessages() + 1;
+    MpiMessageMatcher::PendingRecv pendingRecv;
+    pendingRecv.requestId = (int)faabric::util::generateGid();
+    pendingRecv.source = sendRank;
+    pendingRecv.tag = tag;
+    pendingRecv.messageType = messageType;
+    pendingRecv.buffer = buffer;
+    pendingRecv.dataType = dataType;
+    pendingRecv.count = count;
+
+    // If no message that has already arrived matches, let the sender copy
+    // large messages straight into our buffer
+    const MpiMessageMatcher::PendingRecv& posted =
+      getMessageMatcher(recvRank).postRecv(pendingRecv);
+    if (!posted.isMatched()) {
+        postLocalRecvBuffer(posted, recvRank, dataType->size * count);
     }
 
-    // Work out whether the message is sent locally or from another host
-    assert(thisHost == getHostForRank(recvRank));
-    const std::string otherHost = getHostForRank(sendRank);
-    bool isLocal = otherHost == thisHost;
+    return pendingRecv.requestId;
+}
 
-    // Recv message: first we receive all messages for which there is an id
-    // in the unacknowleged buffer but no msg. Note that these messages
-    // (batchSize - 1) were `irecv`-ed before ours.
-    std::shared_ptr<faabric::MPIMessage> ourMsg;
-    auto msgIt = umb->getFirstNullMsg();
-    if (isLocal) {
-        // First receive messages that happened before us
-        for (int i = 0; i < batchSize - 1; i++) {
-            SPDLOG_TRACE("MPI - pending recv {} -> {}", sendRank, recvRank);
-            auto pendingMsg = getLocalQueue(sendRank, recvRank)->dequeue();
-
-            // Put the unacked message in the UMB
-            assert(!msgIt->isAcknowledged());
-            msgIt->acknowledge(pendingMsg);
-            msgIt++;
+void MpiWorld::awaitRecv(int recvRank, int requestId, MPI_Status* status)
+{
+    MpiMessageMatcher& matcher = getMessageMatcher(recvRank);
+    MpiMessageMatcher::PendingRecv* pendingRecv = matcher.getRecv(requestId);
+    assert(pendingRecv != nullptr);
+
+    // Messages taken off the queues before ours may match other receives, or
+    // none yet, in which case the matcher keeps them
+    while (!pendingRecv->isMatched()) {
+        if (pendingRecv->source == MPI_ANY_SOURCE) {
+            progressRecvs(recvRank, allRanks);
+        } else {
+            progressRecv(pendingRecv->source, recvRank);
         }
+    }
+
+    doRecv(pendingRecv->msg,
+           pendingRecv->buffer,
+           pendingRecv->dataType,
+           pendingRecv->count,
+           status,
+           pendingRecv->messageType);
+
+    matcher.removeRecv(requestId);
+}
+
+// Receives are ready to complete once matched, and sends straight away
+bool MpiWorld::isAsyncRequestReady(int requestId, int& recvRank)
+{
+    if (iSendRequests.find(requestId) != iSendRequests.end()) {
+        return true;
+    }
 
-        // Finally receive the message corresponding to us
+    auto it = reqIdToRanks.find(requestId);
+    if (it == reqIdToRanks.end()) {
+        SPDLOG_ERROR("Asynchronous request id not recognized: {}", requestId);
+        throw std::runtime_error("Unrecognized async request id");
+    }
+
+    recvRank = it->second.second;
+    return getMessageMatcher(recvRank).getRecv(requestId)->isMatched();
+}
+
+std::vector<int> MpiWorld::getPendingSendRanks(int recvRank)
+{
+    std::vector<int> sendRanks =
+      getMessageMatcher(recvRank).getPendingSources();
+    if (!sendRanks.empty() && sendRanks.front() == MPI_ANY_SOURCE) {
+        return allRanks;
+    }
+
+    return sendRanks;
+}
+
+// Takes the next message from the sending rank off its queue, and hands it to
+// the matcher
+int MpiWorld::progressRecv(int sendRank, int recvRank)
+{
+    assert(thisHost == getHostForRank(recvRank));
+
+    std::shared_ptr<faabric::MPIMessage> m;
+    if (getHostForRank(sendRank) == thisHost) {
         SPDLOG_TRACE("MPI - recv {} -> {}", sendRank, recvRank);
-        ourMsg = getLocalQueue(sendRank, recvRank)->dequeue();
+        m = dequeueLocal(sendRank, recvRank);
     } else {
-        // First receive messages that happened before us
-        for (int i = 0; i < batchSize - 1; i++) {
-            SPDLOG_TRACE(
-              "MPI - pending remote recv {} -> {}", sendRank, recvRank);
-            auto pendingMsg = recvRemoteMpiMessage(sendRank, recvRank);
-
-            // Put the unacked message in the UMB
-            assert(!msgIt->isAcknowledged());
-            msgIt->acknowledge(pendingMsg);
-            msgIt++;
+        SPDLOG_TRACE("MPI - recv remote {} -> {}", sendRank, recvRank);
+        m = recvRemoteMpiMessage(sendRank, recvRank);
+    }
+
+    return getMessageMatcher(recvRank).addMessage(std::move(m));
+}
+
+// Takes whatever has arrived from any of the sending ranks, blocking until
+// there's at least one message. There's no single queue to wait on for more
+// than one rank, so we poll them all in turn, yielding between rounds. Each
+// queue is drained in its own order, but there is no ordering between
+// sending ranks beyond the order in which they're polled.
+std::vector<int> MpiWorld::progressRecvs(int recvRank,
+                                         const std::vector<int>& sendRanks)
+{
+    std::vector<int> matched;
+    if (sendRanks.size() == 1) {
+        int requestId = progressRecv(sendRanks.front(), recvRank);
+        if (requestId != -1) {
+            matched.push_back(requestId);
         }
+        pollRecvs(recvRank, sendRanks, matched);
 
-        // Finally receive the message corresponding to us
-        SPDLOG_TRACE("MPI - recv remote {} -> {}", sendRank, recvRank);
-        ourMsg = recvRemoteMpiMessage(sendRank, recvRank);
+        return matched;
     }
 
-    return ourMsg;
+    bool hasRemoteRanks =
+      std::any_of(sendRanks.begin(), sendRanks.end(), [this](int sendRank) {
+          return getHostForRank(sendRank) != thisHost;
+      });
+    long timeoutMs =
+      hasRemoteRanks ? DEFAULT_RECV_TIMEOUT_MS : DEFAULT_QUEUE_TIMEOUT_MS;
+
+    // As with single receives, large rendezvous messages still arriving
+    // restart the wait
+    auto getProgress = [this, recvRank, &sendRanks]() {
+        size_t progress = 0;
+        for (int sendRank : sendRanks) {
+            progress += rendezvousProgress[getIndexForRanks(sendRank, recvRank)]
+                          .load(std::memory_order_relaxed);
+        }
+        return progress;
+    };
+
+    faabric::util::TimePoint tp = faabric::util::startTimer();
+    size_t lastProgress = getProgress();
+    while (pollRecvs(recvRank, sendRanks, matched) == 0) {
+        if (faabric::util::getTimeDiffMillis(tp) > timeoutMs) {
+            size_t currentProgress = getProgress();
+            if (currentProgress == lastProgress) {
+                throw faabric::util::QueueTimeoutException(
+                  "Timeout waiting for message from any of the ranks");
+            }
+
+            lastProgress = currentProgress;
+            tp = faabric::util::startTimer();
+        }
+
+        std::this_thread::yield();
+    }
+
+    return matched;
+}
+
+// Takes whatever has already arrived from the sending ranks without blocking,
+// in the order it arrived on each queue. Returns the number of messages taken.
+int MpiWorld::pollRecvs(int recvRank,
+                        const std::vector<int>& sendRanks,
+                        std::vector<int>& matched)
+{
+    assert(thisHost == getHostForRank(recvRank));
+
+    MpiMessageMatcher& matcher = getMessageMatcher(recvRank);
+    int nMessages = 0;
+    for (int sendRank : sendRanks) {
+        long nArrived = getLocalQueueSize(sendRank, recvRank);
+        for (long i = 0; i < nArrived; i++) {
+            int requestId =
+              matcher.addMessage(dequeueLocal(sendRank, recvRank));
+            if (requestId != -1) {
+                matched.push_back(requestId);
+            }
+        }
+        nMessages += nArrived;
+    }
+
+    return nMessages;
 }
 
 int MpiWorld::getIndexForRanks(int sendRank, int recvRank)
@@ -1417,4 +2713,10 @@ void MpiWorld::checkRanksRange(int sendRank, int recvRank)
         throw std::runtime_error("Recv rank outside range");
     }
 }
+
+void MpiWorld::checkRecvRanksRange(int sendRank, int recvRank)
+{
+    checkRanksRange(sendRank == MPI_ANY_SOURCE ? recvRank : sendRank,
+                    recvRank);
+}
 }
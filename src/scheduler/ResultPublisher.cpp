@@ -0,0 +1,183 @@
+#include <faabric/redis/Redis.h>
+#include <faabric/scheduler/ResultPublisher.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+
+namespace faabric::scheduler {
+
+ResultPublisher::ResultPublisher() {}
+
+ResultPublisher::~ResultPublisher()
+{
+    stop();
+}
+
+void ResultPublisher::publish(const faabric::Message& msg, bool enqueueResult)
+{
+    faabric::util::UniqueLock lock(mx);
+
+    // Don't queue anything, or start a new thread, while stop is joining the
+    // publisher. The result is written directly instead.
+    if (stopping) {
+        lock.unlock();
+
+        SPDLOG_DEBUG("Publisher stopping, writing result {} directly",
+                     msg.id());
+        writeBatch({ { msg, enqueueResult } });
+        return;
+    }
+
+    if (!running) {
+        faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+        batchSize = std::max(conf.resultBatchSize, 1);
+        flushInterval = std::chrono::microseconds(conf.resultFlushIntervalUs);
+
+        SPDLOG_DEBUG("Starting result publisher (batch {}, interval {}us)",
+                     batchSize,
+                     conf.resultFlushIntervalUs);
+
+        running = true;
+        publisherThread = std::thread(&ResultPublisher::run, this);
+    }
+
+    if (pending.empty()) {
+        pendingStart = faabric::util::startTimer();
+    }
+
+    pending.push_back({ msg, enqueueResult });
+    publishedCount++;
+
+    // Wake the publisher to start the time window, or when the batch is full
+    if (pending.size() == 1 || pending.size() >= batchSize) {
+        pendingCv.notify_one();
+    }
+}
+
+void ResultPublisher::flush()
+{
+    faabric::util::UniqueLock lock(mx);
+    if (!running) {
+        return;
+    }
+
+    long target = publishedCount;
+    flushRequested = true;
+    pendingCv.notify_one();
+
+    writtenCv.wait(lock, [this, target] { return writtenCount >= target; });
+}
+
+void ResultPublisher::stop()
+{
+    {
+        faabric::util::UniqueLock lock(mx);
+        if (!running || stopping) {
+            return;
+        }
+
+        running = false;
+        stopping = true;
+        pendingCv.notify_one();
+    }
+
+    // The publisher writes everything outstanding before it exits
+    if (publisherThread.joinable()) {
+        publisherThread.join();
+    }
+
+    faabric::util::UniqueLock lock(mx);
+    stopping = false;
+}
+
+ResultPublisherStats ResultPublisher::getStats()
+{
+    faabric::util::UniqueLock lock(mx);
+    return stats;
+}
+
+void ResultPublisher::run()
+{
+    std::vector<PendingResult> batch;
+
+    while (true) {
+        faabric::util::TimePoint batchStart;
+        {
+            faabric::util::UniqueLock lock(mx);
+
+            pendingCv.wait(lock,
+                           [this] { return !running || !pending.empty(); });
+
+            if (pending.empty()) {
+                break;
+            }
+
+            pendingCv.wait_until(lock, pendingStart + flushInterval, [this] {
+                return !running || flushRequested ||
+                       pending.size() >= batchSize;
+            });
+
+            std::swap(batch, pending);
+            batchStart = pendingStart;
+            flushRequested = false;
+        }
+
+        try {
+            writeBatch(batch);
+        } catch (std::exception& e) {
+            SPDLOG_ERROR("Failed to publish {} results: {}",
+                         batch.size(),
+                         e.what());
+
+            // Drop any unread replies from the pipeline
+            redis::Redis::getQueue().refresh();
+        }
+
+        long flushMicros = faabric::util::getTimeDiffMicros(batchStart);
+
+        {
+            faabric::util::UniqueLock lock(mx);
+            writtenCount += batch.size();
+
+            stats.nFlushes++;
+            stats.nResults += batch.size();
+            stats.lastFlushMicros = flushMicros;
+            stats.maxFlushMicros = std::max(stats.maxFlushMicros, flushMicros);
+            stats.totalFlushMicros += flushMicros;
+        }
+
+        writtenCv.notify_all();
+
+        SPDLOG_TRACE("Published {} results in {}us", batch.size(), flushMicros);
+
+        batch.clear();
+    }
+}
+
+void ResultPublisher::writeBatch(const std::vector<PendingResult>& batch)
+{
+    redis::Redis& redis = redis::Redis::getQueue();
+
+    long nCommands = 0;
+    for (const auto& r : batch) {
+        std::vector<uint8_t> bytes = faabric::util::messageToBytes(r.msg);
+
+        if (r.enqueueResult) {
+            redis.enqueueBytesPipeline(
+              r.msg.resultkey(), bytes.data(), bytes.size());
+            redis.expirePipeline(r.msg.resultkey(), RESULT_KEY_EXPIRY);
+            nCommands += 2;
+        }
+
+        redis.setPipeline(r.msg.statuskey(), bytes.data(), bytes.size());
+        redis.expirePipeline(r.msg.statuskey(), STATUS_KEY_EXPIRY);
+        nCommands += 2;
+    }
+
+    redis.flushPipeline(nCommands);
+}
+}
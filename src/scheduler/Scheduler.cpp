@@ -5,6 +5,7 @@
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/snapshot/SnapshotClient.h>
 #include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/dirty.h>
 #include <faabric/util/environment.h>
 #include <faabric/util/func.h>
 #include <faabric/util/logging.h>
@@ -17,6 +18,7 @@
 #include <unordered_set>
 
 #define FLUSH_TIMEOUT_MS 10000
+#define DISPATCH_POOL_SIZE 8
 
 using namespace faabric::util;
 using namespace faabric::snapshot;
@@ -35,6 +37,9 @@ static thread_local std::unordered_map<std::string,
                                        faabric::snapshot::SnapshotClient>
   snapshotClients;
 
+// The epoch of each host when this dispatch thread last used its clients
+static thread_local std::unordered_map<std::string, int> dispatchHostEpochsSeen;
+
 Scheduler& getScheduler()
 {
     static Scheduler sch;
@@ -47,7 +52,9 @@ Scheduler::Scheduler()
 {
     // Set up the initial resources
     int cores = faabric::util::getUsableCores();
-    thisHostResources.set_slots(cores);
+    thisHostSlots = cores;
+
+    policy = getSchedulingPolicy(conf.schedulingPolicy);
 }
 
 std::set<std::string> Scheduler::getAvailableHosts()
@@ -66,6 +73,10 @@ void Scheduler::removeHostFromGlobalSet(const std::string& host)
 {
     redis::Redis& redis = redis::Redis::getQueue();
     redis.srem(AVAILABLE_HOST_SET, host);
+
+    if (host != thisHost) {
+        resetDispatchHost(host);
+    }
 }
 
 void Scheduler::addHostToGlobalSet()
@@ -89,31 +100,69 @@ void Scheduler::reset()
 
     resetThreadLocalCache();
 
+    // Take ownership of all executors, then shut them down without holding
+    // the lock, as their threads may call back into the scheduler. Clearing
+    // the per-function state here means any such calls will start afresh.
+    std::unordered_map<std::string, std::vector<std::shared_ptr<Executor>>>
+      executorsToFinish;
+    std::vector<std::shared_ptr<Executor>> deadExecutorsToFinish;
+    {
+        faabric::util::FullLock lock(mx);
+        std::swap(executorsToFinish, executors);
+        std::swap(deadExecutorsToFinish, deadExecutors);
+
+        functionMutexes.clear();
+        registeredHosts.clear();
+    }
+
     // Shut down all Executors
-    for (auto& p : executors) {
+    for (auto& p : executorsToFinish) {
         for (auto& e : p.second) {
             e->finish();
         }
     }
 
-    for (auto& e : deadExecutors) {
+    for (auto& e : deadExecutorsToFinish) {
         e->finish();
     }
 
-    executors.clear();
+    // Make sure results from the executors have been written
+    resultPublisher.flush();
+
+    faabric::util::FullLock lock(mx);
+
+    // Executors may have died while we were shutting the others down
     deadExecutors.clear();
 
     // Ensure host is set correctly
     thisHost = faabric::util::getSystemConfig().endpointHost;
 
     // Reset resources
-    thisHostResources = faabric::HostResources();
-    thisHostResources.set_slots(faabric::util::getUsableCores());
+    thisHostSlots = faabric::util::getUsableCores();
+    thisHostUsedSlots = 0;
 
     // Reset scheduler state
+    policy = getSchedulingPolicy(conf.schedulingPolicy);
     availableHostsCache.clear();
-    registeredHosts.clear();
-    threadResults.clear();
+    availableHostsRefreshedMillis = 0;
+    snapshotHosts.clear();
+    lastPublishedUsedSlots = 0;
+
+    {
+        faabric::util::UniqueLock resourcesLock(hostResourcesMx);
+        hostResources.clear();
+    }
+
+    {
+        faabric::util::UniqueLock resultsLock(threadResultsMx);
+        threadResults.clear();
+    }
+
+    {
+        faabric::util::UniqueLock resultsLock(functionResultsMx);
+        functionResults.clear();
+        lastFunctionResultsPruneMillis = 0;
+    }
 
     // Records
     recordedMessagesAll.clear();
@@ -123,72 +172,197 @@ void Scheduler::reset()
 
 void Scheduler::shutdown()
 {
+    stopResourcePublisher();
+
+    stopDispatchThreads();
+
     reset();
 
+    resultPublisher.stop();
+
     removeHostFromGlobalSet(thisHost);
 }
 
+std::shared_ptr<std::mutex> Scheduler::getFunctionMutex(
+  const std::string& funcStr)
+{
+    {
+        faabric::util::SharedLock lock(mx);
+        auto it = functionMutexes.find(funcStr);
+        if (it != functionMutexes.end()) {
+            return it->second;
+        }
+    }
+
+    faabric::util::FullLock lock(mx);
+
+    // Set up all the per-function state at once, so that lookups made while
+    // holding the function mutex never have to insert
+    executors[funcStr];
+    registeredHosts[funcStr];
+
+    std::shared_ptr<std::mutex>& funcMx = functionMutexes[funcStr];
+    if (funcMx == nullptr) {
+        funcMx = std::make_shared<std::mutex>();
+    }
+
+    return funcMx;
+}
+
+// Callers must hold the function mutex. References into the map remain valid
+// when other functions are inserted, so we only need the shared lock for the
+// lookup itself. The entry is only missing if the scheduler has been reset
+// since the caller took the function mutex, in which case we start afresh.
+std::vector<std::shared_ptr<Executor>>& Scheduler::getFunctionExecutors(
+  const std::string& funcStr)
+{
+    {
+        faabric::util::SharedLock lock(mx);
+        auto it = executors.find(funcStr);
+        if (it != executors.end()) {
+            return it->second;
+        }
+    }
+
+    faabric::util::FullLock lock(mx);
+    return executors[funcStr];
+}
+
+std::set<std::string> Scheduler::getRegisteredHosts(const std::string& funcStr)
+{
+    std::shared_ptr<std::mutex> funcMx = getFunctionMutex(funcStr);
+    faabric::util::UniqueLock funcLock(*funcMx);
+
+    faabric::util::SharedLock lock(mx);
+    auto it = registeredHosts.find(funcStr);
+    if (it == registeredHosts.end()) {
+        return {};
+    }
+
+    return it->second;
+}
+
+void Scheduler::registerHost(const std::string& funcStr,
+                             const std::string& host)
+{
+    std::shared_ptr<std::mutex> funcMx = getFunctionMutex(funcStr);
+    faabric::util::UniqueLock funcLock(*funcMx);
+
+    SPDLOG_DEBUG("Registering {} for {}", host, funcStr);
+
+    faabric::util::FullLock lock(mx);
+    registeredHosts[funcStr].insert(host);
+}
+
 long Scheduler::getFunctionExecutorCount(const faabric::Message& msg)
 {
     const std::string funcStr = faabric::util::funcToString(msg, false);
-    return executors[funcStr].size();
+
+    std::shared_ptr<std::mutex> funcMx = getFunctionMutex(funcStr);
+    faabric::util::UniqueLock funcLock(*funcMx);
+
+    return getFunctionExecutors(funcStr).size();
 }
 
 int Scheduler::getFunctionRegisteredHostCount(const faabric::Message& msg)
 {
     const std::string funcStr = faabric::util::funcToString(msg, false);
-    return (int)registeredHosts[funcStr].size();
+    return (int)getRegisteredHosts(funcStr).size();
 }
 
 std::set<std::string> Scheduler::getFunctionRegisteredHosts(
   const faabric::Message& msg)
 {
     const std::string funcStr = faabric::util::funcToString(msg, false);
-    return registeredHosts[funcStr];
+    return getRegisteredHosts(funcStr);
 }
 
 void Scheduler::removeRegisteredHost(const std::string& host,
                                      const faabric::Message& msg)
 {
     const std::string funcStr = faabric::util::funcToString(msg, false);
-    registeredHosts[funcStr].erase(host);
+
+    std::shared_ptr<std::mutex> funcMx = getFunctionMutex(funcStr);
+    faabric::util::UniqueLock funcLock(*funcMx);
+
+    faabric::util::SharedLock lock(mx);
+    auto it = registeredHosts.find(funcStr);
+    if (it != registeredHosts.end()) {
+        it->second.erase(host);
+    }
+}
+
+int Scheduler::claimLocalSlots(int nRequested)
+{
+    int32_t usedSlots = thisHostUsedSlots.load();
+    int nClaimed;
+    do {
+        // Work out available cores, flooring at zero
+        int available = thisHostSlots.load() - usedSlots;
+        available = std::max<int>(available, 0);
+
+        // Claim as many as we can
+        nClaimed = std::min<int>(available, nRequested);
+    } while (!thisHostUsedSlots.compare_exchange_weak(usedSlots,
+                                                      usedSlots + nClaimed));
+
+    notifyLocalSlotsChanged();
+
+    return nClaimed;
 }
 
 void Scheduler::vacateSlot()
 {
-    faabric::util::FullLock lock(mx);
-    thisHostResources.set_usedslots(thisHostResources.usedslots() - 1);
+    thisHostUsedSlots.fetch_sub(1);
+
+    notifyLocalSlotsChanged();
 }
 
 void Scheduler::notifyExecutorShutdown(Executor* exec,
                                        const faabric::Message& msg)
 {
-    faabric::util::FullLock lock(mx);
-
     SPDLOG_TRACE("Shutting down executor {}", exec->id);
 
     std::string funcStr = faabric::util::funcToString(msg, false);
 
-    // Find in list of executors
-    int execIdx = -1;
-    std::vector<std::shared_ptr<Executor>>& thisExecutors = executors[funcStr];
-    for (int i = 0; i < thisExecutors.size(); i++) {
-        if (thisExecutors.at(i)->id == exec->id) {
-            execIdx = i;
-            break;
+    bool noneRemaining = false;
+    {
+        std::shared_ptr<std::mutex> funcMx = getFunctionMutex(funcStr);
+        faabric::util::UniqueLock funcLock(*funcMx);
+
+        // Find in list of executors
+        int execIdx = -1;
+        std::vector<std::shared_ptr<Executor>>& thisExecutors =
+          getFunctionExecutors(funcStr);
+        for (int i = 0; i < thisExecutors.size(); i++) {
+            if (thisExecutors.at(i)->id == exec->id) {
+                execIdx = i;
+                break;
+            }
+        }
+
+        // If the scheduler is being reset it will already have taken
+        // ownership of this executor
+        if (execIdx < 0) {
+            SPDLOG_DEBUG("Executor {} already removed from scheduler",
+                         exec->id);
+            return;
         }
-    }
 
-    // We assume it's been found or something has gone very wrong
-    assert(execIdx >= 0);
+        // Record as dead, remove from live executors
+        // Note that this is necessary as this method may be called from a
+        // worker thread, so we can't fully clean up the executor without
+        // having a deadlock
+        {
+            faabric::util::FullLock lock(mx);
+            deadExecutors.emplace_back(thisExecutors.at(execIdx));
+        }
+        thisExecutors.erase(thisExecutors.begin() + execIdx);
 
-    // Record as dead, remove from live executors
-    // Note that this is necessary as this method may be called from a worker
-    // thread, so we can't fully clean up the executor without having a deadlock
-    deadExecutors.emplace_back(thisExecutors.at(execIdx));
-    thisExecutors.erase(thisExecutors.begin() + execIdx);
+        noneRemaining = thisExecutors.empty();
+    }
 
-    if (thisExecutors.empty()) {
+    if (noneRemaining) {
         SPDLOG_TRACE("No remaining executors for {}", funcStr);
 
         // Unregister if this was the last executor for that function
@@ -223,9 +397,6 @@ std::vector<std::string> Scheduler::callFunctions(
         throw std::runtime_error("Message with no master host");
     }
 
-    // TODO - more granular locking, this is incredibly conservative
-    faabric::util::FullLock lock(mx);
-
     // If we're not the master host, we need to forward the request back to the
     // master host. This will only happen if a nested batch execution happens.
     std::vector<int> localMessageIdxs;
@@ -237,29 +408,63 @@ std::vector<std::string> Scheduler::callFunctions(
         return executed;
     }
 
+    // As the master, results for these functions will be sent back to us. We
+    // only hold them in memory if the caller is on this host, i.e. this isn't
+    // a batch forwarded from elsewhere, otherwise the waiter on the other
+    // host would never see them in Redis.
+    if (!isThreads && !forceLocal && masterHost == thisHost) {
+        registerFunctionResults(req);
+    }
+
     if (forceLocal) {
         // We're forced to execute locally here so we do all the messages
         for (int i = 0; i < nMessages; i++) {
             localMessageIdxs.emplace_back(i);
             executed.at(i) = thisHost;
         }
+
+        int32_t usedSlots = thisHostUsedSlots.fetch_add(nMessages) + nMessages;
+
+        // If the master has sent us more than we can handle, its view of our
+        // resources is out of date. We reject the over-allocation by pushing
+        // our real resources straight back, so that it stops sending work
+        // here. The messages themselves are still queued locally.
+        if (masterHost != thisHost && usedSlots > thisHostSlots.load()) {
+            SPDLOG_DEBUG("Over-allocated by {} ({}/{} slots), notifying {}",
+                         masterHost,
+                         usedSlots,
+                         thisHostSlots.load(),
+                         masterHost);
+
+            faabric::PushResourcesRequest resReq;
+            resReq.set_host(thisHost);
+            *resReq.mutable_resources() = getThisHostResources();
+            getFunctionCallClient(masterHost).pushResources(resReq);
+        }
+
+        notifyLocalSlotsChanged();
     } else {
         // At this point we know we're the master host, and we've not been
         // asked to force full local execution.
 
-        // Get a list of other registered hosts
-        std::set<std::string>& thisRegisteredHosts = registeredHosts[funcStr];
+        // Get a copy of the other registered hosts. Note that we don't hold
+        // any locks from here on, as we may make several network calls.
+        std::set<std::string> thisRegisteredHosts = getRegisteredHosts(funcStr);
 
         // For threads/ processes we need to have a snapshot key and be
         // ready to push the snapshot to other hosts.
-        // We also have to broadcast the latest snapshots to all registered
-        // hosts, regardless of whether they're going to execute a function.
-        // This ensures everything is up to date, and we don't have to
-        // maintain different records of which hosts hold which updates.
+        // We also have to broadcast the latest snapshots to all hosts holding
+        // the snapshot, regardless of whether they're going to execute a
+        // function. This ensures everything is up to date, and we don't have
+        // to maintain different records of which hosts hold which updates.
         faabric::util::SnapshotData snapshotData;
         std::string snapshotKey = firstMsg.snapshotkey();
         bool snapshotNeeded =
           req->type() == req->THREADS || req->type() == req->PROCESSES;
+        std::set<std::string> thisSnapshotHosts;
+
+        // Requests sent to other hosts, which we wait on all at once
+        std::vector<std::future<void>> dispatches;
 
         if (snapshotNeeded) {
             if (snapshotKey.empty()) {
@@ -271,19 +476,28 @@ std::vector<std::string> Scheduler::callFunctions(
             snapshotData =
               faabric::snapshot::getSnapshotRegistry().getSnapshot(snapshotKey);
 
-            if (!thisRegisteredHosts.empty()) {
+            thisSnapshotHosts = getSnapshotHosts(snapshotKey);
+
+            std::set<std::string> diffHosts = thisRegisteredHosts;
+            diffHosts.insert(thisSnapshotHosts.begin(),
+                             thisSnapshotHosts.end());
+
+            if (!diffHosts.empty()) {
                 std::vector<faabric::util::SnapshotDiff> snapshotDiffs =
                   snapshotData.getDirtyPages();
 
                 // Do the snapshot diff pushing
                 if (!snapshotDiffs.empty()) {
-                    for (const auto& h : thisRegisteredHosts) {
+                    for (const auto& h : diffHosts) {
                         SPDLOG_DEBUG("Pushing {} snapshot diffs for {} to {}",
                                      snapshotDiffs.size(),
                                      funcStr,
                                      h);
-                        SnapshotClient& c = getSnapshotClient(h);
-                        c.pushSnapshotDiffs(snapshotKey, snapshotDiffs);
+                        dispatches.emplace_back(dispatchToHost(
+                          h, [this, h, snapshotKey, snapshotDiffs] {
+                              SnapshotClient& c = getSnapshotClient(h);
+                              c.pushSnapshotDiffs(snapshotKey, snapshotDiffs);
+                          }));
                     }
                 }
 
@@ -292,74 +506,87 @@ std::vector<std::string> Scheduler::callFunctions(
                 // updates sent back from all the threads)
                 SPDLOG_DEBUG("Resetting dirty tracking after pushing diffs {}",
                              funcStr);
-                faabric::util::resetDirtyTracking();
-            }
-        }
-
-        // Work out how many we can handle locally
-        int nLocally;
-        {
-            int slots = thisHostResources.slots();
-
-            // Work out available cores, flooring at zero
-            int available = slots - thisHostResources.usedslots();
-            available = std::max<int>(available, 0);
-
-            // Claim as many as we can
-            nLocally = std::min<int>(available, nMessages);
-        }
-
-        // Add those that can be executed locally
-        if (nLocally > 0) {
-            SPDLOG_DEBUG(
-              "Executing {}/{} {} locally", nLocally, nMessages, funcStr);
-            for (int i = 0; i < nLocally; i++) {
-                localMessageIdxs.emplace_back(i);
-                executed.at(i) = thisHost;
+                faabric::util::getDirtyTracker().resetTracking(
+                  snapshotData.data, snapshotData.size);
             }
         }
 
-        // If some are left, we need to distribute
-        int offset = nLocally;
-        if (offset < nMessages) {
-            // Schedule first to already registered hosts
-            for (const auto& h : thisRegisteredHosts) {
-                int nOnThisHost =
-                  scheduleFunctionsOnHost(h, req, executed, offset, nullptr);
-
-                offset += nOnThisHost;
+        // Ask the scheduling policy which order to try the hosts in
+        SchedulingCandidates candidates;
+        candidates.thisHost = thisHost;
+        candidates.registeredHosts = thisRegisteredHosts;
+        candidates.snapshotHosts = thisSnapshotHosts;
+        candidates.otherHosts = getUnregisteredHosts(funcStr);
+
+        std::shared_ptr<SchedulingPolicy> thisPolicy = getPolicy();
+        std::vector<std::string> hostOrder =
+          thisPolicy->getHostOrder(candidates);
+        int hostLimit = thisPolicy->getHostLimit(nMessages, hostOrder.size());
+
+        faabric::util::SnapshotData* snapshotPtr =
+          snapshotNeeded ? &snapshotData : nullptr;
+
+        int offset = 0;
+        auto scheduleOnHosts = [&](const std::vector<std::string>& hosts,
+                                   int limit) {
+            for (const auto& h : hosts) {
                 if (offset >= nMessages) {
                     break;
                 }
-            }
-        }
 
-        // Now schedule to unregistered hosts if there are some left
-        if (offset < nMessages) {
-            std::vector<std::string> unregisteredHosts =
-              getUnregisteredHosts(funcStr);
+                int nOnThisHost = std::min<int>(limit, nMessages - offset);
 
-            for (auto& h : unregisteredHosts) {
-                // Skip if this host
                 if (h == thisHost) {
-                    continue;
-                }
-
-                // Schedule functions on the host
-                int nOnThisHost = scheduleFunctionsOnHost(
-                  h, req, executed, offset, &snapshotData);
+                    // Add those that can be executed locally
+                    nOnThisHost = claimLocalSlots(nOnThisHost);
+                    if (nOnThisHost > 0) {
+                        SPDLOG_DEBUG("Executing {}/{} {} locally",
+                                     nOnThisHost,
+                                     nMessages,
+                                     funcStr);
+                    }
 
-                // Register the host if it's exected a function
-                if (nOnThisHost > 0) {
-                    SPDLOG_DEBUG("Registering {} for {}", h, funcStr);
-                    registeredHosts[funcStr].insert(h);
+                    for (int i = offset; i < offset + nOnThisHost; i++) {
+                        localMessageIdxs.emplace_back(i);
+                        executed.at(i) = thisHost;
+                    }
+                } else {
+                    // Schedule functions on the host
+                    nOnThisHost = scheduleFunctionsOnHost(h,
+                                                          req,
+                                                          executed,
+                                                          offset,
+                                                          nOnThisHost,
+                                                          snapshotPtr,
+                                                          dispatches);
+
+                    // Register the host if it's exected a function
+                    if (nOnThisHost > 0 && thisRegisteredHosts.count(h) == 0) {
+                        registerHost(funcStr, h);
+                        thisRegisteredHosts.insert(h);
+                    }
                 }
 
                 offset += nOnThisHost;
-                if (offset >= nMessages) {
-                    break;
-                }
             }
+        };
+
+        scheduleOnHosts(hostOrder, hostLimit);
+
+        // Use up any capacity left over if the policy limited each host
+        if (offset < nMessages && hostLimit < nMessages) {
+            scheduleOnHosts(hostOrder, nMessages);
+        }
+
+        // If we didn't know about any other hosts, check again without the
+        // cache in case some have joined
+        if (offset < nMessages && candidates.otherHosts.empty()) {
+            std::set<std::string> newHosts =
+              getUnregisteredHosts(funcStr, true);
+
+            scheduleOnHosts(
+              std::vector<std::string>(newHosts.begin(), newHosts.end()),
+              nMessages);
         }
 
         // At this point there's no more capacity in the system, so we
@@ -370,6 +597,9 @@ std::vector<std::string> Scheduler::callFunctions(
                          nMessages,
                          funcStr);
 
+            thisHostUsedSlots.fetch_add(nMessages - offset);
+            notifyLocalSlotsChanged();
+
             for (; offset < nMessages; offset++) {
                 localMessageIdxs.emplace_back(offset);
                 executed.at(offset) = thisHost;
@@ -378,6 +608,11 @@ std::vector<std::string> Scheduler::callFunctions(
 
         // Sanity check
         assert(offset == nMessages);
+
+        // Wait for the requests to all hosts to be sent
+        for (auto& d : dispatches) {
+            d.get();
+        }
     }
 
     // Register thread results if necessary
@@ -390,15 +625,15 @@ std::vector<std::string> Scheduler::callFunctions(
     // Schedule messages locally if necessary. For threads we only need one
     // executor, for anything else we want one Executor per function in flight
     if (!localMessageIdxs.empty()) {
-        // Update slots
-        thisHostResources.set_usedslots(thisHostResources.usedslots() +
-                                        localMessageIdxs.size());
+        // Only calls to this function contend for its executors
+        std::shared_ptr<std::mutex> funcMx = getFunctionMutex(funcStr);
+        faabric::util::UniqueLock funcLock(*funcMx);
 
         if (isThreads) {
             // Threads use the existing executor. We assume there's only one
             // running at a time.
             std::vector<std::shared_ptr<Executor>>& thisExecutors =
-              executors[funcStr];
+              getFunctionExecutors(funcStr);
 
             std::shared_ptr<Executor> e = nullptr;
             if (thisExecutors.empty()) {
@@ -430,6 +665,7 @@ std::vector<std::string> Scheduler::callFunctions(
 
     // Records for tests
     if (faabric::util::isTestMode()) {
+        faabric::util::FullLock lock(mx);
         for (int i = 0; i < nMessages; i++) {
             std::string executedHost = executed.at(i);
             faabric::Message msg = req->messages().at(i);
@@ -447,42 +683,94 @@ std::vector<std::string> Scheduler::callFunctions(
     return executed;
 }
 
-std::vector<std::string> Scheduler::getUnregisteredHosts(
+// Loads the list of available hosts, without holding the lock while we query
+// Redis, and drops any state kept for hosts that have gone
+std::set<std::string> Scheduler::refreshAvailableHosts(
+  const std::set<std::string>& previousHosts)
+{
+    std::set<std::string> availableHosts = getAvailableHosts();
+
+    {
+        faabric::util::FullLock lock(mx);
+        availableHostsCache = availableHosts;
+        availableHostsRefreshedMillis =
+          faabric::util::getGlobalClock().epochMillis();
+    }
+
+    for (const auto& host : previousHosts) {
+        if (availableHosts.count(host) == 0) {
+            resetDispatchHost(host);
+        }
+    }
+
+    return availableHosts;
+}
+
+std::set<std::string> Scheduler::getUnregisteredHosts(
   const std::string& funcStr,
   bool noCache)
 {
-    // Load the list of available hosts
-    if (availableHostsCache.empty() || noCache) {
-        availableHostsCache = getAvailableHosts();
+    std::set<std::string> availableHosts;
+    {
+        faabric::util::SharedLock lock(mx);
+        availableHosts = availableHostsCache;
+    }
+
+    if (availableHosts.empty() || noCache) {
+        availableHosts = refreshAvailableHosts(availableHosts);
     }
 
-    // At this point we know we need to enlist unregistered hosts
-    std::set<std::string>& thisRegisteredHosts = registeredHosts[funcStr];
+    std::set<std::string> thisRegisteredHosts = getRegisteredHosts(funcStr);
 
-    std::vector<std::string> unregisteredHosts;
+    std::set<std::string> unregisteredHosts;
 
     std::set_difference(
-      availableHostsCache.begin(),
-      availableHostsCache.end(),
+      availableHosts.begin(),
+      availableHosts.end(),
       thisRegisteredHosts.begin(),
       thisRegisteredHosts.end(),
       std::inserter(unregisteredHosts, unregisteredHosts.begin()));
 
-    // If we've not got any, try again without caching
-    if (unregisteredHosts.empty() && !noCache) {
-        return getUnregisteredHosts(funcStr, true);
-    }
+    unregisteredHosts.erase(thisHost);
 
     return unregisteredHosts;
 }
 
+std::shared_ptr<SchedulingPolicy> Scheduler::getPolicy()
+{
+    faabric::util::SharedLock lock(mx);
+    return policy;
+}
+
+std::set<std::string> Scheduler::getSnapshotHosts(
+  const std::string& snapshotKey)
+{
+    faabric::util::SharedLock lock(mx);
+    auto it = snapshotHosts.find(snapshotKey);
+    if (it == snapshotHosts.end()) {
+        return {};
+    }
+
+    return it->second;
+}
+
 void Scheduler::broadcastSnapshotDelete(const faabric::Message& msg,
                                         const std::string& snapshotKey)
 {
     std::string funcStr = faabric::util::funcToString(msg, false);
-    std::set<std::string>& thisRegisteredHosts = registeredHosts[funcStr];
+    std::set<std::string> hosts = getRegisteredHosts(funcStr);
+
+    // Hosts we've pushed the snapshot to will hold it too
+    {
+        faabric::util::FullLock lock(mx);
+        auto it = snapshotHosts.find(snapshotKey);
+        if (it != snapshotHosts.end()) {
+            hosts.insert(it->second.begin(), it->second.end());
+            snapshotHosts.erase(it);
+        }
+    }
 
-    for (auto host : thisRegisteredHosts) {
+    for (auto host : hosts) {
         SnapshotClient& c = getSnapshotClient(host);
         c.deleteSnapshot(snapshotKey);
     }
@@ -493,20 +781,20 @@ int Scheduler::scheduleFunctionsOnHost(
   std::shared_ptr<faabric::BatchExecuteRequest> req,
   std::vector<std::string>& records,
   int offset,
-  faabric::util::SnapshotData* snapshot)
+  int nMessagesMax,
+  faabric::util::SnapshotData* snapshot,
+  std::vector<std::future<void>>& dispatches)
 {
     const faabric::Message& firstMsg = req->messages().at(0);
     std::string funcStr = faabric::util::funcToString(firstMsg, false);
 
     int nMessages = req->messages_size();
-    int remainder = nMessages - offset;
 
     // Work out how many we can put on the host
-    faabric::HostResources r = getHostResources(host);
-    int available = r.slots() - r.usedslots();
+    int nOnThisHost = claimHostSlots(host, nMessagesMax);
 
     // Drop out if none available
-    if (available <= 0) {
+    if (nOnThisHost <= 0) {
         SPDLOG_DEBUG("Not scheduling {} on {}, no resources", funcStr, host);
         return 0;
     }
@@ -520,7 +808,6 @@ int Scheduler::scheduleFunctionsOnHost(
     hostRequest->set_contextdata(req->contextdata());
 
     // Add messages
-    int nOnThisHost = std::min<int>(available, remainder);
     for (int i = offset; i < (offset + nOnThisHost); i++) {
         *hostRequest->add_messages() = req->messages().at(i);
         records.at(i) = host;
@@ -529,18 +816,146 @@ int Scheduler::scheduleFunctionsOnHost(
     SPDLOG_DEBUG(
       "Sending {}/{} {} to {}", nOnThisHost, nMessages, funcStr, host);
 
-    // Handle snapshots
+    // Push the snapshot, unless the host already holds it. We record the
+    // host as holding it straight away, as any later requests to the same
+    // host will be sent after this one.
     std::string snapshotKey = firstMsg.snapshotkey();
-    if (snapshot != nullptr && !snapshotKey.empty()) {
-        SnapshotClient& c = getSnapshotClient(host);
-        c.pushSnapshot(snapshotKey, *snapshot);
+    bool pushSnapshot = snapshot != nullptr && !snapshotKey.empty() &&
+                        getSnapshotHosts(snapshotKey).count(host) == 0;
+    faabric::util::SnapshotData snapshotData;
+    if (pushSnapshot) {
+        snapshotData = *snapshot;
+
+        faabric::util::FullLock lock(mx);
+        snapshotHosts[snapshotKey].insert(host);
     }
 
-    getFunctionCallClient(host).executeFunctions(hostRequest);
+    dispatches.emplace_back(dispatchToHost(
+      host, [this, host, hostRequest, snapshotKey, snapshotData, pushSnapshot] {
+          if (pushSnapshot) {
+              SnapshotClient& c = getSnapshotClient(host);
+              c.pushSnapshot(snapshotKey, snapshotData);
+          }
+
+          getFunctionCallClient(host).executeFunctions(hostRequest);
+      }));
 
     return nOnThisHost;
 }
 
+std::future<void> Scheduler::dispatchToHost(const std::string& host,
+                                            std::function<void()> task)
+{
+    auto packagedTask =
+      std::make_shared<std::packaged_task<void()>>(std::move(task));
+    std::future<void> result = packagedTask->get_future();
+
+    faabric::util::UniqueLock lock(dispatchMx);
+
+    // Start the dispatch threads on first use
+    if (dispatchThreads.empty()) {
+        dispatchStopping = false;
+        for (int i = 0; i < DISPATCH_POOL_SIZE; i++) {
+            dispatchThreads.emplace_back([this] { runDispatchThread(); });
+        }
+    }
+
+    HostDispatchQueue& queue = hostDispatchQueues[host];
+    queue.tasks.emplace_back([packagedTask] { (*packagedTask)(); });
+
+    // Hosts already waiting for, or held by, a thread will get to this task
+    if (!queue.scheduled) {
+        queue.scheduled = true;
+        readyDispatchHosts.push_back(host);
+        dispatchCv.notify_one();
+    }
+
+    return result;
+}
+
+void Scheduler::runDispatchThread()
+{
+    while (true) {
+        std::string host;
+        std::function<void()> task;
+        int epoch = 0;
+        {
+            faabric::util::UniqueLock lock(dispatchMx);
+            dispatchCv.wait(lock, [this] {
+                return dispatchStopping || !readyDispatchHosts.empty();
+            });
+
+            // Pending tasks are still sent when stopping
+            if (readyDispatchHosts.empty()) {
+                break;
+            }
+
+            host = readyDispatchHosts.front();
+            readyDispatchHosts.pop_front();
+
+            HostDispatchQueue& queue = hostDispatchQueues[host];
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            epoch = dispatchHostEpochs[host];
+        }
+
+        // Drop any clients left over from before the host last left
+        auto it = dispatchHostEpochsSeen.find(host);
+        if (it != dispatchHostEpochsSeen.end() && it->second != epoch) {
+            functionCallClients.erase(host);
+            snapshotClients.erase(host);
+        }
+        dispatchHostEpochsSeen[host] = epoch;
+
+        task();
+
+        // Hand the host back to the pool if it has more to do. Putting it at
+        // the back lets other hosts' requests go first.
+        faabric::util::UniqueLock lock(dispatchMx);
+        HostDispatchQueue& queue = hostDispatchQueues[host];
+        if (queue.tasks.empty()) {
+            queue.scheduled = false;
+        } else {
+            readyDispatchHosts.push_back(host);
+            dispatchCv.notify_one();
+        }
+    }
+}
+
+void Scheduler::stopDispatchThreads()
+{
+    std::vector<std::thread> threadsToJoin;
+    {
+        faabric::util::UniqueLock lock(dispatchMx);
+        dispatchStopping = true;
+        std::swap(threadsToJoin, dispatchThreads);
+    }
+    dispatchCv.notify_all();
+
+    for (auto& t : threadsToJoin) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    faabric::util::UniqueLock lock(dispatchMx);
+    hostDispatchQueues.clear();
+    readyDispatchHosts.clear();
+}
+
+void Scheduler::resetDispatchHost(const std::string& host)
+{
+    SPDLOG_DEBUG("Resetting dispatch clients for {}", host);
+
+    faabric::util::UniqueLock lock(dispatchMx);
+    dispatchHostEpochs[host]++;
+
+    auto it = hostDispatchQueues.find(host);
+    if (it != hostDispatchQueues.end() && !it->second.scheduled) {
+        hostDispatchQueues.erase(it);
+    }
+}
+
 void Scheduler::callFunction(faabric::Message& msg, bool forceLocal)
 {
     // TODO - avoid this copy
@@ -556,6 +971,7 @@ void Scheduler::callFunction(faabric::Message& msg, bool forceLocal)
 
 void Scheduler::clearRecordedMessages()
 {
+    faabric::util::FullLock lock(mx);
     recordedMessagesAll.clear();
     recordedMessagesLocal.clear();
     recordedMessagesShared.clear();
@@ -563,11 +979,13 @@ void Scheduler::clearRecordedMessages()
 
 std::vector<faabric::Message> Scheduler::getRecordedMessagesAll()
 {
+    faabric::util::SharedLock lock(mx);
     return recordedMessagesAll;
 }
 
 std::vector<faabric::Message> Scheduler::getRecordedMessagesLocal()
 {
+    faabric::util::SharedLock lock(mx);
     return recordedMessagesLocal;
 }
 
@@ -595,14 +1013,17 @@ SnapshotClient& Scheduler::getSnapshotClient(const std::string& otherHost)
 std::vector<std::pair<std::string, faabric::Message>>
 Scheduler::getRecordedMessagesShared()
 {
+    faabric::util::SharedLock lock(mx);
     return recordedMessagesShared;
 }
 
+// Callers must hold the function mutex
 std::shared_ptr<Executor> Scheduler::claimExecutor(faabric::Message& msg)
 {
     std::string funcStr = faabric::util::funcToString(msg, false);
 
-    std::vector<std::shared_ptr<Executor>>& thisExecutors = executors[funcStr];
+    std::vector<std::shared_ptr<Executor>>& thisExecutors =
+      getFunctionExecutors(funcStr);
 
     std::shared_ptr<faabric::scheduler::ExecutorFactory> factory =
       getExecutorFactory();
@@ -669,35 +1090,169 @@ void Scheduler::flushLocally()
 
 void Scheduler::setFunctionResult(faabric::Message& msg)
 {
+    bool enqueueResult = sendFunctionResult(msg);
+
     redis::Redis& redis = redis::Redis::getQueue();
+    std::vector<uint8_t> inputData = faabric::util::messageToBytes(msg);
+
+    if (enqueueResult) {
+        redis.enqueueBytes(msg.resultkey(), inputData);
+        redis.expire(msg.resultkey(), RESULT_KEY_EXPIRY);
+    }
+
+    // Set long-lived result for status lookups
+    redis.set(msg.statuskey(), inputData);
+    redis.expire(msg.statuskey(), STATUS_KEY_EXPIRY);
+}
+
+void Scheduler::setFunctionResultAsync(faabric::Message& msg)
+{
+    bool enqueueResult = sendFunctionResult(msg);
+    resultPublisher.publish(msg, enqueueResult);
+}
+
+ResultPublisher& Scheduler::getResultPublisher()
+{
+    return resultPublisher;
+}
 
+// Sends the result straight to the master host where possible. Returns true
+// if the result must also go on the Redis result queue.
+bool Scheduler::sendFunctionResult(faabric::Message& msg)
+{
     // Record which host did the execution
     msg.set_executedhost(faabric::util::getSystemConfig().endpointHost);
 
     // Set finish timestamp
     msg.set_finishtimestamp(faabric::util::getGlobalClock().epochMillis());
 
-    std::string key = msg.resultkey();
-    if (key.empty()) {
+    if (msg.resultkey().empty()) {
         throw std::runtime_error("Result key empty. Cannot publish result");
     }
 
-    // Write the successful result to the result queue
+    const std::string& masterHost = msg.masterhost();
+    if (masterHost == conf.endpointHost) {
+        return !deliverFunctionResultLocally(msg);
+    }
+
+    if (!masterHost.empty()) {
+        getFunctionCallClient(masterHost).setFunctionResult(msg);
+        return false;
+    }
+
+    return true;
+}
+
+bool Scheduler::deliverFunctionResultLocally(const faabric::Message& msg)
+{
+    std::shared_ptr<PendingFunctionResult> pending =
+      getPendingFunctionResult(msg.id());
+
+    if (pending == nullptr) {
+        return false;
+    }
+
+    faabric::util::UniqueLock lock(functionResultsMx);
+    if (!pending->isSet) {
+        pending->isSet = true;
+        pending->promise.set_value(msg);
+    }
+
+    return true;
+}
+
+void Scheduler::setFunctionResultLocally(const faabric::Message& msg)
+{
+    if (deliverFunctionResultLocally(msg)) {
+        return;
+    }
+
+    // Nobody on this host is waiting for the result, so it may be awaited
+    // elsewhere through Redis
+    SPDLOG_TRACE("No local waiter for {}, writing result to Redis", msg.id());
+
+    redis::Redis& redis = redis::Redis::getQueue();
     std::vector<uint8_t> inputData = faabric::util::messageToBytes(msg);
-    redis.enqueueBytes(key, inputData);
+    redis.enqueueBytes(msg.resultkey(), inputData);
+    redis.expire(msg.resultkey(), RESULT_KEY_EXPIRY);
+}
 
-    // Set the result key to expire
-    redis.expire(key, RESULT_KEY_EXPIRY);
+void Scheduler::registerFunctionResults(
+  std::shared_ptr<faabric::BatchExecuteRequest> req)
+{
+    long now = faabric::util::getGlobalClock().epochMillis();
 
-    // Set long-lived result for function too
-    redis.set(msg.statuskey(), inputData);
-    redis.expire(key, STATUS_KEY_EXPIRY);
+    std::vector<faabric::Message> expiredResults;
+    {
+        faabric::util::UniqueLock lock(functionResultsMx);
+        for (const auto& m : req->messages()) {
+            // Async results are only looked up through Redis
+            if (m.isasync()) {
+                continue;
+            }
+
+            auto pending = std::make_shared<PendingFunctionResult>();
+            pending->future = pending->promise.get_future().share();
+            pending->registeredMillis = now;
+            functionResults[m.id()] = pending;
+        }
+
+        expiredResults = pruneFunctionResults(now);
+    }
+
+    // Results that arrived but weren't collected in time weren't written to
+    // Redis, so they go there now, where late callers will look for them
+    for (const auto& msg : expiredResults) {
+        resultPublisher.publish(msg, true);
+    }
+}
+
+// Callers must hold the function results mutex. Returns the results that had
+// already arrived for the entries pruned.
+std::vector<faabric::Message> Scheduler::pruneFunctionResults(long nowMillis)
+{
+    std::vector<faabric::Message> expiredResults;
+    long expiryMs = conf.pendingResultExpiryMs;
+    if (nowMillis - lastFunctionResultsPruneMillis < expiryMs) {
+        return expiredResults;
+    }
+
+    // Drop entries nobody has collected. Entries with a waiter are kept, and
+    // results arriving for a pruned entry fall through to Redis.
+    for (auto it = functionResults.begin(); it != functionResults.end();) {
+        long age = nowMillis - it->second->registeredMillis;
+        if (it->second->nWaiters == 0 && age > expiryMs) {
+            if (it->second->isSet) {
+                expiredResults.emplace_back(it->second->future.get());
+            }
+            it = functionResults.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    lastFunctionResultsPruneMillis = nowMillis;
+
+    return expiredResults;
+}
+
+std::shared_ptr<Scheduler::PendingFunctionResult>
+Scheduler::getPendingFunctionResult(uint32_t msgId)
+{
+    faabric::util::UniqueLock lock(functionResultsMx);
+    auto it = functionResults.find(msgId);
+    if (it == functionResults.end()) {
+        return nullptr;
+    }
+
+    return it->second;
 }
 
 void Scheduler::registerThread(uint32_t msgId)
 {
     // Here we need to ensure the promise is registered locally so callers can
     // start waiting
+    faabric::util::UniqueLock lock(threadResultsMx);
     threadResults[msgId];
 }
 
@@ -729,17 +1284,26 @@ void Scheduler::pushSnapshotDiffs(
 void Scheduler::setThreadResultLocally(uint32_t msgId, int32_t returnValue)
 {
     SPDLOG_DEBUG("Setting result for thread {} to {}", msgId, returnValue);
+
+    faabric::util::UniqueLock lock(threadResultsMx);
     threadResults[msgId].set_value(returnValue);
 }
 
 int32_t Scheduler::awaitThreadResult(uint32_t messageId)
 {
-    if (threadResults.count(messageId) == 0) {
-        SPDLOG_ERROR("Thread {} not registered on this host", messageId);
-        throw std::runtime_error("Awaiting unregistered thread");
+    std::future<int32_t> result;
+    {
+        faabric::util::UniqueLock lock(threadResultsMx);
+        if (threadResults.count(messageId) == 0) {
+            SPDLOG_ERROR("Thread {} not registered on this host", messageId);
+            throw std::runtime_error("Awaiting unregistered thread");
+        }
+
+        result = threadResults[messageId].get_future();
     }
 
-    return threadResults[messageId].get_future().get();
+    // Note that we must not hold the lock while waiting
+    return result.get();
 }
 
 faabric::Message Scheduler::getFunctionResult(unsigned int messageId,
@@ -749,10 +1313,49 @@ faabric::Message Scheduler::getFunctionResult(unsigned int messageId,
         throw std::runtime_error("Must provide non-zero message ID");
     }
 
-    redis::Redis& redis = redis::Redis::getQueue();
-
     bool isBlocking = timeoutMs > 0;
 
+    // Check for results delivered straight to this host
+    std::shared_ptr<PendingFunctionResult> pending;
+    {
+        faabric::util::UniqueLock lock(functionResultsMx);
+        auto it = functionResults.find(messageId);
+        if (it != functionResults.end()) {
+            pending = it->second;
+            pending->nWaiters++;
+        }
+    }
+
+    if (pending != nullptr) {
+        std::future_status status =
+          pending->future.wait_for(std::chrono::milliseconds(timeoutMs));
+
+        {
+            faabric::util::UniqueLock lock(functionResultsMx);
+            pending->nWaiters--;
+        }
+
+        if (status != std::future_status::ready) {
+            if (isBlocking) {
+                throw redis::RedisNoResponseException(
+                  "Timed out waiting for function result");
+            }
+
+            faabric::Message msgResult;
+            msgResult.set_type(faabric::Message_MessageType_EMPTY);
+            return msgResult;
+        }
+
+        {
+            faabric::util::UniqueLock lock(functionResultsMx);
+            functionResults.erase(messageId);
+        }
+
+        return pending->future.get();
+    }
+
+    redis::Redis& redis = redis::Redis::getQueue();
+
     std::string resultKey = faabric::util::resultKeyFromMessageId(messageId);
 
     faabric::Message msgResult;
@@ -799,17 +1402,184 @@ std::string Scheduler::getMessageStatus(unsigned int messageId)
 
 faabric::HostResources Scheduler::getThisHostResources()
 {
-    return thisHostResources;
+    faabric::HostResources res;
+    res.set_slots(thisHostSlots.load());
+    res.set_usedslots(thisHostUsedSlots.load());
+    return res;
 }
 
 void Scheduler::setThisHostResources(faabric::HostResources& res)
 {
-    thisHostResources = res;
+    thisHostSlots = res.slots();
+    thisHostUsedSlots = res.usedslots();
 }
 
 faabric::HostResources Scheduler::getHostResources(const std::string& host)
 {
-    return getFunctionCallClient(host).getResources();
+    long now = faabric::util::getGlobalClock().epochMillis();
+    {
+        faabric::util::UniqueLock lock(hostResourcesMx);
+        auto it = hostResources.find(host);
+        if (it != hostResources.end() &&
+            (now - it->second.updatedMillis) < conf.resourceTableTtlMs) {
+            return it->second.resources;
+        }
+    }
+
+    // If we've not heard from the host recently, ask it directly
+    SPDLOG_DEBUG("No recent resources for {}, requesting", host);
+    faabric::HostResources res = getFunctionCallClient(host).getResources();
+    setHostResources(host, res);
+
+    return res;
+}
+
+void Scheduler::setHostResources(const std::string& host,
+                                 const faabric::HostResources& res)
+{
+    faabric::util::UniqueLock lock(hostResourcesMx);
+    HostResourcesRecord& record = hostResources[host];
+    record.resources = res;
+    record.updatedMillis = faabric::util::getGlobalClock().epochMillis();
+}
+
+int Scheduler::claimHostSlots(const std::string& host, int nRequested)
+{
+    // Make sure we have a recent record for this host
+    getHostResources(host);
+
+    // Optimistically claim the slots in our table. If this turns out to be
+    // wrong the host will push its real resources back to us.
+    faabric::util::UniqueLock lock(hostResourcesMx);
+    faabric::HostResources& res = hostResources[host].resources;
+
+    int available = std::max<int>(res.slots() - res.usedslots(), 0);
+    int nClaimed = std::min<int>(available, nRequested);
+    res.set_usedslots(res.usedslots() + nClaimed);
+
+    return nClaimed;
+}
+
+void Scheduler::notifyLocalSlotsChanged()
+{
+    if (!resourcePublisherRunning) {
+        return;
+    }
+
+    int32_t change = thisHostUsedSlots.load() - lastPublishedUsedSlots.load();
+    if (std::abs(change) < conf.resourcePushThreshold) {
+        return;
+    }
+
+    // Wake up the publisher to push straight away
+    {
+        faabric::util::UniqueLock lock(resourcePublisherMx);
+        resourcePushRequested = true;
+    }
+    resourcePublisherCv.notify_one();
+}
+
+void Scheduler::publishThisHostResources()
+{
+    std::string host;
+    {
+        faabric::util::SharedLock lock(mx);
+        host = thisHost;
+    }
+
+    faabric::PushResourcesRequest req;
+    req.set_host(host);
+    *req.mutable_resources() = getThisHostResources();
+    lastPublishedUsedSlots = req.resources().usedslots();
+
+    // Hosts come and go rarely, so we only go back to Redis for them once per
+    // resource table TTL. Hosts that have pushed to us since are included
+    // straight away, so new hosts hear from us without waiting for that.
+    std::set<std::string> allHosts;
+    bool isStale = false;
+    long now = faabric::util::getGlobalClock().epochMillis();
+    {
+        faabric::util::SharedLock lock(mx);
+        allHosts = availableHostsCache;
+        long age = now - availableHostsRefreshedMillis;
+        isStale = allHosts.empty() || age >= conf.resourceTableTtlMs;
+    }
+
+    if (isStale) {
+        allHosts = refreshAvailableHosts(allHosts);
+    }
+
+    {
+        faabric::util::UniqueLock lock(hostResourcesMx);
+        for (const auto& p : hostResources) {
+            if ((now - p.second.updatedMillis) < conf.resourceTableTtlMs) {
+                allHosts.insert(p.first);
+            }
+        }
+    }
+    allHosts.erase(host);
+
+    for (const auto& otherHost : allHosts) {
+        getFunctionCallClient(otherHost).pushResources(req);
+    }
+}
+
+void Scheduler::startResourcePublisher()
+{
+    {
+        faabric::util::UniqueLock lock(resourcePublisherMx);
+        if (resourcePublisherRunning) {
+            return;
+        }
+
+        resourcePublisherRunning = true;
+        resourcePushRequested = false;
+    }
+
+    SPDLOG_DEBUG("Starting resource publisher (every {}ms)",
+                 conf.resourcePushIntervalMs);
+
+    resourcePublisherThread = std::thread([this] {
+        while (true) {
+            {
+                faabric::util::UniqueLock lock(resourcePublisherMx);
+                resourcePublisherCv.wait_for(
+                  lock,
+                  std::chrono::milliseconds(conf.resourcePushIntervalMs),
+                  [this] {
+                      return !resourcePublisherRunning || resourcePushRequested;
+                  });
+
+                if (!resourcePublisherRunning) {
+                    break;
+                }
+
+                resourcePushRequested = false;
+            }
+
+            publishThisHostResources();
+        }
+
+        // Close this thread's sockets before it exits
+        resetThreadLocalCache();
+    });
+}
+
+void Scheduler::stopResourcePublisher()
+{
+    {
+        faabric::util::UniqueLock lock(resourcePublisherMx);
+        if (!resourcePublisherRunning) {
+            return;
+        }
+
+        resourcePublisherRunning = false;
+    }
+    resourcePublisherCv.notify_one();
+
+    if (resourcePublisherThread.joinable()) {
+        resourcePublisherThread.join();
+    }
 }
 
 // --------------------------------------------
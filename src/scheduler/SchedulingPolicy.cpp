@@ -0,0 +1,92 @@
+#include <faabric/scheduler/SchedulingPolicy.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace faabric::scheduler {
+
+static void appendHosts(std::vector<std::string>& order,
+                        std::set<std::string>& added,
+                        const std::set<std::string>& hosts)
+{
+    for (const auto& h : hosts) {
+        if (added.insert(h).second) {
+            order.emplace_back(h);
+        }
+    }
+}
+
+std::vector<std::string> SchedulingPolicy::getHostOrder(
+  const SchedulingCandidates& candidates)
+{
+    std::vector<std::string> order;
+    std::set<std::string> added;
+
+    appendHosts(order, added, { candidates.thisHost });
+    appendHosts(order, added, candidates.registeredHosts);
+    appendHosts(order, added, candidates.otherHosts);
+
+    return order;
+}
+
+int SchedulingPolicy::getHostLimit(int nMessages, int nHosts)
+{
+    return nMessages;
+}
+
+int SpreadPolicy::getHostLimit(int nMessages, int nHosts)
+{
+    if (nHosts <= 0) {
+        return nMessages;
+    }
+
+    // Round up so that the batch always fits on the given hosts
+    return (nMessages + nHosts - 1) / nHosts;
+}
+
+std::vector<std::string> SnapshotAffinityPolicy::getHostOrder(
+  const SchedulingCandidates& candidates)
+{
+    std::vector<std::string> order;
+    std::set<std::string> added;
+
+    appendHosts(order, added, { candidates.thisHost });
+
+    // Hosts holding the snapshot, preferring those already registered
+    std::set<std::string> registeredWithSnapshot;
+    std::set_intersection(
+      candidates.snapshotHosts.begin(),
+      candidates.snapshotHosts.end(),
+      candidates.registeredHosts.begin(),
+      candidates.registeredHosts.end(),
+      std::inserter(registeredWithSnapshot, registeredWithSnapshot.begin()));
+
+    appendHosts(order, added, registeredWithSnapshot);
+    appendHosts(order, added, candidates.snapshotHosts);
+    appendHosts(order, added, candidates.registeredHosts);
+    appendHosts(order, added, candidates.otherHosts);
+
+    return order;
+}
+
+std::shared_ptr<SchedulingPolicy> getSchedulingPolicy(
+  const std::string& policyName)
+{
+    if (policyName == BIN_PACK_POLICY) {
+        return std::make_shared<BinPackPolicy>();
+    }
+
+    if (policyName == SPREAD_POLICY) {
+        return std::make_shared<SpreadPolicy>();
+    }
+
+    if (policyName == SNAPSHOT_AFFINITY_POLICY) {
+        return std::make_shared<SnapshotAffinityPolicy>();
+    }
+
+    SPDLOG_ERROR("Unrecognised scheduling policy: {}", policyName);
+    throw std::runtime_error("Unrecognised scheduling policy");
+}
+}
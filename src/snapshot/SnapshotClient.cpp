@@ -1,10 +1,18 @@
 #include <faabric/snapshot/SnapshotClient.h>
+#include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/transport/common.h>
 #include <faabric/transport/macros.h>
 #include <faabric/util/config.h>
+#include <faabric/util/delta.h>
 #include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
 #include <faabric/util/queue.h>
 #include <faabric/util/testing.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+
+#define DELTA_SAMPLE_BYTES (64 * 1024)
 
 namespace faabric::snapshot {
 
@@ -56,6 +64,66 @@ void clearMockSnapshotRequests()
     threadResults.clear();
 }
 
+// -----------------------------------
+// Delta encoding
+// -----------------------------------
+
+// Snapshots and diffs are delta-encoded unless DELTA_SNAPSHOT_ENCODING is
+// "none", and are sent as they are if encoding doesn't make them any smaller.
+// This is decided for each push, and the receiver handles either.
+static bool shouldDeltaEncode()
+{
+    const std::string& encoding =
+      faabric::util::getSystemConfig().deltaSnapshotEncoding;
+    return !encoding.empty() && encoding != "none";
+}
+
+static bool isDeltaSmaller(const std::string& key,
+                           size_t rawSize,
+                           const std::vector<uint8_t>& delta,
+                           const faabric::util::TimePoint& tp)
+{
+    long nanos = faabric::util::getTimeDiffNanos(tp);
+    SPDLOG_DEBUG("Delta-encoded {} from {} to {} bytes ({:.1f}x, {:.1f}MB/s)",
+                 key,
+                 rawSize,
+                 delta.size(),
+                 (double)rawSize / delta.size(),
+                 ((double)rawSize * 1000) / std::max<long>(nanos, 1));
+
+    return delta.size() < rawSize;
+}
+
+// Encodes the data as a delta from empty memory, which skips pages of zeros
+// and compresses the rest. Returns nothing if that isn't any smaller. A sample
+// from the start is tried first, so data that won't compress isn't encoded in
+// full only to be thrown away.
+static std::vector<uint8_t> deltaEncode(const std::string& key,
+                                        const uint8_t* data,
+                                        size_t size)
+{
+    faabric::util::DeltaSettings settings(
+      faabric::util::getSystemConfig().deltaSnapshotEncoding);
+
+    if (size > DELTA_SAMPLE_BYTES) {
+        std::vector<uint8_t> sample = faabric::util::serializeDelta(
+          settings, nullptr, 0, data, DELTA_SAMPLE_BYTES);
+        if (sample.size() >= DELTA_SAMPLE_BYTES) {
+            SPDLOG_DEBUG("Not delta-encoding {}, sample didn't compress", key);
+            return {};
+        }
+    }
+
+    const faabric::util::TimePoint tp = faabric::util::startTimer();
+    std::vector<uint8_t> delta =
+      faabric::util::serializeDelta(settings, nullptr, 0, data, size);
+    if (!isDeltaSmaller(key, size, delta, tp)) {
+        delta.clear();
+    }
+
+    return delta;
+}
+
 // -----------------------------------
 // Snapshot client
 // -----------------------------------
@@ -66,8 +134,8 @@ SnapshotClient::SnapshotClient(const std::string& hostIn)
                                               SNAPSHOT_SYNC_PORT)
 {}
 
-void SnapshotClient::pushSnapshot(const std::string& key,
-                                  const faabric::util::SnapshotData& data)
+size_t SnapshotClient::pushSnapshot(const std::string& key,
+                                    const faabric::util::SnapshotData& data)
 {
     if (data.size == 0) {
         SPDLOG_ERROR("Cannot push snapshot {} with size zero to {}", key, host);
@@ -76,22 +144,197 @@ void SnapshotClient::pushSnapshot(const std::string& key,
 
     SPDLOG_DEBUG("Pushing snapshot {} to {} ({} bytes)", key, host, data.size);
 
+    // Snapshots too big to send in one message are streamed, and only the
+    // pages the receiver doesn't already hold are sent if dedup is on. Small
+    // ones aren't worth the extra round trip.
+    const faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+    bool isLarge = conf.snapshotChunkSize > 0 &&
+                   data.size > (size_t)conf.snapshotChunkSize;
+
     if (faabric::util::isMockMode()) {
         faabric::util::UniqueLock lock(mockMutex);
         snapshotPushes.emplace_back(host, data);
+    } else if (isLarge && conf.snapshotPageDedup) {
+        return pushSnapshotPages(key, data);
+    } else if (isLarge) {
+        streamSnapshot(key, data);
     } else {
+        std::vector<uint8_t> delta;
+        if (shouldDeltaEncode()) {
+            delta = deltaEncode(key, data.data, data.size);
+        }
+
         // Set up the main request
         // TODO - avoid copying data here
         flatbuffers::FlatBufferBuilder mb;
         auto keyOffset = mb.CreateString(key);
-        auto dataOffset = mb.CreateVector<uint8_t>(data.data, data.size);
-        auto requestOffset =
-          CreateSnapshotPushRequest(mb, keyOffset, dataOffset);
+        flatbuffers::Offset<SnapshotPushRequest> requestOffset;
+        if (delta.empty()) {
+            auto dataOffset = mb.CreateVector<uint8_t>(data.data, data.size);
+            requestOffset =
+              CreateSnapshotPushRequest(mb, keyOffset, dataOffset);
+        } else {
+            auto deltaOffset = mb.CreateVector<uint8_t>(delta);
+            requestOffset =
+              CreateSnapshotPushRequest(mb, keyOffset, 0, deltaOffset);
+        }
         mb.Finish(requestOffset);
 
         // Send it
         SEND_FB_MSG(SnapshotCalls::PushSnapshot, mb)
     }
+
+    return data.size;
+}
+
+void SnapshotClient::streamSnapshot(const std::string& key,
+                                    const faabric::util::SnapshotData& data)
+{
+    SPDLOG_DEBUG("Streaming snapshot {} to {}", key, host);
+
+    flatbuffers::FlatBufferBuilder mb;
+    auto keyOffset = mb.CreateString(key);
+    auto requestOffset =
+      CreateSnapshotStreamStartRequest(mb, keyOffset, data.size);
+    mb.Finish(requestOffset);
+
+    SEND_FB_MSG(SnapshotCalls::StreamSnapshotStart, mb)
+
+    streamSnapshotRanges(key, data, { { 0, data.size } }, 0);
+}
+
+size_t SnapshotClient::pushSnapshotPages(
+  const std::string& key,
+  const faabric::util::SnapshotData& data)
+{
+    // Send the hash of each page, and the receiver replies with the pages it
+    // doesn't already hold. Registered snapshots may be live memory that's
+    // changed since it was indexed, so the pages are always hashed here.
+    std::vector<faabric::util::PageHash> hashes =
+      faabric::util::hashPages(data.data, data.size);
+
+    std::vector<uint8_t> hashBytes;
+    hashBytes.reserve(hashes.size() * PAGE_HASH_BYTES);
+    for (const auto& hash : hashes) {
+        hashBytes.insert(hashBytes.end(), hash.bytes.begin(), hash.bytes.end());
+    }
+
+    faabric::SnapshotManifestResponse response;
+    {
+        flatbuffers::FlatBufferBuilder mb;
+        auto keyOffset = mb.CreateString(key);
+        auto hashesOffset = mb.CreateVector<uint8_t>(hashBytes);
+        auto requestOffset = CreateSnapshotManifestRequest(
+          mb, keyOffset, data.size, hashesOffset);
+        mb.Finish(requestOffset);
+
+        syncSend(SnapshotCalls::PushSnapshotManifest,
+                 mb.GetBufferPointer(),
+                 mb.GetSize(),
+                 &response);
+    }
+
+    // Send runs of consecutive missing pages together
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t missingBytes = 0;
+    for (int page : response.missingpages()) {
+        size_t offset = page * faabric::util::HOST_PAGE_SIZE;
+        size_t size =
+          std::min<size_t>(faabric::util::HOST_PAGE_SIZE, data.size - offset);
+        missingBytes += size;
+
+        if (!ranges.empty() &&
+            ranges.back().first + ranges.back().second == offset) {
+            ranges.back().second += size;
+        } else {
+            ranges.emplace_back(offset, size);
+        }
+    }
+
+    SPDLOG_DEBUG("Sending {}/{} pages of snapshot {} to {} ({} bytes)",
+                 response.missingpages_size(),
+                 hashes.size(),
+                 key,
+                 host,
+                 missingBytes);
+
+    streamSnapshotRanges(key, data, ranges, data.size - missingBytes);
+
+    return missingBytes;
+}
+
+void SnapshotClient::streamSnapshotRanges(
+  const std::string& key,
+  const faabric::util::SnapshotData& data,
+  const std::vector<std::pair<size_t, size_t>>& ranges,
+  size_t bytesWritten)
+{
+    const faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+    size_t chunkSize =
+      conf.snapshotChunkSize > 0 ? conf.snapshotChunkSize : data.size;
+    int window = std::max(conf.snapshotChunkWindow, 1);
+
+    // Each chunk is delta-encoded on its own
+    bool isDeltaEncoded = shouldDeltaEncode();
+
+    // Only one chunk is held here at a time, reusing the builder's buffer. The
+    // chunks are sent without waiting for each to be acked, and we only wait
+    // for the receiver to catch up once a window of them is in flight.
+    flatbuffers::FlatBufferBuilder mb;
+    int chunksInFlight = 0;
+    for (size_t r = 0; r < ranges.size(); r++) {
+        size_t rangeEnd = ranges.at(r).first + ranges.at(r).second;
+        for (size_t offset = ranges.at(r).first; offset < rangeEnd;
+             offset += chunkSize) {
+            size_t size = std::min(chunkSize, rangeEnd - offset);
+            const uint8_t* chunk = data.data + offset;
+
+            std::vector<uint8_t> delta;
+            if (isDeltaEncoded) {
+                delta = deltaEncode(key, chunk, size);
+            }
+
+            mb.Clear();
+            auto keyOffset = mb.CreateString(key);
+            flatbuffers::Offset<SnapshotStreamChunkRequest> requestOffset;
+            if (delta.empty()) {
+                auto dataOffset = mb.CreateVector<uint8_t>(chunk, size);
+                requestOffset = CreateSnapshotStreamChunkRequest(
+                  mb, keyOffset, offset, size, dataOffset);
+            } else {
+                auto deltaOffset = mb.CreateVector<uint8_t>(delta);
+                requestOffset = CreateSnapshotStreamChunkRequest(
+                  mb, keyOffset, offset, size, 0, deltaOffset);
+            }
+            mb.Finish(requestOffset);
+
+            SEND_FB_MSG_ASYNC(SnapshotCalls::StreamSnapshotChunk, mb)
+            bytesWritten += size;
+
+            // The last chunk is acked below
+            bool isLast = r == ranges.size() - 1 && offset + size == rangeEnd;
+            if (++chunksInFlight == window && !isLast) {
+                sendStreamAck(key, bytesWritten, false);
+                chunksInFlight = 0;
+            }
+        }
+    }
+
+    // The last ack also tells the receiver to register the snapshot
+    sendStreamAck(key, bytesWritten, true);
+}
+
+void SnapshotClient::sendStreamAck(const std::string& key,
+                                   size_t nBytes,
+                                   bool complete)
+{
+    flatbuffers::FlatBufferBuilder mb;
+    auto keyOffset = mb.CreateString(key);
+    auto requestOffset =
+      CreateSnapshotStreamAckRequest(mb, keyOffset, nBytes, complete);
+    mb.Finish(requestOffset);
+
+    SEND_FB_MSG(SnapshotCalls::StreamSnapshotAck, mb)
 }
 
 void SnapshotClient::pushSnapshotDiffs(
@@ -107,22 +350,48 @@ void SnapshotClient::pushSnapshotDiffs(
                      snapshotKey,
                      host);
 
-        flatbuffers::FlatBufferBuilder mb;
-
-        // Create objects for all the chunks
-        std::vector<flatbuffers::Offset<SnapshotDiffChunk>> diffsFbVector;
-        for (const auto& d : diffs) {
-            auto dataOffset = mb.CreateVector<uint8_t>(d.data, d.size);
-            auto chunk = CreateSnapshotDiffChunk(mb, d.offset, dataOffset);
-            diffsFbVector.push_back(chunk);
+        // The receiver's copy of the snapshot may have had other diffs
+        // applied to it, so diffs are encoded as overwrites rather than XORed
+        // with this host's copy
+        std::vector<uint8_t> delta;
+        if (shouldDeltaEncode()) {
+            size_t diffsSize = 0;
+            for (const auto& d : diffs) {
+                diffsSize += d.size;
+            }
+
+            faabric::util::DeltaSettings settings(
+              faabric::util::getSystemConfig().deltaSnapshotEncoding);
+            const faabric::util::TimePoint tp = faabric::util::startTimer();
+            delta = faabric::util::serializeDiffsDelta(settings, diffs);
+
+            if (!isDeltaSmaller(snapshotKey, diffsSize, delta, tp)) {
+                delta.clear();
+            }
         }
 
-        // Set up the main request
-        // TODO - avoid copying data here
+        flatbuffers::FlatBufferBuilder mb;
         auto keyOffset = mb.CreateString(snapshotKey);
-        auto diffsOffset = mb.CreateVector(diffsFbVector);
-        auto requestOffset =
-          CreateSnapshotDiffPushRequest(mb, keyOffset, diffsOffset);
+        flatbuffers::Offset<SnapshotDiffPushRequest> requestOffset;
+        if (delta.empty()) {
+            // Create objects for all the chunks
+            std::vector<flatbuffers::Offset<SnapshotDiffChunk>> diffsFbVector;
+            for (const auto& d : diffs) {
+                auto dataOffset = mb.CreateVector<uint8_t>(d.data, d.size);
+                auto chunk = CreateSnapshotDiffChunk(mb, d.offset, dataOffset);
+                diffsFbVector.push_back(chunk);
+            }
+
+            // Set up the main request
+            // TODO - avoid copying data here
+            auto diffsOffset = mb.CreateVector(diffsFbVector);
+            requestOffset =
+              CreateSnapshotDiffPushRequest(mb, keyOffset, diffsOffset);
+        } else {
+            auto deltaOffset = mb.CreateVector<uint8_t>(delta);
+            requestOffset =
+              CreateSnapshotDiffPushRequest(mb, keyOffset, 0, deltaOffset);
+        }
         mb.Finish(requestOffset);
 
         SEND_FB_MSG(SnapshotCalls::PushSnapshotDiffs, mb);
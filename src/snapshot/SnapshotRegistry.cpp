@@ -1,10 +1,14 @@
 #include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/config.h>
+#include <faabric/util/dirty.h>
 #include <faabric/util/func.h>
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/memory.h>
 
+#include <algorithm>
 #include <sys/mman.h>
+#include <unistd.h>
 
 namespace faabric::snapshot {
 SnapshotRegistry::SnapshotRegistry() {}
@@ -51,9 +55,12 @@ void SnapshotRegistry::mapSnapshot(const std::string& key, uint8_t* target)
     }
 }
 
-void SnapshotRegistry::takeSnapshot(const std::string& key,
-                                    faabric::util::SnapshotData data,
-                                    bool locallyRestorable)
+void SnapshotRegistry::takeSnapshot(
+  const std::string& key,
+  faabric::util::SnapshotData data,
+  bool locallyRestorable,
+  bool ownsData,
+  std::vector<faabric::util::PageHash> pageHashes)
 {
     if (data.size == 0) {
         SPDLOG_ERROR("Cannot take snapshot {} of size zero", key);
@@ -65,10 +72,37 @@ void SnapshotRegistry::takeSnapshot(const std::string& key,
                  data.size,
                  locallyRestorable);
 
+    // Hash the pages before taking the lock, so other hosts can reuse them,
+    // unless the caller already has their hashes. Only snapshots pushed in
+    // chunks are sent page by page, so smaller ones aren't worth hashing.
+    const faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+    bool isChunked = conf.snapshotChunkSize > 0 &&
+                     data.size > (size_t)conf.snapshotChunkSize;
+    bool isHashed =
+      pageHashes.size() == faabric::util::getRequiredHostPages(data.size);
+    if (!conf.snapshotPageDedup || (!isHashed && !isChunked)) {
+        pageHashes.clear();
+    } else if (!isHashed) {
+        pageHashes = faabric::util::hashPages(data.data, data.size);
+    }
+
     // Note - we only preserve the snapshot in the in-memory file, and do not
-    // take ownership for the original data referenced in SnapshotData
+    // take ownership for the original data referenced in SnapshotData, unless
+    // told to. A snapshot we own that's being replaced is released here.
     faabric::util::UniqueLock lock(snapshotsMx);
+    auto it = snapshotMap.find(key);
+    if (it != snapshotMap.end() && ownedSnapshots.count(key) > 0) {
+        releaseOwnedData(key, it->second);
+        if (it->second.fd > 0) {
+            ::close(it->second.fd);
+        }
+    }
+
     snapshotMap[key] = data;
+    if (ownsData) {
+        ownedSnapshots.insert(key);
+    }
+    indexPages(key, std::move(pageHashes));
 
     // Write to fd to be locally restorable
     if (locallyRestorable) {
@@ -87,10 +121,19 @@ void SnapshotRegistry::deleteSnapshot(const std::string& key)
     faabric::util::SnapshotData d = snapshotMap[key];
 
     // Note - the data referenced by the SnapshotData object is not owned by the
-    // snapshot registry so we don't delete it here. We only remove the file
-    // descriptor used for mapping memory
-    if (d.fd > 0) {
-        ::close(d.fd);
+    // snapshot registry unless it was handed over, so we only unmap it in
+    // that case. Otherwise we only remove the file descriptor used for mapping
+    // memory (or keep it for its pages), and stop tracking its dirty pages
+    faabric::util::getDirtyTracker().stopTracking(d.data, d.size);
+    releaseOwnedData(key, d);
+    if (d.fd > 0 && snapshotPageHashes.count(key) > 0) {
+        retireSnapshot(key, d);
+    } else {
+        if (d.fd > 0) {
+            ::close(d.fd);
+        }
+
+        removeIndexedPages(key);
     }
 
     snapshotMap.erase(key);
@@ -111,12 +154,216 @@ SnapshotRegistry& getSnapshotRegistry()
 void SnapshotRegistry::clear()
 {
     for (auto p : snapshotMap) {
+        faabric::util::getDirtyTracker().stopTracking(p.second.data,
+                                                      p.second.size);
+        releaseOwnedData(p.first, p.second);
         if (p.second.fd > 0) {
             ::close(p.second.fd);
         }
     }
 
+    for (auto p : retiredSnapshots) {
+        ::close(p.second.fd);
+    }
+
     snapshotMap.clear();
+    ownedSnapshots.clear();
+    pageIndex.clear();
+    snapshotPageHashes.clear();
+    retiredSnapshots.clear();
+    retiredBytes = 0;
+}
+
+std::vector<faabric::util::PageHash> SnapshotRegistry::getPageHashes(
+  const std::string& key,
+  const faabric::util::SnapshotData& data)
+{
+    faabric::util::UniqueLock lock(snapshotsMx);
+
+    auto snapIt = snapshotMap.find(key);
+    auto hashesIt = snapshotPageHashes.find(key);
+    if (snapIt == snapshotMap.end() || hashesIt == snapshotPageHashes.end() ||
+        snapIt->second.data != data.data || snapIt->second.size != data.size) {
+        return {};
+    }
+
+    return hashesIt->second;
+}
+
+void SnapshotRegistry::reindexPages(
+  const std::string& key,
+  const std::vector<std::pair<size_t, size_t>>& ranges)
+{
+    faabric::util::UniqueLock lock(snapshotsMx);
+
+    auto snapIt = snapshotMap.find(key);
+    auto hashesIt = snapshotPageHashes.find(key);
+    if (snapIt == snapshotMap.end() || hashesIt == snapshotPageHashes.end()) {
+        return;
+    }
+
+    const faabric::util::SnapshotData& snap = snapIt->second;
+    std::vector<faabric::util::PageHash>& hashes = hashesIt->second;
+
+    // Ranges often share pages, which only need hashing once
+    std::vector<size_t> pages;
+    for (const auto& [offset, size] : ranges) {
+        if (size == 0) {
+            continue;
+        }
+
+        size_t endPage = std::min<size_t>(
+          faabric::util::getRequiredHostPages(offset + size), hashes.size());
+        for (size_t p = offset / faabric::util::HOST_PAGE_SIZE; p < endPage;
+             p++) {
+            pages.emplace_back(p);
+        }
+    }
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+    for (size_t p : pages) {
+        size_t pageOffset = p * faabric::util::HOST_PAGE_SIZE;
+        size_t pageSize = std::min<size_t>(faabric::util::HOST_PAGE_SIZE,
+                                           snap.size - pageOffset);
+
+        auto pageIt = pageIndex.find(hashes.at(p));
+        if (pageIt != pageIndex.end() && pageIt->second.key == key &&
+            pageIt->second.offset == pageOffset) {
+            pageIndex.erase(pageIt);
+        }
+
+        hashes.at(p) =
+          faabric::util::hashPage(snap.data + pageOffset, pageSize);
+        pageIndex.insert_or_assign(hashes.at(p),
+                                   PageLocation{ key, pageOffset, pageSize });
+    }
+}
+
+bool SnapshotRegistry::copyPageByHash(const faabric::util::PageHash& hash,
+                                      uint8_t* target,
+                                      size_t size)
+{
+    faabric::util::UniqueLock lock(snapshotsMx);
+
+    auto it = pageIndex.find(hash);
+    if (it == pageIndex.end() || it->second.size != size) {
+        return false;
+    }
+
+    const PageLocation& location = it->second;
+    auto snapIt = snapshotMap.find(location.key);
+    if (snapIt != snapshotMap.end()) {
+        if (location.offset + size > snapIt->second.size) {
+            return false;
+        }
+
+        std::memcpy(target, snapIt->second.data + location.offset, size);
+    } else {
+        auto retiredIt = std::find_if(
+          retiredSnapshots.begin(),
+          retiredSnapshots.end(),
+          [&location](const auto& p) { return p.first == location.key; });
+        if (retiredIt == retiredSnapshots.end()) {
+            return false;
+        }
+
+        ssize_t nRead =
+          ::pread(retiredIt->second.fd, target, size, location.offset);
+        if (nRead != (ssize_t)size) {
+            return false;
+        }
+    }
+
+    // The page may have changed since it was indexed
+    return faabric::util::hashPage(target, size) == hash;
+}
+
+void SnapshotRegistry::indexPages(const std::string& key,
+                                  std::vector<faabric::util::PageHash> hashes)
+{
+    removeIndexedPages(key);
+    if (hashes.empty()) {
+        return;
+    }
+
+    size_t snapSize = snapshotMap[key].size;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        size_t offset = i * faabric::util::HOST_PAGE_SIZE;
+        size_t size =
+          std::min<size_t>(faabric::util::HOST_PAGE_SIZE, snapSize - offset);
+
+        // Point at the newest copy of each page, as it'll be kept longest
+        pageIndex.insert_or_assign(hashes.at(i),
+                                   PageLocation{ key, offset, size });
+    }
+
+    snapshotPageHashes[key] = std::move(hashes);
+}
+
+void SnapshotRegistry::retireSnapshot(const std::string& key,
+                                      const faabric::util::SnapshotData& data)
+{
+    size_t capacity =
+      faabric::util::getSystemConfig().snapshotPageCacheMb * 1024L * 1024L;
+    if (data.size > capacity) {
+        ::close(data.fd);
+        removeIndexedPages(key);
+        return;
+    }
+
+    // The key may be reused for a new snapshot, so its pages move to a new one
+    std::string retiredKey = key + "#retired" + std::to_string(retiredCount++);
+    std::vector<faabric::util::PageHash>& hashes = snapshotPageHashes[key];
+    for (const auto& hash : hashes) {
+        auto pageIt = pageIndex.find(hash);
+        if (pageIt != pageIndex.end() && pageIt->second.key == key) {
+            pageIt->second.key = retiredKey;
+        }
+    }
+
+    snapshotPageHashes[retiredKey] = std::move(hashes);
+    snapshotPageHashes.erase(key);
+
+    retiredSnapshots.emplace_back(retiredKey, data);
+    retiredBytes += data.size;
+
+    while (retiredBytes > capacity) {
+        auto& oldest = retiredSnapshots.front();
+        SPDLOG_DEBUG("Dropping pages of deleted snapshot {}", oldest.first);
+
+        removeIndexedPages(oldest.first);
+        ::close(oldest.second.fd);
+        retiredBytes -= oldest.second.size;
+        retiredSnapshots.pop_front();
+    }
+}
+
+void SnapshotRegistry::removeIndexedPages(const std::string& key)
+{
+    auto it = snapshotPageHashes.find(key);
+    if (it == snapshotPageHashes.end()) {
+        return;
+    }
+
+    for (const auto& hash : it->second) {
+        auto pageIt = pageIndex.find(hash);
+        if (pageIt != pageIndex.end() && pageIt->second.key == key) {
+            pageIndex.erase(pageIt);
+        }
+    }
+
+    snapshotPageHashes.erase(it);
+}
+
+void SnapshotRegistry::releaseOwnedData(
+  const std::string& key,
+  const faabric::util::SnapshotData& data)
+{
+    // Retired snapshots are read through their fd, so the mapping can go
+    if (ownedSnapshots.erase(key) > 0 && data.data != nullptr) {
+        ::munmap(data.data, data.size);
+    }
 }
 
 int SnapshotRegistry::writeSnapshotToFd(const std::string& key)
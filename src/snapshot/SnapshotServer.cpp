@@ -5,10 +5,18 @@
 #include <faabric/state/State.h>
 #include <faabric/transport/common.h>
 #include <faabric/transport/macros.h>
+#include <faabric/util/config.h>
+#include <faabric/util/delta.h>
 #include <faabric/util/func.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+#include <faabric/util/timing.h>
 
+#include <algorithm>
+#include <chrono>
 #include <sys/mman.h>
+#include <unistd.h>
 
 namespace faabric::snapshot {
 SnapshotServer::SnapshotServer()
@@ -29,6 +37,10 @@ void SnapshotServer::doAsyncRecv(int header,
             this->recvThreadResult(buffer, bufferSize);
             break;
         }
+        case faabric::snapshot::SnapshotCalls::StreamSnapshotChunk: {
+            this->recvStreamSnapshotChunk(buffer, bufferSize);
+            break;
+        }
         default: {
             throw std::runtime_error(
               fmt::format("Unrecognized async call header: {}", header));
@@ -46,6 +58,15 @@ SnapshotServer::doSyncRecv(int header, const uint8_t* buffer, size_t bufferSize)
         case faabric::snapshot::SnapshotCalls::PushSnapshotDiffs: {
             return recvPushSnapshotDiffs(buffer, bufferSize);
         }
+        case faabric::snapshot::SnapshotCalls::StreamSnapshotStart: {
+            return recvStreamSnapshotStart(buffer, bufferSize);
+        }
+        case faabric::snapshot::SnapshotCalls::StreamSnapshotAck: {
+            return recvStreamSnapshotAck(buffer, bufferSize);
+        }
+        case faabric::snapshot::SnapshotCalls::PushSnapshotManifest: {
+            return recvPushSnapshotManifest(buffer, bufferSize);
+        }
         default: {
             throw std::runtime_error(
               fmt::format("Unrecognized sync call header: {}", header));
@@ -60,29 +81,58 @@ std::unique_ptr<google::protobuf::Message> SnapshotServer::recvPushSnapshot(
     const SnapshotPushRequest* r =
       flatbuffers::GetRoot<SnapshotPushRequest>(buffer);
 
-    if (r->contents()->size() == 0) {
+    bool isDelta = r->delta() != nullptr && r->delta()->size() > 0;
+    size_t contentsSize = r->contents() == nullptr ? 0 : r->contents()->size();
+    if (!isDelta && contentsSize == 0) {
         SPDLOG_ERROR("Received shapshot {} with zero size", r->key()->c_str());
         throw std::runtime_error("Received snapshot with zero size");
     }
 
-    SPDLOG_DEBUG("Receiving shapshot {} (size {})",
+    SPDLOG_DEBUG("Receiving shapshot {} ({} {} bytes)",
                  r->key()->c_str(),
-                 r->contents()->size());
+                 isDelta ? "delta" : "raw",
+                 isDelta ? r->delta()->size() : contentsSize);
 
     faabric::snapshot::SnapshotRegistry& reg =
       faabric::snapshot::getSnapshotRegistry();
 
     // Set up the snapshot
-    faabric::util::SnapshotData data;
-    data.size = r->contents()->size();
-
-    // TODO - avoid this copy by changing server superclass to allow subclasses
-    // to provide a buffer to receive data.
     // TODO - work out snapshot ownership here, how do we know when to delete
     // this data?
-    data.data = (uint8_t*)mmap(
-      nullptr, data.size, PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    std::memcpy(data.data, r->contents()->Data(), data.size);
+    faabric::util::SnapshotData data;
+    auto allocateData = [&data](size_t size) {
+        data.size = size;
+        data.data = (uint8_t*)mmap(
+          nullptr, data.size, PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    };
+
+    if (isDelta) {
+        // The delta is taken against empty memory, so only writes the pages
+        // that aren't zero
+        const faabric::util::TimePoint tp = faabric::util::startTimer();
+        faabric::util::applyDelta(
+          r->delta()->data(),
+          r->delta()->size(),
+          [&allocateData](uint32_t size) { allocateData(size); },
+          [&data]() { return data.data; });
+        long nanos = faabric::util::getTimeDiffNanos(tp);
+
+        if (data.size == 0) {
+            SPDLOG_ERROR("Received shapshot {} with zero size",
+                         r->key()->c_str());
+            throw std::runtime_error("Received snapshot with zero size");
+        }
+
+        SPDLOG_DEBUG("Decoded snapshot {} to {} bytes ({:.1f}MB/s)",
+                     r->key()->c_str(),
+                     data.size,
+                     ((double)data.size * 1000) / std::max<long>(nanos, 1));
+    } else {
+        // TODO - avoid this copy by changing server superclass to allow
+        // subclasses to provide a buffer to receive data.
+        allocateData(contentsSize);
+        std::memcpy(data.data, r->contents()->Data(), data.size);
+    }
 
     reg.takeSnapshot(r->key()->str(), data, true);
 
@@ -109,17 +159,44 @@ SnapshotServer::recvPushSnapshotDiffs(const uint8_t* buffer, size_t bufferSize)
     const SnapshotDiffPushRequest* r =
       flatbuffers::GetRoot<SnapshotDiffPushRequest>(buffer);
 
-    SPDLOG_DEBUG(
-      "Applying {} diffs to snapshot {}", r->chunks()->size(), r->key()->str());
-
     // Get the snapshot
     faabric::snapshot::SnapshotRegistry& reg =
       faabric::snapshot::getSnapshotRegistry();
     faabric::util::SnapshotData& snap = reg.getSnapshot(r->key()->str());
 
-    // Copy diffs to snapshot
-    for (const auto* r : *r->chunks()) {
-        snap.applyDiff(r->offset(), r->data()->data(), r->data()->size());
+    if (r->delta() != nullptr && r->delta()->size() > 0) {
+        SPDLOG_DEBUG("Applying {} byte delta to snapshot {}",
+                     r->delta()->size(),
+                     r->key()->str());
+
+        // Diffs are only ever encoded as overwrites within the snapshot
+        std::vector<std::pair<size_t, size_t>> written =
+          faabric::util::applyDelta(
+            r->delta()->data(),
+            r->delta()->size(),
+            [&r](uint32_t size) {
+                SPDLOG_ERROR("Delta for snapshot {} tried to resize it to {}",
+                             r->key()->str(),
+                             size);
+                throw std::runtime_error(
+                  "Snapshot diff delta resizes snapshot");
+            },
+            [&snap]() { return snap.data; });
+
+        reg.reindexPages(r->key()->str(), written);
+    } else {
+        SPDLOG_DEBUG("Applying {} diffs to snapshot {}",
+                     r->chunks()->size(),
+                     r->key()->str());
+
+        // Copy diffs to snapshot
+        std::vector<std::pair<size_t, size_t>> written;
+        for (const auto* c : *r->chunks()) {
+            snap.applyDiff(c->offset(), c->data()->data(), c->data()->size());
+            written.emplace_back(c->offset(), c->data()->size());
+        }
+
+        reg.reindexPages(r->key()->str(), written);
     }
 
     // Send response
@@ -139,4 +216,348 @@ void SnapshotServer::recvDeleteSnapshot(const uint8_t* buffer,
     // Delete the registry entry
     reg.deleteSnapshot(r->key()->str());
 }
+
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvStreamSnapshotStart(const uint8_t* buffer,
+                                        size_t bufferSize)
+{
+    const SnapshotStreamStartRequest* r =
+      flatbuffers::GetRoot<SnapshotStreamStartRequest>(buffer);
+    const std::string key = r->key()->str();
+
+    if (r->size() == 0) {
+        SPDLOG_ERROR("Received shapshot {} with zero size", key);
+        throw std::runtime_error("Received snapshot with zero size");
+    }
+
+    SPDLOG_DEBUG("Receiving streamed snapshot {} (size {})", key, r->size());
+
+    addIncomingSnapshot(key, createIncomingSnapshot(key, r->size()));
+
+    return std::make_unique<faabric::EmptyResponse>();
+}
+
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvPushSnapshotManifest(const uint8_t* buffer,
+                                         size_t bufferSize)
+{
+    const SnapshotManifestRequest* r =
+      flatbuffers::GetRoot<SnapshotManifestRequest>(buffer);
+    const std::string key = r->key()->str();
+    size_t size = r->size();
+    size_t nPages = faabric::util::getRequiredHostPages(size);
+
+    if (size == 0) {
+        SPDLOG_ERROR("Received shapshot {} with zero size", key);
+        throw std::runtime_error("Received snapshot with zero size");
+    }
+
+    if (r->page_hashes() == nullptr ||
+        r->page_hashes()->size() != nPages * PAGE_HASH_BYTES) {
+        SPDLOG_ERROR("Manifest for snapshot {} doesn't match its size", key);
+        throw std::runtime_error("Invalid snapshot manifest");
+    }
+
+    // Pages of zeros don't need writing, as the fd starts out zeroed
+    size_t tailSize = size - ((nPages - 1) * faabric::util::HOST_PAGE_SIZE);
+    std::vector<uint8_t> zeros(faabric::util::HOST_PAGE_SIZE, 0);
+    faabric::util::PageHash zeroPage =
+      faabric::util::hashPage(zeros.data(), faabric::util::HOST_PAGE_SIZE);
+    faabric::util::PageHash zeroTail =
+      faabric::util::hashPage(zeros.data(), tailSize);
+
+    // Build the snapshot from the pages we already have, and ask for the rest
+    std::shared_ptr<IncomingSnapshot> incoming =
+      createIncomingSnapshot(key, size);
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+    auto response = std::make_unique<faabric::SnapshotManifestResponse>();
+    size_t nZeroPages = 0;
+    incoming->pageHashes.resize(nPages);
+    for (size_t p = 0; p < nPages; p++) {
+        faabric::util::PageHash& hash = incoming->pageHashes.at(p);
+        std::memcpy(hash.bytes.data(),
+                    r->page_hashes()->data() + (p * PAGE_HASH_BYTES),
+                    PAGE_HASH_BYTES);
+        size_t offset = p * faabric::util::HOST_PAGE_SIZE;
+        size_t pageSize =
+          p == nPages - 1 ? tailSize : faabric::util::HOST_PAGE_SIZE;
+
+        if (hash == (p == nPages - 1 ? zeroTail : zeroPage)) {
+            nZeroPages++;
+        } else if (!reg.copyPageByHash(
+                     hash, incoming->data + offset, pageSize)) {
+            response->add_missingpages(p);
+            continue;
+        }
+
+        incoming->bytesWritten += pageSize;
+    }
+
+    SPDLOG_DEBUG("Snapshot {} has {} pages, {} zero and {} missing",
+                 key,
+                 nPages,
+                 nZeroPages,
+                 response->missingpages_size());
+
+    addIncomingSnapshot(key, incoming);
+
+    return response;
+}
+
+SnapshotServer::IncomingSnapshot::~IncomingSnapshot()
+{
+    // Once handed to the registry, the snapshot owns the fd and mapping
+    if (data != nullptr) {
+        ::munmap(data, size);
+    }
+
+    if (fd > 0) {
+        ::close(fd);
+    }
+}
+
+std::shared_ptr<SnapshotServer::IncomingSnapshot>
+SnapshotServer::createIncomingSnapshot(const std::string& key, size_t size)
+{
+    // The fd is zero-filled, so chunks of zeros don't need writing, and the
+    // shared mapping lets pages be copied and delta-encoded chunks be applied
+    // in place
+    auto incoming = std::make_shared<IncomingSnapshot>();
+    incoming->size = size;
+    incoming->lastUsed = faabric::util::startTimer();
+    incoming->fd = ::memfd_create(key.c_str(), 0);
+    if (incoming->fd == -1 || ::ftruncate(incoming->fd, incoming->size) != 0) {
+        SPDLOG_ERROR("Failed to create fd for snapshot {} ({})",
+                     key,
+                     ::strerror(errno));
+        throw std::runtime_error("Failed creating fd for streamed snapshot");
+    }
+
+    void* mmapRes = ::mmap(nullptr,
+                           incoming->size,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED,
+                           incoming->fd,
+                           0);
+    if (mmapRes == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to map fd for snapshot {} ({})",
+                     key,
+                     ::strerror(errno));
+        throw std::runtime_error("Failed mapping fd for streamed snapshot");
+    }
+    incoming->data = (uint8_t*)mmapRes;
+
+    return incoming;
+}
+
+void SnapshotServer::addIncomingSnapshot(
+  const std::string& key,
+  std::shared_ptr<IncomingSnapshot> incoming)
+{
+    faabric::util::UniqueLock lock(incomingMx);
+    expireIncomingSnapshots();
+
+    if (incomingSnapshots.count(key) > 0) {
+        SPDLOG_WARN("Restarting stream of snapshot {}", key);
+    }
+    incomingSnapshots[key] = std::move(incoming);
+}
+
+size_t SnapshotServer::getIncomingSnapshotCount()
+{
+    faabric::util::UniqueLock lock(incomingMx);
+    return incomingSnapshots.size();
+}
+
+// Streams whose sender has gone away are dropped once nothing has arrived for
+// them in a while. This is checked whenever anything arrives for any stream.
+// Any chunk still being written holds its own reference, so the memory is
+// only released once that's done. Callers must hold the lock.
+void SnapshotServer::expireIncomingSnapshots()
+{
+    long expiryMs = faabric::util::getSystemConfig().snapshotStreamExpiryMs;
+    for (auto it = incomingSnapshots.begin(); it != incomingSnapshots.end();) {
+        if (faabric::util::getTimeDiffMillis(it->second->lastUsed) > expiryMs) {
+            SPDLOG_WARN("Dropping abandoned stream of snapshot {}", it->first);
+            it = incomingSnapshots.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Errors here are recorded against the stream rather than thrown, as there's
+// nobody to report them to on the async socket. The sender's next ack fails.
+void SnapshotServer::recvStreamSnapshotChunk(const uint8_t* buffer,
+                                             size_t bufferSize)
+{
+    const SnapshotStreamChunkRequest* r =
+      flatbuffers::GetRoot<SnapshotStreamChunkRequest>(buffer);
+    const std::string key = r->key()->str();
+
+    // Chunks are only written by this thread, into the part of the snapshot
+    // they cover, so we don't need to hold the lock while writing
+    std::shared_ptr<IncomingSnapshot> incoming;
+    {
+        faabric::util::UniqueLock lock(incomingMx);
+        expireIncomingSnapshots();
+
+        auto it = incomingSnapshots.find(key);
+        if (it == incomingSnapshots.end()) {
+            SPDLOG_ERROR("Received chunk for unknown snapshot {}", key);
+            return;
+        }
+        incoming = it->second;
+        incoming->lastUsed = faabric::util::startTimer();
+
+        if (incoming->failed) {
+            return;
+        }
+    }
+
+    size_t offset = r->offset();
+    size_t size = r->size();
+    bool success = true;
+    try {
+        writeIncomingChunk(key, *incoming, r);
+    } catch (std::exception& e) {
+        SPDLOG_ERROR("Failed writing chunk {}-{} of snapshot {}: {}",
+                     offset,
+                     offset + size,
+                     key,
+                     e.what());
+        success = false;
+    }
+
+    {
+        faabric::util::UniqueLock lock(incomingMx);
+        if (success) {
+            incoming->bytesWritten += size;
+        } else {
+            incoming->failed = true;
+        }
+    }
+    incomingCv.notify_all();
+}
+
+void SnapshotServer::writeIncomingChunk(const std::string& key,
+                                        IncomingSnapshot& incoming,
+                                        const SnapshotStreamChunkRequest* r)
+{
+    size_t offset = r->offset();
+    size_t size = r->size();
+    if (offset + size > incoming.size) {
+        SPDLOG_ERROR("Chunk {}-{} out of range for snapshot {} (size {})",
+                     offset,
+                     offset + size,
+                     key,
+                     incoming.size);
+        throw std::runtime_error("Streamed snapshot chunk out of range");
+    }
+
+    if (r->delta() != nullptr && r->delta()->size() > 0) {
+        faabric::util::applyDelta(
+          r->delta()->data(),
+          r->delta()->size(),
+          [size](uint32_t deltaSize) {
+              if (deltaSize != size) {
+                  throw std::runtime_error("Chunk delta has the wrong size");
+              }
+          },
+          [&incoming, offset]() { return incoming.data + offset; });
+        return;
+    }
+
+    if (r->contents() == nullptr || r->contents()->size() != size) {
+        throw std::runtime_error("Chunk contents have the wrong size");
+    }
+
+    const uint8_t* contents = r->contents()->data();
+    size_t written = 0;
+    while (written < size) {
+        ssize_t res = ::pwrite(
+          incoming.fd, contents + written, size - written, offset + written);
+        if (res == -1) {
+            SPDLOG_ERROR("Failed writing chunk of snapshot {} ({})",
+                         key,
+                         ::strerror(errno));
+            throw std::runtime_error("Failed writing snapshot chunk");
+        }
+        written += res;
+    }
+}
+
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvStreamSnapshotAck(const uint8_t* buffer, size_t bufferSize)
+{
+    const SnapshotStreamAckRequest* r =
+      flatbuffers::GetRoot<SnapshotStreamAckRequest>(buffer);
+    const std::string key = r->key()->str();
+    size_t nBytes = r->n_bytes();
+
+    // Chunks arrive on the async socket, so we wait for them to catch up, or
+    // for one of them to fail
+    faabric::util::UniqueLock lock(incomingMx);
+    expireIncomingSnapshots();
+
+    std::shared_ptr<IncomingSnapshot> incoming;
+    bool caughtUp = incomingCv.wait_for(
+      lock, std::chrono::milliseconds(DEFAULT_RECV_TIMEOUT_MS), [&] {
+          auto it = incomingSnapshots.find(key);
+          if (it == incomingSnapshots.end()) {
+              return false;
+          }
+
+          incoming = it->second;
+          return incoming->failed || incoming->bytesWritten >= nBytes;
+      });
+
+    if (incoming != nullptr && incoming->failed) {
+        SPDLOG_ERROR("Streaming snapshot {} failed, dropping it", key);
+        incomingSnapshots.erase(key);
+        throw std::runtime_error("Failed receiving snapshot chunks");
+    }
+
+    if (!caughtUp) {
+        SPDLOG_ERROR("Timed out waiting for {} bytes of snapshot {}",
+                     nBytes,
+                     key);
+        throw std::runtime_error("Timed out waiting for snapshot chunks");
+    }
+
+    incoming->lastUsed = faabric::util::startTimer();
+    if (!r->complete()) {
+        return std::make_unique<faabric::EmptyResponse>();
+    }
+
+    incomingSnapshots.erase(key);
+    lock.unlock();
+
+    if (incoming->bytesWritten != incoming->size) {
+        SPDLOG_ERROR("Streamed snapshot {} has {} bytes, expected {}",
+                     key,
+                     incoming->bytesWritten,
+                     incoming->size);
+        throw std::runtime_error("Streamed snapshot size mismatch");
+    }
+
+    SPDLOG_DEBUG(
+      "Received streamed snapshot {} (size {})", key, incoming->size);
+
+    // The data is already in the fd, so the registry doesn't need to write it,
+    // and it takes over the fd and mapping. Pages sent with a manifest are
+    // indexed by the hashes in it.
+    faabric::util::SnapshotData data;
+    data.size = incoming->size;
+    data.data = incoming->data;
+    data.fd = incoming->fd;
+    faabric::snapshot::getSnapshotRegistry().takeSnapshot(
+      key, data, false, true, std::move(incoming->pageHashes));
+
+    incoming->data = nullptr;
+    incoming->fd = 0;
+
+    return std::make_unique<faabric::EmptyResponse>();
+}
 }
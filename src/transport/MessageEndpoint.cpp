@@ -152,9 +152,20 @@ Message MessageEndpoint::recvBuffer(zmq::socket_t& socket, int size)
     // Pre-allocate buffer to avoid copying data
     Message msg(size);
 
+    if (!recvIntoBuffer(socket, msg.udata(), msg.size())) {
+        return Message();
+    }
+
+    return msg;
+}
+
+bool MessageEndpoint::recvIntoBuffer(zmq::socket_t& socket,
+                                     uint8_t* buffer,
+                                     size_t size)
+{
     CATCH_ZMQ_ERR(
       try {
-          auto res = socket.recv(zmq::buffer(msg.udata(), msg.size()));
+          auto res = socket.recv(zmq::buffer(buffer, size));
 
           if (!res.has_value()) {
               SPDLOG_TRACE("Timed out receiving message of size {}", size);
@@ -171,14 +182,14 @@ Message MessageEndpoint::recvBuffer(zmq::socket_t& socket, int size)
       } catch (zmq::error_t& e) {
           if (e.num() == ZMQ_ETERM) {
               SPDLOG_WARN("Endpoint {}:{} received ETERM on recv", host, port);
-              return Message();
+              return false;
           }
 
           throw;
       },
       "recv_buffer")
 
-    return msg;
+    return true;
 }
 
 Message MessageEndpoint::recvNoBuffer(zmq::socket_t& socket)
@@ -294,6 +305,13 @@ Message RecvMessageEndpoint::recv(int size)
     return doRecv(socket, size);
 }
 
+bool RecvMessageEndpoint::recvInto(uint8_t* buffer, size_t size)
+{
+    assert(tid == std::this_thread::get_id());
+    SPDLOG_TRACE("RECV {} into buffer ({} bytes)", port, size);
+    return recvIntoBuffer(socket, buffer, size);
+}
+
 // ----------------------------------------------
 // ASYNC RECV ENDPOINT
 // ----------------------------------------------
@@ -1,29 +1,116 @@
 #include <faabric/transport/MpiMessageEndpoint.h>
 #include <faabric/util/logging.h>
-#include <faabric/util/testing.h>
+
+#include <cstring>
 
 namespace faabric::transport {
 
-MpiMessageEndpoint::MpiMessageEndpoint(const std::string& hostIn,
-                                       int sendPort,
-                                       int recvPort)
+// A world id that no world will ever have
+static const int32_t shutdownWorldId = -1;
+
+MpiSendMessageEndpoint::MpiSendMessageEndpoint(const std::string& hostIn,
+                                               int portIn)
   : host(hostIn)
-  , sendSocket(hostIn, sendPort)
-  , recvSocket(recvPort)
+  , sendSocket(hostIn, portIn)
+{}
+
+void MpiSendMessageEndpoint::sendMpiMessage(const MpiMessageHeader& header,
+                                            const uint8_t* payload)
+{
+    bool hasPayload = header.hasPayloadFrame();
+    sendSocket.send(reinterpret_cast<const uint8_t*>(&header),
+                    sizeof(MpiMessageHeader),
+                    hasPayload);
+
+    if (hasPayload) {
+        sendSocket.send(payload, header.payloadSize, false);
+    }
+}
+
+void MpiSendMessageEndpoint::sendShutdown()
+{
+    MpiMessageHeader header{};
+    header.worldId = shutdownWorldId;
+    sendSocket.send(
+      reinterpret_cast<uint8_t*>(&header), sizeof(MpiMessageHeader), false);
+}
+
+MpiRecvMessageEndpoint::MpiRecvMessageEndpoint(int portIn, int timeoutMs)
+  : recvSocket(portIn, timeoutMs)
 {}
 
-void MpiMessageEndpoint::sendMpiMessage(
-  const std::shared_ptr<faabric::MPIMessage>& msg)
+bool MpiRecvMessageEndpoint::recvHeader(MpiMessageHeader& header)
+{
+    Message headerMessage = recvSocket.recv();
+    if (headerMessage.size() == 0) {
+        return false;
+    }
+
+    if (headerMessage.size() != sizeof(MpiMessageHeader)) {
+        SPDLOG_ERROR("Unexpected MPI header size: {}", headerMessage.size());
+        throw std::runtime_error("Unexpected MPI header size");
+    }
+
+    std::memcpy(&header, headerMessage.udata(), sizeof(MpiMessageHeader));
+    if (header.worldId == shutdownWorldId) {
+        return false;
+    }
+
+    if (headerMessage.more() != header.hasPayloadFrame()) {
+        SPDLOG_ERROR("MPI header for {} bytes sent with SNDMORE {}",
+                     header.payloadSize,
+                     headerMessage.more());
+        throw std::runtime_error("MPI header sent with wrong SNDMORE flag");
+    }
+
+    return true;
+}
+
+bool MpiRecvMessageEndpoint::recvPayload(uint8_t* buffer, size_t bufferSize)
 {
-    SERIALISE_MSG_PTR(msg)
-    sendSocket.send(buffer, msgSize, false);
+    return recvSocket.recvInto(buffer, bufferSize);
+}
+
+std::shared_ptr<faabric::MPIMessage> MpiRecvMessageEndpoint::recvMpiMessage(
+  MpiMessageHeader& header)
+{
+    if (!recvHeader(header)) {
+        return nullptr;
+    }
+
+    if (header.kind != MpiMessageKind::Eager) {
+        SPDLOG_ERROR("Expected eager MPI message, got kind {}",
+                     static_cast<int>(header.kind));
+        throw std::runtime_error("Expected eager MPI message");
+    }
+
+    auto msg = mpiMessageFromHeader(header);
+    if (header.payloadSize > 0) {
+        std::string* buffer = msg->mutable_buffer();
+        buffer->resize(header.payloadSize);
+        if (!recvPayload(reinterpret_cast<uint8_t*>(buffer->data()),
+                         header.payloadSize)) {
+            return nullptr;
+        }
+    }
+
+    return msg;
 }
 
-std::shared_ptr<faabric::MPIMessage> MpiMessageEndpoint::recvMpiMessage()
+std::shared_ptr<faabric::MPIMessage> mpiMessageFromHeader(
+  const MpiMessageHeader& header)
 {
-    Message m = recvSocket.recv();
-    PARSE_MSG(faabric::MPIMessage, m.data(), m.size());
+    auto msg = std::make_shared<faabric::MPIMessage>();
+    msg->set_id(header.id);
+    msg->set_worldid(header.worldId);
+    msg->set_sender(header.sender);
+    msg->set_destination(header.destination);
+    msg->set_type(header.datatype);
+    msg->set_count(header.count);
+    msg->set_tag(header.tag);
+    msg->set_messagetype(
+      static_cast<faabric::MPIMessage::MPIMessageType>(header.messageType));
 
-    return std::make_shared<faabric::MPIMessage>(msg);
+    return msg;
 }
 }
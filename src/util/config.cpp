@@ -23,8 +23,22 @@ void SystemConfig::initialise()
     logLevel = getEnvVar("LOG_LEVEL", "info");
     logFile = getEnvVar("LOG_FILE", "off");
     stateMode = getEnvVar("STATE_MODE", "inmemory");
+    // Snapshots are delta-encoded by default, "none" turns this off
     deltaSnapshotEncoding =
       getEnvVar("DELTA_SNAPSHOT_ENCODING", "pages=4096;xor;zstd=1");
+    dirtyTrackingMode = getEnvVar("DIRTY_TRACKING_MODE", "softpte");
+    snapshotDiffMergeGap =
+      this->getSystemConfIntParam("SNAPSHOT_DIFF_MERGE_GAP", "0");
+    snapshotChunkSize =
+      this->getSystemConfIntParam("SNAPSHOT_CHUNK_SIZE", "1048576");
+    snapshotChunkWindow =
+      this->getSystemConfIntParam("SNAPSHOT_CHUNK_WINDOW", "4");
+    snapshotPageDedup =
+      this->getSystemConfIntParam("SNAPSHOT_PAGE_DEDUP", "1");
+    snapshotPageCacheMb =
+      this->getSystemConfIntParam("SNAPSHOT_PAGE_CACHE_MB", "1024");
+    snapshotStreamExpiryMs =
+      this->getSystemConfIntParam("SNAPSHOT_STREAM_EXPIRY_MS", "60000");
 
     // Redis
     redisStateHost = getEnvVar("REDIS_STATE_HOST", "localhost");
@@ -34,6 +48,18 @@ void SystemConfig::initialise()
     // Scheduling
     noScheduler = this->getSystemConfIntParam("NO_SCHEDULER", "0");
     overrideCpuCount = this->getSystemConfIntParam("OVERRIDE_CPU_COUNT", "0");
+    schedulingPolicy = getEnvVar("SCHEDULING_POLICY", "binpack");
+    resourcePushIntervalMs =
+      this->getSystemConfIntParam("RESOURCE_PUSH_INTERVAL_MS", "1000");
+    resourcePushThreshold =
+      this->getSystemConfIntParam("RESOURCE_PUSH_THRESHOLD", "4");
+    resourceTableTtlMs =
+      this->getSystemConfIntParam("RESOURCE_TABLE_TTL_MS", "10000");
+    resultBatchSize = this->getSystemConfIntParam("RESULT_BATCH_SIZE", "64");
+    resultFlushIntervalUs =
+      this->getSystemConfIntParam("RESULT_FLUSH_INTERVAL_US", "500");
+    pendingResultExpiryMs =
+      this->getSystemConfIntParam("PENDING_RESULT_EXPIRY_MS", "30000");
 
     // Worker-related timeouts (all in seconds)
     globalMessageTimeout =
@@ -43,6 +69,11 @@ void SystemConfig::initialise()
     // MPI
     defaultMpiWorldSize =
       this->getSystemConfIntParam("DEFAULT_MPI_WORLD_SIZE", "5");
+    mpiRendezvousThreshold =
+      this->getSystemConfIntParam("MPI_RENDEZVOUS_THRESHOLD", "65536");
+    mpiEagerLimit = this->getSystemConfIntParam("MPI_EAGER_LIMIT", "1048576");
+    mpiChunkSize = this->getSystemConfIntParam("MPI_CHUNK_SIZE", "262144");
+    mpiAllReduceAlgorithm = getEnvVar("MPI_ALLREDUCE_ALGORITHM", "auto");
 
     // Endpoint
     endpointInterface = getEnvVar("ENDPOINT_INTERFACE", "");
@@ -80,6 +111,13 @@ void SystemConfig::print()
     SPDLOG_INFO("LOG_FILE                   {}", logFile);
     SPDLOG_INFO("STATE_MODE                 {}", stateMode);
     SPDLOG_INFO("DELTA_SNAPSHOT_ENCODING    {}", deltaSnapshotEncoding);
+    SPDLOG_INFO("DIRTY_TRACKING_MODE        {}", dirtyTrackingMode);
+    SPDLOG_INFO("SNAPSHOT_DIFF_MERGE_GAP    {}", snapshotDiffMergeGap);
+    SPDLOG_INFO("SNAPSHOT_CHUNK_SIZE        {}", snapshotChunkSize);
+    SPDLOG_INFO("SNAPSHOT_CHUNK_WINDOW      {}", snapshotChunkWindow);
+    SPDLOG_INFO("SNAPSHOT_PAGE_DEDUP        {}", snapshotPageDedup);
+    SPDLOG_INFO("SNAPSHOT_PAGE_CACHE_MB     {}", snapshotPageCacheMb);
+    SPDLOG_INFO("SNAPSHOT_STREAM_EXPIRY_MS  {}", snapshotStreamExpiryMs);
 
     SPDLOG_INFO("--- Redis ---");
     SPDLOG_INFO("REDIS_STATE_HOST           {}", redisStateHost);
@@ -89,6 +127,13 @@ void SystemConfig::print()
     SPDLOG_INFO("--- Scheduling ---");
     SPDLOG_INFO("NO_SCHEDULER               {}", noScheduler);
     SPDLOG_INFO("OVERRIDE_CPU_COUNT         {}", overrideCpuCount);
+    SPDLOG_INFO("SCHEDULING_POLICY          {}", schedulingPolicy);
+    SPDLOG_INFO("RESOURCE_PUSH_INTERVAL_MS  {}", resourcePushIntervalMs);
+    SPDLOG_INFO("RESOURCE_PUSH_THRESHOLD    {}", resourcePushThreshold);
+    SPDLOG_INFO("RESOURCE_TABLE_TTL_MS      {}", resourceTableTtlMs);
+    SPDLOG_INFO("RESULT_BATCH_SIZE          {}", resultBatchSize);
+    SPDLOG_INFO("RESULT_FLUSH_INTERVAL_US   {}", resultFlushIntervalUs);
+    SPDLOG_INFO("PENDING_RESULT_EXPIRY_MS   {}", pendingResultExpiryMs);
 
     SPDLOG_INFO("--- Timeouts ---");
     SPDLOG_INFO("GLOBAL_MESSAGE_TIMEOUT     {}", globalMessageTimeout);
@@ -96,6 +141,10 @@ void SystemConfig::print()
 
     SPDLOG_INFO("--- MPI ---");
     SPDLOG_INFO("DEFAULT_MPI_WORLD_SIZE  {}", defaultMpiWorldSize);
+    SPDLOG_INFO("MPI_RENDEZVOUS_THRESHOLD   {}", mpiRendezvousThreshold);
+    SPDLOG_INFO("MPI_EAGER_LIMIT            {}", mpiEagerLimit);
+    SPDLOG_INFO("MPI_CHUNK_SIZE             {}", mpiChunkSize);
+    SPDLOG_INFO("MPI_ALLREDUCE_ALGORITHM    {}", mpiAllReduceAlgorithm);
 
     SPDLOG_INFO("--- Endpoint ---");
     SPDLOG_INFO("ENDPOINT_INTERFACE         {}", endpointInterface);
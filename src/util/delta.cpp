@@ -57,6 +57,47 @@ std::string DeltaSettings::toString() const
     return ss.str();
 }
 
+static std::vector<uint8_t> compressDelta(const DeltaSettings& cfg,
+                                          std::vector<uint8_t> outb)
+{
+    if (!cfg.useZstd) {
+        outb.shrink_to_fit();
+        return outb;
+    } else {
+        std::vector<uint8_t> compressBuffer;
+        size_t compressBound = ZSTD_compressBound(outb.size());
+        compressBuffer.reserve(compressBound + 19);
+        compressBuffer.push_back(DELTA_PROTOCOL_VERSION);
+        compressBuffer.push_back(DELTACMD_ZSTD_COMPRESSED_COMMANDS);
+        size_t idxComprLen = compressBuffer.size();
+        appendBytesOf(compressBuffer, uint64_t(0xDEAD)); // to be filled in
+        appendBytesOf(compressBuffer, uint64_t(outb.size()));
+        size_t idxCDataStart = compressBuffer.size();
+        compressBuffer.insert(compressBuffer.end(), compressBound, uint8_t(0));
+        auto zstdResult = ZSTD_compress(compressBuffer.data() + idxCDataStart,
+                                        compressBuffer.size() - idxCDataStart,
+                                        outb.data(),
+                                        outb.size(),
+                                        cfg.zstdLevel);
+        if (ZSTD_isError(zstdResult)) {
+            auto error = ZSTD_getErrorName(zstdResult);
+            throw std::runtime_error(std::string("ZSTD compression error: ") +
+                                     error);
+        } else {
+            compressBuffer.resize(idxCDataStart + zstdResult);
+        }
+        {
+            uint64_t comprLen = zstdResult;
+            std::copy_n(reinterpret_cast<uint8_t*>(&comprLen),
+                        sizeof(uint64_t),
+                        compressBuffer.data() + idxComprLen);
+        }
+        compressBuffer.push_back(DELTACMD_END);
+        compressBuffer.shrink_to_fit();
+        return compressBuffer;
+    }
+}
+
 std::vector<uint8_t> serializeDelta(const DeltaSettings& cfg,
                                     const uint8_t* oldDataStart,
                                     size_t oldDataLen,
@@ -119,18 +160,18 @@ std::vector<uint8_t> serializeDelta(const DeltaSettings& cfg,
             if (startInBoth && endInBoth) {
                 bool anyChanges = !std::equal(newDataStart + pageStart,
                                               newDataStart + pageEnd,
-                                              oldDataStart);
+                                              oldDataStart + pageStart);
                 if (anyChanges) {
                     encodeChangedRegion(pageStart, cfg.pageSize);
                 }
             } else if (!startInBoth) {
                 using namespace std::placeholders;
+                size_t newPageEnd = std::min(pageEnd, newDataLen);
                 if (std::any_of(
                       newDataStart + pageStart,
-                      newDataStart + pageEnd,
+                      newDataStart + newPageEnd,
                       std::bind(std::not_equal_to<uint8_t>(), 0, _1))) {
-                    encodeNewRegion(pageStart,
-                                    std::min(pageEnd, newDataLen) - pageStart);
+                    encodeNewRegion(pageStart, newPageEnd - pageStart);
                 }
             } else {
                 encodeNewRegion(pageStart,
@@ -147,70 +188,86 @@ std::vector<uint8_t> serializeDelta(const DeltaSettings& cfg,
         }
     }
     outb.push_back(DELTACMD_END);
-    outb.shrink_to_fit();
-    if (!cfg.useZstd) {
-        return outb;
-    } else {
-        std::vector<uint8_t> compressBuffer;
-        size_t compressBound = ZSTD_compressBound(outb.size());
-        compressBuffer.reserve(compressBound + 19);
-        compressBuffer.push_back(DELTA_PROTOCOL_VERSION);
-        compressBuffer.push_back(DELTACMD_ZSTD_COMPRESSED_COMMANDS);
-        size_t idxComprLen = compressBuffer.size();
-        appendBytesOf(compressBuffer, uint64_t(0xDEAD)); // to be filled in
-        appendBytesOf(compressBuffer, uint64_t(outb.size()));
-        size_t idxCDataStart = compressBuffer.size();
-        compressBuffer.insert(compressBuffer.end(), compressBound, uint8_t(0));
-        auto zstdResult = ZSTD_compress(compressBuffer.data() + idxCDataStart,
-                                        compressBuffer.size() - idxCDataStart,
-                                        outb.data(),
-                                        outb.size(),
-                                        cfg.zstdLevel);
-        if (ZSTD_isError(zstdResult)) {
-            auto error = ZSTD_getErrorName(zstdResult);
-            throw std::runtime_error(std::string("ZSTD compression error: ") +
-                                     error);
-        } else {
-            compressBuffer.resize(idxCDataStart + zstdResult);
-        }
-        {
-            uint64_t comprLen = zstdResult;
-            std::copy_n(reinterpret_cast<uint8_t*>(&comprLen),
-                        sizeof(uint64_t),
-                        compressBuffer.data() + idxComprLen);
-        }
-        compressBuffer.push_back(DELTACMD_END);
-        compressBuffer.shrink_to_fit();
-        return compressBuffer;
+
+    return compressDelta(cfg, std::move(outb));
+}
+
+std::vector<uint8_t> serializeDiffsDelta(
+  const DeltaSettings& cfg,
+  const std::vector<SnapshotDiff>& diffs)
+{
+    size_t nBytes = 0;
+    for (const auto& d : diffs) {
+        nBytes += d.size;
+    }
+
+    std::vector<uint8_t> outb;
+    outb.reserve(2 + (diffs.size() * 9) + nBytes);
+    outb.push_back(DELTA_PROTOCOL_VERSION);
+    for (const auto& d : diffs) {
+        outb.push_back(DELTACMD_DELTA_OVERWRITE);
+        appendBytesOf(outb, uint32_t(d.offset));
+        appendBytesOf(outb, uint32_t(d.size));
+        outb.insert(outb.end(), d.data, d.data + d.size);
     }
+    outb.push_back(DELTACMD_END);
+
+    return compressDelta(cfg, std::move(outb));
 }
 
-void applyDelta(const std::vector<uint8_t>& delta,
-                std::function<void(uint32_t)> setDataSize,
-                std::function<uint8_t*()> getDataPointer)
+// Reads from a delta held anywhere, rather than only in a vector
+template<class T>
+static size_t readDeltaBytes(const uint8_t* delta,
+                             size_t deltaLen,
+                             size_t offset,
+                             T* outValue)
+{
+    if (offset >= deltaLen || offset + sizeof(T) > deltaLen) {
+        throw std::range_error("Trying to read bytes out of delta range");
+    }
+    uint8_t* outStart = reinterpret_cast<uint8_t*>(outValue);
+    std::copy_n(delta + offset, sizeof(T), outStart);
+    return offset + sizeof(T);
+}
+
+std::vector<std::pair<size_t, size_t>> applyDelta(
+  const std::vector<uint8_t>& delta,
+  std::function<void(uint32_t)> setDataSize,
+  std::function<uint8_t*()> getDataPointer)
+{
+    return applyDelta(delta.data(), delta.size(), setDataSize, getDataPointer);
+}
+
+std::vector<std::pair<size_t, size_t>> applyDelta(
+  const uint8_t* delta,
+  size_t deltaLen,
+  std::function<void(uint32_t)> setDataSize,
+  std::function<uint8_t*()> getDataPointer)
 {
-    size_t deltaLen = delta.size();
     if (deltaLen < 2) {
         throw std::runtime_error("Delta too short to be valid");
     }
-    if (delta.at(0) != DELTA_PROTOCOL_VERSION) {
+    if (delta[0] != DELTA_PROTOCOL_VERSION) {
         throw std::runtime_error("Unsupported delta version");
     }
+    std::vector<std::pair<size_t, size_t>> written;
     size_t readIdx = 1;
     while (readIdx < deltaLen) {
-        uint8_t cmd = delta.at(readIdx);
+        uint8_t cmd = delta[readIdx];
         readIdx++;
         switch (cmd) {
             case DELTACMD_TOTAL_SIZE: {
                 uint32_t totalSize{};
-                readIdx = readBytesOf(delta, readIdx, &totalSize);
+                readIdx = readDeltaBytes(delta, deltaLen, readIdx, &totalSize);
                 setDataSize(totalSize);
                 break;
             }
             case DELTACMD_ZSTD_COMPRESSED_COMMANDS: {
                 uint64_t compressedSize{}, decompressedSize{};
-                readIdx = readBytesOf(delta, readIdx, &compressedSize);
-                readIdx = readBytesOf(delta, readIdx, &decompressedSize);
+                readIdx =
+                  readDeltaBytes(delta, deltaLen, readIdx, &compressedSize);
+                readIdx =
+                  readDeltaBytes(delta, deltaLen, readIdx, &decompressedSize);
                 if (readIdx + compressedSize > deltaLen) {
                     throw std::range_error(
                       "Delta compressed commands block goes out of range:");
@@ -218,7 +275,7 @@ void applyDelta(const std::vector<uint8_t>& delta,
                 std::vector<uint8_t> decompressedCmds(decompressedSize, 0);
                 auto zstdResult = ZSTD_decompress(decompressedCmds.data(),
                                                   decompressedCmds.size(),
-                                                  delta.data() + readIdx,
+                                                  delta + readIdx,
                                                   compressedSize);
                 if (ZSTD_isError(zstdResult)) {
                     auto error = ZSTD_getErrorName(zstdResult);
@@ -228,36 +285,42 @@ void applyDelta(const std::vector<uint8_t>& delta,
                     throw std::runtime_error(
                       "Mismatched decompression sizes in the NDP delta");
                 }
-                applyDelta(decompressedCmds, setDataSize, getDataPointer);
+                auto decompressedWritten =
+                  applyDelta(decompressedCmds, setDataSize, getDataPointer);
+                written.insert(written.end(),
+                               decompressedWritten.begin(),
+                               decompressedWritten.end());
                 readIdx += compressedSize;
                 break;
             }
             case DELTACMD_DELTA_OVERWRITE: {
                 uint32_t offset{}, length{};
-                readIdx = readBytesOf(delta, readIdx, &offset);
-                readIdx = readBytesOf(delta, readIdx, &length);
+                readIdx = readDeltaBytes(delta, deltaLen, readIdx, &offset);
+                readIdx = readDeltaBytes(delta, deltaLen, readIdx, &length);
                 if (readIdx + length > deltaLen) {
                     throw std::range_error(
                       "Delta overwrite block goes out of range");
                 }
                 uint8_t* data = getDataPointer();
-                std::copy_n(delta.data() + readIdx, length, data + offset);
+                std::copy_n(delta + readIdx, length, data + offset);
+                written.emplace_back(offset, length);
                 readIdx += length;
                 break;
             }
             case DELTACMD_DELTA_XOR: {
                 uint32_t offset{}, length{};
-                readIdx = readBytesOf(delta, readIdx, &offset);
-                readIdx = readBytesOf(delta, readIdx, &length);
+                readIdx = readDeltaBytes(delta, deltaLen, readIdx, &offset);
+                readIdx = readDeltaBytes(delta, deltaLen, readIdx, &length);
                 if (readIdx + length > deltaLen) {
                     throw std::range_error("Delta XOR block goes out of range");
                 }
                 uint8_t* data = getDataPointer();
-                std::transform(delta.data() + readIdx,
-                               delta.data() + readIdx + length,
+                std::transform(delta + readIdx,
+                               delta + readIdx + length,
                                data + offset,
                                data + offset,
                                std::bit_xor<uint8_t>());
+                written.emplace_back(offset, length);
                 readIdx += length;
                 break;
             }
@@ -267,6 +330,8 @@ void applyDelta(const std::vector<uint8_t>& delta,
             }
         }
     }
+
+    return written;
 }
 
 }
@@ -0,0 +1,343 @@
+#include <faabric/util/config.h>
+#include <faabric/util/dirty.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#define MAX_TRACKED_REGIONS 64
+
+namespace faabric::util {
+
+// -------------------------
+// Soft PTE
+// -------------------------
+
+void SoftPTEDirtyTracker::resetTracking(uint8_t* ptr, size_t size)
+{
+    faabric::util::UniqueLock lock(mx);
+
+    // Clearing the bits loses what's been written to the other regions
+    for (auto& p : allDirty) {
+        if (p.first != ptr) {
+            p.second = true;
+        }
+    }
+
+    if (ptr != nullptr) {
+        allDirty[ptr] = false;
+    }
+
+    resetDirtyTracking();
+}
+
+void SoftPTEDirtyTracker::stopTracking(uint8_t* ptr, size_t size)
+{
+    faabric::util::UniqueLock lock(mx);
+    allDirty.erase(ptr);
+}
+
+// Writes from the kernel set the soft-dirty bits like any other
+void SoftPTEDirtyTracker::markDirty(uint8_t* ptr, size_t size) {}
+
+std::vector<int> SoftPTEDirtyTracker::getDirtyPageNumbers(const uint8_t* ptr,
+                                                          int nPages)
+{
+    {
+        faabric::util::UniqueLock lock(mx);
+        auto it = allDirty.find(ptr);
+        if (it != allDirty.end() && it->second) {
+            std::vector<int> pageNumbers(nPages);
+            for (int i = 0; i < nPages; i++) {
+                pageNumbers[i] = i;
+            }
+
+            return pageNumbers;
+        }
+    }
+
+    return faabric::util::getDirtyPageNumbers(ptr, nPages);
+}
+
+// -------------------------
+// Segfault
+// -------------------------
+
+// The fault handler can't take locks or allocate, so tracked regions live in a
+// fixed table, and are published by setting their start once everything else
+// is in place. Changes to the table are made holding the mutex.
+struct TrackedRegion
+{
+    std::atomic<uint8_t*> start = nullptr;
+    std::atomic<size_t> nPages = 0;
+    std::atomic<std::atomic<uint8_t>*> dirtyFlags = nullptr;
+
+    // Only replaced when the region needs more flags than it has
+    std::unique_ptr<std::atomic<uint8_t>[]> flags = nullptr;
+    size_t flagsCapacity = 0;
+};
+
+static std::array<TrackedRegion, MAX_TRACKED_REGIONS> trackedRegions;
+
+static std::mutex trackedRegionsMx;
+
+static struct sigaction previousAction;
+
+// Only writes to mapped but write-protected pages are ours. Anything else,
+// e.g. a read of unmapped memory, is a genuine fault.
+static bool isWriteProtectionFault(siginfo_t* info, void* context)
+{
+    if (info->si_code != SEGV_ACCERR) {
+        return false;
+    }
+
+#if defined(__x86_64__)
+    // Bit 1 of the page fault error code is set for writes
+    auto* ucontext = (ucontext_t*)context;
+    return (ucontext->uc_mcontext.gregs[REG_ERR] & 0x2) != 0;
+#else
+    return true;
+#endif
+}
+
+static void handleWriteFault(int sig, siginfo_t* info, void* context)
+{
+    auto* addr = (uint8_t*)info->si_addr;
+    bool isWrite = isWriteProtectionFault(info, context);
+
+    for (TrackedRegion& region : trackedRegions) {
+        uint8_t* start = region.start.load(std::memory_order_acquire);
+        if (!isWrite || start == nullptr || addr < start) {
+            continue;
+        }
+
+        size_t pageIdx = (addr - start) / HOST_PAGE_SIZE;
+        if (pageIdx >= region.nPages.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        region.dirtyFlags.load(std::memory_order_relaxed)[pageIdx].store(
+          1, std::memory_order_relaxed);
+        ::mprotect(start + (pageIdx * HOST_PAGE_SIZE),
+                   HOST_PAGE_SIZE,
+                   PROT_READ | PROT_WRITE);
+        return;
+    }
+
+    // Not one of ours, so hand it on to whatever was handling it before
+    if (previousAction.sa_flags & SA_SIGINFO) {
+        previousAction.sa_sigaction(sig, info, context);
+    } else if (previousAction.sa_handler != SIG_DFL &&
+               previousAction.sa_handler != SIG_IGN) {
+        previousAction.sa_handler(sig);
+    } else {
+        // Returning re-runs the faulting instruction with the default action
+        ::signal(SIGSEGV, SIG_DFL);
+    }
+}
+
+// Other code (e.g. test frameworks) may replace the handler after we've
+// installed it, so we check it's still in place whenever a region is reset
+static void installWriteFaultHandler()
+{
+    struct sigaction currentAction;
+    ::sigaction(SIGSEGV, nullptr, &currentAction);
+    if ((currentAction.sa_flags & SA_SIGINFO) &&
+        currentAction.sa_sigaction == handleWriteFault) {
+        return;
+    }
+
+    struct sigaction action;
+    action.sa_sigaction = handleWriteFault;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+
+    if (::sigaction(SIGSEGV, &action, &previousAction) != 0) {
+        SPDLOG_ERROR("Failed to install write fault handler ({})",
+                     strerror(errno));
+        throw std::runtime_error("Failed to install write fault handler");
+    }
+}
+
+static TrackedRegion* findRegionContaining(const uint8_t* ptr)
+{
+    for (TrackedRegion& region : trackedRegions) {
+        uint8_t* start = region.start.load();
+        if (start != nullptr && ptr >= start &&
+            ptr < start + (region.nPages.load() * HOST_PAGE_SIZE)) {
+            return &region;
+        }
+    }
+
+    return nullptr;
+}
+
+void SegfaultDirtyTracker::resetTracking(uint8_t* ptr, size_t size)
+{
+    if (ptr == nullptr || size == 0) {
+        return;
+    }
+
+    if (!isPageAligned(ptr)) {
+        SPDLOG_ERROR("Tracking non page-aligned address {}", (void*)ptr);
+        throw std::runtime_error("Tracking non page-aligned address");
+    }
+
+    size_t nPages = getRequiredHostPages(size);
+
+    faabric::util::UniqueLock lock(trackedRegionsMx);
+    installWriteFaultHandler();
+
+    TrackedRegion* region = findRegionContaining(ptr);
+    if (region != nullptr && region->start.load() != ptr) {
+        SPDLOG_ERROR("Tracking {} inside another tracked region", (void*)ptr);
+        throw std::runtime_error("Tracking region inside another");
+    }
+
+    for (int i = 0; region == nullptr && i < MAX_TRACKED_REGIONS; i++) {
+        if (trackedRegions.at(i).start.load() == nullptr) {
+            region = &trackedRegions.at(i);
+        }
+    }
+
+    if (region == nullptr) {
+        SPDLOG_ERROR("Cannot track more than {} regions", MAX_TRACKED_REGIONS);
+        throw std::runtime_error("Too many tracked regions");
+    }
+
+    // Take the region out of the table while its flags are changed, then
+    // publish it again before any of its pages are protected
+    region->start.store(nullptr);
+    if (region->flagsCapacity < nPages) {
+        region->flags = std::make_unique<std::atomic<uint8_t>[]>(nPages);
+        region->flagsCapacity = nPages;
+        region->dirtyFlags.store(region->flags.get());
+    }
+
+    for (size_t i = 0; i < nPages; i++) {
+        region->flags[i].store(0, std::memory_order_relaxed);
+    }
+
+    region->nPages.store(nPages);
+    region->start.store(ptr, std::memory_order_release);
+
+    if (::mprotect(ptr, nPages * HOST_PAGE_SIZE, PROT_READ) != 0) {
+        region->start.store(nullptr);
+        SPDLOG_ERROR("Failed to write-protect {} ({})",
+                     (void*)ptr,
+                     strerror(errno));
+        throw std::runtime_error("Failed to write-protect tracked region");
+    }
+}
+
+void SegfaultDirtyTracker::stopTracking(uint8_t* ptr, size_t size)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    faabric::util::UniqueLock lock(trackedRegionsMx);
+    TrackedRegion* region = findRegionContaining(ptr);
+    if (region == nullptr || region->start.load() != ptr) {
+        return;
+    }
+
+    // The memory may already have been unmapped, in which case there's
+    // nothing to unprotect
+    size_t nBytes = region->nPages.load() * HOST_PAGE_SIZE;
+    if (::mprotect(ptr, nBytes, PROT_READ | PROT_WRITE) != 0) {
+        SPDLOG_DEBUG("Failed to unprotect {} ({})", (void*)ptr, errno);
+    }
+
+    region->start.store(nullptr);
+}
+
+void SegfaultDirtyTracker::markDirty(uint8_t* ptr, size_t size)
+{
+    if (ptr == nullptr || size == 0) {
+        return;
+    }
+
+    faabric::util::UniqueLock lock(trackedRegionsMx);
+    TrackedRegion* region = findRegionContaining(ptr);
+    if (region == nullptr) {
+        return;
+    }
+
+    uint8_t* start = region->start.load();
+    size_t offset = ptr - start;
+    size_t firstIdx = offset / HOST_PAGE_SIZE;
+    size_t endIdx = std::min(region->nPages.load(),
+                             getRequiredHostPages(offset + size));
+
+    for (size_t i = firstIdx; i < endIdx; i++) {
+        region->flags[i].store(1, std::memory_order_relaxed);
+    }
+
+    uint8_t* firstPage = start + (firstIdx * HOST_PAGE_SIZE);
+    size_t nBytes = (endIdx - firstIdx) * HOST_PAGE_SIZE;
+    if (::mprotect(firstPage, nBytes, PROT_READ | PROT_WRITE) != 0) {
+        SPDLOG_ERROR("Failed to unprotect {} ({})",
+                     (void*)firstPage,
+                     strerror(errno));
+        throw std::runtime_error("Failed to unprotect dirty pages");
+    }
+}
+
+std::vector<int> SegfaultDirtyTracker::getDirtyPageNumbers(const uint8_t* ptr,
+                                                           int nPages)
+{
+    faabric::util::UniqueLock lock(trackedRegionsMx);
+    TrackedRegion* region = findRegionContaining(ptr);
+
+    std::vector<int> pageNumbers;
+    if (region == nullptr) {
+        pageNumbers.reserve(nPages);
+        for (int i = 0; i < nPages; i++) {
+            pageNumbers.emplace_back(i);
+        }
+
+        return pageNumbers;
+    }
+
+    // Pages past the end of the region aren't tracked, so count as dirty
+    size_t firstIdx = (ptr - region->start.load()) / HOST_PAGE_SIZE;
+    size_t regionPages = region->nPages.load();
+    for (int i = 0; i < nPages; i++) {
+        size_t pageIdx = firstIdx + i;
+        if (pageIdx >= regionPages ||
+            region->flags[pageIdx].load(std::memory_order_relaxed)) {
+            pageNumbers.emplace_back(i);
+        }
+    }
+
+    return pageNumbers;
+}
+
+DirtyTracker& getDirtyTracker()
+{
+    static SoftPTEDirtyTracker softPTETracker;
+    static SegfaultDirtyTracker segfaultTracker;
+
+    const std::string& mode = getSystemConfig().dirtyTrackingMode;
+    if (mode == "softpte") {
+        return softPTETracker;
+    }
+
+    if (mode == "segfault") {
+        return segfaultTracker;
+    }
+
+    SPDLOG_ERROR("Unrecognised dirty tracking mode: {}", mode);
+    throw std::runtime_error("Unrecognised dirty tracking mode");
+}
+}
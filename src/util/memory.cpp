@@ -100,35 +100,37 @@ void resetDirtyTracking()
     fclose(fd);
 }
 
+// The pagemap is opened once and kept open, as reads don't depend on the file
+// position
+static int getPagemapFd()
+{
+    static int fd = [] {
+        int pagemapFd = ::open(PAGEMAP, O_RDONLY);
+        if (pagemapFd < 0) {
+            SPDLOG_ERROR("Could not open pagemap ({})", strerror(errno));
+            throw std::runtime_error("Could not open pagemap");
+        }
+
+        return pagemapFd;
+    }();
+
+    return fd;
+}
+
 std::vector<uint64_t> readPagemapEntries(uintptr_t ptr, int nEntries)
 {
     // Work out offset for this pointer in the pagemap
     off_t offset = (ptr / getpagesize()) * PAGEMAP_ENTRY_BYTES;
 
-    // Open the pagemap
-    FILE* fd = fopen(PAGEMAP, "rb");
-    if (fd == nullptr) {
-        SPDLOG_ERROR("Could not open pagemap ({})", strerror(errno));
-        throw std::runtime_error("Could not open pagemap");
-    }
-
-    // Skip to location of this page
-    int r = fseek(fd, offset, SEEK_SET);
-    if (r < 0) {
-        SPDLOG_ERROR("Could not seek pagemap ({})", r);
-        throw std::runtime_error("Could not seek pagemap");
-    }
-
     // Read the entries
     std::vector<uint64_t> entries(nEntries, 0);
-    int nRead = fread(entries.data(), PAGEMAP_ENTRY_BYTES, nEntries, fd);
-    if (nRead != nEntries) {
-        SPDLOG_ERROR("Could not read pagemap ({} != {})", nRead, nEntries);
+    size_t nBytes = nEntries * PAGEMAP_ENTRY_BYTES;
+    ssize_t nRead = ::pread(getPagemapFd(), entries.data(), nBytes, offset);
+    if (nRead != (ssize_t)nBytes) {
+        SPDLOG_ERROR("Could not read pagemap ({} != {})", nRead, nBytes);
         throw std::runtime_error("Could not read pagemap");
     }
 
-    fclose(fd);
-
     return entries;
 }
 
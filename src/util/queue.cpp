@@ -1,8 +1,11 @@
 #include <faabric/util/queue.h>
 
+#include <algorithm>
+
 namespace faabric::util {
 TokenPool::TokenPool(int nTokens)
   : _size(nTokens)
+  , queue(std::max(nTokens, 1))
 {
     // Initialise all tokens as available
     for (int i = 0; i < nTokens; i++) {
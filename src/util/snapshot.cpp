@@ -1,9 +1,81 @@
+#include <faabric/util/config.h>
+#include <faabric/util/dirty.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/memory.h>
 #include <faabric/util/snapshot.h>
 
+#include <algorithm>
+#include <cstring>
+#include <openssl/sha.h>
+
 namespace faabric::util {
 
+// Pages are compared in blocks of this many bytes, a word at a time, in
+// fixed-size loops the compiler can vectorise. Blocks that differ are turned
+// into a mask with a bit per byte, so diffs can be found from where the bits
+// change rather than byte by byte.
+#define DIFF_BLOCK_BYTES 32
+#define DIFF_BLOCK_WORDS (DIFF_BLOCK_BYTES / sizeof(uint64_t))
+
+// Sets bit i of the result if byte i of the word is non-zero. The bits are
+// folded down to the bottom of each byte, then multiplied up into the top
+// byte, none of the partial products overlapping.
+static uint32_t getNonZeroBytes(uint64_t word)
+{
+    word |= word >> 4;
+    word |= word >> 2;
+    word |= word >> 1;
+    word &= 0x0101010101010101ULL;
+
+    return (uint32_t)((word * 0x0102040810204080ULL) >> 56);
+}
+
+static uint32_t getDiffMask(const uint8_t* a, const uint8_t* b)
+{
+    uint64_t xors[DIFF_BLOCK_WORDS];
+    uint64_t differentBits = 0;
+    for (size_t i = 0; i < DIFF_BLOCK_WORDS; i++) {
+        uint64_t wordA;
+        uint64_t wordB;
+        std::memcpy(&wordA, a + (i * sizeof(uint64_t)), sizeof(uint64_t));
+        std::memcpy(&wordB, b + (i * sizeof(uint64_t)), sizeof(uint64_t));
+        xors[i] = wordA ^ wordB;
+        differentBits |= xors[i];
+    }
+
+    if (differentBits == 0) {
+        return 0;
+    }
+
+    // Memory is little-endian, so the first byte is the lowest in each word
+    uint32_t mask = 0;
+    for (size_t i = 0; i < DIFF_BLOCK_WORDS; i++) {
+        mask |= getNonZeroBytes(xors[i]) << (i * sizeof(uint64_t));
+    }
+
+    return mask;
+}
+
+// Adds a diff of the given bytes of the base, extending the previous diff to
+// cover it instead if the gap between them is no bigger than the merge gap
+static void addDiff(std::vector<SnapshotDiff>& diffs,
+                    const uint8_t* base,
+                    size_t offset,
+                    size_t size,
+                    size_t mergeGap)
+{
+    if (!diffs.empty()) {
+        SnapshotDiff& last = diffs.back();
+        size_t lastEnd = last.offset + last.size;
+        if (offset >= lastEnd && offset - lastEnd <= mergeGap) {
+            last.size = offset + size - last.offset;
+            return;
+        }
+    }
+
+    diffs.emplace_back(offset, base + offset, size);
+}
+
 std::vector<SnapshotDiff> SnapshotData::getDirtyPages()
 {
     if (data == nullptr || size == 0) {
@@ -13,17 +85,20 @@ std::vector<SnapshotDiff> SnapshotData::getDirtyPages()
 
     // Get dirty pages
     int nPages = getRequiredHostPages(size);
-    std::vector<int> dirtyPageNumbers = getDirtyPageNumbers(data, nPages);
+    std::vector<int> dirtyPageNumbers =
+      getDirtyTracker().getDirtyPageNumbers(data, nPages);
 
-    // Convert to snapshot diffs
-    // TODO - reduce number of diffs by merging adjacent dirty pages
+    // Convert to snapshot diffs, merging runs of dirty pages
+    size_t mergeGap = getSystemConfig().snapshotDiffMergeGap;
     std::vector<SnapshotDiff> diffs;
     for (int i : dirtyPageNumbers) {
-        uint32_t offset = i * HOST_PAGE_SIZE;
-        diffs.emplace_back(offset, data + offset, HOST_PAGE_SIZE);
+        addDiff(diffs, data, i * HOST_PAGE_SIZE, HOST_PAGE_SIZE, mergeGap);
     }
 
-    SPDLOG_DEBUG("Snapshot has {}/{} dirty pages", diffs.size(), nPages);
+    SPDLOG_DEBUG("Snapshot has {}/{} dirty pages in {} diffs",
+                 dirtyPageNumbers.size(),
+                 nPages,
+                 diffs.size());
 
     return diffs;
 }
@@ -34,48 +109,78 @@ std::vector<SnapshotDiff> SnapshotData::getChangeDiffs(const uint8_t* updated,
     // Work out which pages have changed in the comparison
     size_t nThisPages = getRequiredHostPages(size);
     std::vector<int> dirtyPageNumbers =
-      getDirtyPageNumbers(updated, nThisPages);
+      getDirtyTracker().getDirtyPageNumbers(updated, nThisPages);
 
-    // Get byte-wise diffs _within_ the dirty pages
-    // NOTE - this will cause diffs to be split across pages if they hit a page
-    // boundary, but we can be relatively confident that variables will be
-    // page-aligned so this shouldn't be a problem
+    // Get byte-wise diffs _within_ the dirty pages. Diffs that run over a page
+    // boundary are merged back together, as are those closer than the merge
+    // gap. Merging over a gap sends bytes this host hasn't changed, which can
+    // overwrite changes made to them elsewhere, so is off by default.
+    size_t mergeGap = getSystemConfig().snapshotDiffMergeGap;
     std::vector<SnapshotDiff> diffs;
+
+    bool diffInProgress = false;
+    size_t diffStart = 0;
+    auto compareByte = [&](size_t offset) {
+        bool isDirtyByte = *(data + offset) != *(updated + offset);
+        if (isDirtyByte && !diffInProgress) {
+            // Diff starts here if it's different and diff not in progress
+            diffInProgress = true;
+            diffStart = offset;
+        } else if (!isDirtyByte && diffInProgress) {
+            // Diff ends if it's not different and diff is in progress
+            diffInProgress = false;
+            addDiff(diffs, updated, diffStart, offset - diffStart, mergeGap);
+        }
+    };
+
     for (int i : dirtyPageNumbers) {
-        int pageOffset = i * HOST_PAGE_SIZE;
-
-        // Iterate through each byte of the page
-        bool diffInProgress = false;
-        int diffStart = 0;
-        int offset = pageOffset;
-        for (int b = 0; b < HOST_PAGE_SIZE; b++) {
-            offset = pageOffset + b;
-            bool isDirtyByte = *(data + offset) != *(updated + offset);
-            if (isDirtyByte && !diffInProgress) {
-                // Diff starts here if it's different and diff not in progress
-                diffInProgress = true;
-                diffStart = offset;
-            } else if (!isDirtyByte && diffInProgress) {
-                // Diff ends if it's not different and diff is in progress
-                diffInProgress = false;
-                diffs.emplace_back(
-                  diffStart, updated + diffStart, offset - diffStart);
+        size_t pageStart = i * HOST_PAGE_SIZE;
+        size_t pageEnd = std::min<size_t>(pageStart + HOST_PAGE_SIZE, size);
+
+        size_t offset = pageStart;
+        for (; offset + DIFF_BLOCK_BYTES <= pageEnd;
+             offset += DIFF_BLOCK_BYTES) {
+            uint32_t mask = getDiffMask(data + offset, updated + offset);
+
+            // Skip to each byte where the diff starts or ends in turn
+            int b = 0;
+            while (b < DIFF_BLOCK_BYTES) {
+                uint32_t next = (diffInProgress ? ~mask : mask) >> b;
+                if (next == 0) {
+                    break;
+                }
+
+                b += __builtin_ctz(next);
+                if (diffInProgress) {
+                    diffInProgress = false;
+                    addDiff(diffs,
+                            updated,
+                            diffStart,
+                            offset + b - diffStart,
+                            mergeGap);
+                } else {
+                    diffInProgress = true;
+                    diffStart = offset + b;
+                }
             }
         }
 
-        // If we've reached the end with a diff in progress, we need to close it
-        // off
+        for (; offset < pageEnd; offset++) {
+            compareByte(offset);
+        }
+
+        // Close off any diff in progress at the end of the page, as the next
+        // dirty page may not follow on from it
         if (diffInProgress) {
-            offset++;
-            diffs.emplace_back(
-              diffStart, updated + diffStart, offset - diffStart);
+            diffInProgress = false;
+            addDiff(diffs, updated, diffStart, pageEnd - diffStart, mergeGap);
         }
     }
 
     // If comparison has more pages than the original, add another diff
     // containing all the new pages
     if (updatedSize > size) {
-        diffs.emplace_back(size, updated + size, updatedSize - size);
+        addDiff(diffs, updated, size, updatedSize - size, mergeGap);
     }
 
     return diffs;
@@ -89,4 +194,24 @@ void SnapshotData::applyDiff(size_t diffOffset,
     std::memcpy(dest, diffData, diffLen);
 }
 
+static_assert(SHA256_DIGEST_LENGTH == PAGE_HASH_BYTES);
+
+PageHash hashPage(const uint8_t* data, size_t size)
+{
+    PageHash hash;
+    ::SHA256(data, size, hash.bytes.data());
+    return hash;
+}
+
+std::vector<PageHash> hashPages(const uint8_t* data, size_t size)
+{
+    std::vector<PageHash> hashes;
+    hashes.reserve(getRequiredHostPages(size));
+    for (size_t offset = 0; offset < size; offset += HOST_PAGE_SIZE) {
+        size_t pageSize = std::min<size_t>(HOST_PAGE_SIZE, size - offset);
+        hashes.emplace_back(hashPage(data + offset, pageSize));
+    }
+
+    return hashes;
+}
 }
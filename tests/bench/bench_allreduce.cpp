@@ -0,0 +1,113 @@
+#include "DummyExecutorFactory.h"
+
+#include <faabric/mpi/mpi.h>
+#include <faabric/scheduler/ExecutorFactory.h>
+#include <faabric/scheduler/MpiWorld.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/transport/context.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/macros.h>
+#include <faabric/util/timing.h>
+
+#include <thread>
+#include <vector>
+
+using namespace faabric::scheduler;
+
+/*
+ * Runs the given number of allreduces of doubles with every rank in its own
+ * thread, and returns the mean time per allreduce in microseconds.
+ */
+double runAllReduce(MpiWorld& world, int worldSize, int count, int nIterations)
+{
+    faabric::util::TimePoint tp;
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < worldSize; r++) {
+        threads.emplace_back([&world, &tp, r, count, nIterations] {
+            std::vector<double> sendData(count, (double)r);
+            std::vector<double> recvData(count, 0);
+
+            // Line the ranks up before timing
+            world.barrier(r);
+            if (r == 0) {
+                tp = faabric::util::startTimer();
+            }
+
+            for (int i = 0; i < nIterations; i++) {
+                world.allReduce(r,
+                                BYTES(sendData.data()),
+                                BYTES(recvData.data()),
+                                MPI_DOUBLE,
+                                count,
+                                MPI_SUM);
+            }
+
+            world.barrier(r);
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    return faabric::util::getTimeDiffMicros(tp) / (double)nIterations;
+}
+
+/*
+ * Compares the allreduce algorithms for a range of buffer sizes, with all
+ * ranks on this host. Algorithm bandwidth is the buffer size divided by the
+ * time taken. Requires Redis, as creating the world schedules the other
+ * ranks.
+ *
+ * Usage: bench_allreduce [world_size] [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+    faabric::transport::initGlobalMessageContext();
+
+    int worldSize = argc > 1 ? std::stoi(argv[1]) : 8;
+    int nIterations = argc > 2 ? std::stoi(argv[2]) : 20;
+
+    setExecutorFactory(std::make_shared<DummyExecutorFactory>());
+    Scheduler& sch = getScheduler();
+    sch.addHostToGlobalSet();
+
+    faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+
+    faabric::Message msg = faabric::util::messageFactory("mpi", "bench");
+    msg.set_mpiworldid(123);
+    msg.set_mpiworldsize(worldSize);
+
+    MpiWorld world;
+    world.create(msg, 123, worldSize);
+
+    for (int count : { 16, 1024, 64 * 1024, 1024 * 1024, 4 * 1024 * 1024 }) {
+        size_t bufferBytes = count * sizeof(double);
+
+        for (const std::string algorithm :
+             { "reduce_broadcast", "recursive_doubling", "ring" }) {
+            conf.mpiAllReduceAlgorithm = algorithm;
+
+            double micros = runAllReduce(world, worldSize, count, nIterations);
+            double gbPerSec = bufferBytes / (micros * 1000.0);
+
+            SPDLOG_INFO("{:>10} bytes {:<18} {:>12.1f}us {:>8.3f}GB/s",
+                        bufferBytes,
+                        algorithm,
+                        micros,
+                        gbPerSec);
+        }
+    }
+
+    world.destroy();
+    conf.reset();
+    sch.shutdown();
+
+    faabric::transport::closeGlobalMessageContext();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/scheduler/ExecutorFactory.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/transport/context.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/macros.h>
+#include <faabric/util/testing.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <thread>
+
+using namespace faabric::scheduler;
+
+static faabric::util::TimePoint batchStart;
+static std::vector<long> taskFinishMicros;
+
+/*
+ * Executor whose tasks sleep for the number of microseconds given in their
+ * input data, recording when each one finishes.
+ */
+class SkewedExecutor final : public Executor
+{
+  public:
+    SkewedExecutor(faabric::Message& msg, bool affinityIn)
+      : Executor(msg)
+      , affinity(affinityIn)
+    {}
+
+    int32_t executeTask(
+      int threadPoolIdx,
+      int msgIdx,
+      std::shared_ptr<faabric::BatchExecuteRequest> req) override
+    {
+        const faabric::Message& msg = req->messages().at(msgIdx);
+        std::this_thread::sleep_for(
+          std::chrono::microseconds(std::stol(msg.inputdata())));
+
+        taskFinishMicros.at(msgIdx) =
+          faabric::util::getTimeDiffMicros(batchStart);
+
+        return 0;
+    }
+
+  protected:
+    bool requiresThreadAffinity(
+      std::shared_ptr<faabric::BatchExecuteRequest> req) override
+    {
+        return affinity;
+    }
+
+  private:
+    bool affinity;
+};
+
+class SkewedExecutorFactory : public ExecutorFactory
+{
+  public:
+    explicit SkewedExecutorFactory(bool affinityIn)
+      : affinity(affinityIn)
+    {}
+
+  protected:
+    std::shared_ptr<Executor> createExecutor(faabric::Message& msg) override
+    {
+        return std::make_shared<SkewedExecutor>(msg, affinity);
+    }
+
+  private:
+    bool affinity;
+};
+
+/*
+ * Compares task completion latency in a thread pool with and without work
+ * stealing. One in every few tasks is long-running, and app indices are
+ * chosen so that the long tasks all land on the same pool thread.
+ *
+ * Usage: bench_executor [pool_size] [n_tasks] [short_us] [long_us]
+ */
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+    faabric::transport::initGlobalMessageContext();
+
+    int poolSize = argc > 1 ? std::stoi(argv[1]) : 8;
+    int nTasks = argc > 2 ? std::stoi(argv[2]) : 700;
+    long shortMicros = argc > 3 ? std::stol(argv[3]) : 200;
+    long longMicros = argc > 4 ? std::stol(argv[4]) : 10000;
+
+    faabric::util::setMockMode(true);
+
+    faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+    conf.overrideCpuCount = poolSize;
+
+    Scheduler& sch = getScheduler();
+
+    // Thread pool index zero is kept free for threads, so they're spread
+    // over the remaining pool threads by app index
+    int nThreadSlots = poolSize - 1;
+
+    for (bool affinity : { true, false }) {
+        setExecutorFactory(std::make_shared<SkewedExecutorFactory>(affinity));
+        sch.reset();
+        sch.addHostToGlobalSet();
+
+        std::shared_ptr<faabric::BatchExecuteRequest> req =
+          faabric::util::batchExecFactory("bench", "skew", nTasks);
+        req->set_type(faabric::BatchExecuteRequest::THREADS);
+
+        for (int i = 0; i < nTasks; i++) {
+            faabric::Message& msg = req->mutable_messages()->at(i);
+            msg.set_appindex(i);
+
+            bool isLong = (i % nThreadSlots) == 0;
+            long taskMicros = isLong ? longMicros : shortMicros;
+            msg.set_inputdata(std::to_string(taskMicros));
+        }
+
+        taskFinishMicros.assign(nTasks, 0);
+        batchStart = faabric::util::startTimer();
+
+        sch.callFunctions(req, true);
+        for (const auto& m : req->messages()) {
+            sch.awaitThreadResult(m.id());
+        }
+
+        std::vector<long> sorted = taskFinishMicros;
+        std::sort(sorted.begin(), sorted.end());
+
+        auto percentile = [&sorted](double p) {
+            size_t idx = std::min(sorted.size() - 1,
+                                  (size_t)(p * (double)sorted.size()));
+            return sorted.at(idx) / 1000.0;
+        };
+
+        SPDLOG_INFO("{:<9} p50 {:>8.2f}ms  p99 {:>8.2f}ms  max {:>8.2f}ms",
+                    affinity ? "affinity" : "stealing",
+                    percentile(0.5),
+                    percentile(0.99),
+                    sorted.back() / 1000.0);
+    }
+
+    sch.shutdown();
+    faabric::util::setMockMode(false);
+
+    faabric::transport::closeGlobalMessageContext();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+#include "DummyExecutorFactory.h"
+
+#include <faabric/mpi/mpi.h>
+#include <faabric/scheduler/ExecutorFactory.h>
+#include <faabric/scheduler/MpiWorld.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/transport/context.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/macros.h>
+#include <faabric/util/queue.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace faabric::scheduler;
+
+static void logLatency(const std::string& label,
+                       const faabric::util::TimePoint& tp,
+                       int nRoundTrips)
+{
+    long elapsedNanos = faabric::util::getTimeDiffNanos(tp);
+    SPDLOG_INFO("{:<12} {:>8.3f}us per round trip",
+                label,
+                elapsedNanos / (1000.0 * nRoundTrips));
+}
+
+/*
+ * Passes a message back and forth between two threads over a pair of queues.
+ */
+template<typename Q>
+void benchQueuePingPong(const std::string& label, int nRoundTrips)
+{
+    Q ping;
+    Q pong;
+
+    std::thread other([&ping, &pong, nRoundTrips] {
+        for (int i = 0; i < nRoundTrips; i++) {
+            pong.enqueue(ping.dequeue());
+        }
+    });
+
+    const faabric::util::TimePoint tp = faabric::util::startTimer();
+    for (int i = 0; i < nRoundTrips; i++) {
+        ping.enqueue(std::make_shared<faabric::MPIMessage>());
+        pong.dequeue();
+    }
+
+    logLatency(label, tp, nRoundTrips);
+
+    other.join();
+}
+
+/*
+ * Passes a message of the given number of ints back and forth between two
+ * ranks on this host.
+ */
+void benchMpiPingPong(const std::string& label, int nRoundTrips, int nInts)
+{
+    faabric::Message msg = faabric::util::messageFactory("mpi", "bench");
+    msg.set_mpiworldid(123);
+    msg.set_mpiworldsize(2);
+
+    MpiWorld world;
+    world.create(msg, 123, 2);
+
+    std::thread other([&world, nRoundTrips, nInts] {
+        std::vector<int> buffer(nInts, 0);
+        for (int i = 0; i < nRoundTrips; i++) {
+            world.recv(0, 1, BYTES(buffer.data()), MPI_INT, nInts, nullptr);
+            world.send(1, 0, BYTES(buffer.data()), MPI_INT, nInts);
+        }
+    });
+
+    std::vector<int> buffer(nInts, 0);
+    const faabric::util::TimePoint tp = faabric::util::startTimer();
+    for (int i = 0; i < nRoundTrips; i++) {
+        world.send(0, 1, BYTES(buffer.data()), MPI_INT, nInts);
+        world.recv(1, 0, BYTES(buffer.data()), MPI_INT, nInts, nullptr);
+    }
+
+    logLatency(label, tp, nRoundTrips);
+
+    other.join();
+    world.destroy();
+}
+
+/*
+ * Measures small-message round trip latency between co-located MPI ranks,
+ * along with the raw latency of the queues underneath. Then compares large
+ * messages sent eagerly with those copied straight into posted receive
+ * buffers. Requires Redis, as creating the world schedules the other rank.
+ *
+ * Usage: bench_mpi [round_trips] [large_message_bytes]
+ */
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+    faabric::transport::initGlobalMessageContext();
+
+    int nRoundTrips = argc > 1 ? std::stoi(argv[1]) : 100000;
+    int largeBytes = argc > 2 ? std::stoi(argv[2]) : 4 * 1024 * 1024;
+
+    typedef std::shared_ptr<faabric::MPIMessage> MessagePtr;
+    benchQueuePingPong<faabric::util::Queue<MessagePtr>>("Queue",
+                                                         nRoundTrips);
+    benchQueuePingPong<faabric::util::SpscQueue<MessagePtr>>("SpscQueue",
+                                                             nRoundTrips);
+
+    setExecutorFactory(std::make_shared<DummyExecutorFactory>());
+    Scheduler& sch = getScheduler();
+    sch.addHostToGlobalSet();
+
+    benchMpiPingPong("MPI world", nRoundTrips, 1);
+
+    // Large messages are much slower, so do fewer round trips
+    faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+    int nLargeRoundTrips = std::max(nRoundTrips / 100, 10);
+    int nLargeInts = largeBytes / sizeof(int);
+
+    conf.mpiRendezvousThreshold = 0;
+    benchMpiPingPong("Eager", nLargeRoundTrips, nLargeInts);
+
+    conf.mpiRendezvousThreshold = 1024;
+    benchMpiPingPong("Rendezvous", nLargeRoundTrips, nLargeInts);
+
+    conf.reset();
+
+    sch.shutdown();
+
+    faabric::transport::closeGlobalMessageContext();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+#include <faabric/mpi/mpi.h>
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/transport/MessageEndpoint.h>
+#include <faabric/transport/MpiMessageEndpoint.h>
+#include <faabric/transport/context.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/network.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define BENCH_PORT 8799
+
+using namespace faabric::transport;
+
+static void logBandwidth(const std::string& label,
+                         const faabric::util::TimePoint& tp,
+                         size_t nBytes,
+                         int nMessages)
+{
+    long nanos = faabric::util::getTimeDiffNanos(tp);
+    SPDLOG_INFO("{:<8} {:>10} bytes {:>9.3f}GB/s",
+                label,
+                nBytes,
+                ((double)nBytes * nMessages) / nanos);
+}
+
+/*
+ * Sends each message as a serialised MPIMessage, which is parsed on receipt,
+ * i.e. how remote MPI messages used to be sent.
+ */
+void benchProtobuf(size_t nBytes, int nMessages)
+{
+    std::vector<uint8_t> sendBuffer(nBytes, 1);
+    std::vector<uint8_t> recvBuffer(nBytes, 0);
+
+    AsyncRecvMessageEndpoint recvEndpoint(BENCH_PORT);
+
+    const faabric::util::TimePoint tp = faabric::util::startTimer();
+    std::thread sender([&sendBuffer, nMessages] {
+        AsyncSendMessageEndpoint sendEndpoint(LOCALHOST, BENCH_PORT);
+        for (int i = 0; i < nMessages; i++) {
+            faabric::MPIMessage msg;
+            msg.set_worldid(123);
+            msg.set_type(FAABRIC_BYTE);
+            msg.set_count(sendBuffer.size());
+            msg.set_buffer(sendBuffer.data(), sendBuffer.size());
+
+            std::vector<uint8_t> serialised(msg.ByteSizeLong());
+            msg.SerializeToArray(serialised.data(), serialised.size());
+            sendEndpoint.send(serialised.data(), serialised.size());
+        }
+    });
+
+    for (int i = 0; i < nMessages; i++) {
+        Message m = recvEndpoint.recv();
+        faabric::MPIMessage parsed;
+        parsed.ParseFromArray(m.data(), m.size());
+        auto msg = std::make_shared<faabric::MPIMessage>(parsed);
+        std::memcpy(recvBuffer.data(), msg->buffer().data(), nBytes);
+    }
+
+    logBandwidth("Protobuf", tp, nBytes, nMessages);
+
+    sender.join();
+}
+
+/*
+ * Sends each message as a binary header and raw payload
+ */
+void benchBinary(size_t nBytes, int nMessages)
+{
+    std::vector<uint8_t> sendBuffer(nBytes, 1);
+    std::vector<uint8_t> recvBuffer(nBytes, 0);
+
+    MpiRecvMessageEndpoint recvEndpoint(BENCH_PORT);
+
+    const faabric::util::TimePoint tp = faabric::util::startTimer();
+    std::thread sender([&sendBuffer, nMessages] {
+        MpiSendMessageEndpoint sendEndpoint(LOCALHOST, BENCH_PORT);
+        for (int i = 0; i < nMessages; i++) {
+            MpiMessageHeader header{};
+            header.payloadSize = sendBuffer.size();
+            header.worldId = 123;
+            header.datatype = FAABRIC_BYTE;
+            header.count = sendBuffer.size();
+            sendEndpoint.sendMpiMessage(header, sendBuffer.data());
+        }
+    });
+
+    for (int i = 0; i < nMessages; i++) {
+        MpiMessageHeader header{};
+        auto msg = recvEndpoint.recvMpiMessage(header);
+        std::memcpy(recvBuffer.data(), msg->buffer().data(), nBytes);
+    }
+
+    logBandwidth("Binary", tp, nBytes, nMessages);
+
+    sender.join();
+}
+
+/*
+ * Compares the bandwidth of the two wire formats for remote MPI messages over
+ * localhost, for messages from 1KB to 64MB. Each size sends roughly the same
+ * total amount of data.
+ *
+ * Usage: bench_mpi_bandwidth [total_bytes]
+ */
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+    faabric::transport::initGlobalMessageContext();
+
+    size_t totalBytes = argc > 1 ? std::stol(argv[1]) : 256L * 1024 * 1024;
+
+    for (size_t nBytes = 1024; nBytes <= 64 * 1024 * 1024; nBytes *= 4) {
+        int nMessages = std::max<int>(totalBytes / nBytes, 10);
+        benchProtobuf(nBytes, nMessages);
+        benchBinary(nBytes, nMessages);
+    }
+
+    faabric::transport::closeGlobalMessageContext();
+
+    return EXIT_SUCCESS;
+}
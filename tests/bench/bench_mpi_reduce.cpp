@@ -0,0 +1,66 @@
+#include <faabric/mpi/mpi.h>
+#include <faabric/scheduler/MpiReduceKernels.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <string>
+#include <vector>
+
+using namespace faabric::scheduler;
+
+// Names indexed by the ids in mpi.h
+static const std::vector<std::string> opNames = {
+    "", "max", "min", "sum", "prod", "land", "lor", "band", "bor", "maxloc",
+    "minloc"
+};
+
+static const std::vector<std::string> datatypeNames = {
+    "",       "int8",      "int16",     "int32",         "int",
+    "int64",  "uint8",     "uint16",    "uint32",        "uint",
+    "uint64", "long",      "long_long", "long_long_int", "float",
+    "double", "double_int", "char",     "c_bool",        "byte"
+};
+
+/*
+ * Measures the throughput of the reduction kernel for every supported pair of
+ * operation and datatype, reducing one buffer into another repeatedly.
+ *
+ * Usage: bench_mpi_reduce [buffer_bytes] [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+
+    int bufferBytes = argc > 1 ? std::stoi(argv[1]) : 1024 * 1024;
+    int nIterations = argc > 2 ? std::stoi(argv[2]) : 100;
+
+    std::vector<uint8_t> inBuffer(bufferBytes, 0);
+    std::vector<uint8_t> outBuffer(bufferBytes, 0);
+
+    for (int opId = FAABRIC_OP_MAX; opId <= FAABRIC_OP_MINLOC; opId++) {
+        for (int datatypeId = FAABRIC_INT8; datatypeId <= FAABRIC_BYTE;
+             datatypeId++) {
+            MpiReduceKernel kernel = getMpiReduceKernel(opId, datatypeId);
+            if (kernel == nullptr) {
+                continue;
+            }
+
+            int count =
+              bufferBytes / getFaabricDatatypeFromId(datatypeId)->size;
+
+            const faabric::util::TimePoint tp = faabric::util::startTimer();
+            for (int i = 0; i < nIterations; i++) {
+                kernel(inBuffer.data(), outBuffer.data(), count);
+            }
+            long nanos = faabric::util::getTimeDiffNanos(tp);
+
+            double gbPerSec = ((double)bufferBytes * nIterations) / nanos;
+            SPDLOG_INFO("{:<7} {:<14} {:>8.3f}GB/s",
+                        opNames[opId],
+                        datatypeNames[datatypeId],
+                        gbPerSec);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#include <faabric/util/logging.h>
+#include <faabric/util/queue.h>
+#include <faabric/util/timing.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faabric::util;
+
+/*
+ * Runs the given number of producers and consumers against the queue, with
+ * each producer passing the given number of elements through it.
+ */
+template<typename Q>
+void runQueueBench(const std::string& label,
+                   Q& queue,
+                   int nThreads,
+                   int nPerProducer)
+{
+    const TimePoint tp = startTimer();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&queue, nPerProducer] {
+            for (int j = 0; j < nPerProducer; j++) {
+                queue.enqueue(j);
+            }
+        });
+
+        threads.emplace_back([&queue, nPerProducer] {
+            for (int j = 0; j < nPerProducer; j++) {
+                queue.dequeue(DEFAULT_QUEUE_TIMEOUT_MS);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    double elapsedMs = getTimeDiffMillis(tp);
+    long nElems = (long)nThreads * nPerProducer;
+
+    SPDLOG_INFO("{:<8} {:>3} producers/consumers: {:>9.2f}ms ({:.0f} ops/s)",
+                label,
+                nThreads,
+                elapsedMs,
+                (1000.0 * nElems) / elapsedMs);
+}
+
+/*
+ * Compares the mutex-based queue with the fixed capacity lock-free queue, with
+ * equal numbers of producer and consumer threads.
+ *
+ * Usage: bench_queue [elems_per_producer] [capacity]
+ */
+int main(int argc, char* argv[])
+{
+    initLogging();
+
+    int nPerProducer = argc > 1 ? std::stoi(argv[1]) : 100000;
+    int capacity = argc > 2 ? std::stoi(argv[2]) : 1024;
+
+    for (int nThreads : { 1, 4, 16, 64 }) {
+        Queue<int> mutexQueue;
+        runQueueBench("mutex", mutexQueue, nThreads, nPerProducer);
+
+        FixedCapacityQueue<int> fixedQueue(capacity);
+        runQueueBench("lockfree", fixedQueue, nThreads, nPerProducer);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+#include "DummyExecutorFactory.h"
+
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/scheduler/ExecutorFactory.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/transport/context.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/testing.h>
+#include <faabric/util/timing.h>
+
+#include <thread>
+
+using namespace faabric::scheduler;
+
+/*
+ * Measures scheduler throughput when many callers schedule distinct functions
+ * concurrently. Each caller thread invokes its own function, so any slowdown
+ * as the number of callers grows is due to contention on shared scheduler
+ * state. Requires Redis, as the dummy executors write results there.
+ *
+ * Usage: bench_scheduler [max_callers] [calls_per_caller]
+ */
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+    faabric::transport::initGlobalMessageContext();
+
+    int maxCallers = argc > 1 ? std::stoi(argv[1]) : 16;
+    int callsPerCaller = argc > 2 ? std::stoi(argv[2]) : 1000;
+
+    // Avoid any network calls to other hosts
+    faabric::util::setMockMode(true);
+
+    auto fac = std::make_shared<DummyExecutorFactory>();
+    setExecutorFactory(fac);
+
+    Scheduler& sch = getScheduler();
+
+    for (int nCallers = 1; nCallers <= maxCallers; nCallers *= 2) {
+        sch.reset();
+        sch.addHostToGlobalSet();
+
+        faabric::HostResources res;
+        res.set_slots(nCallers * callsPerCaller);
+        sch.setThisHostResources(res);
+
+        const faabric::util::TimePoint tp = faabric::util::startTimer();
+
+        std::vector<std::thread> callers;
+        for (int t = 0; t < nCallers; t++) {
+            callers.emplace_back([&sch, t, callsPerCaller] {
+                for (int i = 0; i < callsPerCaller; i++) {
+                    faabric::Message msg = faabric::util::messageFactory(
+                      "bench", "func" + std::to_string(t));
+                    sch.callFunction(msg);
+                }
+            });
+        }
+
+        for (auto& c : callers) {
+            c.join();
+        }
+
+        double elapsedMs = faabric::util::getTimeDiffMillis(tp);
+        int totalCalls = nCallers * callsPerCaller;
+
+        SPDLOG_INFO("{:>3} callers: {:>8} calls in {:>9.2f}ms ({:.0f} calls/s)",
+                    nCallers,
+                    totalCalls,
+                    elapsedMs,
+                    (1000.0 * totalCalls) / elapsedMs);
+    }
+
+    sch.shutdown();
+    faabric::util::setMockMode(false);
+
+    faabric::transport::closeGlobalMessageContext();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#include <faabric/util/config.h>
+#include <faabric/util/delta.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+#include <faabric/util/timing.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace faabric::util;
+
+/*
+ * Measures the size and encode/decode throughput of delta-encoded snapshots
+ * that are mostly pages of zeros, like a sparsely used heap.
+ *
+ * Usage: bench_snapshot_delta [snapshot_mb] [encoding]
+ */
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+
+    size_t snapshotBytes = (argc > 1 ? std::stol(argv[1]) : 256) * 1024 * 1024L;
+    std::string encoding =
+      argc > 2 ? argv[2] : getSystemConfig().deltaSnapshotEncoding;
+    DeltaSettings settings(encoding);
+
+    // Every 16th page has some data in it
+    std::vector<uint8_t> snapshot(snapshotBytes, 0);
+    for (size_t p = 0; p < snapshotBytes; p += 16 * HOST_PAGE_SIZE) {
+        for (int b = 0; b < 512; b++) {
+            snapshot[p + (b * 4)] = b;
+        }
+    }
+
+    faabric::util::TimePoint tp = faabric::util::startTimer();
+    std::vector<uint8_t> delta =
+      serializeDelta(settings, nullptr, 0, snapshot.data(), snapshot.size());
+    long encodeNanos = faabric::util::getTimeDiffNanos(tp);
+
+    std::vector<uint8_t> decoded;
+    tp = faabric::util::startTimer();
+    applyDelta(
+      delta,
+      [&decoded](uint32_t size) { decoded.resize(size, 0); },
+      [&decoded]() { return decoded.data(); });
+    long decodeNanos = faabric::util::getTimeDiffNanos(tp);
+
+    if (decoded != snapshot) {
+        SPDLOG_ERROR("Decoded snapshot doesn't match original");
+        return EXIT_FAILURE;
+    }
+
+    SPDLOG_INFO("{}MB with {}: {} bytes ({:.1f}x), encode {:.1f}MB/s, "
+                "decode {:.1f}MB/s",
+                snapshotBytes / (1024 * 1024),
+                settings.toString(),
+                delta.size(),
+                (double)snapshotBytes / delta.size(),
+                ((double)snapshotBytes * 1000) / encodeNanos,
+                ((double)snapshotBytes * 1000) / decodeNanos);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+#include <faabric/util/config.h>
+#include <faabric/util/dirty.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+#include <faabric/util/snapshot.h>
+#include <faabric/util/timing.h>
+
+#include <cstring>
+#include <functional>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+using namespace faabric::util;
+
+static uint8_t* allocateMemory(size_t nBytes)
+{
+    auto* mem = (uint8_t*)mmap(nullptr,
+                               nBytes,
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS,
+                               -1,
+                               0);
+    if (mem == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to allocate {} bytes", nBytes);
+        throw std::runtime_error("Failed to allocate memory");
+    }
+
+    return mem;
+}
+
+// The byte-by-byte comparison of dirty pages that the diff engine replaced
+static size_t countScalarDiffs(const uint8_t* original,
+                               const uint8_t* updated,
+                               const std::vector<int>& dirtyPageNumbers)
+{
+    size_t nDiffs = 0;
+    for (int i : dirtyPageNumbers) {
+        size_t pageOffset = i * HOST_PAGE_SIZE;
+        bool diffInProgress = false;
+        for (int b = 0; b < HOST_PAGE_SIZE; b++) {
+            bool isDirtyByte =
+              original[pageOffset + b] != updated[pageOffset + b];
+            if (isDirtyByte && !diffInProgress) {
+                nDiffs++;
+            }
+            diffInProgress = isDirtyByte;
+        }
+    }
+
+    return nDiffs;
+}
+
+/*
+ * Measures the time taken to diff a snapshot against memory written with
+ * sparse and dense patterns, with the diff engine and with a scalar byte loop.
+ *
+ * Usage: bench_snapshot_diffs [snapshot_mb] [merge_gap]
+ */
+int main(int argc, char* argv[])
+{
+    faabric::util::initLogging();
+
+    size_t snapshotBytes =
+      (argc > 1 ? std::stol(argv[1]) : 1024) * 1024 * 1024L;
+    SystemConfig& conf = getSystemConfig();
+    conf.snapshotDiffMergeGap = argc > 2 ? std::stoi(argv[2]) : 0;
+
+    SnapshotData snap;
+    snap.size = snapshotBytes;
+    snap.data = allocateMemory(snapshotBytes);
+    uint8_t* updated = allocateMemory(snapshotBytes);
+    int nPages = getRequiredHostPages(snapshotBytes);
+
+    std::vector<std::pair<std::string, std::function<void()>>> patterns = {
+        // One word every 64 pages
+        { "sparse",
+          [&] {
+              for (int p = 0; p < nPages; p += 64) {
+                  std::memset(updated + (p * HOST_PAGE_SIZE) + 128, 1, 8);
+              }
+          } },
+        // One byte every 64 bytes, so every page is dirty with lots of diffs
+        { "strided",
+          [&] {
+              for (size_t b = 0; b < snapshotBytes; b += 64) {
+                  updated[b] = 1;
+              }
+          } },
+        // Every byte
+        { "dense", [&] { std::memset(updated, 1, snapshotBytes); } },
+    };
+
+    DirtyTracker& tracker = getDirtyTracker();
+    SPDLOG_INFO("Diffing {}MB with {} tracking and merge gap {}",
+                snapshotBytes / (1024 * 1024),
+                tracker.getMode(),
+                conf.snapshotDiffMergeGap);
+
+    for (const auto& [name, writePattern] : patterns) {
+        std::memset(updated, 0, snapshotBytes);
+        tracker.resetTracking(updated, snapshotBytes);
+        writePattern();
+
+        std::vector<int> dirtyPageNumbers =
+          tracker.getDirtyPageNumbers(updated, nPages);
+
+        faabric::util::TimePoint tp = faabric::util::startTimer();
+        std::vector<SnapshotDiff> diffs =
+          snap.getChangeDiffs(updated, snapshotBytes);
+        long engineNanos = faabric::util::getTimeDiffNanos(tp);
+
+        tp = faabric::util::startTimer();
+        size_t nScalarDiffs =
+          countScalarDiffs(snap.data, updated, dirtyPageNumbers);
+        long scalarNanos = faabric::util::getTimeDiffNanos(tp);
+
+        size_t diffBytes = 0;
+        for (const auto& d : diffs) {
+            diffBytes += d.size;
+        }
+
+        SPDLOG_INFO("{:<8} {:>7} dirty pages, {:>9} diffs ({:>9} scalar) "
+                    "of {:>11} bytes, engine {:>9.3f}ms scalar {:>9.3f}ms",
+                    name,
+                    dirtyPageNumbers.size(),
+                    diffs.size(),
+                    nScalarDiffs,
+                    diffBytes,
+                    engineNanos / 1e6,
+                    scalarNanos / 1e6);
+
+        tracker.stopTracking(updated, snapshotBytes);
+    }
+
+    munmap(snap.data, snapshotBytes);
+    munmap(updated, snapshotBytes);
+
+    return EXIT_SUCCESS;
+}
@@ -660,6 +660,32 @@ TEST_CASE("Test range set pipeline")
     REQUIRE(actual == expected);
 }
 
+TEST_CASE("Test mixed command pipeline", "[redis]")
+{
+    Redis& redisQueue = Redis::getQueue();
+    redisQueue.flushAll();
+
+    std::string setKey = "pipelineSet";
+    std::string queueKey = "pipelineQueue";
+
+    std::vector<uint8_t> valueA = { 1, 2, 3 };
+    std::vector<uint8_t> valueB = { 4, 5 };
+    std::vector<uint8_t> valueC = { 6 };
+
+    redisQueue.setPipeline(setKey, valueA.data(), valueA.size());
+    redisQueue.expirePipeline(setKey, 100);
+    redisQueue.enqueueBytesPipeline(queueKey, valueB.data(), valueB.size());
+    redisQueue.enqueueBytesPipeline(queueKey, valueC.data(), valueC.size());
+
+    redisQueue.flushPipeline(4);
+
+    REQUIRE(redisQueue.get(setKey) == valueA);
+    REQUIRE(redisQueue.getTtl(setKey) > 10);
+    REQUIRE(redisQueue.listLength(queueKey) == 2);
+    REQUIRE(redisQueue.dequeueBytes(queueKey) == valueB);
+    REQUIRE(redisQueue.dequeueBytes(queueKey) == valueC);
+}
+
 void checkDequeueBytes(Redis& redis,
                        const std::string& queueName,
                        const std::vector<uint8_t> expected)
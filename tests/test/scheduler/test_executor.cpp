@@ -70,7 +70,20 @@ class TestExecutor final : public Executor
         reg.mapSnapshot(msg.snapshotkey(), dummyMemory);
     }
 
+    bool requiresThreadAffinity(
+      std::shared_ptr<faabric::BatchExecuteRequest> req) override
+    {
+        // Snapshot checks modify the page for their thread pool index
+        const std::string& func = req->messages().at(0).function();
+        return func == "snap-check" || func == "affinity-check";
+    }
+
     faabric::util::SnapshotData snapshot() override
+    {
+        return getMemoryView();
+    }
+
+    faabric::util::SnapshotData getMemoryView() override
     {
         faabric::util::SnapshotData snap;
         snap.data = dummyMemory;
@@ -213,6 +226,12 @@ class TestExecutor final : public Executor
             throw std::runtime_error("This is a test error");
         }
 
+        if (msg.function() == "steal-check" ||
+            msg.function() == "affinity-check") {
+            SLEEP_MS(100);
+            return threadPoolIdx;
+        }
+
         if (reqOrig->type() == faabric::BatchExecuteRequest::THREADS) {
             return msg.id() / 100;
         }
@@ -359,6 +378,53 @@ TEST_CASE_METHOD(TestExecutorFixture,
     REQUIRE(restoreCount == 0);
 }
 
+TEST_CASE_METHOD(TestExecutorFixture,
+                 "Test idle threads steal tasks",
+                 "[executor]")
+{
+    int nThreads = 4;
+    std::string function;
+    bool expectStealing = false;
+
+    SECTION("Stealing allowed")
+    {
+        function = "steal-check";
+        expectStealing = true;
+    }
+
+    SECTION("Affinity required")
+    {
+        function = "affinity-check";
+        expectStealing = false;
+    }
+
+    std::shared_ptr<BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("dummy", function, nThreads);
+    req->set_type(faabric::BatchExecuteRequest::THREADS);
+
+    // Assign all the tasks to the same thread
+    for (int i = 0; i < nThreads; i++) {
+        faabric::Message& msg = req->mutable_messages()->at(i);
+        msg.set_snapshotkey(snapshotKey);
+        msg.set_appindex(1);
+    }
+
+    executeWithTestExecutor(req, true);
+
+    std::set<int32_t> threadPoolIdxs;
+    for (const auto& m : req->messages()) {
+        int32_t threadPoolIdx = sch.awaitThreadResult(m.id());
+        REQUIRE(threadPoolIdx != 0);
+        threadPoolIdxs.insert(threadPoolIdx);
+    }
+
+    if (expectStealing) {
+        REQUIRE(threadPoolIdxs.size() > 1);
+    } else {
+        REQUIRE(threadPoolIdxs == std::set<int32_t>({ 2 }));
+    }
+}
+
 TEST_CASE_METHOD(TestExecutorFixture,
                  "Test executing threads indirectly",
                  "[executor]")
@@ -239,4 +239,67 @@ TEST_CASE_METHOD(ClientServerFixture, "Test unregister request", "[scheduler]")
     sch.setThisHostResources(originalResources);
     faabric::scheduler::clearMockRequests();
 }
+
+TEST_CASE_METHOD(ClientServerFixture,
+                 "Test push resources request",
+                 "[scheduler]")
+{
+    std::string otherHost = "other";
+
+    faabric::HostResources originalResources;
+    originalResources.set_slots(sch.getThisHostResources().slots());
+
+    // Push resources for the other host
+    faabric::PushResourcesRequest req;
+    req.set_host(otherHost);
+    req.mutable_resources()->set_slots(5);
+    req.mutable_resources()->set_usedslots(2);
+
+    server.setAsyncLatch();
+    cli.pushResources(req);
+    server.awaitAsyncLatch();
+
+    // Remove capacity from this host
+    faabric::util::setMockMode(true);
+
+    faabric::HostResources thisResources;
+    thisResources.set_slots(0);
+    sch.setThisHostResources(thisResources);
+
+    // Check the pushed resources are used without asking the other host
+    std::shared_ptr<faabric::BatchExecuteRequest> batchReq =
+      faabric::util::batchExecFactory("foo", "bar", 4);
+    sch.addHostToGlobalSet(otherHost);
+    std::vector<std::string> executedHosts = sch.callFunctions(batchReq);
+
+    std::vector<std::string> expectedHosts = {
+        otherHost, otherHost, otherHost, sch.getThisHost()
+    };
+    REQUIRE(executedHosts == expectedHosts);
+    REQUIRE(faabric::scheduler::getResourceRequests().empty());
+
+    faabric::util::setMockMode(false);
+    sch.setThisHostResources(originalResources);
+    faabric::scheduler::clearMockRequests();
+}
+
+TEST_CASE_METHOD(ClientServerFixture,
+                 "Test set function result request",
+                 "[scheduler]")
+{
+    faabric::Message msg = faabric::util::messageFactory("foo", "bar");
+    msg.set_outputdata("remote result");
+    msg.set_returnvalue(3);
+
+    // Nothing on this host is waiting, so the result will go to Redis
+    server.setAsyncLatch();
+    cli.setFunctionResult(msg);
+    server.awaitAsyncLatch();
+
+    REQUIRE(redis.listLength(msg.resultkey()) == 1);
+
+    faabric::Message actual = sch.getFunctionResult(msg.id(), 1);
+    REQUIRE(actual.outputdata() == "remote result");
+    REQUIRE(actual.returnvalue() == 3);
+}
 }
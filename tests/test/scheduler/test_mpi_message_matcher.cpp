@@ -0,0 +1,235 @@
+#include <catch.hpp>
+
+#include <faabric/mpi/mpi.h>
+#include <faabric/scheduler/MpiMessageMatcher.h>
+
+using namespace faabric::scheduler;
+
+static MpiMessageMatcher::PendingRecv recvFactory(
+  int requestId,
+  int source,
+  int tag,
+  faabric::MPIMessage::MPIMessageType messageType =
+    faabric::MPIMessage::NORMAL)
+{
+    MpiMessageMatcher::PendingRecv recv;
+    recv.requestId = requestId;
+    recv.source = source;
+    recv.tag = tag;
+    recv.messageType = messageType;
+
+    return recv;
+}
+
+static std::shared_ptr<faabric::MPIMessage> messageFactory(
+  int sender,
+  int tag,
+  faabric::MPIMessage::MPIMessageType messageType =
+    faabric::MPIMessage::NORMAL)
+{
+    auto msg = std::make_shared<faabric::MPIMessage>();
+    msg->set_sender(sender);
+    msg->set_tag(tag);
+    msg->set_messagetype(messageType);
+
+    return msg;
+}
+
+namespace tests {
+TEST_CASE("Test posting a receive before its message", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+    REQUIRE(matcher.isEmpty());
+
+    auto& recv = matcher.postRecv(recvFactory(1, 2, 3));
+    REQUIRE(!recv.isMatched());
+    REQUIRE(matcher.getNumRecvs() == 1);
+    REQUIRE(matcher.getNumPending(2, 3, faabric::MPIMessage::NORMAL) == 1);
+
+    auto msg = messageFactory(2, 3);
+    REQUIRE(matcher.addMessage(msg) == 1);
+    REQUIRE(matcher.getRecv(1)->msg == msg);
+    REQUIRE(matcher.getNumUnexpected() == 0);
+    REQUIRE(matcher.getNumPending(2, 3, faabric::MPIMessage::NORMAL) == 0);
+
+    matcher.removeRecv(1);
+    REQUIRE(matcher.getRecv(1) == nullptr);
+    REQUIRE(matcher.isEmpty());
+}
+
+TEST_CASE("Test posting a receive after its message", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+
+    auto msg = messageFactory(2, 3);
+    REQUIRE(matcher.addMessage(msg) == -1);
+    REQUIRE(matcher.getNumUnexpected() == 1);
+    REQUIRE(matcher.peekUnexpected(2, 3, faabric::MPIMessage::NORMAL) == msg);
+
+    auto& recv = matcher.postRecv(recvFactory(1, 2, 3));
+    REQUIRE(recv.msg == msg);
+    REQUIRE(matcher.getNumUnexpected() == 0);
+    REQUIRE(matcher.peekUnexpected(2, 3, faabric::MPIMessage::NORMAL) ==
+            nullptr);
+
+    matcher.removeRecv(1);
+    REQUIRE(matcher.isEmpty());
+}
+
+TEST_CASE("Test messages only match their own tag and message type", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+
+    auto msgA = messageFactory(0, 1);
+    auto msgB = messageFactory(0, 2);
+    auto msgC = messageFactory(0, 1, faabric::MPIMessage::REDUCE);
+    matcher.addMessage(msgA);
+    matcher.addMessage(msgB);
+    matcher.addMessage(msgC);
+
+    // Receives take the messages out of order
+    REQUIRE(matcher.postRecv(recvFactory(1, 0, 1, faabric::MPIMessage::REDUCE))
+              .msg == msgC);
+    REQUIRE(matcher.postRecv(recvFactory(2, 0, 2)).msg == msgB);
+    REQUIRE(matcher.postRecv(recvFactory(3, 1, 1)).msg == nullptr);
+    REQUIRE(matcher.postRecv(recvFactory(4, 0, 1)).msg == msgA);
+
+    REQUIRE(matcher.getNumUnexpected() == 0);
+    REQUIRE(matcher.getNumRecvs() == 4);
+    REQUIRE(!matcher.getRecv(3)->isMatched());
+}
+
+TEST_CASE("Test messages with the same tag match in order", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+
+    matcher.postRecv(recvFactory(1, 0, 5));
+    matcher.postRecv(recvFactory(2, 0, 5));
+
+    auto msgA = messageFactory(0, 5);
+    auto msgB = messageFactory(0, 5);
+    auto msgC = messageFactory(0, 5);
+    REQUIRE(matcher.addMessage(msgA) == 1);
+    REQUIRE(matcher.addMessage(msgB) == 2);
+    REQUIRE(matcher.addMessage(msgC) == -1);
+
+    REQUIRE(matcher.postRecv(recvFactory(3, 0, 5)).msg == msgC);
+}
+
+TEST_CASE("Test wildcard receives take the earliest message", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+
+    auto msgA = messageFactory(2, 7);
+    auto msgB = messageFactory(1, 4);
+    auto msgC = messageFactory(1, 7);
+    matcher.addMessage(msgA);
+    matcher.addMessage(msgB);
+    matcher.addMessage(msgC);
+
+    SECTION("Any source")
+    {
+        REQUIRE(matcher.peekUnexpected(
+                  MPI_ANY_SOURCE, 7, faabric::MPIMessage::NORMAL) == msgA);
+        REQUIRE(matcher.postRecv(recvFactory(1, MPI_ANY_SOURCE, 7)).msg ==
+                msgA);
+        REQUIRE(matcher.postRecv(recvFactory(2, MPI_ANY_SOURCE, 7)).msg ==
+                msgC);
+        REQUIRE(matcher.postRecv(recvFactory(3, MPI_ANY_SOURCE, 7)).msg ==
+                nullptr);
+    }
+
+    SECTION("Any tag")
+    {
+        REQUIRE(matcher.peekUnexpected(
+                  1, MPI_ANY_TAG, faabric::MPIMessage::NORMAL) == msgB);
+        REQUIRE(matcher.postRecv(recvFactory(1, 1, MPI_ANY_TAG)).msg == msgB);
+        REQUIRE(matcher.postRecv(recvFactory(2, 1, MPI_ANY_TAG)).msg == msgC);
+        REQUIRE(matcher.postRecv(recvFactory(3, 1, MPI_ANY_TAG)).msg ==
+                nullptr);
+    }
+
+    SECTION("Any source and tag")
+    {
+        REQUIRE(
+          matcher.postRecv(recvFactory(1, MPI_ANY_SOURCE, MPI_ANY_TAG)).msg ==
+          msgA);
+        REQUIRE(
+          matcher.postRecv(recvFactory(2, MPI_ANY_SOURCE, MPI_ANY_TAG)).msg ==
+          msgB);
+        REQUIRE(
+          matcher.postRecv(recvFactory(3, MPI_ANY_SOURCE, MPI_ANY_TAG)).msg ==
+          msgC);
+    }
+
+    // Wildcards never match other message types
+    REQUIRE(matcher.peekUnexpected(MPI_ANY_SOURCE,
+                                   MPI_ANY_TAG,
+                                   faabric::MPIMessage::BARRIER_JOIN) ==
+            nullptr);
+}
+
+TEST_CASE("Test messages go to the earliest receive they match", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+
+    matcher.postRecv(recvFactory(1, 3, 1));
+    matcher.postRecv(recvFactory(2, MPI_ANY_SOURCE, MPI_ANY_TAG));
+    matcher.postRecv(recvFactory(3, 3, MPI_ANY_TAG));
+    REQUIRE(matcher.getNumPendingWildcards() == 2);
+
+    // The exact receive was posted first
+    REQUIRE(matcher.addMessage(messageFactory(3, 1)) == 1);
+
+    // Then the wildcards in the order they were posted
+    REQUIRE(matcher.addMessage(messageFactory(3, 1)) == 2);
+    REQUIRE(matcher.getNumPendingWildcards() == 1);
+    REQUIRE(matcher.addMessage(messageFactory(2, 1)) == -1);
+    REQUIRE(matcher.addMessage(messageFactory(3, 9)) == 3);
+    REQUIRE(matcher.getNumPendingWildcards() == 0);
+}
+
+TEST_CASE("Test removing a receive that hasn't been matched", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+
+    matcher.postRecv(recvFactory(1, MPI_ANY_SOURCE, 2));
+    matcher.postRecv(recvFactory(2, MPI_ANY_SOURCE, 2));
+    matcher.removeRecv(1);
+    REQUIRE(matcher.getNumPendingWildcards() == 1);
+
+    REQUIRE(matcher.addMessage(messageFactory(0, 2)) == 2);
+    REQUIRE(matcher.getNumPendingWildcards() == 0);
+}
+
+TEST_CASE("Test getting the sources pending receives wait on", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+    REQUIRE(matcher.getPendingSources().empty());
+
+    matcher.postRecv(recvFactory(1, 3, 0));
+    matcher.postRecv(recvFactory(2, 1, 0));
+    matcher.postRecv(recvFactory(3, 3, 1));
+    REQUIRE(matcher.getPendingSources() == std::vector<int>({ 1, 3 }));
+
+    matcher.postRecv(recvFactory(4, MPI_ANY_SOURCE, 0));
+    REQUIRE(matcher.getPendingSources() ==
+            std::vector<int>({ MPI_ANY_SOURCE, 1, 3 }));
+
+    // Sources drop out once all their receives have been matched or removed
+    matcher.addMessage(messageFactory(3, 0));
+    matcher.removeRecv(4);
+    REQUIRE(matcher.getPendingSources() == std::vector<int>({ 1, 3 }));
+
+    matcher.addMessage(messageFactory(3, 1));
+    REQUIRE(matcher.getPendingSources() == std::vector<int>({ 1 }));
+}
+
+TEST_CASE("Test posting the same receive twice", "[mpi]")
+{
+    MpiMessageMatcher matcher;
+
+    matcher.postRecv(recvFactory(1, 0, 0));
+    REQUIRE_THROWS(matcher.postRecv(recvFactory(1, 0, 0)));
+}
+}
@@ -1,6 +1,7 @@
 #include <catch.hpp>
 
 #include <faabric/mpi/mpi.h>
+#include <faabric/scheduler/MpiReduceKernels.h>
 #include <faabric/scheduler/MpiWorld.h>
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/util/bytes.h>
@@ -8,6 +9,7 @@
 #include <faabric/util/random.h>
 #include <faabric_utils.h>
 
+#include <numeric>
 #include <thread>
 
 using namespace faabric::scheduler;
@@ -378,6 +380,304 @@ TEST_CASE_METHOD(MpiTestFixture, "Test async send and recv", "[mpi]")
     REQUIRE(actualB == messageDataB);
 }
 
+TEST_CASE_METHOD(MpiTestFixture, "Test waiting on all async requests", "[mpi]")
+{
+    int recvRank = 0;
+    std::vector<int> sendRanks = { 1, 2, 3 };
+
+    // Post the receives before anything has been sent
+    std::vector<int> actual(sendRanks.size(), -1);
+    std::vector<int> requestIds;
+    for (int i = 0; i < sendRanks.size(); i++) {
+        requestIds.push_back(world.irecv(
+          sendRanks.at(i), recvRank, BYTES(&actual.at(i)), MPI_INT, 1));
+    }
+
+    // None of the receives can complete yet
+    std::vector<MPI_Status> statuses(sendRanks.size());
+    REQUIRE(!world.testAllAsyncRequests(requestIds, statuses.data()));
+
+    // Send in the reverse order to the receives, with one send being async
+    int sendId = -1;
+    for (int i = sendRanks.size() - 1; i >= 0; i--) {
+        int data = sendRanks.at(i) * 10;
+        if (i == 0) {
+            sendId = world.isend(
+              sendRanks.at(i), recvRank, BYTES(&data), MPI_INT, 1);
+        } else {
+            world.send(sendRanks.at(i), recvRank, BYTES(&data), MPI_INT, 1);
+        }
+    }
+    requestIds.push_back(sendId);
+    statuses.emplace_back();
+
+    SECTION("Wait all")
+    {
+        world.awaitAllAsyncRequests(requestIds, statuses.data());
+    }
+
+    SECTION("Test all")
+    {
+        REQUIRE(world.testAllAsyncRequests(requestIds, statuses.data()));
+    }
+
+    REQUIRE(actual == std::vector<int>({ 10, 20, 30 }));
+    for (int i = 0; i < sendRanks.size(); i++) {
+        REQUIRE(statuses.at(i).MPI_SOURCE == sendRanks.at(i));
+        REQUIRE(statuses.at(i).bytesSize == sizeof(int));
+    }
+
+    // All the requests are now complete, so waiting again does nothing
+    REQUIRE(requestIds ==
+            std::vector<int>(requestIds.size(), FAABRIC_REQUEST_NULL_ID));
+    world.awaitAllAsyncRequests(requestIds);
+    REQUIRE(world.testAllAsyncRequests(requestIds));
+}
+
+TEST_CASE_METHOD(MpiTestFixture, "Test waiting on any async request", "[mpi]")
+{
+    int recvRank = 0;
+    int actualA = -1;
+    int actualB = -1;
+    int recvIdA = world.irecv(1, recvRank, BYTES(&actualA), MPI_INT, 1);
+    int recvIdB = world.irecv(2, recvRank, BYTES(&actualB), MPI_INT, 1);
+
+    // Only the second receive's message is sent
+    int dataB = 20;
+    world.send(2, recvRank, BYTES(&dataB), MPI_INT, 1);
+
+    MPI_Status status{};
+    std::vector<int> requestIds = { recvIdA, recvIdB };
+    REQUIRE(world.awaitAnyAsyncRequest(requestIds, &status) == 1);
+    REQUIRE(actualB == dataB);
+    REQUIRE(status.MPI_SOURCE == 2);
+    REQUIRE(requestIds ==
+            std::vector<int>({ recvIdA, FAABRIC_REQUEST_NULL_ID }));
+
+    // The completed request is skipped when waiting on the same array again
+    int dataA = 10;
+    world.send(1, recvRank, BYTES(&dataA), MPI_INT, 1);
+    REQUIRE(world.awaitAnyAsyncRequest(requestIds, &status) == 0);
+    REQUIRE(actualA == dataA);
+    REQUIRE(status.MPI_SOURCE == 1);
+
+    // Nothing left to wait on
+    REQUIRE(world.awaitAnyAsyncRequest(requestIds) == MPI_UNDEFINED);
+
+    std::vector<int> noRequests;
+    REQUIRE(world.awaitAnyAsyncRequest(noRequests) == MPI_UNDEFINED);
+}
+
+TEST_CASE_METHOD(MpiBaseTestFixture,
+                 "Test large local messages sent to posted buffers",
+                 "[mpi]")
+{
+    conf.mpiRendezvousThreshold = 1024;
+
+    MpiWorld world;
+    world.create(msg, worldId, worldSize);
+
+    int rankA = 1;
+    int rankB = 2;
+
+    int nInts = 0;
+    bool expectRendezvous = false;
+
+    SECTION("Above threshold")
+    {
+        nInts = 1000;
+        expectRendezvous = true;
+    }
+
+    SECTION("Below threshold")
+    {
+        nInts = 100;
+        expectRendezvous = false;
+    }
+
+    std::vector<int> messageData(nInts);
+    std::iota(messageData.begin(), messageData.end(), 0);
+
+    // Post the receive before the send
+    std::vector<int> actual(nInts, 0);
+    int recvId =
+      world.irecv(rankA, rankB, BYTES(actual.data()), MPI_INT, nInts);
+    world.send(rankA, rankB, BYTES(messageData.data()), MPI_INT, nInts);
+
+    // Check the message only carries the data when sent eagerly
+    std::shared_ptr<InMemoryMpiQueue> queue = world.getLocalQueue(rankA, rankB);
+    faabric::MPIMessage queuedMsg = **(queue->peek());
+    REQUIRE(queuedMsg.count() == nInts);
+    if (expectRendezvous) {
+        REQUIRE(queuedMsg.buffer().empty());
+        REQUIRE(actual == messageData);
+    } else {
+        REQUIRE(queuedMsg.buffer().size() == nInts * sizeof(int));
+    }
+
+    world.awaitAsyncRequest(recvId);
+    REQUIRE(actual == messageData);
+
+    world.destroy();
+}
+
+TEST_CASE_METHOD(MpiBaseTestFixture,
+                 "Test mixing eager and posted large local messages",
+                 "[mpi]")
+{
+    conf.mpiRendezvousThreshold = 1024;
+
+    MpiWorld world;
+    world.create(msg, worldId, worldSize);
+
+    int rankA = 1;
+    int rankB = 2;
+    int nInts = 1000;
+
+    std::vector<int> messageDataA(nInts, 1);
+    std::vector<int> messageDataB(nInts, 2);
+    std::vector<int> messageDataC(nInts, 3);
+
+    // First message is sent before anything is posted
+    world.send(rankA, rankB, BYTES(messageDataA.data()), MPI_INT, nInts);
+
+    // Only the second receive is posted, as the first message has already
+    // been sent, and only one buffer is exposed at a time
+    std::vector<int> actualA(nInts, 0);
+    std::vector<int> actualB(nInts, 0);
+    std::vector<int> actualC(nInts, 0);
+    int recvIdA =
+      world.irecv(rankA, rankB, BYTES(actualA.data()), MPI_INT, nInts);
+    int recvIdB =
+      world.irecv(rankA, rankB, BYTES(actualB.data()), MPI_INT, nInts);
+    int recvIdC =
+      world.irecv(rankA, rankB, BYTES(actualC.data()), MPI_INT, nInts);
+
+    world.send(rankA, rankB, BYTES(messageDataB.data()), MPI_INT, nInts);
+    world.send(rankA, rankB, BYTES(messageDataC.data()), MPI_INT, nInts);
+
+    REQUIRE(world.getLocalQueueSize(rankA, rankB) == 3);
+    REQUIRE(actualB == messageDataB);
+
+    // Await out of order
+    world.awaitAsyncRequest(recvIdC);
+    world.awaitAsyncRequest(recvIdA);
+    world.awaitAsyncRequest(recvIdB);
+
+    REQUIRE(actualA == messageDataA);
+    REQUIRE(actualB == messageDataB);
+    REQUIRE(actualC == messageDataC);
+
+    world.destroy();
+}
+
+TEST_CASE_METHOD(MpiBaseTestFixture,
+                 "Test posted buffers only take messages with their tag",
+                 "[mpi]")
+{
+    conf.mpiRendezvousThreshold = 1024;
+
+    MpiWorld world;
+    world.create(msg, worldId, worldSize);
+
+    int rankA = 1;
+    int rankB = 2;
+    int nInts = 1000;
+
+    std::vector<int> messageDataA(nInts, 1);
+    std::vector<int> messageDataB(nInts, 2);
+
+    // The first receive posts its buffer, which the message for the second
+    // must not take, even though it's sent first
+    std::vector<int> actualA(nInts, 0);
+    std::vector<int> actualB(nInts, 0);
+    int recvIdA = world.irecv(rankA,
+                              rankB,
+                              BYTES(actualA.data()),
+                              MPI_INT,
+                              nInts,
+                              faabric::MPIMessage::NORMAL,
+                              1);
+    int recvIdB = world.irecv(rankA,
+                              rankB,
+                              BYTES(actualB.data()),
+                              MPI_INT,
+                              nInts,
+                              faabric::MPIMessage::NORMAL,
+                              2);
+
+    world.send(rankA,
+               rankB,
+               BYTES(messageDataB.data()),
+               MPI_INT,
+               nInts,
+               faabric::MPIMessage::NORMAL,
+               2);
+    REQUIRE(actualA == std::vector<int>(nInts, 0));
+
+    world.send(rankA,
+               rankB,
+               BYTES(messageDataA.data()),
+               MPI_INT,
+               nInts,
+               faabric::MPIMessage::NORMAL,
+               1);
+    REQUIRE(actualA == messageDataA);
+
+    world.awaitAsyncRequest(recvIdB);
+    world.awaitAsyncRequest(recvIdA);
+
+    REQUIRE(actualA == messageDataA);
+    REQUIRE(actualB == messageDataB);
+
+    world.destroy();
+}
+
+TEST_CASE_METHOD(MpiBaseTestFixture,
+                 "Test large local message ping-pong",
+                 "[mpi]")
+{
+    conf.mpiRendezvousThreshold = 1024;
+
+    MpiWorld world;
+    world.create(msg, worldId, worldSize);
+
+    int rankA = 1;
+    int rankB = 2;
+    int nInts = 2000;
+    int nRoundTrips = 200;
+
+    // Each rank adds one to every element before sending it back, so any
+    // message landing in the wrong buffer shows up in the final values
+    std::thread other([&world, rankA, rankB, nInts, nRoundTrips] {
+        std::vector<int> buffer(nInts, 0);
+        for (int i = 0; i < nRoundTrips; i++) {
+            world.recv(
+              rankA, rankB, BYTES(buffer.data()), MPI_INT, nInts, nullptr);
+            for (auto& v : buffer) {
+                v++;
+            }
+            world.send(rankB, rankA, BYTES(buffer.data()), MPI_INT, nInts);
+        }
+    });
+
+    std::vector<int> buffer(nInts, 0);
+    for (int i = 0; i < nRoundTrips; i++) {
+        world.send(rankA, rankB, BYTES(buffer.data()), MPI_INT, nInts);
+        world.recv(rankB, rankA, BYTES(buffer.data()), MPI_INT, nInts, nullptr);
+        for (auto& v : buffer) {
+            v++;
+        }
+    }
+
+    other.join();
+
+    std::vector<int> expected(nInts, 2 * nRoundTrips);
+    REQUIRE(buffer == expected);
+
+    world.destroy();
+}
+
 TEST_CASE_METHOD(MpiTestFixture, "Test send/recv message with no data", "[mpi]")
 {
     int rankA1 = 1;
@@ -427,6 +727,169 @@ TEST_CASE_METHOD(MpiTestFixture, "Test recv with partial data", "[mpi]")
     REQUIRE(status.bytesSize == actualSize * sizeof(int));
 }
 
+TEST_CASE_METHOD(MpiTestFixture, "Test receiving messages by tag", "[mpi]")
+{
+    int rankA = 1;
+    int rankB = 2;
+    int dataA = 10;
+    int dataB = 20;
+    world.send(
+      rankA, rankB, BYTES(&dataA), MPI_INT, 1, faabric::MPIMessage::NORMAL, 5);
+    world.send(
+      rankA, rankB, BYTES(&dataB), MPI_INT, 1, faabric::MPIMessage::NORMAL, 7);
+
+    // Receive the later message first
+    int actualA = 0;
+    int actualB = 0;
+    MPI_Status statusA{};
+    MPI_Status statusB{};
+    world.recv(rankA,
+               rankB,
+               BYTES(&actualB),
+               MPI_INT,
+               1,
+               &statusB,
+               faabric::MPIMessage::NORMAL,
+               7);
+    REQUIRE(actualB == dataB);
+    REQUIRE(statusB.MPI_TAG == 7);
+
+    world.recv(rankA,
+               rankB,
+               BYTES(&actualA),
+               MPI_INT,
+               1,
+               &statusA,
+               faabric::MPIMessage::NORMAL,
+               5);
+    REQUIRE(actualA == dataA);
+    REQUIRE(statusA.MPI_TAG == 5);
+
+    // Only messages with the tag are taken by asynchronous receives too
+    world.send(
+      rankA, rankB, BYTES(&dataA), MPI_INT, 1, faabric::MPIMessage::NORMAL, 1);
+    world.send(
+      rankA, rankB, BYTES(&dataB), MPI_INT, 1, faabric::MPIMessage::NORMAL, 2);
+
+    actualA = 0;
+    actualB = 0;
+    int recvIdB = world.irecv(rankA,
+                              rankB,
+                              BYTES(&actualB),
+                              MPI_INT,
+                              1,
+                              faabric::MPIMessage::NORMAL,
+                              2);
+    int recvIdA = world.irecv(rankA,
+                              rankB,
+                              BYTES(&actualA),
+                              MPI_INT,
+                              1,
+                              faabric::MPIMessage::NORMAL,
+                              1);
+
+    world.awaitAsyncRequest(recvIdA);
+    world.awaitAsyncRequest(recvIdB);
+    REQUIRE(actualA == dataA);
+    REQUIRE(actualB == dataB);
+}
+
+TEST_CASE_METHOD(MpiTestFixture,
+                 "Test receiving from any source and with any tag",
+                 "[mpi]")
+{
+    int recvRank = 2;
+
+    // Each rank sends its own rank, with its own tag
+    for (int sendRank : { 0, 1, 3 }) {
+        world.send(sendRank,
+                   recvRank,
+                   BYTES(&sendRank),
+                   MPI_INT,
+                   1,
+                   faabric::MPIMessage::NORMAL,
+                   sendRank + 10);
+    }
+
+    // Any source with a given tag takes only the message with that tag
+    int actual = -1;
+    MPI_Status status{};
+    world.recv(MPI_ANY_SOURCE,
+               recvRank,
+               BYTES(&actual),
+               MPI_INT,
+               1,
+               &status,
+               faabric::MPIMessage::NORMAL,
+               11);
+    REQUIRE(actual == 1);
+    REQUIRE(status.MPI_SOURCE == 1);
+    REQUIRE(status.MPI_TAG == 11);
+
+    // Any tag from a given source
+    world.recv(3,
+               recvRank,
+               BYTES(&actual),
+               MPI_INT,
+               1,
+               &status,
+               faabric::MPIMessage::NORMAL,
+               MPI_ANY_TAG);
+    REQUIRE(actual == 3);
+    REQUIRE(status.MPI_SOURCE == 3);
+    REQUIRE(status.MPI_TAG == 13);
+
+    // Any source and tag takes what's left
+    world.recv(MPI_ANY_SOURCE,
+               recvRank,
+               BYTES(&actual),
+               MPI_INT,
+               1,
+               &status,
+               faabric::MPIMessage::NORMAL,
+               MPI_ANY_TAG);
+    REQUIRE(actual == 0);
+    REQUIRE(status.MPI_SOURCE == 0);
+    REQUIRE(status.MPI_TAG == 10);
+}
+
+TEST_CASE_METHOD(MpiTestFixture,
+                 "Test receiving from any source across threads",
+                 "[mpi]")
+{
+    int recvRank = 0;
+    std::vector<int> sendRanks = { 1, 2, 3 };
+
+    // Each sender sends one message, which the receiver takes in whatever
+    // order they arrive in
+    std::vector<std::thread> threads;
+    for (int sendRank : sendRanks) {
+        threads.emplace_back([this, sendRank, recvRank] {
+            int data = sendRank;
+            world.send(sendRank, recvRank, BYTES(&data), MPI_INT, 1);
+        });
+    }
+
+    std::vector<int> actual;
+    for (size_t i = 0; i < sendRanks.size(); i++) {
+        int data = -1;
+        MPI_Status status{};
+        world.recv(
+          MPI_ANY_SOURCE, recvRank, BYTES(&data), MPI_INT, 1, &status);
+        REQUIRE(status.MPI_SOURCE == data);
+        actual.push_back(data);
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    std::sort(actual.begin(), actual.end());
+    REQUIRE(actual == sendRanks);
+}
+
 TEST_CASE_METHOD(MpiTestFixture, "Test probe", "[mpi]")
 {
     // Send two messages of different sizes
@@ -474,6 +937,137 @@ TEST_CASE_METHOD(MpiTestFixture, "Check sending to invalid rank", "[mpi]")
     REQUIRE_THROWS(world.send(0, invalidRank, BYTES(input.data()), MPI_INT, 4));
 }
 
+TEST_CASE_METHOD(MpiBaseTestFixture, "Test binomial tree broadcast", "[mpi]")
+{
+    int thisWorldSize = 6;
+    msg.set_mpiworldsize(thisWorldSize);
+    MpiWorld world;
+    world.create(msg, worldId, thisWorldSize);
+
+    int root = 2;
+    std::vector<int> messageData = { 0, 1, 2 };
+    world.broadcast(
+      root, root, BYTES(messageData.data()), MPI_INT, messageData.size());
+
+    // Relative to the root, rank 2 sends to 4, 2 and 1
+    REQUIRE(world.getLocalQueueSize(root, 0) == 1);
+    REQUIRE(world.getLocalQueueSize(root, 4) == 1);
+    REQUIRE(world.getLocalQueueSize(root, 3) == 1);
+    REQUIRE(world.getLocalQueueSize(root, 5) == 0);
+    REQUIRE(world.getLocalQueueSize(root, 1) == 0);
+
+    // Parents always come before their children relative to the root, so
+    // the other ranks can take part in that order
+    std::vector<std::vector<int>> actual(thisWorldSize, { -1, -1, -1 });
+    for (int r : { 3, 4, 5, 0, 1 }) {
+        world.broadcast(root, r, BYTES(actual[r].data()), MPI_INT, 3);
+    }
+
+    // Relative ranks 2 and 4 forward to 3 and 5 respectively
+    REQUIRE(world.getLocalQueueSize(4, 5) == 0);
+    REQUIRE(world.getLocalQueueSize(0, 1) == 0);
+
+    for (int r = 0; r < thisWorldSize; r++) {
+        if (r != root) {
+            REQUIRE(actual[r] == messageData);
+        }
+    }
+
+    world.destroy();
+}
+
+TEST_CASE_METHOD(MpiBaseTestFixture, "Test pipelined chain broadcast", "[mpi]")
+{
+    int thisWorldSize = 4;
+    msg.set_mpiworldsize(thisWorldSize);
+    MpiWorld world;
+    world.create(msg, worldId, thisWorldSize);
+
+    int root = 1;
+    int nSegments = 32;
+    int nInts = nSegments * MPI_BCAST_SEGMENT_BYTES / sizeof(int);
+    std::vector<int> messageData(nInts);
+    std::iota(messageData.begin(), messageData.end(), 0);
+
+    world.broadcast(root, root, BYTES(messageData.data()), MPI_INT, nInts);
+
+    // The root only sends to the next rank, one message per segment
+    REQUIRE(world.getLocalQueueSize(root, 2) == nSegments);
+    REQUIRE(world.getLocalQueueSize(root, 3) == 0);
+    REQUIRE(world.getLocalQueueSize(root, 0) == 0);
+
+    std::vector<std::vector<int>> actual(thisWorldSize,
+                                         std::vector<int>(nInts, -1));
+    for (int r : { 2, 3, 0 }) {
+        world.broadcast(root, r, BYTES(actual[r].data()), MPI_INT, nInts);
+        REQUIRE(actual[r] == messageData);
+    }
+
+    // The last rank in the chain doesn't forward anything
+    REQUIRE(world.getLocalQueueSize(0, 1) == 0);
+
+    world.destroy();
+}
+
+TEST_CASE_METHOD(MpiBaseTestFixture,
+                 "Test broadcast with all ranks in threads",
+                 "[mpi]")
+{
+    int thisWorldSize = 0;
+    int nInts = 0;
+
+    SECTION("Small world, small message")
+    {
+        thisWorldSize = 3;
+        nInts = 10;
+    }
+
+    SECTION("Large world, small message")
+    {
+        thisWorldSize = 11;
+        nInts = 10;
+    }
+
+    SECTION("Large world, large message")
+    {
+        thisWorldSize = 11;
+        nInts = 3 * MPI_BCAST_CHAIN_MIN_BYTES / sizeof(int) + 7;
+    }
+
+    msg.set_mpiworldsize(thisWorldSize);
+    MpiWorld world;
+    world.create(msg, worldId, thisWorldSize);
+
+    std::vector<int> messageData(nInts);
+    std::iota(messageData.begin(), messageData.end(), 0);
+
+    for (int root : { 0, thisWorldSize - 1 }) {
+        std::vector<std::vector<int>> actual(thisWorldSize,
+                                             std::vector<int>(nInts, -1));
+        actual[root] = messageData;
+
+        std::vector<std::thread> threads;
+        for (int r = 0; r < thisWorldSize; r++) {
+            threads.emplace_back([&world, &actual, root, r, nInts] {
+                world.broadcast(
+                  root, r, BYTES(actual[r].data()), MPI_INT, nInts);
+            });
+        }
+
+        for (auto& t : threads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+
+        for (int r = 0; r < thisWorldSize; r++) {
+            REQUIRE(actual[r] == messageData);
+        }
+    }
+
+    world.destroy();
+}
+
 TEST_CASE_METHOD(MpiTestFixture, "Test collective messaging locally", "[mpi]")
 {
     int root = 3;
@@ -845,6 +1439,114 @@ TEST_CASE_METHOD(MpiTestFixture, "Test reduce", "[mpi]")
     }
 }
 
+TEST_CASE_METHOD(MpiBaseTestFixture, "Test allreduce algorithms", "[mpi]")
+{
+    std::string algorithm;
+
+    SECTION("Reduce and broadcast") { algorithm = "reduce_broadcast"; }
+
+    SECTION("Recursive doubling") { algorithm = "recursive_doubling"; }
+
+    SECTION("Ring") { algorithm = "ring"; }
+
+    SECTION("Automatic") { algorithm = "auto"; }
+
+    conf.mpiAllReduceAlgorithm = algorithm;
+
+    int thisWorldSize = 0;
+    int count = 0;
+
+    SECTION("Single rank")
+    {
+        thisWorldSize = 1;
+        count = 10;
+    }
+
+    SECTION("Power of two, fewer elements than ranks")
+    {
+        thisWorldSize = 8;
+        count = 3;
+    }
+
+    SECTION("Not a power of two, uneven chunks")
+    {
+        thisWorldSize = 7;
+        count = 1003;
+    }
+
+    SECTION("Not a power of two, large buffer")
+    {
+        thisWorldSize = 6;
+        count = 2 * MPI_ALLREDUCE_RING_MIN_BYTES / sizeof(double) + 5;
+    }
+
+    msg.set_mpiworldsize(thisWorldSize);
+    MpiWorld world;
+    world.create(msg, worldId, thisWorldSize);
+
+    // Each rank contributes different values to each element
+    std::vector<std::vector<double>> rankData(thisWorldSize,
+                                              std::vector<double>(count));
+    std::vector<double> expectedSum(count, 0);
+    std::vector<double> expectedMax(count, 0);
+    for (int r = 0; r < thisWorldSize; r++) {
+        for (int i = 0; i < count; i++) {
+            rankData[r][i] = 0.5 * ((r + i) % 13);
+            expectedSum[i] += rankData[r][i];
+            expectedMax[i] = std::max(expectedMax[i], rankData[r][i]);
+        }
+    }
+
+    std::vector<std::vector<double>> actualSum(thisWorldSize);
+    std::vector<std::vector<double>> actualMax(thisWorldSize);
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < thisWorldSize; r++) {
+        threads.emplace_back([&, r] {
+            // Sum not in place, then max in place
+            actualSum[r] = std::vector<double>(count, 0);
+            world.allReduce(r,
+                            BYTES(rankData[r].data()),
+                            BYTES(actualSum[r].data()),
+                            MPI_DOUBLE,
+                            count,
+                            MPI_SUM);
+
+            actualMax[r] = rankData[r];
+            world.allReduce(r,
+                            BYTES(actualMax[r].data()),
+                            BYTES(actualMax[r].data()),
+                            MPI_DOUBLE,
+                            count,
+                            MPI_MAX);
+        });
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    for (int r = 0; r < thisWorldSize; r++) {
+        REQUIRE(actualSum[r] == expectedSum);
+        REQUIRE(actualMax[r] == expectedMax);
+    }
+
+    world.destroy();
+}
+
+TEST_CASE_METHOD(MpiTestFixture,
+                 "Test unrecognised allreduce algorithm",
+                 "[mpi]")
+{
+    conf.mpiAllReduceAlgorithm = "foobar";
+
+    std::vector<int> data = { 1, 2, 3 };
+    REQUIRE_THROWS(world.allReduce(
+      0, BYTES(data.data()), BYTES(data.data()), MPI_INT, 3, MPI_SUM));
+}
+
 TEST_CASE_METHOD(MpiTestFixture, "Test operator reduce", "[mpi]")
 {
     SECTION("Max")
@@ -1016,9 +1718,205 @@ TEST_CASE_METHOD(MpiTestFixture, "Test operator reduce", "[mpi]")
                                            (uint8_t*)input.data(),
                                            (uint8_t*)output.data()));
         }
+
+        SECTION("Unsigned integers")
+        {
+            std::vector<uint32_t> input = { 1, 2, 3 };
+            std::vector<uint32_t> output = { 4, 5, 6 };
+            std::vector<uint32_t> expected = { 5, 7, 9 };
+
+            world.op_reduce(MPI_SUM,
+                            MPI_UINT_T,
+                            3,
+                            (uint8_t*)input.data(),
+                            (uint8_t*)output.data());
+            REQUIRE(output == expected);
+        }
+
+        SECTION("Floats")
+        {
+            std::vector<float> input = { 0.5, 1.5, 2.5 };
+            std::vector<float> output = { 1, 1, 1 };
+            std::vector<float> expected = { 1.5, 2.5, 3.5 };
+
+            world.op_reduce(MPI_SUM,
+                            MPI_FLOAT,
+                            3,
+                            (uint8_t*)input.data(),
+                            (uint8_t*)output.data());
+            REQUIRE(output == expected);
+        }
+    }
+
+    SECTION("Prod")
+    {
+        std::vector<long> input = { 2, 3, -4 };
+        std::vector<long> output = { 5, 0, 6 };
+        std::vector<long> expected = { 10, 0, -24 };
+
+        world.op_reduce(MPI_PROD,
+                        MPI_LONG,
+                        3,
+                        (uint8_t*)input.data(),
+                        (uint8_t*)output.data());
+        REQUIRE(output == expected);
+    }
+
+    SECTION("Logical and")
+    {
+        std::vector<char> input = { 0, 1, 1, 0 };
+        std::vector<char> output = { 0, 0, 5, 3 };
+        std::vector<char> expected = { 0, 0, 1, 0 };
+
+        world.op_reduce(MPI_LAND,
+                        MPI_CHAR,
+                        4,
+                        (uint8_t*)input.data(),
+                        (uint8_t*)output.data());
+        REQUIRE(output == expected);
+    }
+
+    SECTION("Logical or")
+    {
+        bool input[] = { false, true, false, true };
+        bool output[] = { false, false, true, true };
+        bool expected[] = { false, true, true, true };
+
+        world.op_reduce(MPI_LOR, MPI_C_BOOL, 4, BYTES(input), BYTES(output));
+        REQUIRE(std::equal(output, output + 4, expected));
+    }
+
+    SECTION("Bitwise and")
+    {
+        std::vector<uint8_t> input = { 0b1100, 0b1010, 0xFF };
+        std::vector<uint8_t> output = { 0b1010, 0b1010, 0x0F };
+        std::vector<uint8_t> expected = { 0b1000, 0b1010, 0x0F };
+
+        world.op_reduce(MPI_BAND, MPI_BYTE, 3, input.data(), output.data());
+        REQUIRE(output == expected);
+    }
+
+    SECTION("Bitwise or")
+    {
+        std::vector<int64_t> input = { 0b1100, 0b1010, 0 };
+        std::vector<int64_t> output = { 0b1010, 0b1010, 0 };
+        std::vector<int64_t> expected = { 0b1110, 0b1010, 0 };
+
+        world.op_reduce(MPI_BOR,
+                        MPI_INT64_T,
+                        3,
+                        (uint8_t*)input.data(),
+                        (uint8_t*)output.data());
+        REQUIRE(output == expected);
+    }
+
+    SECTION("Max and min location")
+    {
+        std::vector<MpiDoubleInt> input = { { 1, 3 }, { 2, 3 }, { 3, 3 } };
+        std::vector<MpiDoubleInt> output = { { 2, 1 }, { 2, 1 }, { 2, 4 } };
+
+        // Ties go to the lowest index
+        std::vector<std::pair<double, int>> expected;
+        SECTION("Max")
+        {
+            world.op_reduce(MPI_MAXLOC,
+                            MPI_DOUBLE_INT,
+                            3,
+                            BYTES(input.data()),
+                            BYTES(output.data()));
+            expected = { { 2, 1 }, { 2, 1 }, { 3, 3 } };
+        }
+
+        SECTION("Min")
+        {
+            world.op_reduce(MPI_MINLOC,
+                            MPI_DOUBLE_INT,
+                            3,
+                            BYTES(input.data()),
+                            BYTES(output.data()));
+            expected = { { 1, 3 }, { 2, 1 }, { 2, 4 } };
+        }
+
+        std::vector<std::pair<double, int>> actual;
+        for (const auto& o : output) {
+            actual.emplace_back(o.value, o.index);
+        }
+        REQUIRE(actual == expected);
+    }
+
+    SECTION("Unsupported operation for datatype")
+    {
+        std::vector<double> input = { 1, 1, 1 };
+        std::vector<double> output = { 1, 1, 1 };
+
+        REQUIRE_THROWS(world.op_reduce(MPI_BAND,
+                                       MPI_DOUBLE,
+                                       3,
+                                       (uint8_t*)input.data(),
+                                       (uint8_t*)output.data()));
     }
 }
 
+TEST_CASE("Test reduce kernels cover all operations and datatypes", "[mpi]")
+{
+    std::vector<int> integerTypes = { FAABRIC_INT8,      FAABRIC_INT16,
+                                      FAABRIC_INT32,     FAABRIC_INT,
+                                      FAABRIC_INT64,     FAABRIC_UINT8,
+                                      FAABRIC_UINT16,    FAABRIC_UINT32,
+                                      FAABRIC_UINT,      FAABRIC_UINT64,
+                                      FAABRIC_LONG,      FAABRIC_LONG_LONG,
+                                      FAABRIC_LONG_LONG_INT, FAABRIC_CHAR };
+    std::vector<int> floatingTypes = { FAABRIC_FLOAT, FAABRIC_DOUBLE };
+
+    std::vector<int> supportedTypes;
+    std::vector<int> opIds;
+
+    SECTION("Arithmetic")
+    {
+        opIds = { FAABRIC_OP_MAX, FAABRIC_OP_MIN, FAABRIC_OP_SUM,
+                  FAABRIC_OP_PROD };
+        supportedTypes = integerTypes;
+        supportedTypes.insert(
+          supportedTypes.end(), floatingTypes.begin(), floatingTypes.end());
+    }
+
+    SECTION("Logical")
+    {
+        opIds = { FAABRIC_OP_LAND, FAABRIC_OP_LOR };
+        supportedTypes = integerTypes;
+        supportedTypes.push_back(FAABRIC_C_BOOL);
+    }
+
+    SECTION("Bitwise")
+    {
+        opIds = { FAABRIC_OP_BAND, FAABRIC_OP_BOR };
+        supportedTypes = integerTypes;
+        supportedTypes.push_back(FAABRIC_BYTE);
+    }
+
+    SECTION("Location")
+    {
+        opIds = { FAABRIC_OP_MAXLOC, FAABRIC_OP_MINLOC };
+        supportedTypes = { FAABRIC_DOUBLE_INT };
+    }
+
+    for (int opId : opIds) {
+        for (int datatypeId = FAABRIC_INT8; datatypeId <= FAABRIC_DATATYPE_NULL;
+             datatypeId++) {
+            bool isSupported =
+              std::find(supportedTypes.begin(),
+                        supportedTypes.end(),
+                        datatypeId) != supportedTypes.end();
+            REQUIRE((getMpiReduceKernel(opId, datatypeId) != nullptr) ==
+                    isSupported);
+        }
+    }
+
+    REQUIRE(getMpiReduceKernel(FAABRIC_OP_NULL, FAABRIC_INT) == nullptr);
+    REQUIRE(getMpiReduceKernel(-1, FAABRIC_INT) == nullptr);
+    REQUIRE(getMpiReduceKernel(FAABRIC_OP_SUM, 100) == nullptr);
+}
+
 TEST_CASE_METHOD(MpiTestFixture, "Test gather and allgather", "[mpi]")
 {
     int root = 3;
@@ -1192,6 +2090,89 @@ TEST_CASE_METHOD(MpiTestFixture, "Test scan", "[mpi]")
     }
 }
 
+TEST_CASE_METHOD(MpiBaseTestFixture, "Test scan with other types", "[mpi]")
+{
+    // Use a world size that isn't a power of two
+    int thisWorldSize = 7;
+    msg.set_mpiworldsize(thisWorldSize);
+    MpiWorld world;
+    world.create(msg, worldId, thisWorldSize);
+
+    // Products of these are exact
+    std::vector<double> expected = { 1, 1 };
+    for (int r = 0; r < thisWorldSize; r++) {
+        std::vector<double> sendData = { (double)r + 1, 0.5 };
+        expected[0] *= sendData[0];
+        expected[1] *= sendData[1];
+
+        std::vector<double> result(2, 0);
+        world.scan(r,
+                   BYTES(sendData.data()),
+                   BYTES(result.data()),
+                   MPI_DOUBLE,
+                   2,
+                   MPI_PROD);
+        REQUIRE(result == expected);
+    }
+
+    world.destroy();
+}
+
+TEST_CASE_METHOD(MpiTestFixture, "Test exscan", "[mpi]")
+{
+    int count = 3;
+
+    std::vector<std::vector<int>> rankData(worldSize, std::vector<int>(count));
+    for (int r = 0; r < worldSize; r++) {
+        for (int i = 0; i < count; i++) {
+            rankData[r][i] = r * 10 + i;
+        }
+    }
+
+    // Rank 0's receive buffer is left untouched
+    std::vector<std::vector<int>> expected(worldSize,
+                                           std::vector<int>(count, -1));
+    for (int r = 1; r < worldSize; r++) {
+        for (int i = 0; i < count; i++) {
+            expected[r][i] = rankData[r - 1][i];
+            if (r > 1) {
+                expected[r][i] += expected[r - 1][i];
+            }
+        }
+    }
+
+    bool inPlace;
+    SECTION("In place") { inPlace = true; }
+    SECTION("Not in place") { inPlace = false; }
+
+    std::vector<std::vector<int>> result(worldSize,
+                                         std::vector<int>(count, -1));
+    for (int r = 0; r < worldSize; r++) {
+        if (inPlace) {
+            result[r] = rankData[r];
+            world.exscan(r,
+                         BYTES(result[r].data()),
+                         BYTES(result[r].data()),
+                         MPI_INT,
+                         count,
+                         MPI_SUM);
+        } else {
+            world.exscan(r,
+                         BYTES(rankData[r].data()),
+                         BYTES(result[r].data()),
+                         MPI_INT,
+                         count,
+                         MPI_SUM);
+        }
+
+        if (inPlace && r == 0) {
+            REQUIRE(result[r] == rankData[r]);
+        } else {
+            REQUIRE(result[r] == expected[r]);
+        }
+    }
+}
+
 TEST_CASE_METHOD(MpiBaseTestFixture, "Test all-to-all", "[mpi]")
 {
     // For this test we need a fixed world size of 4, otherwise the built
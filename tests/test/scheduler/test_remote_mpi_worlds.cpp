@@ -295,6 +295,104 @@ TEST_CASE_METHOD(RemoteMpiTestFixture,
     thisWorld.destroy();
 }
 
+TEST_CASE_METHOD(RemoteMpiTestFixture,
+                 "Test large messages across hosts use a rendezvous",
+                 "[mpi]")
+{
+    faabric::util::SystemConfig& conf = faabric::util::getSystemConfig();
+    conf.mpiEagerLimit = 1024;
+
+    // Chunks that don't divide the message, and more of them than the window
+    conf.mpiChunkSize = 1000;
+
+    SECTION("Receive buffers not posted") { conf.mpiRendezvousThreshold = 0; }
+
+    SECTION("Receive buffers posted") { conf.mpiRendezvousThreshold = 1024; }
+
+    // Register two ranks (one on each host)
+    setWorldSizes(2, 1, 1);
+    int rankA = 0;
+    int rankB = 1;
+    int nInts = 10000;
+
+    std::vector<int> dataA(nInts);
+    std::vector<int> dataB(nInts);
+    for (int i = 0; i < nInts; i++) {
+        dataA[i] = i;
+        dataB[i] = -i;
+    }
+
+    // Init worlds
+    MpiWorld& thisWorld = getMpiWorldRegistry().createWorld(msg, worldId);
+    faabric::util::setMockMode(false);
+    thisWorld.broadcastHostsToRanks();
+
+    std::thread otherWorldThread([this, rankA, rankB, nInts, &dataA, &dataB] {
+        otherWorld.initialiseFromMsg(msg);
+
+        // Both ranks send before waiting on their receive
+        std::vector<int> actual(nInts, 0);
+        otherWorld.sendRecv(BYTES(dataB.data()),
+                            nInts,
+                            MPI_INT,
+                            rankA,
+                            BYTES(actual.data()),
+                            nInts,
+                            MPI_INT,
+                            rankA,
+                            rankB,
+                            MPI_STATUS_IGNORE);
+        assert(actual == dataA);
+
+        // Then a plain receive, followed by a send
+        std::vector<int> actualB(nInts, 0);
+        otherWorld.recv(rankA,
+                        rankB,
+                        BYTES(actualB.data()),
+                        MPI_INT,
+                        nInts,
+                        MPI_STATUS_IGNORE);
+        assert(actualB == dataA);
+
+        otherWorld.send(rankB, rankA, BYTES(dataB.data()), MPI_INT, nInts);
+
+        testLatch->wait();
+        otherWorld.destroy();
+    });
+
+    std::vector<int> actual(nInts, 0);
+    thisWorld.sendRecv(BYTES(dataA.data()),
+                       nInts,
+                       MPI_INT,
+                       rankB,
+                       BYTES(actual.data()),
+                       nInts,
+                       MPI_INT,
+                       rankB,
+                       rankA,
+                       MPI_STATUS_IGNORE);
+    REQUIRE(actual == dataB);
+
+    thisWorld.send(rankA, rankB, BYTES(dataA.data()), MPI_INT, nInts);
+
+    MPI_Status status{};
+    std::vector<int> actualA(nInts, 0);
+    thisWorld.recv(
+      rankB, rankA, BYTES(actualA.data()), MPI_INT, nInts, &status);
+    REQUIRE(actualA == dataB);
+    REQUIRE(status.MPI_SOURCE == rankB);
+    REQUIRE(status.bytesSize == nInts * sizeof(int));
+
+    // Clean up
+    testLatch->wait();
+    if (otherWorldThread.joinable()) {
+        otherWorldThread.join();
+    }
+
+    thisWorld.destroy();
+    conf.reset();
+}
+
 TEST_CASE_METHOD(RemoteCollectiveTestFixture,
                  "Test broadcast across hosts",
                  "[mpi]")
@@ -306,11 +404,15 @@ TEST_CASE_METHOD(RemoteCollectiveTestFixture,
     std::thread otherWorldThread([this, &messageData] {
         otherWorld.initialiseFromMsg(msg);
 
-        // Broadcast a message
+        // Broadcast a message with the deprecated root-only broadcast, which
+        // the other ranks receive with recv
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
         otherWorld.broadcast(otherHostRankB,
                              BYTES(messageData.data()),
                              MPI_INT,
                              messageData.size());
+#pragma GCC diagnostic pop
 
         // Check the broadcast is received on this host by the other ranks
         for (int rank : otherWorldRanks) {
@@ -525,6 +627,133 @@ TEST_CASE_METHOD(RemoteCollectiveTestFixture,
     thisWorld.destroy();
 }
 
+TEST_CASE_METHOD(RemoteCollectiveTestFixture,
+                 "Test hierarchical collectives across hosts",
+                 "[mpi]")
+{
+    MpiWorld& thisWorld = setUpThisWorld();
+
+    // Check roots that lead their host, and ones that don't
+    int root = 0;
+    SECTION("Root is lowest rank on this host") { root = 0; }
+
+    SECTION("Root is not lowest rank on this host") { root = thisHostRankA; }
+
+    SECTION("Root is not lowest rank on other host") { root = otherHostRankB; }
+
+    int nPerRank = 3;
+    std::vector<std::vector<int>> reduceResults(thisWorldSize);
+    std::vector<std::vector<int>> allReduceResults(thisWorldSize);
+    std::vector<std::vector<int>> bcastResults(thisWorldSize);
+    std::vector<std::vector<int>> gatherResults(thisWorldSize);
+    std::vector<std::vector<int>> allGatherResults(thisWorldSize);
+
+    // Every rank runs in its own thread, as the collectives need all ranks on
+    // a host to take part at once
+    auto rankLatch = faabric::util::Latch::create(thisWorldSize);
+    auto doCollectives = [&, this](MpiWorld& world, int rank) {
+        std::vector<int> rankData = { rank, 10 * rank, 100 * rank };
+
+        std::vector<int> reduced(nPerRank, -1);
+        world.reduce(rank,
+                     root,
+                     BYTES(rankData.data()),
+                     rank == root ? BYTES(reduced.data()) : nullptr,
+                     MPI_INT,
+                     nPerRank,
+                     MPI_SUM);
+        reduceResults[rank] = reduced;
+
+        std::vector<int> allReduced(nPerRank, -1);
+        world.allReduce(rank,
+                        BYTES(rankData.data()),
+                        BYTES(allReduced.data()),
+                        MPI_INT,
+                        nPerRank,
+                        MPI_SUM);
+        allReduceResults[rank] = allReduced;
+
+        std::vector<int> bcast = rank == root ? rankData
+                                              : std::vector<int>(nPerRank, -1);
+        world.broadcast(root, rank, BYTES(bcast.data()), MPI_INT, nPerRank);
+        bcastResults[rank] = bcast;
+
+        std::vector<int> gathered(nPerRank * thisWorldSize, -1);
+        world.gather(rank,
+                     root,
+                     BYTES(rankData.data()),
+                     MPI_INT,
+                     nPerRank,
+                     rank == root ? BYTES(gathered.data()) : nullptr,
+                     MPI_INT,
+                     nPerRank);
+        gatherResults[rank] = gathered;
+
+        std::vector<int> allGathered(nPerRank * thisWorldSize, -1);
+        world.allGather(rank,
+                        BYTES(rankData.data()),
+                        MPI_INT,
+                        nPerRank,
+                        BYTES(allGathered.data()),
+                        MPI_INT,
+                        nPerRank);
+        allGatherResults[rank] = allGathered;
+
+        world.barrier(rank);
+
+        rankLatch->wait();
+        world.destroy();
+    };
+
+    std::thread otherWorldThread([this, &doCollectives] {
+        otherWorld.initialiseFromMsg(msg);
+
+        std::vector<std::thread> rankThreads;
+        for (int rank : otherWorldRanks) {
+            rankThreads.emplace_back([this, rank, &doCollectives] {
+                doCollectives(otherWorld, rank);
+            });
+        }
+
+        for (auto& t : rankThreads) {
+            t.join();
+        }
+    });
+
+    std::vector<std::thread> rankThreads;
+    for (int rank : thisWorldRanks) {
+        rankThreads.emplace_back([&thisWorld, rank, &doCollectives] {
+            doCollectives(thisWorld, rank);
+        });
+    }
+
+    for (auto& t : rankThreads) {
+        t.join();
+    }
+
+    if (otherWorldThread.joinable()) {
+        otherWorldThread.join();
+    }
+
+    // Build the expectations
+    int rankSum = 0;
+    std::vector<int> expectedGather;
+    for (int r = 0; r < thisWorldSize; r++) {
+        rankSum += r;
+        expectedGather.insert(expectedGather.end(), { r, 10 * r, 100 * r });
+    }
+    std::vector<int> expectedReduce = { rankSum, 10 * rankSum, 100 * rankSum };
+    std::vector<int> expectedBcast = { root, 10 * root, 100 * root };
+
+    REQUIRE(reduceResults[root] == expectedReduce);
+    REQUIRE(gatherResults[root] == expectedGather);
+    for (int r = 0; r < thisWorldSize; r++) {
+        REQUIRE(allReduceResults[r] == expectedReduce);
+        REQUIRE(bcastResults[r] == expectedBcast);
+        REQUIRE(allGatherResults[r] == expectedGather);
+    }
+}
+
 TEST_CASE_METHOD(RemoteMpiTestFixture,
                  "Test sending sync and async message to same host",
                  "[mpi]")
@@ -723,4 +952,92 @@ TEST_CASE_METHOD(RemoteMpiTestFixture,
 
     thisWorld.destroy();
 }
+
+TEST_CASE_METHOD(RemoteMpiTestFixture,
+                 "Test multiple ranks sharing the channel to a host",
+                 "[mpi]")
+{
+    // One rank on this host, two on the other, so messages from both remote
+    // ranks arrive on the same port here and must be told apart
+    setWorldSizes(3, 1, 2);
+    int thisRank = 0;
+    std::vector<int> otherRanks = { 1, 2 };
+    int nMessages = 20;
+
+    MpiWorld& thisWorld = getMpiWorldRegistry().createWorld(msg, worldId);
+    faabric::util::setMockMode(false);
+    thisWorld.broadcastHostsToRanks();
+
+    std::thread otherWorldThread([this, thisRank, &otherRanks, nMessages] {
+        otherWorld.initialiseFromMsg(msg);
+
+        // Each rank sends from its own thread, interleaving on the wire
+        std::vector<std::thread> rankThreads;
+        std::vector<std::vector<int>> received(otherRanks.size());
+        for (int i = 0; i < otherRanks.size(); i++) {
+            rankThreads.emplace_back([this, i, thisRank, &otherRanks,
+                                      &received, nMessages] {
+                int rank = otherRanks.at(i);
+                for (int j = 0; j < nMessages; j++) {
+                    int data = rank * 1000 + j;
+                    otherWorld.send(rank, thisRank, BYTES(&data), MPI_INT, 1);
+                }
+
+                for (int j = 0; j < nMessages; j++) {
+                    int data = -1;
+                    otherWorld.recv(thisRank,
+                                    rank,
+                                    BYTES(&data),
+                                    MPI_INT,
+                                    1,
+                                    MPI_STATUS_IGNORE);
+                    received.at(i).push_back(data);
+                }
+
+                otherWorld.destroy();
+            });
+        }
+
+        for (auto& t : rankThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+
+        for (int i = 0; i < otherRanks.size(); i++) {
+            for (int j = 0; j < nMessages; j++) {
+                assert(received.at(i).at(j) == -(otherRanks.at(i) * 1000 + j));
+            }
+        }
+
+        testLatch->wait();
+    });
+
+    // Receive from the two ranks in the opposite order to how they're sent,
+    // so each message must end up in its sender's queue
+    for (auto it = otherRanks.rbegin(); it != otherRanks.rend(); ++it) {
+        for (int j = 0; j < nMessages; j++) {
+            int data = -1;
+            MPI_Status status{};
+            thisWorld.recv(*it, thisRank, BYTES(&data), MPI_INT, 1, &status);
+            REQUIRE(data == *it * 1000 + j);
+            REQUIRE(status.MPI_SOURCE == *it);
+        }
+    }
+
+    // Send back to each remote rank, interleaving the destinations
+    for (int j = 0; j < nMessages; j++) {
+        for (int rank : otherRanks) {
+            int data = -(rank * 1000 + j);
+            thisWorld.send(thisRank, rank, BYTES(&data), MPI_INT, 1);
+        }
+    }
+
+    testLatch->wait();
+    if (otherWorldThread.joinable()) {
+        otherWorldThread.join();
+    }
+
+    thisWorld.destroy();
+}
 }
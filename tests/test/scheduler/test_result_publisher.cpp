@@ -0,0 +1,152 @@
+#include <catch.hpp>
+
+#include "faabric_utils.h"
+#include "fixtures.h"
+
+#include <faabric/redis/Redis.h>
+#include <faabric/scheduler/ResultPublisher.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/macros.h>
+
+using namespace faabric::scheduler;
+
+namespace tests {
+
+class ResultPublisherTestFixture
+  : public RedisTestFixture
+  , public ConfTestFixture
+{};
+
+TEST_CASE_METHOD(ResultPublisherTestFixture,
+                 "Test publishing results in batches",
+                 "[scheduler]")
+{
+    int nResults = 10;
+    conf.resultBatchSize = 4;
+
+    // Make sure only full batches or flushes trigger writes
+    conf.resultFlushIntervalUs = 60 * 1000 * 1000;
+
+    ResultPublisher publisher;
+
+    std::vector<faabric::Message> msgs;
+    for (int i = 0; i < nResults; i++) {
+        faabric::Message msg = faabric::util::messageFactory("foo", "bar");
+        msg.set_outputdata("result " + std::to_string(i));
+        msgs.push_back(msg);
+
+        // Only put every other result on the result queue
+        publisher.publish(msg, i % 2 == 0);
+    }
+
+    publisher.flush();
+
+    for (int i = 0; i < nResults; i++) {
+        const faabric::Message& msg = msgs.at(i);
+
+        std::vector<uint8_t> statusBytes = redis.get(msg.statuskey());
+        faabric::Message actual;
+        actual.ParseFromArray(statusBytes.data(), (int)statusBytes.size());
+        REQUIRE(actual.outputdata() == msg.outputdata());
+        REQUIRE(redis.getTtl(msg.statuskey()) > 10);
+
+        long expectedLength = i % 2 == 0 ? 1 : 0;
+        REQUIRE(redis.listLength(msg.resultkey()) == expectedLength);
+    }
+
+    // Batches are only written when full or on the flush, and may contain
+    // more results than the batch size if the publisher falls behind
+    ResultPublisherStats stats = publisher.getStats();
+    REQUIRE(stats.nResults == nResults);
+    REQUIRE(stats.nFlushes >= 1);
+    REQUIRE(stats.nFlushes <= 3);
+    REQUIRE(stats.maxFlushMicros >= stats.lastFlushMicros);
+    REQUIRE(stats.totalFlushMicros >= stats.maxFlushMicros);
+}
+
+TEST_CASE_METHOD(ResultPublisherTestFixture,
+                 "Test publishing results after flush interval",
+                 "[scheduler]")
+{
+    conf.resultBatchSize = 100;
+    conf.resultFlushIntervalUs = 1000;
+
+    ResultPublisher publisher;
+
+    faabric::Message msg = faabric::util::messageFactory("foo", "bar");
+    publisher.publish(msg, true);
+
+    // Result should be written without an explicit flush
+    REQUIRE_RETRY({}, redis.listLength(msg.resultkey()) == 1);
+    REQUIRE_RETRY({}, publisher.getStats().nFlushes == 1);
+}
+
+TEST_CASE_METHOD(ResultPublisherTestFixture,
+                 "Test stopping result publisher writes outstanding results",
+                 "[scheduler]")
+{
+    conf.resultBatchSize = 100;
+    conf.resultFlushIntervalUs = 60 * 1000 * 1000;
+
+    ResultPublisher publisher;
+
+    faabric::Message msg = faabric::util::messageFactory("foo", "bar");
+    publisher.publish(msg, true);
+    publisher.stop();
+
+    REQUIRE(redis.listLength(msg.resultkey()) == 1);
+    REQUIRE(!redis.get(msg.statuskey()).empty());
+
+    // Check it can be used again after stopping
+    faabric::Message msgB = faabric::util::messageFactory("foo", "bar");
+    publisher.publish(msgB, false);
+    publisher.flush();
+
+    REQUIRE(!redis.get(msgB.statuskey()).empty());
+}
+
+TEST_CASE_METHOD(ResultPublisherTestFixture,
+                 "Test publishing results while stopping",
+                 "[scheduler]")
+{
+    conf.resultBatchSize = 8;
+    conf.resultFlushIntervalUs = 100;
+
+    ResultPublisher publisher;
+
+    int nThreads = 4;
+    int nResults = 50;
+    std::vector<std::vector<faabric::Message>> msgs(nThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&publisher, &msgs, t, nResults] {
+            for (int i = 0; i < nResults; i++) {
+                faabric::Message msg =
+                  faabric::util::messageFactory("foo", "bar");
+                publisher.publish(msg, false);
+                msgs.at(t).push_back(msg);
+            }
+        });
+    }
+
+    // Stop repeatedly while the others publish
+    for (int i = 0; i < 20; i++) {
+        publisher.stop();
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    publisher.stop();
+
+    for (const auto& threadMsgs : msgs) {
+        for (const auto& msg : threadMsgs) {
+            REQUIRE(!redis.get(msg.statuskey()).empty());
+        }
+    }
+}
+}
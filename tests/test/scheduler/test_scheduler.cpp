@@ -328,9 +328,6 @@ TEST_CASE_METHOD(SlowExecutorFixture, "Test batch scheduling", "[scheduler]")
     // Clear mocks
     faabric::scheduler::clearMockRequests();
 
-    // Set up resource response again
-    faabric::scheduler::queueResourceResponse(otherHost, otherResources);
-
     // Now schedule a second batch and check they're all sent to the other host
     std::vector<std::string> expectedHostsTwo;
     std::shared_ptr<faabric::BatchExecuteRequest> reqTwo =
@@ -347,10 +344,8 @@ TEST_CASE_METHOD(SlowExecutorFixture, "Test batch scheduling", "[scheduler]")
     // Schedule the functions
     std::vector<std::string> actualHostsTwo = sch.callFunctions(reqTwo);
 
-    // Check resource request made again
-    auto resRequestsTwo = faabric::scheduler::getResourceRequests();
-    REQUIRE(resRequestsTwo.size() == 1);
-    REQUIRE(resRequestsTwo.at(0).first == otherHost);
+    // Check the other host's resources are taken from the local table
+    REQUIRE(faabric::scheduler::getResourceRequests().empty());
 
     // Check scheduled on expected hosts
     REQUIRE(actualHostsTwo == expectedHostsTwo);
@@ -797,6 +792,153 @@ TEST_CASE_METHOD(SlowExecutorFixture,
     REQUIRE(actualPair.second == returnValue);
 }
 
+TEST_CASE_METHOD(DummyExecutorFixture,
+                 "Test function results delivered to master in memory",
+                 "[scheduler]")
+{
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", 3);
+    sch.callFunctions(req);
+
+    for (const auto& m : req->messages()) {
+        faabric::Message result =
+          sch.getFunctionResult(m.id(), SHORT_TEST_TIMEOUT_MS);
+        REQUIRE(result.id() == m.id());
+        REQUIRE(result.executedhost() == sch.getThisHost());
+    }
+
+    // Status is written in the background
+    sch.getResultPublisher().flush();
+
+    for (const auto& m : req->messages()) {
+        // Nothing should go through the Redis result queue
+        REQUIRE(redis.listLength(m.resultkey()) == 0);
+
+        // But the long-lived status is still written
+        REQUIRE(!redis.get(m.statuskey()).empty());
+    }
+}
+
+TEST_CASE_METHOD(DummyExecutorFixture,
+                 "Test function results for batch forwarded to master",
+                 "[scheduler]")
+{
+    // A non-master host forwards the batch, and the master executes it as if
+    // it had arrived through the function call server
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", 2);
+    for (auto& m : *req->mutable_messages()) {
+        m.set_masterhost(sch.getThisHost());
+    }
+
+    sch.callFunctions(req, true);
+
+    // The caller lives on the other host, so results must reach Redis
+    for (const auto& m : req->messages()) {
+        std::vector<uint8_t> resultBytes =
+          redis.dequeueBytes(m.resultkey(), SHORT_TEST_TIMEOUT_MS);
+        faabric::Message result;
+        result.ParseFromArray(resultBytes.data(), (int)resultBytes.size());
+        REQUIRE(result.id() == m.id());
+        REQUIRE(result.executedhost() == sch.getThisHost());
+    }
+}
+
+TEST_CASE_METHOD(SlowExecutorFixture,
+                 "Test non-blocking get of pending function result",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+
+    // Make sure the function is sent to another host
+    std::string otherHost = "otherHost";
+    faabric::HostResources thisRes;
+    faabric::HostResources otherRes;
+    otherRes.set_slots(1);
+    sch.setThisHostResources(thisRes);
+    sch.addHostToGlobalSet(otherHost);
+    sch.setHostResources(otherHost, otherRes);
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", 1);
+    faabric::Message msg = req->messages().at(0);
+    std::vector<std::string> executedHosts = sch.callFunctions(req);
+    REQUIRE(executedHosts == std::vector<std::string>({ otherHost }));
+
+    // Result not yet set
+    faabric::Message result = sch.getFunctionResult(msg.id(), 0);
+    REQUIRE(result.type() == faabric::Message_MessageType_EMPTY);
+
+    // Set the result as if sent from another host
+    msg.set_outputdata("done");
+    sch.setFunctionResultLocally(msg);
+
+    result = sch.getFunctionResult(msg.id(), 0);
+    REQUIRE(result.outputdata() == "done");
+    REQUIRE(redis.listLength(msg.resultkey()) == 0);
+}
+
+TEST_CASE_METHOD(SlowExecutorFixture,
+                 "Test getting function result after it expires locally",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+    conf.pendingResultExpiryMs = 10;
+
+    // Make sure the functions are sent to another host
+    std::string otherHost = "otherHost";
+    faabric::HostResources thisRes;
+    faabric::HostResources otherRes;
+    otherRes.set_slots(2);
+    sch.setThisHostResources(thisRes);
+    sch.addHostToGlobalSet(otherHost);
+    sch.setHostResources(otherHost, otherRes);
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", 1);
+    faabric::Message msg = req->messages().at(0);
+    sch.callFunctions(req);
+
+    // The result arrives, but isn't collected before it expires
+    msg.set_outputdata("done");
+    sch.setFunctionResultLocally(msg);
+    REQUIRE(redis.listLength(msg.resultkey()) == 0);
+
+    SLEEP_MS(50);
+
+    // Results are pruned when more are registered
+    std::shared_ptr<faabric::BatchExecuteRequest> reqB =
+      faabric::util::batchExecFactory("foo", "bar", 1);
+    sch.callFunctions(reqB);
+
+    faabric::Message result =
+      sch.getFunctionResult(msg.id(), SHORT_TEST_TIMEOUT_MS);
+    REQUIRE(result.outputdata() == "done");
+}
+
+TEST_CASE_METHOD(SlowExecutorFixture,
+                 "Test set function result on remote host",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+
+    faabric::Message msg = faabric::util::messageFactory("foo", "bar");
+    msg.set_masterhost("otherHost");
+    msg.set_outputdata("remote output");
+
+    sch.setFunctionResult(msg);
+
+    // Check result sent to the master and not written to the result queue
+    auto actualPushes = faabric::scheduler::getFunctionResultPushes();
+    REQUIRE(actualPushes.size() == 1);
+    REQUIRE(actualPushes.at(0).first == "otherHost");
+    REQUIRE(actualPushes.at(0).second.id() == msg.id());
+    REQUIRE(actualPushes.at(0).second.outputdata() == "remote output");
+
+    REQUIRE(redis.listLength(msg.resultkey()) == 0);
+    REQUIRE(!redis.get(msg.statuskey()).empty());
+}
+
 TEST_CASE_METHOD(DummyExecutorFixture, "Test executor reuse", "[scheduler]")
 {
     faabric::Message msgA = faabric::util::messageFactory("foo", "bar");
@@ -822,4 +964,294 @@ TEST_CASE_METHOD(DummyExecutorFixture, "Test executor reuse", "[scheduler]")
     // Check executor count is still the same
     REQUIRE(sch.getFunctionExecutorCount(msgA) == 2);
 }
+
+TEST_CASE_METHOD(DummyExecutorFixture,
+                 "Test concurrent scheduling of different functions",
+                 "[scheduler]")
+{
+    int nThreads = 10;
+    int nCallsPerThread = 5;
+
+    // Make sure everything can be executed locally
+    faabric::HostResources res;
+    res.set_slots(nThreads * nCallsPerThread);
+    sch.setThisHostResources(res);
+
+    // Each thread calls its own function
+    std::vector<std::vector<faabric::Message>> msgs(nThreads);
+    for (int t = 0; t < nThreads; t++) {
+        for (int i = 0; i < nCallsPerThread; i++) {
+            msgs.at(t).emplace_back(
+              faabric::util::messageFactory("foo", "bar" + std::to_string(t)));
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([this, t, &msgs] {
+            for (auto& m : msgs.at(t)) {
+                sch.callFunction(m);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    // Check all the calls have been executed locally
+    REQUIRE(sch.getRecordedMessagesLocal().size() ==
+            nThreads * nCallsPerThread);
+    REQUIRE(sch.getRecordedMessagesShared().empty());
+
+    for (int t = 0; t < nThreads; t++) {
+        for (auto& m : msgs.at(t)) {
+            faabric::Message result =
+              sch.getFunctionResult(m.id(), SHORT_TEST_TIMEOUT_MS);
+            REQUIRE(result.returnvalue() == 0);
+        }
+
+        // Each function has its own executors
+        long nExecutors = sch.getFunctionExecutorCount(msgs.at(t).at(0));
+        REQUIRE(nExecutors > 0);
+        REQUIRE(nExecutors <= nCallsPerThread);
+    }
+
+    // Check all slots have been released
+    REQUIRE_RETRY({}, sch.getThisHostResources().usedslots() == 0);
+}
+
+TEST_CASE_METHOD(SlowExecutorFixture,
+                 "Test scheduling with pushed host resources",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+
+    std::string thisHost = sch.getThisHost();
+
+    int nHosts = 20;
+    int slotsPerHost = 5;
+    int nMessages = 100;
+
+    // No capacity on this host
+    faabric::HostResources thisResources;
+    thisResources.set_slots(0);
+    sch.setThisHostResources(thisResources);
+
+    // Other hosts have pushed their resources
+    faabric::HostResources otherResources;
+    otherResources.set_slots(slotsPerHost);
+
+    std::vector<std::string> otherHosts;
+    for (int i = 0; i < nHosts; i++) {
+        std::string otherHost = "host" + std::to_string(i);
+        otherHosts.push_back(otherHost);
+
+        sch.addHostToGlobalSet(otherHost);
+        sch.setHostResources(otherHost, otherResources);
+    }
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", nMessages);
+    std::vector<std::string> executedHosts = sch.callFunctions(req);
+
+    // Check everything is sent out without any resource requests
+    REQUIRE(faabric::scheduler::getResourceRequests().empty());
+    REQUIRE(faabric::scheduler::getBatchRequests().size() == nHosts);
+    REQUIRE(std::count(executedHosts.begin(), executedHosts.end(), thisHost) ==
+            0);
+
+    // Schedule another batch, and check the table is used to avoid sending to
+    // the other hosts, which are now full
+    std::shared_ptr<faabric::BatchExecuteRequest> reqB =
+      faabric::util::batchExecFactory("foo", "bar", 2);
+    std::vector<std::string> executedHostsB = sch.callFunctions(reqB);
+
+    std::vector<std::string> expectedHostsB = { thisHost, thisHost };
+    REQUIRE(executedHostsB == expectedHostsB);
+    REQUIRE(faabric::scheduler::getResourceRequests().empty());
+    REQUIRE(faabric::scheduler::getBatchRequests().size() == nHosts);
+
+    // Push new resources for one host and check it is used again
+    sch.setHostResources(otherHosts.at(3), otherResources);
+
+    std::shared_ptr<faabric::BatchExecuteRequest> reqC =
+      faabric::util::batchExecFactory("foo", "bar", 2);
+    std::vector<std::string> executedHostsC = sch.callFunctions(reqC);
+
+    std::vector<std::string> expectedHostsC = { otherHosts.at(3),
+                                                otherHosts.at(3) };
+    REQUIRE(executedHostsC == expectedHostsC);
+    REQUIRE(faabric::scheduler::getResourceRequests().empty());
+}
+
+TEST_CASE_METHOD(SlowExecutorFixture,
+                 "Test over-allocated host pushes resources to master",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+
+    std::string masterHost = "masterHost";
+
+    int nSlots = 3;
+    faabric::HostResources res;
+    res.set_slots(nSlots);
+    sch.setThisHostResources(res);
+
+    int nMessages = 0;
+    bool expectPush = false;
+
+    SECTION("Within capacity")
+    {
+        nMessages = nSlots;
+        expectPush = false;
+    }
+
+    SECTION("Over capacity")
+    {
+        nMessages = nSlots + 2;
+        expectPush = true;
+    }
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", nMessages);
+    for (auto& m : *req->mutable_messages()) {
+        m.set_masterhost(masterHost);
+    }
+
+    // Execute as if sent from the master
+    sch.callFunctions(req, true);
+
+    auto pushes = faabric::scheduler::getResourcePushes();
+    if (expectPush) {
+        REQUIRE(pushes.size() == 1);
+        REQUIRE(pushes.at(0).first == masterHost);
+        REQUIRE(pushes.at(0).second.host() == sch.getThisHost());
+        REQUIRE(pushes.at(0).second.resources().slots() == nSlots);
+        REQUIRE(pushes.at(0).second.resources().usedslots() == nMessages);
+    } else {
+        REQUIRE(pushes.empty());
+    }
+}
+
+TEST_CASE_METHOD(SlowExecutorFixture,
+                 "Test publishing this host's resources",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+
+    std::string thisHost = sch.getThisHost();
+    std::set<std::string> otherHosts = { "alpha", "beta", "gamma" };
+
+    sch.addHostToGlobalSet();
+    for (const auto& h : otherHosts) {
+        sch.addHostToGlobalSet(h);
+    }
+
+    faabric::HostResources res;
+    res.set_slots(10);
+    res.set_usedslots(4);
+    sch.setThisHostResources(res);
+
+    sch.publishThisHostResources();
+
+    // Check pushed to every other host
+    auto pushes = faabric::scheduler::getResourcePushes();
+    REQUIRE(pushes.size() == otherHosts.size());
+
+    std::set<std::string> actualHosts;
+    for (const auto& p : pushes) {
+        actualHosts.insert(p.first);
+        REQUIRE(p.second.host() == thisHost);
+        REQUIRE(p.second.resources().slots() == 10);
+        REQUIRE(p.second.resources().usedslots() == 4);
+    }
+
+    REQUIRE(actualHosts == otherHosts);
+
+    // The host set isn't loaded from Redis on every push, but hosts that have
+    // pushed their resources to us are included straight away
+    faabric::scheduler::clearMockRequests();
+    sch.addHostToGlobalSet("delta");
+    sch.publishThisHostResources();
+    REQUIRE(faabric::scheduler::getResourcePushes().size() ==
+            otherHosts.size());
+
+    faabric::scheduler::clearMockRequests();
+    sch.setHostResources("delta", res);
+    sch.publishThisHostResources();
+    REQUIRE(faabric::scheduler::getResourcePushes().size() ==
+            otherHosts.size() + 1);
+}
+
+TEST_CASE_METHOD(SlowExecutorFixture,
+                 "Test dispatching batch to several hosts",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+
+    // Set up a snapshot
+    std::string snapshotKey = "dispatchSnap";
+    faabric::util::SnapshotData snapshot;
+    std::vector<uint8_t> snapData(1234, 1);
+    snapshot.size = snapData.size();
+    snapshot.data = snapData.data();
+
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+    reg.takeSnapshot(snapshotKey, snapshot);
+
+    // No capacity on this host, two slots on each of the others
+    faabric::HostResources thisResources;
+    thisResources.set_slots(0);
+    sch.setThisHostResources(thisResources);
+
+    faabric::HostResources otherResources;
+    otherResources.set_slots(2);
+
+    int nHosts = 4;
+    std::set<std::string> otherHosts;
+    for (int i = 0; i < nHosts; i++) {
+        std::string otherHost = "dispatch" + std::to_string(i);
+        otherHosts.insert(otherHost);
+
+        sch.addHostToGlobalSet(otherHost);
+        sch.setHostResources(otherHost, otherResources);
+    }
+
+    int nMessages = 2 * nHosts;
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", nMessages);
+    req->set_type(faabric::BatchExecuteRequest::THREADS);
+    for (auto& m : *req->mutable_messages()) {
+        m.set_snapshotkey(snapshotKey);
+    }
+
+    sch.callFunctions(req);
+
+    // Check every host has been sent the snapshot and its messages, in either
+    // order across hosts
+    auto snapshotPushes = faabric::snapshot::getSnapshotPushes();
+    auto batchRequests = faabric::scheduler::getBatchRequests();
+    REQUIRE(snapshotPushes.size() == nHosts);
+    REQUIRE(batchRequests.size() == nHosts);
+
+    std::set<std::string> pushedHosts;
+    for (const auto& p : snapshotPushes) {
+        pushedHosts.insert(p.first);
+    }
+
+    std::set<std::string> batchHosts;
+    for (const auto& p : batchRequests) {
+        batchHosts.insert(p.first);
+        REQUIRE(p.second->messages_size() == 2);
+    }
+
+    REQUIRE(pushedHosts == otherHosts);
+    REQUIRE(batchHosts == otherHosts);
+
+    reg.deleteSnapshot(snapshotKey);
+}
 }
@@ -0,0 +1,205 @@
+#include <catch.hpp>
+
+#include "DummyExecutorFactory.h"
+#include "faabric_utils.h"
+#include "fixtures.h"
+
+#include <faabric/scheduler/ExecutorFactory.h>
+#include <faabric/scheduler/FunctionCallClient.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/scheduler/SchedulingPolicy.h>
+#include <faabric/snapshot/SnapshotClient.h>
+#include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/config.h>
+#include <faabric/util/func.h>
+#include <faabric/util/testing.h>
+
+using namespace faabric::scheduler;
+
+namespace tests {
+
+TEST_CASE("Test getting scheduling policies", "[scheduler]")
+{
+    REQUIRE(std::dynamic_pointer_cast<BinPackPolicy>(
+              getSchedulingPolicy(BIN_PACK_POLICY)) != nullptr);
+    REQUIRE(std::dynamic_pointer_cast<SpreadPolicy>(
+              getSchedulingPolicy(SPREAD_POLICY)) != nullptr);
+    REQUIRE(std::dynamic_pointer_cast<SnapshotAffinityPolicy>(
+              getSchedulingPolicy(SNAPSHOT_AFFINITY_POLICY)) != nullptr);
+
+    REQUIRE_THROWS(getSchedulingPolicy("foobar"));
+}
+
+TEST_CASE("Test scheduling policy host order", "[scheduler]")
+{
+    SchedulingCandidates candidates;
+    candidates.thisHost = "this";
+    candidates.registeredHosts = { "regA", "regB" };
+    candidates.snapshotHosts = { "regB", "snap" };
+    candidates.otherHosts = { "otherA", "otherB", "snap" };
+
+    std::shared_ptr<SchedulingPolicy> policy;
+    std::vector<std::string> expected;
+
+    SECTION("Bin-pack")
+    {
+        policy = getSchedulingPolicy(BIN_PACK_POLICY);
+        expected = { "this", "regA", "regB", "otherA", "otherB", "snap" };
+    }
+
+    SECTION("Spread")
+    {
+        policy = getSchedulingPolicy(SPREAD_POLICY);
+        expected = { "this", "regA", "regB", "otherA", "otherB", "snap" };
+    }
+
+    SECTION("Snapshot affinity")
+    {
+        policy = getSchedulingPolicy(SNAPSHOT_AFFINITY_POLICY);
+        expected = { "this", "regB", "snap", "regA", "otherA", "otherB" };
+    }
+
+    REQUIRE(policy->getHostOrder(candidates) == expected);
+}
+
+TEST_CASE("Test scheduling policy host limits", "[scheduler]")
+{
+    std::shared_ptr<SchedulingPolicy> binPack =
+      getSchedulingPolicy(BIN_PACK_POLICY);
+    std::shared_ptr<SchedulingPolicy> spread =
+      getSchedulingPolicy(SPREAD_POLICY);
+
+    REQUIRE(binPack->getHostLimit(10, 3) == 10);
+    REQUIRE(spread->getHostLimit(10, 3) == 4);
+    REQUIRE(spread->getHostLimit(9, 3) == 3);
+    REQUIRE(spread->getHostLimit(2, 4) == 1);
+    REQUIRE(spread->getHostLimit(5, 0) == 5);
+}
+
+class SchedulingPolicyTestFixture
+  : public RedisTestFixture
+  , public SchedulerTestFixture
+  , public ConfTestFixture
+{
+  public:
+    SchedulingPolicyTestFixture()
+    {
+        setExecutorFactory(std::make_shared<DummyExecutorFactory>());
+        faabric::util::setMockMode(true);
+    }
+};
+
+TEST_CASE_METHOD(SchedulingPolicyTestFixture,
+                 "Test spread scheduling policy",
+                 "[scheduler]")
+{
+    conf.schedulingPolicy = SPREAD_POLICY;
+    sch.reset();
+
+    std::string thisHost = sch.getThisHost();
+    std::string otherHostA = "otherA";
+    std::string otherHostB = "otherB";
+
+    faabric::HostResources res;
+    res.set_slots(10);
+    sch.setThisHostResources(res);
+
+    sch.addHostToGlobalSet(otherHostA);
+    sch.addHostToGlobalSet(otherHostB);
+    sch.setHostResources(otherHostA, res);
+    sch.setHostResources(otherHostB, res);
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", 7);
+    std::vector<std::string> actualHosts = sch.callFunctions(req);
+
+    // The global set includes this host, so the batch is split three ways
+    std::vector<std::string> expectedHosts = { thisHost,   thisHost,
+                                               thisHost,   otherHostA,
+                                               otherHostA, otherHostA,
+                                               otherHostB };
+    REQUIRE(actualHosts == expectedHosts);
+}
+
+TEST_CASE_METHOD(SchedulingPolicyTestFixture,
+                 "Test snapshot affinity scheduling policy",
+                 "[scheduler]")
+{
+    std::string policy;
+    std::string expectedSecondHost;
+
+    std::string thisHost = sch.getThisHost();
+    std::string otherHostA = "otherA";
+    std::string otherHostB = "otherB";
+
+    SECTION("Bin-pack")
+    {
+        policy = BIN_PACK_POLICY;
+        expectedSecondHost = otherHostA;
+    }
+
+    SECTION("Snapshot affinity")
+    {
+        policy = SNAPSHOT_AFFINITY_POLICY;
+        expectedSecondHost = otherHostB;
+    }
+
+    conf.schedulingPolicy = policy;
+    sch.reset();
+
+    // Set up a snapshot
+    std::string snapshotKey = "policySnap";
+    faabric::util::SnapshotData snapshot;
+    std::vector<uint8_t> snapData(1234, 1);
+    snapshot.size = snapData.size();
+    snapshot.data = snapData.data();
+
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+    reg.takeSnapshot(snapshotKey, snapshot);
+
+    faabric::HostResources thisRes;
+    thisRes.set_slots(0);
+    sch.setThisHostResources(thisRes);
+
+    // Only the second host has capacity initially
+    faabric::HostResources fullRes;
+    faabric::HostResources freeRes;
+    freeRes.set_slots(5);
+
+    sch.addHostToGlobalSet(otherHostA);
+    sch.addHostToGlobalSet(otherHostB);
+    sch.setHostResources(otherHostA, fullRes);
+    sch.setHostResources(otherHostB, freeRes);
+
+    auto makeRequest = [&snapshotKey](const std::string& func) {
+        std::shared_ptr<faabric::BatchExecuteRequest> req =
+          faabric::util::batchExecFactory("foo", func, 1);
+        req->set_type(faabric::BatchExecuteRequest::THREADS);
+        req->mutable_messages()->at(0).set_snapshotkey(snapshotKey);
+        return req;
+    };
+
+    // Execute a batch, which has to go to the second host
+    std::vector<std::string> actualHostsA = sch.callFunctions(makeRequest("a"));
+    REQUIRE(actualHostsA == std::vector<std::string>({ otherHostB }));
+    REQUIRE(faabric::snapshot::getSnapshotPushes().size() == 1);
+
+    // Now free up the first host too, and execute a batch of a different
+    // function using the same snapshot
+    sch.setHostResources(otherHostA, freeRes);
+    std::vector<std::string> actualHostsB = sch.callFunctions(makeRequest("b"));
+    REQUIRE(actualHostsB == std::vector<std::string>({ expectedSecondHost }));
+
+    // Check the snapshot is only pushed again when going to a new host
+    auto pushes = faabric::snapshot::getSnapshotPushes();
+    if (expectedSecondHost == otherHostB) {
+        REQUIRE(pushes.size() == 1);
+    } else {
+        REQUIRE(pushes.size() == 2);
+        REQUIRE(pushes.at(1).first == otherHostA);
+    }
+
+    reg.deleteSnapshot(snapshotKey);
+}
+}
@@ -20,6 +20,7 @@ class SnapshotClientServerFixture
   : public SchedulerTestFixture
   , public RedisTestFixture
   , public SnapshotTestFixture
+  , public ConfTestFixture
 {
   protected:
     faabric::snapshot::SnapshotServer server;
@@ -42,18 +43,29 @@ TEST_CASE_METHOD(SnapshotClientServerFixture,
     // Check nothing to start with
     REQUIRE(reg.getSnapshotCount() == 0);
 
-    // Prepare some snapshot data
+    SECTION("Raw") { conf.deltaSnapshotEncoding = "none"; }
+
+    SECTION("Delta encoded")
+    {
+        conf.deltaSnapshotEncoding = "pages=4096;xor;zstd=1";
+    }
+
+    // Prepare some snapshot data, with some pages of zeros
     std::string snapKeyA = "foo";
     std::string snapKeyB = "bar";
     faabric::util::SnapshotData snapA;
     faabric::util::SnapshotData snapB;
     size_t snapSizeA = 1024;
-    size_t snapSizeB = 500;
+    size_t snapSizeB = 5 * faabric::util::HOST_PAGE_SIZE;
     snapA.size = snapSizeA;
     snapB.size = snapSizeB;
 
     std::vector<uint8_t> dataA(snapSizeA, 1);
-    std::vector<uint8_t> dataB(snapSizeB, 2);
+    std::vector<uint8_t> dataB(snapSizeB, 0);
+    std::fill(dataB.begin() + faabric::util::HOST_PAGE_SIZE,
+              dataB.begin() + (2 * faabric::util::HOST_PAGE_SIZE),
+              2);
+    dataB.back() = 3;
 
     snapA.data = dataA.data();
     snapB.data = dataB.data();
@@ -77,6 +89,205 @@ TEST_CASE_METHOD(SnapshotClientServerFixture,
     REQUIRE(actualDataB == dataB);
 }
 
+TEST_CASE_METHOD(SnapshotClientServerFixture,
+                 "Test streaming snapshots in chunks",
+                 "[snapshot]")
+{
+    // Last chunk is smaller than the others
+    int nPages = 5;
+    size_t snapSize = (nPages * faabric::util::HOST_PAGE_SIZE) - 100;
+    conf.snapshotChunkSize = 2 * faabric::util::HOST_PAGE_SIZE;
+    conf.snapshotPageDedup = 0;
+
+    SECTION("Raw, acking every chunk")
+    {
+        conf.deltaSnapshotEncoding = "none";
+        conf.snapshotChunkWindow = 1;
+    }
+
+    SECTION("Raw, acking windows of chunks")
+    {
+        conf.deltaSnapshotEncoding = "none";
+        conf.snapshotChunkWindow = 2;
+    }
+
+    SECTION("Delta encoded")
+    {
+        conf.deltaSnapshotEncoding = "pages=4096;xor;zstd=1";
+        conf.snapshotChunkWindow = 4;
+    }
+
+    // Chunks of zeros, compressible data, and data that won't compress
+    std::vector<uint8_t> data(snapSize, 0);
+    std::fill(data.begin() + faabric::util::HOST_PAGE_SIZE,
+              data.begin() + (2 * faabric::util::HOST_PAGE_SIZE),
+              3);
+    for (size_t i = 4 * faabric::util::HOST_PAGE_SIZE; i < snapSize; i++) {
+        data[i] = (i * 7919) % 251;
+    }
+
+    faabric::util::SnapshotData snap;
+    snap.size = snapSize;
+    snap.data = data.data();
+
+    std::string snapKey = "streamed";
+    cli.pushSnapshot(snapKey, snap);
+
+    REQUIRE(reg.getSnapshotCount() == 1);
+    const faabric::util::SnapshotData& actual = reg.getSnapshot(snapKey);
+    REQUIRE(actual.size == snapSize);
+    REQUIRE(actual.fd > 0);
+
+    std::vector<uint8_t> actualData(actual.data, actual.data + actual.size);
+    REQUIRE(actualData == data);
+
+    // Check it's restorable from its fd
+    uint8_t* restored = allocatePages(nPages);
+    reg.mapSnapshot(snapKey, restored);
+    std::vector<uint8_t> restoredData(restored, restored + snapSize);
+    REQUIRE(restoredData == data);
+
+    deallocatePages(restored, nPages);
+    reg.deleteSnapshot(snapKey);
+}
+
+TEST_CASE_METHOD(SnapshotClientServerFixture,
+                 "Test abandoned snapshot streams expire",
+                 "[snapshot]")
+{
+    conf.snapshotStreamExpiryMs = 100;
+
+    // Start streaming a snapshot, and never send anything else for it
+    flatbuffers::FlatBufferBuilder mb;
+    auto keyOffset = mb.CreateString("abandoned");
+    auto startOffset = CreateSnapshotStreamStartRequest(
+      mb, keyOffset, faabric::util::HOST_PAGE_SIZE);
+    mb.Finish(startOffset);
+
+    faabric::EmptyResponse response;
+    cli.syncSend(faabric::snapshot::SnapshotCalls::StreamSnapshotStart,
+                 mb.GetBufferPointer(),
+                 mb.GetSize(),
+                 &response);
+    REQUIRE(server.getIncomingSnapshotCount() == 1);
+
+    SLEEP_MS(200);
+
+    // A chunk arriving for any stream drops the abandoned one
+    flatbuffers::FlatBufferBuilder cb;
+    auto otherKeyOffset = cb.CreateString("other");
+    auto chunkOffset = CreateSnapshotStreamChunkRequest(cb, otherKeyOffset);
+    cb.Finish(chunkOffset);
+
+    cli.asyncSend(faabric::snapshot::SnapshotCalls::StreamSnapshotChunk,
+                  cb.GetBufferPointer(),
+                  cb.GetSize());
+
+    REQUIRE_RETRY({}, server.getIncomingSnapshotCount() == 0);
+}
+
+TEST_CASE_METHOD(SnapshotClientServerFixture,
+                 "Test pushing snapshots with pages the receiver already has",
+                 "[snapshot]")
+{
+    conf.snapshotPageDedup = 1;
+    conf.snapshotChunkSize = faabric::util::HOST_PAGE_SIZE;
+    conf.snapshotChunkWindow = 2;
+
+    SECTION("Raw") { conf.deltaSnapshotEncoding = "none"; }
+
+    SECTION("Delta encoded")
+    {
+        conf.deltaSnapshotEncoding = "pages=4096;xor;zstd=1";
+    }
+
+    // A page of zeros, and a partial last page
+    int nPages = 6;
+    size_t snapSize = (nPages * faabric::util::HOST_PAGE_SIZE) - 10;
+    std::vector<uint8_t> dataA(snapSize, 0);
+    for (int p = 0; p < nPages; p++) {
+        if (p != 3) {
+            size_t offset = p * faabric::util::HOST_PAGE_SIZE;
+            size_t end = std::min<size_t>(
+              offset + faabric::util::HOST_PAGE_SIZE, snapSize);
+            std::fill(dataA.begin() + offset, dataA.begin() + end, p + 1);
+        }
+    }
+
+    // The same, with one page changed
+    std::vector<uint8_t> dataB = dataA;
+    std::fill(dataB.begin() + (4 * faabric::util::HOST_PAGE_SIZE),
+              dataB.begin() + (4 * faabric::util::HOST_PAGE_SIZE) + 10,
+              9);
+
+    auto pushAndCheck = [this, snapSize](const std::string& key,
+                                         std::vector<uint8_t>& data,
+                                         size_t expectedBytes) {
+        faabric::util::SnapshotData snap;
+        snap.size = snapSize;
+        snap.data = data.data();
+        REQUIRE(cli.pushSnapshot(key, snap) == expectedBytes);
+
+        const faabric::util::SnapshotData& actual = reg.getSnapshot(key);
+        REQUIRE(actual.size == snapSize);
+        REQUIRE(actual.fd > 0);
+
+        std::vector<uint8_t> actualData(actual.data, actual.data + actual.size);
+        REQUIRE(actualData == data);
+    };
+
+    // The first push sends all the pages that aren't zeros, the second only
+    // the changed page
+    pushAndCheck("snapA", dataA, snapSize - faabric::util::HOST_PAGE_SIZE);
+    pushAndCheck("snapB", dataB, faabric::util::HOST_PAGE_SIZE);
+
+    // Pages are still reused once the snapshots are deleted
+    reg.deleteSnapshot("snapA");
+    reg.deleteSnapshot("snapB");
+    pushAndCheck("snapC", dataB, 0);
+}
+
+TEST_CASE_METHOD(SnapshotClientServerFixture,
+                 "Test pushing a registered snapshot after it's changed",
+                 "[snapshot]")
+{
+    conf.snapshotPageDedup = 1;
+    conf.snapshotChunkSize = faabric::util::HOST_PAGE_SIZE;
+
+    int nPages = 4;
+    size_t snapSize = nPages * faabric::util::HOST_PAGE_SIZE;
+    std::vector<uint8_t> original(snapSize);
+    for (int p = 0; p < nPages; p++) {
+        auto pageStart = original.begin() + (p * faabric::util::HOST_PAGE_SIZE);
+        std::fill(pageStart, pageStart + faabric::util::HOST_PAGE_SIZE, p + 1);
+    }
+
+    // The snapshot is registered over memory that carries on changing, and
+    // the receiver holds a copy of its original pages
+    std::vector<uint8_t> data = original;
+    faabric::util::SnapshotData snap;
+    snap.size = snapSize;
+    snap.data = data.data();
+    reg.takeSnapshot("live", snap);
+
+    faabric::util::SnapshotData originalSnap;
+    originalSnap.size = snapSize;
+    originalSnap.data = original.data();
+    reg.takeSnapshot("original", originalSnap);
+
+    std::fill(data.begin() + faabric::util::HOST_PAGE_SIZE,
+              data.begin() + faabric::util::HOST_PAGE_SIZE + 10,
+              9);
+
+    // Only the changed page is sent, and the receiver mustn't use its original
+    // copy of it instead
+    REQUIRE(cli.pushSnapshot("live", snap) == faabric::util::HOST_PAGE_SIZE);
+
+    const faabric::util::SnapshotData& actual = reg.getSnapshot("live");
+    std::vector<uint8_t> actualData(actual.data, actual.data + actual.size);
+    REQUIRE(actualData == data);
+}
+
 void checkDiffsApplied(const uint8_t* snapBase,
                        std::vector<faabric::util::SnapshotDiff> diffs)
 {
@@ -94,13 +305,20 @@ TEST_CASE_METHOD(SnapshotClientServerFixture,
                  "Test push snapshot diffs",
                  "[snapshot]")
 {
+    SECTION("Raw") { conf.deltaSnapshotEncoding = "none"; }
+
+    SECTION("Delta encoded")
+    {
+        conf.deltaSnapshotEncoding = "pages=4096;xor;zstd=1";
+    }
+
     // Set up a snapshot
     std::string snapKey = std::to_string(faabric::util::generateGid());
     faabric::util::SnapshotData snap = takeSnapshot(snapKey, 5, true);
 
-    // Set up some diffs
+    // Set up some diffs, one big enough to be worth compressing
     std::vector<uint8_t> diffDataA1 = { 0, 1, 2, 3 };
-    std::vector<uint8_t> diffDataA2 = { 4, 5, 6 };
+    std::vector<uint8_t> diffDataA2(1000, 4);
     std::vector<uint8_t> diffDataB = { 7, 7, 8, 8, 8 };
 
     std::vector<faabric::util::SnapshotDiff> diffsA;
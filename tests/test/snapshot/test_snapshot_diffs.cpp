@@ -3,6 +3,8 @@
 #include "faabric_utils.h"
 
 #include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/dirty.h>
+#include <faabric/util/macros.h>
 #include <faabric/util/memory.h>
 
 using namespace faabric::snapshot;
@@ -10,6 +12,11 @@ using namespace faabric::util;
 
 namespace tests {
 
+class SnapshotDiffTestFixture
+  : public SnapshotTestFixture
+  , public ConfTestFixture
+{};
+
 void checkSnapshotDiff(int offset,
                        std::vector<uint8_t> data,
                        SnapshotDiff& actual)
@@ -19,7 +26,7 @@ void checkSnapshotDiff(int offset,
     REQUIRE(data == actualData);
 }
 
-TEST_CASE_METHOD(SnapshotTestFixture, "Test snapshot diffs", "[snapshot]")
+TEST_CASE_METHOD(SnapshotDiffTestFixture, "Test snapshot diffs", "[snapshot]")
 {
     std::string snapKey = "foobar123";
     int snapPages = 5;
@@ -35,7 +42,9 @@ TEST_CASE_METHOD(SnapshotTestFixture, "Test snapshot diffs", "[snapshot]")
     reg.mapSnapshot(snapKey, sharedMem);
 
     // Reset dirty tracking
-    faabric::util::resetDirtyTracking();
+    DirtyTracker& tracker = getDirtyTracker();
+    tracker.resetTracking(snap.data, snapSize);
+    tracker.resetTracking(sharedMem, sharedMemSize);
 
     // Set up some chunks of data to write into the memory
     std::vector<uint8_t> dataA = { 1, 2, 3, 4 };
@@ -72,26 +81,125 @@ TEST_CASE_METHOD(SnapshotTestFixture, "Test snapshot diffs", "[snapshot]")
 
     // Check shared memory does have dirty pages (including the non-change)
     std::vector<int> sharedDirtyPages =
-      getDirtyPageNumbers(sharedMem, sharedMemPages);
+      tracker.getDirtyPageNumbers(sharedMem, sharedMemPages);
     std::vector<int> expected = { 1, 2, 3, 5, 6, 7 };
     REQUIRE(sharedDirtyPages == expected);
 
-    // Check change diffs note that diffs across page boundaries will be split
-    // into two
-    std::vector<SnapshotDiff> changeDiffs =
-      snap.getChangeDiffs(sharedMem, sharedMemSize);
-    REQUIRE(changeDiffs.size() == 6);
-
-    // One chunk will be split over 2 pages
-    std::vector<uint8_t> dataCPart1 = { 7, 6 };
-    std::vector<uint8_t> dataCPart2 = { 5, 4, 3 };
-    int offsetC2 = 2 * HOST_PAGE_SIZE;
-
-    checkSnapshotDiff(offsetA, dataA, changeDiffs.at(0));
-    checkSnapshotDiff(offsetB, dataB, changeDiffs.at(1));
-    checkSnapshotDiff(offsetC, dataCPart1, changeDiffs.at(2));
-    checkSnapshotDiff(offsetC2, dataCPart2, changeDiffs.at(3));
-    checkSnapshotDiff(offsetD, dataD, changeDiffs.at(4));
-    checkSnapshotDiff(snapSize, dataExtra, changeDiffs.at(5));
+    // Check change diffs. Diffs are only merged across gaps up to the merge
+    // gap, but always merged where they run over a page boundary
+    std::vector<SnapshotDiff> changeDiffs;
+
+    SECTION("No merge gap")
+    {
+        conf.snapshotDiffMergeGap = 0;
+        changeDiffs = snap.getChangeDiffs(sharedMem, sharedMemSize);
+        REQUIRE(changeDiffs.size() == 5);
+
+        checkSnapshotDiff(offsetA, dataA, changeDiffs.at(0));
+        checkSnapshotDiff(offsetB, dataB, changeDiffs.at(1));
+    }
+
+    SECTION("Merge gap")
+    {
+        // Large enough to merge A and B, which are 16 bytes apart
+        conf.snapshotDiffMergeGap = 16;
+        changeDiffs = snap.getChangeDiffs(sharedMem, sharedMemSize);
+        REQUIRE(changeDiffs.size() == 4);
+
+        std::vector<uint8_t> dataAB(offsetB + dataB.size() - offsetA, 0);
+        std::copy(dataA.begin(), dataA.end(), dataAB.begin());
+        std::copy(dataB.begin(), dataB.end(), dataAB.begin() + 20);
+        checkSnapshotDiff(offsetA, dataAB, changeDiffs.at(0));
+    }
+
+    int nDiffs = changeDiffs.size();
+    checkSnapshotDiff(offsetC, dataC, changeDiffs.at(nDiffs - 3));
+    checkSnapshotDiff(offsetD, dataD, changeDiffs.at(nDiffs - 2));
+    checkSnapshotDiff(snapSize, dataExtra, changeDiffs.at(nDiffs - 1));
+
+    tracker.stopTracking(sharedMem, sharedMemSize);
+}
+
+TEST_CASE_METHOD(SnapshotDiffTestFixture,
+                 "Test snapshot diffs within and across comparison blocks",
+                 "[snapshot]")
+{
+    std::string snapKey = "foobar123";
+    int snapPages = 3;
+    size_t snapSize = snapPages * HOST_PAGE_SIZE;
+    SnapshotData snap = takeSnapshot(snapKey, snapPages, true);
+
+    uint8_t* sharedMem = allocatePages(snapPages);
+    reg.mapSnapshot(snapKey, sharedMem);
+    conf.snapshotDiffMergeGap = 0;
+
+    DirtyTracker& tracker = getDirtyTracker();
+    tracker.resetTracking(snap.data, snapSize);
+    tracker.resetTracking(sharedMem, snapSize);
+
+    // Single bytes at either end of a block, a run over a block boundary, and
+    // a whole page of changes followed by a change at the start of the next
+    std::vector<std::pair<int, int>> expected = {
+        { 0, 1 },
+        { 31, 1 },
+        { 60, 10 },
+        { HOST_PAGE_SIZE, HOST_PAGE_SIZE + 3 },
+    };
+    for (const auto& [offset, length] : expected) {
+        std::memset(sharedMem + offset, 7, length);
+    }
+
+    std::vector<SnapshotDiff> actual = snap.getChangeDiffs(sharedMem, snapSize);
+    REQUIRE(actual.size() == expected.size());
+    for (int i = 0; i < expected.size(); i++) {
+        REQUIRE(actual.at(i).offset == expected.at(i).first);
+        REQUIRE(actual.at(i).size == expected.at(i).second);
+    }
+
+    // Dirty pages that follow on from each other are merged
+    std::vector<SnapshotDiff> dirtyPages = snap.getDirtyPages();
+    REQUIRE(dirtyPages.empty());
+
+    snap.data[10] = 1;
+    snap.data[HOST_PAGE_SIZE + 10] = 1;
+    dirtyPages = snap.getDirtyPages();
+    REQUIRE(dirtyPages.size() == 1);
+    REQUIRE(dirtyPages.at(0).offset == 0);
+    REQUIRE(dirtyPages.at(0).size == 2 * HOST_PAGE_SIZE);
+
+    tracker.stopTracking(sharedMem, snapSize);
+}
+
+TEST_CASE("Test hashing snapshot pages", "[snapshot]")
+{
+    // Last page is partial
+    size_t size = (3 * HOST_PAGE_SIZE) + 100;
+    std::vector<uint8_t> data(size, 0);
+    data[HOST_PAGE_SIZE + 5] = 1;
+
+    std::vector<PageHash> hashes = hashPages(data.data(), data.size());
+    REQUIRE(hashes.size() == 4);
+
+    // Identical pages have the same hash, any change gives a different one
+    REQUIRE(hashes.at(0) == hashes.at(2));
+    REQUIRE(!(hashes.at(0) == hashes.at(1)));
+
+    // Moving the change gives a different hash too
+    std::vector<uint8_t> moved(HOST_PAGE_SIZE, 0);
+    moved[6] = 1;
+    REQUIRE(!(hashPage(moved.data(), HOST_PAGE_SIZE) == hashes.at(1)));
+
+    // Zeros of different lengths have different hashes
+    REQUIRE(!(hashes.at(3) == hashes.at(0)));
+    REQUIRE(hashes.at(3) == hashPage(data.data(), 100));
+
+    // Check against a known SHA-256 digest
+    std::string abc = "abc";
+    PageHash expected;
+    expected.bytes = { 0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+                       0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+                       0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+                       0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+    REQUIRE(hashPage(BYTES_CONST(abc.data()), abc.size()) == expected);
 }
 }
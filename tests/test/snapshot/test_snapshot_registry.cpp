@@ -1,6 +1,7 @@
 #include "faabric_utils.h"
 #include <catch.hpp>
 
+#include <cstring>
 #include <sys/mman.h>
 
 #include <faabric/snapshot/SnapshotRegistry.h>
@@ -93,4 +94,167 @@ TEST_CASE_METHOD(SnapshotTestFixture,
 {
     REQUIRE_THROWS(reg.getSnapshot(""));
 }
+
+class SnapshotPagesTestFixture
+  : public SnapshotTestFixture
+  , public ConfTestFixture
+{
+  public:
+    // Only snapshots bigger than a chunk have their pages indexed
+    SnapshotPagesTestFixture()
+    {
+        conf.snapshotChunkSize = HOST_PAGE_SIZE;
+    }
+};
+
+TEST_CASE_METHOD(SnapshotPagesTestFixture,
+                 "Test copying snapshot pages by hash",
+                 "[snapshot]")
+{
+    conf.snapshotPageDedup = 1;
+
+    std::string key = "pagesSnap";
+    int nPages = 3;
+    SnapshotData snap;
+    snap.size = nPages * HOST_PAGE_SIZE;
+    snap.data = allocatePages(nPages);
+    for (int p = 0; p < nPages; p++) {
+        std::memset(snap.data + (p * HOST_PAGE_SIZE), p + 1, HOST_PAGE_SIZE);
+    }
+
+    std::vector<PageHash> hashes = hashPages(snap.data, snap.size);
+
+    std::vector<uint8_t> expected(HOST_PAGE_SIZE, 2);
+    std::vector<uint8_t> target(HOST_PAGE_SIZE, 0);
+    bool expectCopied = true;
+
+    SECTION("Registered snapshot") { reg.takeSnapshot(key, snap, true); }
+
+    SECTION("Deleted snapshot")
+    {
+        // Pages of deleted snapshots are kept while there's room for them
+        reg.takeSnapshot(key, snap, true);
+        reg.deleteSnapshot(key);
+    }
+
+    SECTION("Deleted snapshot with no room to keep it")
+    {
+        conf.snapshotPageCacheMb = 0;
+        reg.takeSnapshot(key, snap, true);
+        reg.deleteSnapshot(key);
+        expectCopied = false;
+    }
+
+    SECTION("Page changed since it was indexed")
+    {
+        reg.takeSnapshot(key, snap, true);
+        snap.data[HOST_PAGE_SIZE + 10] = 9;
+        expectCopied = false;
+    }
+
+    SECTION("Deduplication disabled")
+    {
+        conf.snapshotPageDedup = 0;
+        reg.takeSnapshot(key, snap, true);
+        expectCopied = false;
+    }
+
+    REQUIRE(reg.copyPageByHash(hashes.at(1), target.data(), HOST_PAGE_SIZE) ==
+            expectCopied);
+    if (expectCopied) {
+        REQUIRE(target == expected);
+    }
+
+    // Pages must match in size as well as contents
+    REQUIRE(!reg.copyPageByHash(hashes.at(1), target.data(), 100));
+
+    std::vector<uint8_t> unknown(HOST_PAGE_SIZE, 7);
+    REQUIRE(!reg.copyPageByHash(hashPage(unknown.data(), HOST_PAGE_SIZE),
+                                target.data(),
+                                HOST_PAGE_SIZE));
+
+    reg.deleteSnapshot(key);
+    deallocatePages(snap.data, nPages);
+}
+
+TEST_CASE_METHOD(SnapshotPagesTestFixture,
+                 "Test owned snapshot mappings are unmapped on delete",
+                 "[snapshot]")
+{
+    conf.snapshotPageDedup = 1;
+
+    std::string key = "ownedSnap";
+    int nPages = 2;
+    size_t size = nPages * HOST_PAGE_SIZE;
+
+    // Set up a snapshot the way the snapshot server receives one
+    SnapshotData snap;
+    snap.size = size;
+    snap.fd = ::memfd_create(key.c_str(), 0);
+    REQUIRE(::ftruncate(snap.fd, size) == 0);
+    snap.data = (uint8_t*)::mmap(
+      nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, snap.fd, 0);
+    REQUIRE(snap.data != MAP_FAILED);
+    std::memset(snap.data + HOST_PAGE_SIZE, 5, HOST_PAGE_SIZE);
+
+    reg.takeSnapshot(key, snap, false, true);
+    REQUIRE(::msync(snap.data, size, MS_ASYNC) == 0);
+
+    reg.deleteSnapshot(key);
+    REQUIRE(::msync(snap.data, size, MS_ASYNC) == -1);
+    REQUIRE(errno == ENOMEM);
+
+    // Its pages can still be read from the fd
+    std::vector<uint8_t> expected(HOST_PAGE_SIZE, 5);
+    std::vector<uint8_t> target(HOST_PAGE_SIZE, 0);
+    REQUIRE(reg.copyPageByHash(hashPage(expected.data(), HOST_PAGE_SIZE),
+                               target.data(),
+                               HOST_PAGE_SIZE));
+    REQUIRE(target == expected);
+}
+
+TEST_CASE_METHOD(SnapshotPagesTestFixture,
+                 "Test page hashes follow changes to snapshots",
+                 "[snapshot]")
+{
+    conf.snapshotPageDedup = 1;
+
+    std::string key = "changedSnap";
+    int nPages = 3;
+    SnapshotData snap;
+    snap.size = nPages * HOST_PAGE_SIZE;
+    snap.data = allocatePages(nPages);
+    std::memset(snap.data, 1, snap.size);
+
+    reg.takeSnapshot(key, snap, false);
+    REQUIRE(reg.getPageHashes(key, snap) == hashPages(snap.data, snap.size));
+
+    // Hashes aren't given out for different data under the same key
+    SnapshotData other = snap;
+    other.size = HOST_PAGE_SIZE;
+    REQUIRE(reg.getPageHashes(key, other).empty());
+
+    // Change the middle page
+    std::vector<uint8_t> oldPage(HOST_PAGE_SIZE, 1);
+    std::memset(snap.data + HOST_PAGE_SIZE + 10, 2, 20);
+    reg.reindexPages(key, { { HOST_PAGE_SIZE + 10, 20 } });
+
+    std::vector<PageHash> hashes = reg.getPageHashes(key, snap);
+    REQUIRE(hashes == hashPages(snap.data, snap.size));
+
+    // The changed page can be copied, and the others still can be too
+    std::vector<uint8_t> expected(snap.data + HOST_PAGE_SIZE,
+                                  snap.data + (2 * HOST_PAGE_SIZE));
+    std::vector<uint8_t> target(HOST_PAGE_SIZE, 0);
+    REQUIRE(reg.copyPageByHash(hashes.at(1), target.data(), HOST_PAGE_SIZE));
+    REQUIRE(target == expected);
+    REQUIRE(reg.copyPageByHash(hashPage(oldPage.data(), HOST_PAGE_SIZE),
+                               target.data(),
+                               HOST_PAGE_SIZE));
+    REQUIRE(target == oldPage);
+
+    reg.deleteSnapshot(key);
+    REQUIRE(reg.getPageHashes(key, snap).empty());
+    deallocatePages(snap.data, nPages);
+}
 }
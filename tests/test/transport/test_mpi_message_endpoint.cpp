@@ -1,27 +1,121 @@
 #include <catch.hpp>
 
+#include <faabric/mpi/mpi.h>
 #include <faabric/transport/MpiMessageEndpoint.h>
+#include <faabric/util/macros.h>
 #include <faabric_utils.h>
 
+#include <cstring>
+
 using namespace faabric::transport;
 
 namespace tests {
 
+static MpiMessageHeader headerFactory(int sender,
+                                      int destination,
+                                      size_t payloadSize)
+{
+    MpiMessageHeader header{};
+    header.payloadSize = payloadSize;
+    header.worldId = 123;
+    header.sender = sender;
+    header.destination = destination;
+    header.id = 1337;
+    header.messageType = faabric::MPIMessage::REDUCE;
+    header.datatype = FAABRIC_INT;
+    header.count = payloadSize / sizeof(int);
+    header.tag = 3;
+
+    return header;
+}
+
 TEST_CASE_METHOD(SchedulerTestFixture,
                  "Test send and recv an MPI message",
                  "[transport]")
 {
-    std::string thisHost = faabric::util::getSystemConfig().endpointHost;
-    MpiMessageEndpoint sendEndpoint(LOCALHOST, 9999, 9998);
-    MpiMessageEndpoint recvEndpoint(thisHost, 9998, 9999);
+    MpiRecvMessageEndpoint recvEndpoint(9999);
+    MpiSendMessageEndpoint sendEndpoint(LOCALHOST, 9999);
+
+    std::vector<int> data;
+    SECTION("With payload") { data = { 0, 1, 2, 3, 4 }; }
+
+    SECTION("Without payload") {}
+
+    MpiMessageHeader expected =
+      headerFactory(1, 2, data.size() * sizeof(int));
+    sendEndpoint.sendMpiMessage(expected, BYTES(data.data()));
+
+    MpiMessageHeader header{};
+    std::shared_ptr<faabric::MPIMessage> actual =
+      recvEndpoint.recvMpiMessage(header);
+
+    REQUIRE(actual != nullptr);
+    REQUIRE(header.payloadSize == expected.payloadSize);
+    REQUIRE(header.worldId == 123);
+    REQUIRE(header.sender == 1);
+    REQUIRE(header.destination == 2);
+
+    REQUIRE(actual->id() == 1337);
+    REQUIRE(actual->worldid() == 123);
+    REQUIRE(actual->sender() == 1);
+    REQUIRE(actual->destination() == 2);
+    REQUIRE(actual->messagetype() == faabric::MPIMessage::REDUCE);
+    REQUIRE(actual->type() == FAABRIC_INT);
+    REQUIRE(actual->count() == data.size());
+    REQUIRE(actual->tag() == 3);
+
+    std::vector<int> actualData(data.size());
+    if (!data.empty()) {
+        REQUIRE(actual->buffer().size() == data.size() * sizeof(int));
+        std::memcpy(
+          actualData.data(), actual->buffer().data(), actual->buffer().size());
+    } else {
+        REQUIRE(actual->buffer().empty());
+    }
+    REQUIRE(actualData == data);
+}
+
+TEST_CASE_METHOD(SchedulerTestFixture,
+                 "Test MPI messages between many ranks share a channel",
+                 "[transport]")
+{
+    MpiRecvMessageEndpoint recvEndpoint(9999);
+    MpiSendMessageEndpoint sendEndpoint(LOCALHOST, 9999);
+
+    int nRanks = 4;
+    for (int sender = 0; sender < nRanks; sender++) {
+        for (int destination = 0; destination < nRanks; destination++) {
+            std::vector<int> data(sender + 1, destination);
+            MpiMessageHeader header =
+              headerFactory(sender, destination, data.size() * sizeof(int));
+            sendEndpoint.sendMpiMessage(header, BYTES(data.data()));
+        }
+    }
+
+    sendEndpoint.sendShutdown();
+
+    // Messages come out in order, and the shutdown is last
+    for (int sender = 0; sender < nRanks; sender++) {
+        for (int destination = 0; destination < nRanks; destination++) {
+            MpiMessageHeader header{};
+            auto msg = recvEndpoint.recvMpiMessage(header);
 
-    std::shared_ptr<faabric::MPIMessage> expected =
-      std::make_shared<faabric::MPIMessage>();
-    expected->set_id(1337);
+            REQUIRE(msg != nullptr);
+            REQUIRE(header.sender == sender);
+            REQUIRE(header.destination == destination);
+            REQUIRE(msg->sender() == sender);
+            REQUIRE(msg->destination() == destination);
 
-    sendEndpoint.sendMpiMessage(expected);
-    std::shared_ptr<faabric::MPIMessage> actual = recvEndpoint.recvMpiMessage();
+            std::vector<int> expected(sender + 1, destination);
+            std::vector<int> actual(expected.size());
+            REQUIRE(msg->buffer().size() == expected.size() * sizeof(int));
+            std::memcpy(
+              actual.data(), msg->buffer().data(), msg->buffer().size());
+            REQUIRE(actual == expected);
+        }
+    }
 
-    REQUIRE(expected->id() == actual->id());
+    MpiMessageHeader header{};
+    REQUIRE(recvEndpoint.recvMpiMessage(header) == nullptr);
 }
 }
@@ -17,16 +17,34 @@ TEST_CASE("Test default system config initialisation", "[util]")
     REQUIRE(conf.logLevel == "info");
     REQUIRE(conf.logFile == "off");
     REQUIRE(conf.stateMode == "inmemory");
+    REQUIRE(conf.dirtyTrackingMode == "softpte");
+    REQUIRE(conf.snapshotDiffMergeGap == 0);
+    REQUIRE(conf.snapshotChunkSize == 1048576);
+    REQUIRE(conf.snapshotChunkWindow == 4);
+    REQUIRE(conf.snapshotPageDedup == 1);
+    REQUIRE(conf.snapshotPageCacheMb == 1024);
+    REQUIRE(conf.snapshotStreamExpiryMs == 60000);
 
     REQUIRE(conf.redisPort == "6379");
 
     REQUIRE(conf.noScheduler == 0);
     REQUIRE(conf.overrideCpuCount == 0);
+    REQUIRE(conf.schedulingPolicy == "binpack");
+    REQUIRE(conf.resourcePushIntervalMs == 1000);
+    REQUIRE(conf.resourcePushThreshold == 4);
+    REQUIRE(conf.resourceTableTtlMs == 10000);
+    REQUIRE(conf.resultBatchSize == 64);
+    REQUIRE(conf.resultFlushIntervalUs == 500);
+    REQUIRE(conf.pendingResultExpiryMs == 30000);
 
     REQUIRE(conf.globalMessageTimeout == 60000);
     REQUIRE(conf.boundTimeout == 30000);
 
     REQUIRE(conf.defaultMpiWorldSize == 5);
+    REQUIRE(conf.mpiRendezvousThreshold == 65536);
+    REQUIRE(conf.mpiEagerLimit == 1048576);
+    REQUIRE(conf.mpiChunkSize == 262144);
+    REQUIRE(conf.mpiAllReduceAlgorithm == "auto");
 }
 
 TEST_CASE("Test overriding system config initialisation", "[util]")
@@ -36,6 +54,13 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
     std::string pythonPre = setEnvVar("PYTHON_PRELOAD", "on");
     std::string captureStdout = setEnvVar("CAPTURE_STDOUT", "on");
     std::string stateMode = setEnvVar("STATE_MODE", "foobar");
+    std::string dirtyMode = setEnvVar("DIRTY_TRACKING_MODE", "segfault");
+    std::string mergeGap = setEnvVar("SNAPSHOT_DIFF_MERGE_GAP", "128");
+    std::string chunkSize = setEnvVar("SNAPSHOT_CHUNK_SIZE", "4096");
+    std::string chunkWindow = setEnvVar("SNAPSHOT_CHUNK_WINDOW", "8");
+    std::string pageDedup = setEnvVar("SNAPSHOT_PAGE_DEDUP", "0");
+    std::string pageCache = setEnvVar("SNAPSHOT_PAGE_CACHE_MB", "32");
+    std::string streamExpiry = setEnvVar("SNAPSHOT_STREAM_EXPIRY_MS", "2500");
 
     std::string redisState = setEnvVar("REDIS_STATE_HOST", "not-localhost");
     std::string redisQueue = setEnvVar("REDIS_QUEUE_HOST", "other-host");
@@ -43,11 +68,22 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
 
     std::string noScheduler = setEnvVar("NO_SCHEDULER", "1");
     std::string overrideCpuCount = setEnvVar("OVERRIDE_CPU_COUNT", "4");
+    std::string schedulingPolicy = setEnvVar("SCHEDULING_POLICY", "spread");
+    std::string pushInterval = setEnvVar("RESOURCE_PUSH_INTERVAL_MS", "250");
+    std::string pushThreshold = setEnvVar("RESOURCE_PUSH_THRESHOLD", "8");
+    std::string tableTtl = setEnvVar("RESOURCE_TABLE_TTL_MS", "3333");
+    std::string resultBatch = setEnvVar("RESULT_BATCH_SIZE", "12");
+    std::string resultInterval = setEnvVar("RESULT_FLUSH_INTERVAL_US", "250");
+    std::string resultExpiry = setEnvVar("PENDING_RESULT_EXPIRY_MS", "4444");
 
     std::string globalTimeout = setEnvVar("GLOBAL_MESSAGE_TIMEOUT", "9876");
     std::string boundTimeout = setEnvVar("BOUND_TIMEOUT", "6666");
 
     std::string mpiSize = setEnvVar("DEFAULT_MPI_WORLD_SIZE", "2468");
+    std::string mpiRendezvous = setEnvVar("MPI_RENDEZVOUS_THRESHOLD", "1024");
+    std::string mpiEagerLimit = setEnvVar("MPI_EAGER_LIMIT", "4096");
+    std::string mpiChunkSize = setEnvVar("MPI_CHUNK_SIZE", "512");
+    std::string allReduceAlgo = setEnvVar("MPI_ALLREDUCE_ALGORITHM", "ring");
 
     // Create new conf for test
     SystemConfig conf;
@@ -55,6 +91,13 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
     REQUIRE(conf.logLevel == "debug");
     REQUIRE(conf.logFile == "on");
     REQUIRE(conf.stateMode == "foobar");
+    REQUIRE(conf.dirtyTrackingMode == "segfault");
+    REQUIRE(conf.snapshotDiffMergeGap == 128);
+    REQUIRE(conf.snapshotChunkSize == 4096);
+    REQUIRE(conf.snapshotChunkWindow == 8);
+    REQUIRE(conf.snapshotPageDedup == 0);
+    REQUIRE(conf.snapshotPageCacheMb == 32);
+    REQUIRE(conf.snapshotStreamExpiryMs == 2500);
 
     REQUIRE(conf.redisStateHost == "not-localhost");
     REQUIRE(conf.redisQueueHost == "other-host");
@@ -62,11 +105,22 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
 
     REQUIRE(conf.noScheduler == 1);
     REQUIRE(conf.overrideCpuCount == 4);
+    REQUIRE(conf.schedulingPolicy == "spread");
+    REQUIRE(conf.resourcePushIntervalMs == 250);
+    REQUIRE(conf.resourcePushThreshold == 8);
+    REQUIRE(conf.resourceTableTtlMs == 3333);
+    REQUIRE(conf.resultBatchSize == 12);
+    REQUIRE(conf.resultFlushIntervalUs == 250);
+    REQUIRE(conf.pendingResultExpiryMs == 4444);
 
     REQUIRE(conf.globalMessageTimeout == 9876);
     REQUIRE(conf.boundTimeout == 6666);
 
     REQUIRE(conf.defaultMpiWorldSize == 2468);
+    REQUIRE(conf.mpiRendezvousThreshold == 1024);
+    REQUIRE(conf.mpiEagerLimit == 4096);
+    REQUIRE(conf.mpiChunkSize == 512);
+    REQUIRE(conf.mpiAllReduceAlgorithm == "ring");
 
     // Be careful with host type
     setEnvVar("LOG_LEVEL", logLevel);
@@ -74,6 +128,13 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
     setEnvVar("PYTHON_PRELOAD", pythonPre);
     setEnvVar("CAPTURE_STDOUT", captureStdout);
     setEnvVar("STATE_MODE", stateMode);
+    setEnvVar("DIRTY_TRACKING_MODE", dirtyMode);
+    setEnvVar("SNAPSHOT_DIFF_MERGE_GAP", mergeGap);
+    setEnvVar("SNAPSHOT_CHUNK_SIZE", chunkSize);
+    setEnvVar("SNAPSHOT_CHUNK_WINDOW", chunkWindow);
+    setEnvVar("SNAPSHOT_PAGE_DEDUP", pageDedup);
+    setEnvVar("SNAPSHOT_PAGE_CACHE_MB", pageCache);
+    setEnvVar("SNAPSHOT_STREAM_EXPIRY_MS", streamExpiry);
 
     setEnvVar("REDIS_STATE_HOST", redisState);
     setEnvVar("REDIS_QUEUE_HOST", redisQueue);
@@ -81,11 +142,22 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
 
     setEnvVar("NO_SCHEDULER", noScheduler);
     setEnvVar("OVERRIDE_CPU_COUNT", overrideCpuCount);
+    setEnvVar("SCHEDULING_POLICY", schedulingPolicy);
+    setEnvVar("RESOURCE_PUSH_INTERVAL_MS", pushInterval);
+    setEnvVar("RESOURCE_PUSH_THRESHOLD", pushThreshold);
+    setEnvVar("RESOURCE_TABLE_TTL_MS", tableTtl);
+    setEnvVar("RESULT_BATCH_SIZE", resultBatch);
+    setEnvVar("RESULT_FLUSH_INTERVAL_US", resultInterval);
+    setEnvVar("PENDING_RESULT_EXPIRY_MS", resultExpiry);
 
     setEnvVar("GLOBAL_MESSAGE_TIMEOUT", globalTimeout);
     setEnvVar("BOUND_TIMEOUT", boundTimeout);
 
     setEnvVar("DEFAULT_MPI_WORLD_SIZE", mpiSize);
+    setEnvVar("MPI_RENDEZVOUS_THRESHOLD", mpiRendezvous);
+    setEnvVar("MPI_EAGER_LIMIT", mpiEagerLimit);
+    setEnvVar("MPI_CHUNK_SIZE", mpiChunkSize);
+    setEnvVar("MPI_ALLREDUCE_ALGORITHM", allReduceAlgo);
 }
 
 }
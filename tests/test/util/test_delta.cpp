@@ -139,4 +139,73 @@ TEST_CASE("Test delta calculate and apply", "[util][delta]")
     }
 }
 
+TEST_CASE("Test delta encoding snapshot from empty memory", "[util][delta]")
+{
+    DeltaSettings cfg("pages=4096;xor;zstd=1");
+
+    // Mostly pages of zeros, which shouldn't need sending
+    std::vector<uint8_t> mem(10 * 4096, 0);
+    std::fill(mem.begin() + 4096, mem.begin() + 5000, 3);
+    mem.back() = 4;
+
+    auto delta = serializeDelta(cfg, nullptr, 0, mem.data(), mem.size());
+    REQUIRE(delta.size() < 4096);
+
+    // Received into zeroed memory
+    std::vector<uint8_t> appliedMem;
+    applyDelta(
+      delta.data(),
+      delta.size(),
+      [&appliedMem](uint32_t newSize) { appliedMem.resize(newSize, 0); },
+      [&appliedMem]() { return appliedMem.data(); });
+
+    REQUIRE(appliedMem == mem);
+}
+
+TEST_CASE("Test delta encoding snapshot diffs", "[util][delta]")
+{
+    std::string settings;
+    SECTION("No compression") { settings = ""; }
+
+    SECTION("Compression") { settings = "zstd=1"; }
+
+    SECTION("Compression with unused options")
+    {
+        settings = "pages=4096;xor;zstd=1";
+    }
+
+    DeltaSettings cfg(settings);
+
+    std::vector<uint8_t> dataA = { 1, 2, 3 };
+    std::vector<uint8_t> dataB(2000, 5);
+    std::vector<uint8_t> dataC = { 6 };
+    std::vector<SnapshotDiff> diffs = {
+        SnapshotDiff(10, dataA.data(), dataA.size()),
+        SnapshotDiff(100, dataB.data(), dataB.size()),
+        SnapshotDiff(8000, dataC.data(), dataC.size()),
+    };
+
+    // Diffs are applied over whatever is there, and never resize the memory
+    std::vector<uint8_t> mem(8192, 9);
+    std::vector<uint8_t> expected = mem;
+    for (const auto& d : diffs) {
+        std::copy_n(d.data, d.size, expected.begin() + d.offset);
+    }
+
+    auto delta = serializeDiffsDelta(cfg, diffs);
+    std::vector<std::pair<size_t, size_t>> written = applyDelta(
+      delta,
+      [](uint32_t newSize) { FAIL("Diffs delta resized memory"); },
+      [&mem]() { return mem.data(); });
+
+    REQUIRE(mem == expected);
+
+    // Only the diffs are reported as written
+    std::vector<std::pair<size_t, size_t>> expectedWritten = {
+        { 10, 3 },
+        { 100, 2000 },
+        { 8000, 1 },
+    };
+    REQUIRE(written == expectedWritten);
+}
 }
@@ -0,0 +1,215 @@
+#include <catch.hpp>
+
+#include <faabric/util/config.h>
+#include <faabric/util/dirty.h>
+#include <faabric/util/memory.h>
+
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace faabric::util;
+
+namespace tests {
+
+static uint8_t* allocateTrackedPages(int nPages)
+{
+    auto* mem = (uint8_t*)mmap(nullptr,
+                               nPages * HOST_PAGE_SIZE,
+                               PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS,
+                               -1,
+                               0);
+    REQUIRE(mem != MAP_FAILED);
+
+    return mem;
+}
+
+TEST_CASE("Test segfault dirty tracking", "[util]")
+{
+    SegfaultDirtyTracker tracker;
+
+    int nPages = 6;
+    uint8_t* mem = allocateTrackedPages(nPages);
+    tracker.resetTracking(mem, nPages * HOST_PAGE_SIZE);
+    REQUIRE(tracker.getDirtyPageNumbers(mem, nPages).empty());
+
+    mem[HOST_PAGE_SIZE + 10] = 1;
+    mem[(3 * HOST_PAGE_SIZE) + 123] = 4;
+    mem[(3 * HOST_PAGE_SIZE) + 124] = 5;
+
+    std::vector<int> expected = { 1, 3 };
+    REQUIRE(tracker.getDirtyPageNumbers(mem, nPages) == expected);
+
+    // Reset and check the data is still there
+    tracker.resetTracking(mem, nPages * HOST_PAGE_SIZE);
+    REQUIRE(tracker.getDirtyPageNumbers(mem, nPages).empty());
+    REQUIRE(mem[HOST_PAGE_SIZE + 10] == 1);
+    REQUIRE(mem[(3 * HOST_PAGE_SIZE) + 123] == 4);
+
+    mem[(3 * HOST_PAGE_SIZE) + 100] = 2;
+    mem[(4 * HOST_PAGE_SIZE) + 22] = 5;
+    expected = { 3, 4 };
+    REQUIRE(tracker.getDirtyPageNumbers(mem, nPages) == expected);
+
+    // Pages are numbered from the pointer given
+    expected = { 0, 1 };
+    REQUIRE(tracker.getDirtyPageNumbers(mem + (3 * HOST_PAGE_SIZE), 2) ==
+            expected);
+
+    // Once tracking stops, the memory can be written without faulting, and all
+    // of its pages count as dirty
+    tracker.stopTracking(mem, nPages * HOST_PAGE_SIZE);
+    mem[0] = 3;
+    REQUIRE(tracker.getDirtyPageNumbers(mem, nPages).size() == nPages);
+
+    munmap(mem, nPages * HOST_PAGE_SIZE);
+}
+
+TEST_CASE("Test segfault dirty tracking beyond the end of a region", "[util]")
+{
+    SegfaultDirtyTracker tracker;
+
+    int nPages = 4;
+    uint8_t* mem = allocateTrackedPages(nPages);
+    tracker.resetTracking(mem, 2 * HOST_PAGE_SIZE);
+
+    mem[1] = 1;
+
+    // Pages past the tracked region are always dirty
+    std::vector<int> expected = { 0, 2, 3 };
+    REQUIRE(tracker.getDirtyPageNumbers(mem, nPages) == expected);
+
+    tracker.stopTracking(mem, 2 * HOST_PAGE_SIZE);
+    munmap(mem, nPages * HOST_PAGE_SIZE);
+}
+
+TEST_CASE("Test segfault dirty tracking regions are independent", "[util]")
+{
+    SegfaultDirtyTracker tracker;
+
+    int nRegions = 4;
+    int nPages = 8;
+    size_t regionSize = nPages * HOST_PAGE_SIZE;
+    std::vector<uint8_t*> regions;
+    for (int r = 0; r < nRegions; r++) {
+        regions.push_back(allocateTrackedPages(nPages));
+        tracker.resetTracking(regions.at(r), regionSize);
+    }
+
+    // Write to each region from its own thread, each writing every r+1th page
+    std::vector<std::thread> threads;
+    for (int r = 0; r < nRegions; r++) {
+        threads.emplace_back([r, nPages, &regions] {
+            for (int p = 0; p < nPages; p += r + 1) {
+                regions.at(r)[(p * HOST_PAGE_SIZE) + r] = r + 1;
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Resetting one region doesn't affect the others
+    tracker.resetTracking(regions.at(0), regionSize);
+    REQUIRE(tracker.getDirtyPageNumbers(regions.at(0), nPages).empty());
+
+    for (int r = 1; r < nRegions; r++) {
+        std::vector<int> expected;
+        for (int p = 0; p < nPages; p += r + 1) {
+            expected.push_back(p);
+            REQUIRE(regions.at(r)[(p * HOST_PAGE_SIZE) + r] == r + 1);
+        }
+
+        REQUIRE(tracker.getDirtyPageNumbers(regions.at(r), nPages) ==
+                expected);
+    }
+
+    for (auto* region : regions) {
+        tracker.stopTracking(region, regionSize);
+        munmap(region, regionSize);
+    }
+}
+
+TEST_CASE("Test segfault dirty tracking with writes from the kernel", "[util]")
+{
+    SegfaultDirtyTracker tracker;
+
+    int nPages = 4;
+    uint8_t* mem = allocateTrackedPages(nPages);
+    tracker.resetTracking(mem, nPages * HOST_PAGE_SIZE);
+
+    int pipeFds[2];
+    REQUIRE(::pipe(pipeFds) == 0);
+
+    // Read across the boundary between the second and third pages
+    std::vector<uint8_t> data = { 1, 2, 3, 4, 5, 6 };
+    uint8_t* target = mem + (2 * HOST_PAGE_SIZE) - 3;
+    REQUIRE(::write(pipeFds[1], data.data(), data.size()) == data.size());
+
+    tracker.markDirty(target, data.size());
+    REQUIRE(::read(pipeFds[0], target, data.size()) == data.size());
+    REQUIRE(std::vector<uint8_t>(target, target + data.size()) == data);
+
+    std::vector<int> expected = { 1, 2 };
+    REQUIRE(tracker.getDirtyPageNumbers(mem, nPages) == expected);
+
+    ::close(pipeFds[0]);
+    ::close(pipeFds[1]);
+
+    tracker.stopTracking(mem, nPages * HOST_PAGE_SIZE);
+    munmap(mem, nPages * HOST_PAGE_SIZE);
+}
+
+TEST_CASE("Test soft PTE dirty tracking with multiple regions", "[util]")
+{
+    SoftPTEDirtyTracker tracker;
+
+    int nPages = 3;
+    uint8_t* memA = allocateTrackedPages(nPages);
+    uint8_t* memB = allocateTrackedPages(nPages);
+
+    tracker.resetTracking(memA, nPages * HOST_PAGE_SIZE);
+    tracker.resetTracking(memB, nPages * HOST_PAGE_SIZE);
+
+    // Resetting B cleared the bits for A too, so all of A is now dirty
+    std::vector<int> expected = { 0, 1, 2 };
+    REQUIRE(tracker.getDirtyPageNumbers(memA, nPages) == expected);
+
+    // Until A is reset itself
+    tracker.resetTracking(memA, nPages * HOST_PAGE_SIZE);
+    REQUIRE(tracker.getDirtyPageNumbers(memB, nPages) == expected);
+
+    tracker.stopTracking(memA, nPages * HOST_PAGE_SIZE);
+    tracker.stopTracking(memB, nPages * HOST_PAGE_SIZE);
+    munmap(memA, nPages * HOST_PAGE_SIZE);
+    munmap(memB, nPages * HOST_PAGE_SIZE);
+}
+
+TEST_CASE("Test getting the dirty tracker from the config", "[util]")
+{
+    SystemConfig& conf = getSystemConfig();
+    std::string originalMode = conf.dirtyTrackingMode;
+
+    SECTION("Soft PTE")
+    {
+        conf.dirtyTrackingMode = "softpte";
+        REQUIRE(getDirtyTracker().getMode() == "softpte");
+    }
+
+    SECTION("Segfault")
+    {
+        conf.dirtyTrackingMode = "segfault";
+        REQUIRE(getDirtyTracker().getMode() == "segfault");
+    }
+
+    SECTION("Unrecognised")
+    {
+        conf.dirtyTrackingMode = "foobar";
+        REQUIRE_THROWS(getDirtyTracker());
+    }
+
+    conf.dirtyTrackingMode = originalMode;
+}
+}
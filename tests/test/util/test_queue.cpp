@@ -147,4 +147,237 @@ TEST_CASE("Test queue timeout must be positive", "[util]")
     q.enqueue(10);
     REQUIRE_THROWS(q.dequeue(timeoutValueMs));
 }
+
+TEST_CASE("Test fixed capacity queue operations", "[util]")
+{
+    FixedCapacityQueue<int> q(4);
+
+    // Check deqeue if present does nothing if nothing in queue
+    int dummy = -999;
+    q.dequeueIfPresent(&dummy);
+    REQUIRE(dummy == -999);
+
+    q.enqueue(1);
+    q.enqueue(2);
+    q.enqueue(3);
+    q.enqueue(4);
+    REQUIRE(q.size() == 4);
+
+    // Check enqueueing to a full queue times out
+    REQUIRE_THROWS_AS(q.enqueue(5, 10), QueueTimeoutException);
+
+    REQUIRE(q.dequeue() == 1);
+    REQUIRE(q.dequeue() == 2);
+
+    q.dequeueIfPresent(&dummy);
+    REQUIRE(dummy == 3);
+
+    // Wrap around the end of the buffer
+    q.enqueue(5);
+    q.enqueue(6);
+
+    REQUIRE(q.dequeue() == 4);
+    REQUIRE(q.dequeue() == 5);
+    REQUIRE(q.dequeue() == 6);
+    REQUIRE(q.size() == 0);
+
+    // Check error thrown on timeout when waiting
+    REQUIRE_THROWS_AS(q.dequeue(1), QueueTimeoutException);
+
+    // Check timeout must be positive
+    REQUIRE_THROWS(q.dequeue(0));
+    REQUIRE_THROWS(q.dequeue(-1));
+}
+
+TEST_CASE("Test fixed capacity queue drain and wait", "[util]")
+{
+    FixedCapacityQueue<int> q(8);
+
+    q.enqueue(1);
+    q.enqueue(2);
+    q.enqueue(3);
+    q.drain();
+    REQUIRE(q.size() == 0);
+
+    // Empty queue should not wait
+    q.waitToDrain(100);
+
+    int nElems = 5;
+    std::vector<int> expected;
+    for (int i = 0; i < nElems; i++) {
+        q.enqueue(i);
+        expected.emplace_back(i);
+    }
+
+    std::vector<int> dequeued;
+    std::thread t([&q, &dequeued, nElems] {
+        for (int i = 0; i < nElems; i++) {
+            SLEEP_MS(100);
+            dequeued.emplace_back(q.dequeue());
+        }
+    });
+
+    q.waitToDrain(2000);
+
+    if (t.joinable()) {
+        t.join();
+    }
+
+    REQUIRE(dequeued == expected);
+}
+
+TEST_CASE("Test fixed capacity queue blocking enqueue and dequeue", "[util]")
+{
+    FixedCapacityQueue<std::promise<int32_t>> q(1);
+
+    std::promise<int32_t> a;
+    std::promise<int32_t> b;
+    std::future<int32_t> fa = a.get_future();
+    std::future<int32_t> fb = b.get_future();
+
+    q.enqueue(std::move(a));
+
+    // Second enqueue has to wait for the consumer
+    std::thread producer([&q, &b] { q.enqueue(std::move(b), 2000); });
+
+    std::thread consumer([&q] {
+        SLEEP_MS(100);
+        q.dequeue().set_value(1);
+        q.dequeue().set_value(2);
+    });
+
+    if (producer.joinable()) {
+        producer.join();
+    }
+
+    if (consumer.joinable()) {
+        consumer.join();
+    }
+
+    REQUIRE(fa.get() == 1);
+    REQUIRE(fb.get() == 2);
+}
+
+TEST_CASE("Test fixed capacity queue with many producers and consumers",
+          "[util]")
+{
+    int nProducers = 4;
+    int nConsumers = 4;
+    int nPerProducer = 10000;
+
+    FixedCapacityQueue<int> q(64);
+
+    std::atomic<long> sum = 0;
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < nProducers; p++) {
+        threads.emplace_back([&q, nPerProducer] {
+            for (int i = 1; i <= nPerProducer; i++) {
+                q.enqueue(i);
+            }
+        });
+    }
+
+    int nPerConsumer = (nProducers * nPerProducer) / nConsumers;
+    for (int c = 0; c < nConsumers; c++) {
+        threads.emplace_back([&q, &sum, nPerConsumer] {
+            for (int i = 0; i < nPerConsumer; i++) {
+                sum += q.dequeue();
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    long expected = (long)nProducers * nPerProducer * (nPerProducer + 1) / 2;
+    REQUIRE(sum == expected);
+    REQUIRE(q.size() == 0);
+}
+
+TEST_CASE("Test single producer single consumer queue operations", "[util]")
+{
+    SpscQueue<int> q;
+
+    int dummy = -999;
+    q.dequeueIfPresent(&dummy);
+    REQUIRE(dummy == -999);
+
+    // Enqueue enough to span several segments
+    int nElems = (3 * SPSC_QUEUE_SEGMENT_SIZE) + 5;
+    for (int i = 0; i < nElems; i++) {
+        q.enqueue(i);
+    }
+    REQUIRE(q.size() == nElems);
+
+    // Check peek doesn't remove
+    REQUIRE(*(q.peek()) == 0);
+    REQUIRE(*(q.peek()) == 0);
+    REQUIRE(q.dequeue() == 0);
+
+    q.dequeueIfPresent(&dummy);
+    REQUIRE(dummy == 1);
+
+    for (int i = 2; i < nElems; i++) {
+        if (i % SPSC_QUEUE_SEGMENT_SIZE == 0) {
+            REQUIRE(*(q.peek()) == i);
+        }
+
+        REQUIRE(q.dequeue() == i);
+    }
+    REQUIRE(q.size() == 0);
+
+    // Check timeouts
+    REQUIRE_THROWS_AS(q.dequeue(1), QueueTimeoutException);
+    REQUIRE_THROWS_AS(q.peek(1), QueueTimeoutException);
+    REQUIRE_THROWS(q.dequeue(0));
+    REQUIRE_THROWS(q.dequeue(-1));
+
+    // Fill it again, reusing the segments already consumed
+    for (int i = 0; i < nElems; i++) {
+        q.enqueue(i + 1000);
+    }
+    for (int i = 0; i < nElems; i++) {
+        REQUIRE(q.dequeue() == i + 1000);
+    }
+
+    q.enqueue(1);
+    q.enqueue(2);
+    q.drain();
+    REQUIRE(q.size() == 0);
+}
+
+TEST_CASE("Test single producer single consumer queue across threads",
+          "[util]")
+{
+    SpscQueue<std::shared_ptr<int>> q;
+    int nElems = 100000;
+
+    std::thread producer([&q, nElems] {
+        for (int i = 0; i < nElems; i++) {
+            q.enqueue(std::make_shared<int>(i));
+
+            // Make the consumer park every so often
+            if (i % 20000 == 0) {
+                SLEEP_MS(50);
+            }
+        }
+    });
+
+    bool inOrder = true;
+    for (int i = 0; i < nElems; i++) {
+        std::shared_ptr<int> value = q.dequeue();
+        inOrder &= (*value == i);
+    }
+
+    if (producer.joinable()) {
+        producer.join();
+    }
+
+    REQUIRE(inOrder);
+    REQUIRE(q.size() == 0);
+}
 }